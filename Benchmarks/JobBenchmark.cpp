@@ -0,0 +1,277 @@
+//--------------------------------------------------------------------------------------
+// Checks and scaling benchmark for the job system
+//--------------------------------------------------------------------------------------
+// Standalone program, not part of the Visual Studio project (it has its own main). Only needs Utility/JobSystem
+// and the maths headers, so builds on any platform, e.g. on Linux from this folder:
+//     g++ -O2 -std=c++17 -pthread -I../Utility -I../Math JobBenchmark.cpp ../Utility/JobSystem.cpp ../Math/TransformBatch.cpp -o JobBenchmark
+//
+// Usage: JobBenchmark [--quick] [--out results.json]
+// First checks the job system behaves correctly: ParallelFor covers every index exactly once, dependencies run in
+// order, jobs can wait inside jobs, and all of these also work with no worker threads. Any failure is reported and
+// the program returns 1.
+//
+// Then measures how the time for a fixed amount of work (building world matrices with BuildWorldMatrices, split
+// with ParallelFor) scales with 0, 1, 2... worker threads up to one per core, and the cost of an empty job.
+// Results are written as JSON (to stdout, or the file given with --out), a readable table to stderr.
+
+#include "JobSystem.h"
+#include "TransformBatch.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <atomic>
+
+
+/*-----------------------------------------------------------------------------------------
+    Checks
+-----------------------------------------------------------------------------------------*/
+
+int gNumFailures = 0;
+
+void Check(bool passed, const char* description, int numWorkers)
+{
+    if (!passed)
+    {
+        std::fprintf(stderr, "FAILED: %s (%d workers)\n", description, numWorkers);
+        ++gNumFailures;
+    }
+}
+
+void RunChecks(int numWorkers)
+{
+    JobSystem jobSystem(numWorkers, "Check Worker");
+
+    // Every index visited exactly once, for various range sizes and grain sizes
+    for (int count : { 0, 1, 7, 1000, 100003 })
+    {
+        for (int grainSize : { 1, 16, 1000 })
+        {
+            std::vector<std::atomic<int>> visits(count);
+            jobSystem.ParallelFor(0, count, grainSize, [&](int start, int end)
+            {
+                for (int i = start; i < end; ++i)  visits[i].fetch_add(1, std::memory_order_relaxed);
+            });
+            bool once = true;
+            for (auto& v : visits)  once = once && v == 1;
+            Check(once, "ParallelFor visits each index once", numWorkers);
+        }
+    }
+
+    // A chain of dependent jobs runs in order
+    {
+        const int ChainLength = 100;
+        std::vector<JobCounter> counters(ChainLength);
+        std::vector<int> order;
+        std::mutex orderMutex;
+        for (int i = 0; i < ChainLength; ++i)
+        {
+            jobSystem.Run([&, i] { std::lock_guard<std::mutex> lock(orderMutex);  order.push_back(i); },
+                          &counters[i], i > 0 ? &counters[i - 1] : nullptr);
+        }
+        jobSystem.Wait(counters.back());
+        bool inOrder = order.size() == ChainLength;
+        for (int i = 0; inOrder && i < ChainLength; ++i)  inOrder = order[i] == i;
+        Check(inOrder, "Dependent jobs run in order", numWorkers);
+    }
+
+    // Many jobs depending on one counter all run after it
+    {
+        JobCounter first, second;
+        std::atomic<bool> firstDone = false;
+        std::atomic<int>  numAfter = 0;
+        jobSystem.Run([&] { std::this_thread::sleep_for(std::chrono::milliseconds(5));  firstDone = true; }, &first);
+        for (int i = 0; i < 500; ++i)
+        {
+            jobSystem.Run([&] { if (firstDone)  ++numAfter; }, &second, &first);
+        }
+        jobSystem.Wait(second);
+        Check(numAfter == 500, "Dependents wait for their dependency", numWorkers);
+    }
+
+    // Jobs that wait on jobs of their own (nested ParallelFor)
+    {
+        std::atomic<long long> sum = 0;
+        jobSystem.ParallelFor(0, 64, 1, [&](int outerStart, int outerEnd)
+        {
+            for (int outer = outerStart; outer < outerEnd; ++outer)
+            {
+                jobSystem.ParallelFor(0, 1000, 10, [&](int start, int end)
+                {
+                    long long partial = 0;
+                    for (int i = start; i < end; ++i)  partial += i;
+                    sum += partial;
+                });
+            }
+        });
+        Check(sum == 64LL * (999 * 1000 / 2), "Nested ParallelFor", numWorkers);
+    }
+
+    // Counters reused many times in quick succession (catches counters being used after their last decrement)
+    {
+        bool allDone = true;
+        for (int repeat = 0; repeat < 2000; ++repeat)
+        {
+            JobCounter counter;
+            std::atomic<int> count = 0;
+            for (int i = 0; i < 4; ++i)  jobSystem.Run([&] { ++count; }, &counter);
+            jobSystem.Wait(counter);
+            allDone = allDone && count == 4;
+        }
+        Check(allDone, "Short-lived counters", numWorkers);
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Benchmarks
+-----------------------------------------------------------------------------------------*/
+
+double gMinSeconds = 0.2;
+
+struct ScalingResult
+{
+    int    numWorkers;
+    double msPerRun;
+    double speedup;   // Compared to no workers
+    int    numSteals; // Per run
+};
+
+std::vector<ScalingResult> gScaling;
+double gNsPerEmptyJob = 0;
+
+
+// Time a function, repeating it for at least the minimum time and returning the average seconds per call
+template <class Function>
+double Time(Function function)
+{
+    using Clock = std::chrono::steady_clock;
+    function(); // Warm up
+    long long repeats = 0;
+    auto start = Clock::now();
+    double seconds = 0;
+    do
+    {
+        function();
+        ++repeats;
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (seconds < gMinSeconds);
+    return seconds / repeats;
+}
+
+
+void RunBenchmarks()
+{
+    // Work to split up: world matrices for many objects
+    const int NumObjects = 1000000;
+    std::vector<float> px(NumObjects), py(NumObjects), pz(NumObjects), rx(NumObjects), ry(NumObjects), rz(NumObjects);
+    std::vector<float> sx(NumObjects, 1), sy(NumObjects, 1), sz(NumObjects, 1);
+    std::vector<CMatrix3x4> matrices(NumObjects);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> distribution(-100, 100);
+    for (int i = 0; i < NumObjects; ++i)
+    {
+        px[i] = distribution(random);  py[i] = distribution(random);  pz[i] = distribution(random);
+        rx[i] = distribution(random);  ry[i] = distribution(random);  rz[i] = distribution(random);
+    }
+
+    int maxWorkers = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+    if (maxWorkers < 1)  maxWorkers = 1; // Still measure one worker on a single core machine, to show the overhead
+    std::fprintf(stderr, "%-10s %12s %10s %10s\n", "Workers", "ms/run", "Speedup", "Steals");
+    for (int numWorkers = 0; numWorkers <= maxWorkers; ++numWorkers)
+    {
+        JobSystem jobSystem(numWorkers, "Bench Worker");
+        int stealsBefore = jobSystem.NumSteals();
+        int runs = 0;
+        double seconds = Time([&]
+        {
+            jobSystem.ParallelFor(0, NumObjects, 4096, [&](int start, int end)
+            {
+                TransformArrays arrays = { &px[start], &py[start], &pz[start], &rx[start], &ry[start], &rz[start],
+                                           &sx[start], &sy[start], &sz[start] };
+                BuildWorldMatrices(arrays, end - start, &matrices[start]);
+            });
+            ++runs;
+        });
+        double ms = seconds * 1000;
+        double speedup = gScaling.empty() ? 1.0 : gScaling[0].msPerRun / ms;
+        int steals = (jobSystem.NumSteals() - stealsBefore) / runs;
+        gScaling.push_back({ numWorkers, ms, speedup, steals });
+        std::fprintf(stderr, "%-10d %12.3f %10.2f %10d\n", numWorkers, ms, speedup, steals);
+    }
+
+    // Overhead of a job: run many empty jobs from this thread with all workers
+    {
+        JobSystem jobSystem;
+        const int NumJobs = 10000;
+        double seconds = Time([&]
+        {
+            JobCounter counter;
+            for (int i = 0; i < NumJobs; ++i)  jobSystem.Run([] {}, &counter);
+            jobSystem.Wait(counter);
+        });
+        gNsPerEmptyJob = seconds * 1e9 / NumJobs;
+        std::fprintf(stderr, "Empty job: %.1f ns (%d workers)\n", gNsPerEmptyJob, jobSystem.NumWorkers());
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Output
+-----------------------------------------------------------------------------------------*/
+
+void WriteJSON(FILE* file)
+{
+    std::fprintf(file, "{\n  \"hardware_threads\": %u,\n  \"check_failures\": %d,\n  \"ns_per_empty_job\": %.1f,\n  \"scaling\": [\n",
+                 std::thread::hardware_concurrency(), gNumFailures, gNsPerEmptyJob);
+    for (size_t i = 0; i < gScaling.size(); ++i)
+    {
+        const ScalingResult& r = gScaling[i];
+        std::fprintf(file, "    { \"workers\": %d, \"ms_per_run\": %.4f, \"speedup\": %.3f, \"steals_per_run\": %d }%s\n",
+                     r.numWorkers, r.msPerRun, r.speedup, r.numSteals, i + 1 < gScaling.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    const char* outFile = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0)
+        {
+            gMinSeconds = 0.02;
+        }
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            outFile = argv[++i];
+        }
+        else
+        {
+            std::fprintf(stderr, "Usage: %s [--quick] [--out results.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    for (int numWorkers : { 0, 1, 3, 8 })
+    {
+        RunChecks(numWorkers);
+    }
+    std::fprintf(stderr, gNumFailures == 0 ? "All checks passed\n" : "%d checks FAILED\n", gNumFailures);
+
+    RunBenchmarks();
+
+    FILE* file = outFile ? std::fopen(outFile, "w") : stdout;
+    if (file == nullptr)
+    {
+        std::fprintf(stderr, "Could not open %s\n", outFile);
+        return 1;
+    }
+    WriteJSON(file);
+    if (outFile)  std::fclose(file);
+    return gNumFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,727 @@
+//--------------------------------------------------------------------------------------
+// Micro-benchmarks for the maths library
+//--------------------------------------------------------------------------------------
+// Standalone program, not part of the Visual Studio project (it has its own main). Only needs the headers in
+// Math/ and its two .cpp files, so builds on any platform, e.g. on Linux from this folder:
+//     g++ -O2 -std=c++17 -I../Math MathBenchmark.cpp ../Math/TransformBatch.cpp ../Math/CFrustum.cpp -o MathBenchmark
+// Add -mavx for the AVX code, or -DMATH_FORCE_SCALAR for the plain C++ code, to compare instruction sets
+//
+// Usage: MathBenchmark [--quick] [--out results.json]
+// Each function is timed over batches of 1, 1000 and 1000000 elements. A batch of 1 repeats the same element so
+// measures latency with everything in registers/L1 cache, 1000 elements fit in L1/L2 cache, and 1000000 elements
+// come from main memory. Where a function has more than one implementation (SIMD against plain C++, Fast against
+// Precise, 3x4 against 4x4 matrices) the speedup over the first one listed is reported too.
+//
+// Results are written as JSON (to stdout, or the file given with --out) so runs can be compared to track
+// regressions. A readable table is written to stderr as the benchmarks run.
+//
+// Before timing anything the SIMD code is checked against the plain C++ code, which is what the compiler uses when
+// it evaluates the maths for constexpr variables (see MATH_IS_CONSTANT_EVALUATED). The expected results are
+// calculated that way at compile time, so one build checks the instruction set it was compiled for. The batch world
+// matrix builders are checked against building each model's matrix with AffineWorld, and the batched frustum tests
+// against testing each sphere or box on its own. The accuracy of the MathPrecision::Fast functions is measured
+// against double precision and checked against the limits documented in MathHelpers.h. Any failure is reported and
+// the program returns 1 without running the benchmarks.
+//
+// Utility/GraphicsHelpers.h can't be included outside Windows (it needs Direct3D), so MakeProjectionMatrix is
+// measured through MatrixPerspective, which is all it calls.
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "CMatrix3x4.h"
+#include "CQuaternion.h"
+#include "MathHelpers.h"
+#include "MathHelpersSIMD.h"
+#include "TransformBatch.h"
+#include "CFrustum.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+/*-----------------------------------------------------------------------------------------
+    Timing
+-----------------------------------------------------------------------------------------*/
+
+// Stop the compiler keeping values in registers across this point, so repeated calculations on the same data
+// (batch size 1) are really repeated rather than hoisted out of the timing loop
+inline void ClobberMemory()
+{
+#if defined(_MSC_VER)
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : : "memory");
+#endif
+}
+
+const int BatchSizes[] = { 1, 1000, 1000000 };
+const int MaxBatchSize = 1000000;
+
+// Minimum time to spend on each measurement and number of measurements (the fastest is kept)
+double gMinSeconds = 0.05;
+const int NumMeasurements = 3;
+
+
+struct BenchmarkResult
+{
+    std::string name;           // What is being measured, e.g. "CMatrix4x4 multiply"
+    std::string implementation; // Which version, e.g. "SIMD"
+    int         batchSize;
+    double      nsPerOp;
+};
+
+std::vector<BenchmarkResult> gResults;
+
+
+// Time a benchmark at each batch size. batchFunction(count) must process elements 0 to count-1 of its data
+template <class BatchFunction>
+void Benchmark(const char* name, const char* implementation, BatchFunction batchFunction)
+{
+    using Clock = std::chrono::steady_clock;
+
+    for (int batchSize : BatchSizes)
+    {
+        // Find how many repeats fill the minimum time, then keep the best of several measurements
+        long long repeats = 1;
+        double bestSeconds = 0;
+        for (int measurement = 0; measurement < NumMeasurements; )
+        {
+            auto start = Clock::now();
+            for (long long r = 0; r < repeats; ++r)
+            {
+                batchFunction(batchSize);
+                ClobberMemory();
+            }
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            if (seconds < gMinSeconds && batchSize * repeats < 1000000000LL)
+            {
+                repeats *= (seconds < gMinSeconds / 10) ? 10 : 2;
+                continue;
+            }
+            if (measurement == 0 || seconds < bestSeconds)  bestSeconds = seconds;
+            ++measurement;
+        }
+
+        double nsPerOp = bestSeconds * 1e9 / (static_cast<double>(repeats) * batchSize);
+        gResults.push_back({ name, implementation, batchSize, nsPerOp });
+        std::fprintf(stderr, "%-32s %-20s %8d %10.3f ns/op %10.1f Mops/s\n", name, implementation, batchSize, nsPerOp, 1e3 / nsPerOp);
+    }
+}
+
+// Wrap a function of one element index as a batch function
+template <class ElementFunction>
+auto PerElement(ElementFunction elementFunction)
+{
+    return [=](int count)
+    {
+        for (int i = 0; i < count; ++i)  elementFunction(i);
+    };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Test data
+-----------------------------------------------------------------------------------------*/
+
+std::vector<CVector3>    gVectors, gVectors2, gVectorsOut;
+std::vector<float>       gFloats, gFloats2, gFloatsOut, gFloatsOut2;
+std::vector<CMatrix4x4>  gMatrices, gMatricesOut;
+std::vector<CMatrix3x4>  gAffines, gAffinesOut;
+std::vector<CQuaternion> gQuaternions;
+std::vector<BoundingSphere> gSpheres;
+std::vector<BoundingBox>    gBoxes;
+std::vector<uint32_t>       gVisibleBits;
+
+// Structure-of-arrays copies of the transforms for the batch world matrix builder
+std::vector<float> gTransformArrays[10];
+
+void CreateTestData()
+{
+    std::mt19937 random(1234); // Fixed seed so every run uses the same data
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> angle(-PI, PI);
+    std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+    gVectors.resize(MaxBatchSize);   gVectors2.resize(MaxBatchSize);   gVectorsOut.resize(MaxBatchSize);
+    gFloats.resize(MaxBatchSize);    gFloats2.resize(MaxBatchSize);    gFloatsOut.resize(MaxBatchSize);  gFloatsOut2.resize(MaxBatchSize);
+    gMatrices.resize(MaxBatchSize);  gMatricesOut.resize(MaxBatchSize);
+    gAffines.resize(MaxBatchSize);   gAffinesOut.resize(MaxBatchSize);
+    gQuaternions.resize(MaxBatchSize);
+    gSpheres.resize(MaxBatchSize);   gBoxes.resize(MaxBatchSize);      gVisibleBits.resize(MaxBatchSize / 32 + 1);
+    for (auto& array : gTransformArrays)  array.resize(MaxBatchSize);
+
+    for (int i = 0; i < MaxBatchSize; ++i)
+    {
+        CVector3 p = { position(random), position(random), position(random) };
+        CVector3 r = { angle(random), angle(random), angle(random) };
+        CVector3 s = { scale(random), scale(random), scale(random) };
+        CQuaternion q = QuaternionFromEuler(r);
+
+        gVectors[i]     = p;
+        gVectors2[i]    = { position(random), position(random), position(random) };
+        gFloats[i]      = angle(random) * 10.0f;
+        gFloats2[i]     = position(random);
+        gMatrices[i]    = MatrixWorld(p, q, s);
+        gAffines[i]     = AffineWorld(p, q, s);
+        gQuaternions[i] = q;
+        gSpheres[i]     = { p, s.x };
+        gBoxes[i]       = { p, s };
+
+        float transform[10] = { p.x, p.y, p.z, q.x, q.y, q.z, q.w, s.x, s.y, s.z };
+        for (int j = 0; j < 10; ++j)  gTransformArrays[j][i] = transform[j];
+    }
+}
+
+
+// Plain C++ matrix multiply, the code CMatrix4x4 used before SIMD, for comparison
+CMatrix4x4 MultiplyReference(const CMatrix4x4& m1, const CMatrix4x4& m2)
+{
+    CMatrix4x4 m;
+    const float* a = &m1.e00;
+    const float* b = &m2.e00;
+    float* out = &m.e00;
+    for (int row = 0; row < 4; ++row)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            out[row * 4 + column] = a[row * 4] * b[column] + a[row * 4 + 1] * b[4 + column] +
+                                    a[row * 4 + 2] * b[8 + column] + a[row * 4 + 3] * b[12 + column];
+        }
+    }
+    return m;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Checks
+-----------------------------------------------------------------------------------------*/
+
+int gNumFailures = 0;
+
+void Check(bool passed, const char* description)
+{
+    if (!passed)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", description);
+        ++gNumFailures;
+    }
+}
+
+// SIMD and plain C++ code add things up in a different order, so compare to within a tolerance relative to the size
+// of the values
+bool IsNear(float a, float b)
+{
+    return std::fabs(a - b) <= 1e-5f * std::fmax(1.0f, std::fmax(std::fabs(a), std::fabs(b)));
+}
+
+bool IsNear(const CVector3& a, const CVector3& b)
+{
+    return IsNear(a.x, b.x) && IsNear(a.y, b.y) && IsNear(a.z, b.z);
+}
+
+bool IsNear(const CMatrix4x4& a, const CMatrix4x4& b)
+{
+    const float* elementsA = &a.e00;
+    const float* elementsB = &b.e00;
+    for (int i = 0; i < 16; ++i)
+    {
+        if (!IsNear(elementsA[i], elementsB[i]))  return false;
+    }
+    return true;
+}
+
+bool IsNear(const CMatrix3x4& a, const CMatrix3x4& b)
+{
+    const float* elementsA = &a.e00;
+    const float* elementsB = &b.e00;
+    for (int i = 0; i < 12; ++i)
+    {
+        if (!IsNear(elementsA[i], elementsB[i]))  return false;
+    }
+    return true;
+}
+
+
+// Matrices and points with the plain C++ results of multiplying, inverting and transforming them. The count is not
+// a multiple of any SIMD width so the leftover points at the end of TransformPoints are covered
+const int NumCheckMatrices = 67;
+
+struct MatrixCheckData
+{
+    CMatrix4x4 matrices[NumCheckMatrices]; // Random affine matrices
+    CMatrix4x4 products[NumCheckMatrices]; // matrices[i] * matrices[(i + 1) % NumCheckMatrices]
+    CMatrix4x4 inverses[NumCheckMatrices]; // InverseAffine(matrices[i])
+    CVector3   points[NumCheckMatrices];
+    CVector3   transformed[NumCheckMatrices]; // points[i] transformed by matrices[0]
+};
+
+// Random number from -1 to 1 that the compiler can calculate
+constexpr float CheckRandom(uint32_t& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<float>(seed >> 8) / 8388608.0f - 1.0f;
+}
+
+constexpr MatrixCheckData MakeMatrixCheckData()
+{
+    MatrixCheckData data = {};
+    uint32_t seed = 1234;
+    for (CMatrix4x4& m : data.matrices)
+    {
+        // A larger diagonal keeps the matrices well away from singular, so the inverses can be compared closely
+        m = { 2 + CheckRandom(seed),   CheckRandom(seed),       CheckRandom(seed),       0,
+              CheckRandom(seed),       2 + CheckRandom(seed),   CheckRandom(seed),       0,
+              CheckRandom(seed),       CheckRandom(seed),       2 + CheckRandom(seed),   0,
+              100 * CheckRandom(seed), 100 * CheckRandom(seed), 100 * CheckRandom(seed), 1 };
+    }
+    for (int i = 0; i < NumCheckMatrices; ++i)
+    {
+        data.products[i]    = data.matrices[i] * data.matrices[(i + 1) % NumCheckMatrices];
+        data.inverses[i]    = InverseAffine(data.matrices[i]);
+        data.points[i]      = { 100 * CheckRandom(seed), 100 * CheckRandom(seed), 100 * CheckRandom(seed) };
+        data.transformed[i] = TransformPoint(data.points[i], data.matrices[0]);
+    }
+    return data;
+}
+
+// Calculated by the compiler, so with the plain C++ code whatever the instruction set
+constexpr MatrixCheckData MatrixChecks = MakeMatrixCheckData();
+
+
+// Check the SIMD matrix multiply, InverseAffine and TransformPoints against the plain C++ results
+void CheckMatrices()
+{
+    // Copy the inputs so the calls below are made at runtime on data the compiler doesn't know
+    std::vector<CMatrix4x4> matrices(MatrixChecks.matrices, MatrixChecks.matrices + NumCheckMatrices);
+    std::vector<CVector3>   points(MatrixChecks.points, MatrixChecks.points + NumCheckMatrices);
+
+    bool multiplyMatches = true, inverseMatches = true;
+    for (int i = 0; i < NumCheckMatrices; ++i)
+    {
+        multiplyMatches &= IsNear(matrices[i] * matrices[(i + 1) % NumCheckMatrices], MatrixChecks.products[i]);
+        inverseMatches  &= IsNear(InverseAffine(matrices[i]), MatrixChecks.inverses[i]);
+    }
+    Check(multiplyMatches, "CMatrix4x4 multiply matches the plain C++ code");
+    Check(inverseMatches,  "InverseAffine (4x4) matches the plain C++ code");
+
+    // Every count up to the full array, so each possible number of leftover points is covered. Also in place
+    bool transformMatches = true;
+    std::vector<CVector3> transformed(NumCheckMatrices);
+    for (int count = 0; count <= NumCheckMatrices; ++count)
+    {
+        std::fill(transformed.begin(), transformed.end(), CVector3{ 0, 0, 0 });
+        TransformPoints(points.data(), transformed.data(), count, matrices[0]);
+        for (int i = 0; i < NumCheckMatrices; ++i)
+        {
+            transformMatches &= (i < count) ? IsNear(transformed[i], MatrixChecks.transformed[i])
+                                            : (transformed[i].x == 0 && transformed[i].y == 0 && transformed[i].z == 0);
+        }
+    }
+    Check(transformMatches, "TransformPoints (4x4) matches the plain C++ code and writes only the points given");
+
+    TransformPoints(points.data(), points.data(), NumCheckMatrices, matrices[0]);
+    bool inPlaceMatches = true;
+    for (int i = 0; i < NumCheckMatrices; ++i)  inPlaceMatches &= IsNear(points[i], MatrixChecks.transformed[i]);
+    Check(inPlaceMatches, "TransformPoints (4x4) in place matches the plain C++ code");
+}
+
+
+
+// Check the batch world matrix builders against building each model's matrix with AffineWorld. Every count up to
+// a few SIMD registers is tried, so each possible number of models left over after the last full register is covered
+void CheckWorldMatrices()
+{
+    const int NumModels = 37;
+    std::mt19937 random(5678);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> angle(-PI, PI);
+    std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+    // One array per component, positions first then rotations (Euler x,y,z then quaternion x,y,z,w) then scales
+    std::vector<float> components[13];
+    std::vector<CMatrix3x4> eulerExpected, quaternionExpected;
+    for (int i = 0; i < NumModels; ++i)
+    {
+        CVector3 p = { position(random), position(random), position(random) };
+        CVector3 r = { angle(random), angle(random), angle(random) };
+        CVector3 s = { scale(random), scale(random), scale(random) };
+        CQuaternion q = QuaternionFromEuler(r);
+        float values[13] = { p.x, p.y, p.z, r.x, r.y, r.z, q.x, q.y, q.z, q.w, s.x, s.y, s.z };
+        for (int c = 0; c < 13; ++c)  components[c].push_back(values[c]);
+        eulerExpected.push_back(AffineWorld(p, r, s));
+        quaternionExpected.push_back(AffineWorld(p, q, s));
+    }
+    TransformArrays eulerArrays = { components[0].data(), components[1].data(), components[2].data(),
+                                    components[3].data(), components[4].data(), components[5].data(),
+                                    components[10].data(), components[11].data(), components[12].data() };
+    QuaternionTransformArrays quaternionArrays = { components[0].data(), components[1].data(), components[2].data(),
+                                                   components[6].data(), components[7].data(), components[8].data(),
+                                                   components[9].data(),
+                                                   components[10].data(), components[11].data(), components[12].data() };
+
+    // Models past the count must be left alone, so start with a matrix no model will give
+    const CMatrix3x4 untouched = AffineWorld(CVector3{ 12345, 12345, 12345 }, CVector3{ 0, 0, 0 }, CVector3{ 1, 1, 1 });
+    bool eulerMatches = true, quaternionMatches = true;
+    std::vector<CMatrix3x4> matrices(NumModels);
+    for (int count = 0; count <= NumModels; ++count)
+    {
+        std::fill(matrices.begin(), matrices.end(), untouched);
+        BuildWorldMatrices(eulerArrays, count, matrices.data());
+        for (int i = 0; i < NumModels; ++i)  eulerMatches &= IsNear(matrices[i], (i < count) ? eulerExpected[i] : untouched);
+
+        std::fill(matrices.begin(), matrices.end(), untouched);
+        BuildWorldMatrices(quaternionArrays, count, matrices.data());
+        for (int i = 0; i < NumModels; ++i)  quaternionMatches &= IsNear(matrices[i], (i < count) ? quaternionExpected[i] : untouched);
+    }
+    Check(eulerMatches,      "BuildWorldMatrices (Euler) matches AffineWorld for each model");
+    Check(quaternionMatches, "BuildWorldMatrices (quaternion) matches AffineWorld for each model");
+}
+
+
+
+// Check the batched frustum tests against testing each sphere / box on its own. Every count up to a few words of
+// results is tried, so each possible number of bounds left over after the last full SIMD register or 32-bit word is
+// covered
+void CheckFrustumTests()
+{
+    const int NumBounds = 100;
+    std::mt19937 random(9012);
+    std::uniform_real_distribution<float> side(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> depth(-10.0f, 100.0f);
+    std::uniform_real_distribution<float> size(0.5f, 10.0f);
+
+    // Bounds around the edges of the frustum as well as inside and outside
+    const CFrustum frustum = FrustumFromMatrix(MatrixPerspective(PI / 3, 16.0f / 9.0f, 0.1f, 80.0f));
+    std::vector<BoundingSphere> spheres;
+    std::vector<BoundingBox>    boxes;
+    for (int i = 0; i < NumBounds; ++i)
+    {
+        CVector3 centre = { side(random), side(random), depth(random) };
+        spheres.push_back({ centre, size(random) });
+        boxes.push_back({ centre, { size(random), size(random), size(random) } });
+    }
+
+    // Words past the results for the count must be left alone, so start with a pattern the tests won't give
+    const uint32_t untouched = 0xAAAAAAAA;
+    const int NumWords = (NumBounds + 31) / 32;
+    bool spheresMatch = true, boxesMatch = true, anyVisible = false, anyHidden = false;
+    std::vector<uint32_t> visibleBits(NumWords);
+    for (int count = 0; count <= NumBounds; ++count)
+    {
+        std::fill(visibleBits.begin(), visibleBits.end(), untouched);
+        TestSpheres(frustum, spheres.data(), count, visibleBits.data());
+        for (int word = 0; word < NumWords; ++word)
+        {
+            uint32_t expected = (word * 32 < count) ? 0 : untouched;
+            for (int i = word * 32; i < std::min(count, word * 32 + 32); ++i)
+            {
+                if (IsVisible(frustum, spheres[i]))  expected |= 1u << (i % 32);
+            }
+            spheresMatch &= visibleBits[word] == expected;
+        }
+
+        std::fill(visibleBits.begin(), visibleBits.end(), untouched);
+        TestBoxes(frustum, boxes.data(), count, visibleBits.data());
+        for (int word = 0; word < NumWords; ++word)
+        {
+            uint32_t expected = (word * 32 < count) ? 0 : untouched;
+            for (int i = word * 32; i < std::min(count, word * 32 + 32); ++i)
+            {
+                bool visible = IsVisible(frustum, boxes[i]);
+                if (visible)  expected |= 1u << (i % 32);
+                anyVisible |= visible;
+                anyHidden  |= !visible;
+            }
+            boxesMatch &= visibleBits[word] == expected;
+        }
+    }
+    Check(anyVisible && anyHidden, "Frustum test data has both visible and hidden bounds");
+    Check(spheresMatch, "TestSpheres (array) matches IsVisible for each sphere");
+    Check(boxesMatch,   "TestBoxes (array) matches IsVisible for each box");
+
+    // The versions returning a single word of results
+    bool singleWordMatches = true;
+    for (int count = 0; count <= 32; ++count)
+    {
+        uint32_t expectedSpheres = 0, expectedBoxes = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            if (IsVisible(frustum, spheres[i]))  expectedSpheres |= 1u << i;
+            if (IsVisible(frustum, boxes[i]))    expectedBoxes   |= 1u << i;
+        }
+        singleWordMatches &= TestSpheres(frustum, spheres.data(), count) == expectedSpheres &&
+                             TestBoxes(frustum, boxes.data(), count) == expectedBoxes;
+    }
+    Check(singleWordMatches, "TestSpheres / TestBoxes (up to 32) match IsVisible for each bound");
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Benchmarks
+-----------------------------------------------------------------------------------------*/
+
+void RunBenchmarks()
+{
+    CVector3*    v    = gVectors.data();
+    CVector3*    v2   = gVectors2.data();
+    CVector3*    vOut = gVectorsOut.data();
+    float*       f    = gFloats.data();
+    float*       f2   = gFloats2.data();
+    float*       fOut = gFloatsOut.data();
+    float*       fOut2 = gFloatsOut2.data();
+    CMatrix4x4*  m    = gMatrices.data();
+    CMatrix4x4*  mOut = gMatricesOut.data();
+    CMatrix3x4*  a    = gAffines.data();
+    CMatrix3x4*  aOut = gAffinesOut.data();
+    CQuaternion* q    = gQuaternions.data();
+
+    const CMatrix4x4 fixedMatrix = MatrixWorld({ 1, 2, 3 }, CVector3{ 0.1f, 0.2f, 0.3f }, { 1, 1, 1 });
+    const CMatrix3x4 fixedAffine = ToAffine(fixedMatrix);
+
+    // Vectors
+    Benchmark("CVector3 add",        "Default",  PerElement([=](int i) { vOut[i] = v[i] + v2[i]; }));
+    Benchmark("CVector3 Dot",        "Default",  PerElement([=](int i) { fOut[i] = Dot(v[i], v2[i]); }));
+    Benchmark("CVector3 Cross",      "Default",  PerElement([=](int i) { vOut[i] = Cross(v[i], v2[i]); }));
+    Benchmark("CVector3 Length",     "Default",  PerElement([=](int i) { fOut[i] = Length(v[i]); }));
+    Benchmark("CVector3 Normalise",  "Precise",  PerElement([=](int i) { vOut[i] = Normalise(v[i]); }));
+    Benchmark("CVector3 Normalise",  "Fast",     PerElement([=](int i) { vOut[i] = Normalise<MathPrecision::Fast>(v[i]); }));
+
+    // Helpers
+    Benchmark("SinCos",              "Precise",  PerElement([=](int i) { SinCos(f[i], fOut[i], fOut2[i]); }));
+    Benchmark("SinCos",              "Fast",     PerElement([=](int i) { SinCos<MathPrecision::Fast>(f[i], fOut[i], fOut2[i]); }));
+#if defined(MATH_SIMD_SSE)
+    Benchmark("SinCos",              "Fast SIMD x4", [=](int count)
+    {
+        int i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 s, c;
+            FastSinCos4(_mm_loadu_ps(f + i), s, c);
+            _mm_storeu_ps(fOut + i, s);
+            _mm_storeu_ps(fOut2 + i, c);
+        }
+        for (; i < count; ++i)  FastSinCos(f[i], fOut[i], fOut2[i]);
+    });
+#endif
+    Benchmark("Atan2",               "Precise",  PerElement([=](int i) { fOut[i] = Atan2(f[i], f2[i]); }));
+    Benchmark("Atan2",               "Fast",     PerElement([=](int i) { fOut[i] = Atan2<MathPrecision::Fast>(f[i], f2[i]); }));
+    Benchmark("InvSqrt",             "Precise",  PerElement([=](int i) { fOut[i] = InvSqrt(f2[i] * f2[i] + 1.0f); }));
+    Benchmark("InvSqrt",             "Fast",     PerElement([=](int i) { fOut[i] = InvSqrt<MathPrecision::Fast>(f2[i] * f2[i] + 1.0f); }));
+
+    // Matrices
+    Benchmark("Matrix multiply",     "4x4 plain C++", PerElement([=](int i) { mOut[i] = MultiplyReference(m[i], fixedMatrix); }));
+    Benchmark("Matrix multiply",     "4x4 " MATH_SIMD_NAME, PerElement([=](int i) { mOut[i] = m[i] * fixedMatrix; }));
+    Benchmark("Matrix multiply",     "3x4 " MATH_SIMD_NAME, PerElement([=](int i) { aOut[i] = a[i] * fixedAffine; }));
+    Benchmark("InverseAffine",       "4x4",      PerElement([=](int i) { mOut[i] = InverseAffine(m[i]); }));
+    Benchmark("InverseAffine",       "3x4",      PerElement([=](int i) { aOut[i] = InverseAffine(a[i]); }));
+    Benchmark("TransformPoint",      "4x4",      PerElement([=](int i) { vOut[i] = TransformPoint(v[i], fixedMatrix); }));
+    Benchmark("TransformPoint",      "4x4 array", [=](int count) { TransformPoints(v, vOut, count, fixedMatrix); });
+    Benchmark("TransformPoint",      "3x4",      PerElement([=](int i) { vOut[i] = TransformPoint(v[i], fixedAffine); }));
+    Benchmark("GetEulerAngles",      "Matrix",   PerElement([=](int i) { vOut[i] = m[i].GetEulerAngles(); }));
+    Benchmark("GetEulerAngles",      "Quaternion", PerElement([=](int i) { vOut[i] = q[i].GetEulerAngles(); }));
+    Benchmark("FaceTarget",          "Matrix",   PerElement([=](int i) { mOut[i] = m[i];  mOut[i].FaceTarget(v2[i]); }));
+    Benchmark("FaceTarget",          "Quaternion", PerElement([=](int i) { aOut[i] = AffineWorld(v[i], QuaternionLookRotation(v2[i] - v[i]), { 1, 1, 1 }); }));
+    Benchmark("MatrixRotationX",     "Precise",  PerElement([=](int i) { mOut[i] = MatrixRotationX(f[i]); }));
+    Benchmark("MatrixRotationX",     "Fast",     PerElement([=](int i) { mOut[i] = MatrixRotationX<MathPrecision::Fast>(f[i]); }));
+    Benchmark("MatrixRotationY",     "Precise",  PerElement([=](int i) { mOut[i] = MatrixRotationY(f[i]); }));
+    Benchmark("MatrixRotationZ",     "Precise",  PerElement([=](int i) { mOut[i] = MatrixRotationZ(f[i]); }));
+    Benchmark("MakeProjectionMatrix", "Default", PerElement([=](int i) { mOut[i] = MatrixPerspective(f[i] * 0.01f + 1.0f, 16.0f / 9.0f, 0.1f, 10000.0f); }));
+
+    // World matrices - a full Model transform each
+    Benchmark("World matrix",        "4x4 product", PerElement([=](int i) { mOut[i] = MatrixScaling(v2[i]) * MatrixRotationZ(f[i]) * MatrixRotationX(f2[i]) *
+                                                                                          MatrixRotationY(f[i]) * MatrixTranslation(v[i]); }));
+    Benchmark("World matrix",        "Euler",    PerElement([=](int i) { mOut[i] = MatrixWorld(v[i], CVector3{ f[i], f2[i], f[i] }, v2[i]); }));
+    Benchmark("World matrix",        "Quaternion", PerElement([=](int i) { aOut[i] = AffineWorld(v[i], q[i], v2[i]); }));
+    QuaternionTransformArrays transforms = { gTransformArrays[0].data(), gTransformArrays[1].data(), gTransformArrays[2].data(),
+                                             gTransformArrays[3].data(), gTransformArrays[4].data(), gTransformArrays[5].data(),
+                                             gTransformArrays[6].data(), gTransformArrays[7].data(), gTransformArrays[8].data(),
+                                             gTransformArrays[9].data() };
+    Benchmark("World matrix",        "Quaternion batch", [=](int count) { BuildWorldMatrices(transforms, count, aOut); });
+
+    // Frustum culling - a camera at the origin sees roughly a tenth of the test bounds
+    const CFrustum frustum = FrustumFromMatrix(MatrixPerspective(PI / 3, 16.0f / 9.0f, 0.1f, 1000.0f));
+    const BoundingSphere* spheres = gSpheres.data();
+    const BoundingBox*    boxes   = gBoxes.data();
+    uint32_t*             visible = gVisibleBits.data();
+    Benchmark("Frustum test spheres", "Single",  PerElement([=](int i) { fOut[i] = IsVisible(frustum, spheres[i]) ? 1.0f : 0.0f; }));
+    Benchmark("Frustum test spheres", "Batched " MATH_SIMD_NAME, [=](int count) { TestSpheres(frustum, spheres, count, visible); });
+    Benchmark("Frustum test boxes",   "Single",  PerElement([=](int i) { fOut[i] = IsVisible(frustum, boxes[i]) ? 1.0f : 0.0f; }));
+    Benchmark("Frustum test boxes",   "Batched " MATH_SIMD_NAME, [=](int count) { TestBoxes(frustum, boxes, count, visible); });
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Accuracy of the fast functions
+-----------------------------------------------------------------------------------------*/
+
+struct AccuracyResult
+{
+    std::string function;
+    std::string range;
+    double      maxAbsError;
+    double      maxUlpError; // Only counted where the result is not tiny (see range)
+};
+
+std::vector<AccuracyResult> gAccuracy;
+
+// Size of 1 ulp for a float of the given value
+double Ulp(double value)
+{
+    float f = static_cast<float>(std::fabs(value));
+    return static_cast<double>(std::nextafter(f, INFINITY)) - f;
+}
+
+// Measure the error of each fast function against the double precision standard library, and check it is within
+// the limits documented in MathHelpers.h
+void MeasureAccuracy()
+{
+    const int Samples = 4000000;
+
+    double sinAbs = 0, sinUlp = 0;
+    for (int i = 0; i <= Samples; ++i)
+    {
+        float x = -10000.0f + 20000.0f * i / Samples;
+        float s, c;
+        FastSinCos(x, s, c);
+        double refS = std::sin(static_cast<double>(x));
+        double refC = std::cos(static_cast<double>(x));
+        sinAbs = std::fmax(sinAbs, std::fmax(std::fabs(s - refS), std::fabs(c - refC)));
+        if (std::fabs(refS) > 0.001)  sinUlp = std::fmax(sinUlp, std::fabs(s - refS) / Ulp(refS));
+        if (std::fabs(refC) > 0.001)  sinUlp = std::fmax(sinUlp, std::fabs(c - refC) / Ulp(refC));
+    }
+    gAccuracy.push_back({ "SinCos<Fast>", "x in [-10000,10000], ulp where |result| > 0.001", sinAbs, sinUlp });
+    Check(sinAbs <= 8e-8 && sinUlp <= 2, "FastSinCos within 8e-8 and 2 ulp");
+
+    double atanAbs = 0, atanUlp = 0;
+    for (int i = 0; i <= Samples; ++i)
+    {
+        double angle = -PI + 2.0 * PI * i / Samples;
+        float y = static_cast<float>(std::sin(angle) * (1 + i % 100));
+        float x = static_cast<float>(std::cos(angle) * (1 + i % 100));
+        float r = FastAtan2(y, x);
+        double ref = std::atan2(static_cast<double>(y), static_cast<double>(x));
+        atanAbs = std::fmax(atanAbs, std::fabs(r - ref));
+        if (std::fabs(ref) > 0.1)  atanUlp = std::fmax(atanUlp, std::fabs(r - ref) / Ulp(ref));
+    }
+    gAccuracy.push_back({ "Atan2<Fast>", "all angles, ulp where |result| > 0.1", atanAbs, atanUlp });
+    Check(atanAbs <= 3e-7 && atanUlp <= 4, "FastAtan2 within 3e-7 radians and 4 ulp");
+
+    double invAbs = 0, invUlp = 0;
+    for (int i = 0; i <= Samples; ++i)
+    {
+        float x = std::ldexp(1.0f + static_cast<float>(i % 1000) / 1000.0f, -120 + (i % 240)); // Across the normal float range
+        double ref = 1.0 / std::sqrt(static_cast<double>(x));
+        double r = FastInvSqrt(x);
+        invAbs = std::fmax(invAbs, std::fabs(r - ref) / ref); // Relative error, absolute is meaningless over this range
+        invUlp = std::fmax(invUlp, std::fabs(r - ref) / Ulp(ref));
+    }
+    gAccuracy.push_back({ "InvSqrt<Fast>", "normal floats, relative error", invAbs, invUlp });
+#if defined(MATH_SIMD_SSE)
+    Check(invUlp <= 5, "FastInvSqrt within 5 ulp");
+#else
+    Check(invUlp <= 3, "FastInvSqrt within 3 ulp");
+#endif
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Output
+-----------------------------------------------------------------------------------------*/
+
+void WriteJSON(FILE* file)
+{
+    std::fprintf(file, "{\n  \"simd\": \"%s\",\n  \"min_seconds\": %g,\n  \"benchmarks\": [\n", MATH_SIMD_NAME, gMinSeconds);
+    for (size_t i = 0; i < gResults.size(); ++i)
+    {
+        const BenchmarkResult& r = gResults[i];
+        std::fprintf(file, "    { \"name\": \"%s\", \"implementation\": \"%s\", \"batch_size\": %d, \"ns_per_op\": %.4f, \"mops_per_sec\": %.2f }%s\n",
+                     r.name.c_str(), r.implementation.c_str(), r.batchSize, r.nsPerOp, 1e3 / r.nsPerOp, i + 1 < gResults.size() ? "," : "");
+    }
+
+    // Speedup of each implementation over the first one measured with the same name and batch size
+    std::fprintf(file, "  ],\n  \"comparisons\": [\n");
+    bool first = true;
+    for (const BenchmarkResult& r : gResults)
+    {
+        for (const BenchmarkResult& baseline : gResults)
+        {
+            if (baseline.name != r.name || baseline.batchSize != r.batchSize)  continue;
+            if (&baseline != &r)
+            {
+                std::fprintf(file, "%s    { \"name\": \"%s\", \"batch_size\": %d, \"baseline\": \"%s\", \"implementation\": \"%s\", \"speedup\": %.3f }",
+                             first ? "" : ",\n", r.name.c_str(), r.batchSize, baseline.implementation.c_str(), r.implementation.c_str(),
+                             baseline.nsPerOp / r.nsPerOp);
+                first = false;
+            }
+            break; // Only compare against the first (baseline)
+        }
+    }
+
+    std::fprintf(file, "\n  ],\n  \"accuracy\": [\n");
+    for (size_t i = 0; i < gAccuracy.size(); ++i)
+    {
+        const AccuracyResult& r = gAccuracy[i];
+        std::fprintf(file, "    { \"function\": \"%s\", \"range\": \"%s\", \"max_error\": %.3g, \"max_ulp_error\": %.2f }%s\n",
+                     r.function.c_str(), r.range.c_str(), r.maxAbsError, r.maxUlpError, i + 1 < gAccuracy.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    const char* outFile = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0)
+        {
+            gMinSeconds = 0.005;
+        }
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            outFile = argv[++i];
+        }
+        else
+        {
+            std::fprintf(stderr, "Usage: %s [--quick] [--out results.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::fprintf(stderr, "Instruction set: %s\n", MATH_SIMD_NAME);
+    CheckMatrices();
+    CheckWorldMatrices();
+    CheckFrustumTests();
+    MeasureAccuracy();
+    for (const AccuracyResult& r : gAccuracy)
+    {
+        std::fprintf(stderr, "%-16s max error %.3g, %.2f ulp (%s)\n", r.function.c_str(), r.maxAbsError, r.maxUlpError, r.range.c_str());
+    }
+    std::fprintf(stderr, gNumFailures == 0 ? "All checks passed\n" : "%d checks FAILED\n", gNumFailures);
+    if (gNumFailures > 0)  return 1;
+
+    CreateTestData();
+    RunBenchmarks();
+
+    FILE* file = outFile ? std::fopen(outFile, "w") : stdout;
+    if (file == nullptr)
+    {
+        std::fprintf(stderr, "Could not open %s\n", outFile);
+        return 1;
+    }
+    WriteJSON(file);
+    if (outFile)  std::fclose(file);
+    return 0;
+}
@@ -0,0 +1,530 @@
+//--------------------------------------------------------------------------------------
+// Checks and benchmark for the software occlusion buffer
+//--------------------------------------------------------------------------------------
+// Standalone program, not part of the Visual Studio project (it has its own main). Only needs the occlusion buffer,
+// the job system and the maths headers, so builds on any platform with no GPU, e.g. on Linux from this folder:
+//     g++ -O2 -std=c++17 -pthread -I.. -I../Math -I../Utility OcclusionBenchmark.cpp ../OcclusionBuffer.cpp ../Utility/JobSystem.cpp -o OcclusionBenchmark
+// Add -mavx to use AVX, or -DMATH_FORCE_SCALAR to check the plain C++ code
+//
+// Usage: OcclusionBenchmark [--quick] [--out results.json]
+// First checks the occlusion buffer (see OcclusionBuffer.h) on small synthetic scenes: a box behind a wall is hidden,
+// boxes in front of, beside, partly behind or touching the wall are not, and nothing is hidden by an empty buffer or
+// by occluders behind the camera. A floor crossing the near plane must be clipped correctly, and boxes reaching in
+// front of the near plane are always visible. On a scene of random triangles every pixel is checked against rays
+// cast through it: a pixel is only covered if a triangle is there and its depth is never nearer than the triangles
+// hit. Testing boxes must give the same results as checking every pixel without the tiles, and rendering and testing
+// across threads must give exactly the same results as on one thread. Any failure is reported and the program
+// returns 1.
+//
+// Then times rendering a hilly terrain of 2k to 131k triangles plus some buildings at 256x128 and 512x256, on one
+// thread and with the job system, and testing 10k objects scattered over the terrain in the camera's frustum,
+// counting how many are hidden.
+// Results are written as JSON (to stdout, or the file given with --out), a readable table to stderr.
+
+#include "OcclusionBuffer.h"
+#include "JobSystem.h"
+#include "CMatrix4x4.h"
+#include "CFrustum.h"
+#include "MathHelpers.h"
+#include "MathSIMD.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+
+/*-----------------------------------------------------------------------------------------
+    Test scenes
+-----------------------------------------------------------------------------------------*/
+
+// Occluder geometry, a triangle list
+struct Geometry
+{
+    std::vector<CVector3> positions;
+    std::vector<uint32_t> indices;
+
+    void AddTriangle(CVector3 a, CVector3 b, CVector3 c)
+    {
+        uint32_t first = static_cast<uint32_t>(positions.size());
+        positions.insert(positions.end(), { a, b, c });
+        indices.insert(indices.end(), { first, first + 1, first + 2 });
+    }
+
+    void AddQuad(CVector3 a, CVector3 b, CVector3 c, CVector3 d)
+    {
+        AddTriangle(a, b, c);
+        AddTriangle(a, c, d);
+    }
+
+    // Closed box of 12 triangles
+    void AddBox(const BoundingBox& box)
+    {
+        CVector3 c[8];
+        for (int i = 0; i < 8; ++i)
+        {
+            c[i] = { box.centre.x + ((i & 1) ? box.extents.x : -box.extents.x),
+                     box.centre.y + ((i & 2) ? box.extents.y : -box.extents.y),
+                     box.centre.z + ((i & 4) ? box.extents.z : -box.extents.z) };
+        }
+        AddQuad(c[0], c[1], c[3], c[2]);  AddQuad(c[4], c[6], c[7], c[5]);
+        AddQuad(c[0], c[4], c[5], c[1]);  AddQuad(c[2], c[3], c[7], c[6]);
+        AddQuad(c[0], c[2], c[6], c[4]);  AddQuad(c[1], c[5], c[7], c[3]);
+    }
+};
+
+// Camera at the origin facing along +Z, so view space is world space, with a 90 degree field of view
+const float Aspect = 2;
+const float Near   = 1;
+const float Far    = 1000;
+const CMatrix4x4 CheckProjection = MatrixPerspective(ToRadians(90), Aspect, Near, Far);
+
+void RenderGeometry(OcclusionBuffer& buffer, const CMatrix4x4& viewProjection, const Geometry& geometry)
+{
+    buffer.Begin(viewProjection);
+    buffer.AddOccluder(geometry.positions.data(), static_cast<int>(geometry.positions.size()),
+                       geometry.indices.data(), static_cast<int>(geometry.indices.size()), AffineIdentity());
+    buffer.Render();
+}
+
+BoundingBox Box(CVector3 centre, float extent)  { return { centre, { extent, extent, extent } }; }
+
+
+// Rolling hills over a square of ground centred on the origin, divided into cells of two triangles
+float TerrainHeight(float x, float z)
+{
+    return 25 * std::sin(x * 0.013f) * std::cos(z * 0.011f) + 15 * std::sin(x * 0.031f + z * 0.027f);
+}
+
+Geometry MakeTerrain(float size, int numCells)
+{
+    Geometry terrain;
+    for (int z = 0; z <= numCells; ++z)
+    {
+        for (int x = 0; x <= numCells; ++x)
+        {
+            float px = (x / static_cast<float>(numCells) - 0.5f) * size;
+            float pz = (z / static_cast<float>(numCells) - 0.5f) * size;
+            terrain.positions.push_back({ px, TerrainHeight(px, pz), pz });
+        }
+    }
+    for (int z = 0; z < numCells; ++z)
+    {
+        for (int x = 0; x < numCells; ++x)
+        {
+            uint32_t i = z * (numCells + 1) + x;
+            terrain.indices.insert(terrain.indices.end(), { i, i + numCells + 1, i + 1, i + 1, i + numCells + 1, i + numCells + 2 });
+        }
+    }
+    return terrain;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Checks
+-----------------------------------------------------------------------------------------*/
+
+int gNumFailures = 0;
+
+void Check(bool passed, const char* description)
+{
+    if (!passed)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", description);
+        ++gNumFailures;
+    }
+}
+
+
+// Depth (as stored in the buffer) of the nearest of the triangles hit by a ray from the camera through the centre
+// of a pixel, in the check camera's view. Triangles are hit if the ray passes within the given distance (in
+// barycentric coordinates) inside their edges, or outside if the distance is negative. Returns 2 if nothing is hit
+double NearestHit(const Geometry& geometry, int pixelX, int pixelY, int width, int height, double edgeDistance)
+{
+    const CMatrix4x4& p = CheckProjection;
+    double dirX = ((pixelX + 0.5) / width * 2 - 1) / p.e00;
+    double dirY = (1 - (pixelY + 0.5) / height * 2) / p.e11;
+    double nearest = 2;
+    for (size_t i = 0; i < geometry.indices.size(); i += 3)
+    {
+        // Solve origin + t * dir = a + u * (b - a) + v * (c - a), with the direction's z being 1 so t is view depth
+        const CVector3& a = geometry.positions[geometry.indices[i]];
+        const CVector3& b = geometry.positions[geometry.indices[i + 1]];
+        const CVector3& c = geometry.positions[geometry.indices[i + 2]];
+        double e1[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+        double e2[3] = { c.x - a.x, c.y - a.y, c.z - a.z };
+        double d[3]  = { dirX, dirY, 1 };
+        double h[3]  = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+        double det = e1[0] * h[0] + e1[1] * h[1] + e1[2] * h[2];
+        if (std::abs(det) < 1e-12)  continue;
+        double s[3] = { -a.x, -a.y, -a.z };
+        double u = (s[0] * h[0] + s[1] * h[1] + s[2] * h[2]) / det;
+        double q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+        double v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) / det;
+        double t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / det;
+        if (u < edgeDistance || v < edgeDistance || u + v > 1 - edgeDistance || t < Near || t > Far)  continue;
+        nearest = std::min(nearest, (p.e22 * t + p.e32) / t);
+    }
+    return nearest;
+}
+
+// Reference box test: project the box as the buffer does and check every pixel it covers, without the tiles
+bool IsVisibleReference(const OcclusionBuffer& buffer, const CMatrix4x4& m, const BoundingBox& box)
+{
+    float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+    int numInFront = 0;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        CVector3 p = { box.centre.x + ((corner & 1) ? box.extents.x : -box.extents.x),
+                       box.centre.y + ((corner & 2) ? box.extents.y : -box.extents.y),
+                       box.centre.z + ((corner & 4) ? box.extents.z : -box.extents.z) };
+        float z = p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32;
+        if (z < 0)
+        {
+            ++numInFront;
+            continue;
+        }
+        float invW = 1.0f / (p.x * m.e03 + p.y * m.e13 + p.z * m.e23 + m.e33);
+        float x = ((p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30) * invW *  0.5f + 0.5f) * buffer.Width();
+        float y = ((p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31) * invW * -0.5f + 0.5f) * buffer.Height();
+        minX = std::min(minX, x);  maxX = std::max(maxX, x);
+        minY = std::min(minY, y);  maxY = std::max(maxY, y);
+        nearest = std::min(nearest, z * invW);
+    }
+    if (numInFront > 0)  return numInFront < 8;
+    for (int y = 0; y < buffer.Height(); ++y)
+    {
+        for (int x = 0; x < buffer.Width(); ++x)
+        {
+            bool inRect = x + 1 > minX && x <= maxX && y + 1 > minY && y <= maxY;
+            if (inRect && nearest <= buffer.Depths()[y * buffer.Width() + x])  return true;
+        }
+    }
+    return false;
+}
+
+
+void CheckSimpleScenes()
+{
+    bool threw = false;
+    try { OcclusionBuffer badSize(250, 128); } catch (const std::runtime_error&) { threw = true; }
+    Check(threw, "Size that is not a multiple of the tile size is rejected");
+
+    OcclusionBuffer buffer;
+    const CMatrix4x4& viewProjection = CheckProjection;
+
+    // Empty buffer
+    buffer.Begin(viewProjection);
+    buffer.Render();
+    Check(buffer.IsVisible(Box({ 0, 0, 20 }, 1)),    "Nothing hidden by an empty buffer");
+    Check(buffer.IsVisible(Box({ 0, 0, 900 }, 50)),  "Nothing hidden by an empty buffer, far away");
+    Check(!buffer.IsVisible(Box({ 0, 0, -20 }, 1)),  "Box behind the camera is off screen");
+    Check(!buffer.IsVisible(Box({ 500, 0, 20 }, 1)), "Box to the side is off screen");
+
+    // A 10x10 wall 10 units ahead, covering |x| <= 10, |y| <= 10 at 20 units
+    Geometry wall;
+    wall.AddQuad({ -5, -5, 10 }, { -5, 5, 10 }, { 5, 5, 10 }, { 5, -5, 10 });
+    RenderGeometry(buffer, viewProjection, wall);
+    Check(buffer.Stats().numTriangles == 2 && buffer.Stats().numRasterised == 2, "Wall triangles counted");
+    Check(!buffer.IsVisible(Box({ 0, 0, 20 }, 1)),      "Box behind the wall is hidden");
+    Check(!buffer.IsVisible(Box({ 3, -2, 200 }, 20)),   "Large distant box behind the wall is hidden");
+    Check(!buffer.IsVisible(Box({ 0, 0, 10.5f }, 0.4f)),"Box just behind the wall is hidden");
+    Check(buffer.IsVisible(Box({ 0, 0, 5 }, 1)),        "Box in front of the wall is visible");
+    Check(buffer.IsVisible(Box({ 0, 0, 10 }, 1)),       "Box through the wall is visible");
+    Check(buffer.IsVisible(Box({ 0, 0, 10.5f }, 0.55f)),"Box through the back of the wall is visible");
+    Check(buffer.IsVisible(Box({ 9, 0, 20 }, 2)),       "Box partly behind the wall is visible");
+    Check(buffer.IsVisible(Box({ 15, 0, 20 }, 1)),      "Box beside the wall is visible");
+    Check(buffer.IsVisible(Box({ 0, 0, 0.5f }, 1)),     "Box reaching in front of the near plane is visible");
+    Check(!buffer.IsVisible(Box({ 0, 0, 0.5f }, 0.2f)), "Box between the camera and the near plane is not visible");
+
+    // The same wall wound the other way
+    Geometry reversed;
+    reversed.AddQuad({ -5, -5, 10 }, { 5, -5, 10 }, { 5, 5, 10 }, { -5, 5, 10 });
+    RenderGeometry(buffer, viewProjection, reversed);
+    Check(!buffer.IsVisible(Box({ 0, 0, 20 }, 1)), "Box behind a reversed wall is hidden");
+    Check(buffer.IsVisible(Box({ 9, 0, 20 }, 2)),  "Box partly behind a reversed wall is visible");
+
+    // Wall behind the camera
+    Geometry behind;
+    behind.AddQuad({ -5, -5, -10 }, { -5, 5, -10 }, { 5, 5, -10 }, { 5, -5, -10 });
+    RenderGeometry(buffer, viewProjection, behind);
+    Check(buffer.Stats().numRasterised == 0,      "Wall behind the camera is not rasterised");
+    Check(buffer.IsVisible(Box({ 0, 0, 20 }, 1)), "Nothing hidden by a wall behind the camera");
+
+    // A large floor 2 units below the camera, reaching behind it so it must be clipped by the near plane
+    Geometry floor;
+    floor.AddQuad({ -1000, -2, -1000 }, { -1000, -2, 1000 }, { 1000, -2, 1000 }, { 1000, -2, -1000 });
+    RenderGeometry(buffer, viewProjection, floor);
+    Check(buffer.Stats().numRasterised >= 2,        "Floor clipped to the near plane is rasterised");
+    Check(!buffer.IsVisible(Box({ 0, -10, 50 }, 2)), "Box under the floor is hidden");
+    Check(!buffer.IsVisible(Box({ -40, -8, 30 }, 3)),"Box under the floor to the side is hidden");
+    Check(buffer.IsVisible(Box({ 0, 0, 50 }, 1)),    "Box above the floor is visible");
+    Check(buffer.IsVisible(Box({ 0, -2, 50 }, 1)),   "Box sitting in the floor is visible");
+    Check(buffer.IsVisible(Box({ 0, -10, 0 }, 2)),   "Box under the floor reaching in front of the near plane is visible");
+
+    // Floor clipped to one triangle of a quad crossing the near plane
+    Geometry tilted;
+    tilted.AddTriangle({ -100, -2, -50 }, { 0, -2, 200 }, { 100, -2, -50 });
+    RenderGeometry(buffer, viewProjection, tilted);
+    Check(!buffer.IsVisible(Box({ 0, -10, 50 }, 2)), "Box under a clipped triangle is hidden");
+}
+
+
+// Random triangles around the camera, some crossing the near plane or off screen, checked pixel by pixel with rays
+void CheckRandomScene()
+{
+    std::mt19937 random(25);
+    std::uniform_real_distribution<float> position(-60, 60);
+    std::uniform_real_distribution<float> depth(-20, 150);
+    std::uniform_real_distribution<float> offset(-15, 15);
+    Geometry geometry;
+    for (int i = 0; i < 150; ++i)
+    {
+        CVector3 a = { position(random), position(random) * 0.5f, depth(random) };
+        geometry.AddTriangle(a, a + CVector3{ offset(random), offset(random), offset(random) },
+                                a + CVector3{ offset(random), offset(random), offset(random) });
+    }
+
+    OcclusionBuffer buffer;
+    RenderGeometry(buffer, CheckProjection, geometry);
+
+    bool coveredOnlyWhereHit = true, coveredWhereHit = true, neverNearer = true;
+    int numCovered = 0;
+    for (int y = 0; y < buffer.Height(); ++y)
+    {
+        for (int x = 0; x < buffer.Width(); ++x)
+        {
+            // Rays passing very close to an edge may or may not count as covering the pixel
+            float stored       = buffer.Depths()[y * buffer.Width() + x];
+            double nearestAny  = NearestHit(geometry, x, y, buffer.Width(), buffer.Height(), -1e-4);
+            double nearestSure = NearestHit(geometry, x, y, buffer.Width(), buffer.Height(), 1e-4);
+            if (stored < 1)  ++numCovered;
+            if (stored < 1 && nearestAny > 1)             coveredOnlyWhereHit = false;
+            if (nearestSure < 0.999 && stored >= 1)       coveredWhereHit = false;
+            if (stored < 1 && stored < nearestAny - 1e-5) neverNearer = false;
+        }
+    }
+    Check(numCovered > buffer.Width() * buffer.Height() / 4, "Random scene covers a good part of the buffer");
+    Check(coveredOnlyWhereHit, "Pixels only covered where a ray hits a triangle");
+    Check(coveredWhereHit,     "Pixels covered wherever a ray hits a triangle");
+    Check(neverNearer,         "Pixel depths never nearer than the triangles hit");
+
+    // Box tests against checking every pixel
+    std::uniform_real_distribution<float> extent(0.2f, 8);
+    std::vector<BoundingBox> boxes(2000);
+    for (auto& box : boxes)  box = { { position(random), position(random) * 0.5f, depth(random) }, { extent(random), extent(random), extent(random) } };
+    std::vector<uint8_t> visible(boxes.size());
+    buffer.TestBoxes(boxes.data(), static_cast<int>(boxes.size()), visible.data());
+    bool sameAsReference = true;
+    int numHidden = 0;
+    for (size_t i = 0; i < boxes.size(); ++i)
+    {
+        if ((visible[i] != 0) != IsVisibleReference(buffer, CheckProjection, boxes[i]))  sameAsReference = false;
+        numHidden += 1 - visible[i];
+    }
+    Check(sameAsReference, "Box tests match checking every pixel");
+    Check(numHidden > 0 && numHidden == buffer.Stats().numHidden, "Hidden boxes counted in the stats");
+    Check(buffer.Stats().numTested == static_cast<int>(boxes.size()), "Tested boxes counted in the stats");
+
+    // Same results across threads, with enough triangles and boxes for every stage to be split up
+    for (int i = 0; i < 8000; ++i)
+    {
+        CVector3 a = { position(random), position(random) * 0.5f, depth(random) };
+        geometry.AddTriangle(a, a + CVector3{ offset(random), offset(random), offset(random) },
+                                a + CVector3{ offset(random), offset(random), offset(random) });
+    }
+    boxes.resize(5000);
+    for (auto& box : boxes)  box = { { position(random), position(random) * 0.5f, depth(random) }, { extent(random), extent(random), extent(random) } };
+    visible.resize(boxes.size());
+    std::vector<uint8_t> visibleThreaded(boxes.size());
+
+    RenderGeometry(buffer, CheckProjection, geometry);
+    buffer.TestBoxes(boxes.data(), static_cast<int>(boxes.size()), visible.data());
+
+    JobSystem jobSystem(3, "Occlusion Worker");
+    OcclusionBuffer threaded(256, 128, &jobSystem);
+    RenderGeometry(threaded, CheckProjection, geometry);
+    threaded.TestBoxes(boxes.data(), static_cast<int>(boxes.size()), visibleThreaded.data());
+    Check(std::equal(buffer.Depths(), buffer.Depths() + buffer.Width() * buffer.Height(), threaded.Depths()),
+          "Same depths rendered across threads");
+    Check(visible == visibleThreaded, "Same box results across threads");
+    Check(buffer.Stats().numRasterised == threaded.Stats().numRasterised, "Same triangles rasterised across threads");
+}
+
+
+void RunChecks()
+{
+    CheckSimpleScenes();
+    CheckRandomScene();
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Benchmarks
+-----------------------------------------------------------------------------------------*/
+
+double gMinSeconds = 0.2;
+
+struct Result
+{
+    int    width, height;
+    int    numTriangles;
+    int    numRasterised;
+    double renderMs;        // One thread
+    double renderJobsMs;    // With the job system
+    int    numOccludees;
+    double testMs;          // All occludees, one thread
+    double testJobsMs;      // --"--, with the job system
+    int    numHidden;
+};
+
+std::vector<Result> gResults;
+int gNumWorkers = 0;
+
+
+// Time a function, repeating it for at least the minimum time and returning the average seconds per call
+template <class Function>
+double Time(Function function)
+{
+    using Clock = std::chrono::steady_clock;
+    function(); // Warm up
+    long long repeats = 0;
+    auto start = Clock::now();
+    double seconds = 0;
+    do
+    {
+        function();
+        ++repeats;
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (seconds < gMinSeconds);
+    return seconds / repeats;
+}
+
+
+void RunBenchmarks()
+{
+    JobSystem jobSystem;
+    gNumWorkers = jobSystem.NumWorkers();
+
+    // Camera a little above the hills at one side of the terrain, looking across it
+    const float TerrainSize = 1000;
+    CVector3 cameraPosition = { 0, TerrainHeight(0, -450) + 8, -450 };
+    CMatrix4x4 view = InverseAffine(MatrixRotationX(ToRadians(5)) * MatrixTranslation(cameraPosition));
+    CMatrix4x4 viewProjection = view * MatrixPerspective(ToRadians(80), Aspect, Near, Far);
+
+    // Objects standing on the terrain
+    const int NumOccludees = 10000;
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> position(-TerrainSize / 2, TerrainSize / 2);
+    std::uniform_real_distribution<float> extent(0.5f, 4);
+    const CFrustum frustum = FrustumFromMatrix(viewProjection);
+    std::vector<BoundingBox> occludees;
+    while (occludees.size() < NumOccludees)
+    {
+        float x = position(random), z = position(random), e = extent(random);
+        BoundingBox box = { { x, TerrainHeight(x, z) + e, z }, { e, e, e } };
+        if (IsVisible(frustum, box))  occludees.push_back(box); // As frustum culling would leave
+    }
+    std::vector<uint8_t> visible(NumOccludees);
+
+    std::fprintf(stderr, "\n%-9s %9s %10s %11s %11s %10s %12s %12s %8s\n", "Size", "Triangles", "Rasterised",
+                 "Render ms", "Jobs ms", "Occludees", "Test ms", "Jobs ms", "Hidden");
+    for (int numCells : { 32, 64, 128, 256 })
+    {
+        // Terrain plus a few buildings
+        Geometry occluders = MakeTerrain(TerrainSize, numCells);
+        for (int i = 0; i < 50; ++i)
+        {
+            float x = position(random), z = position(random);
+            occluders.AddBox({ { x, TerrainHeight(x, z) + 10, z }, { 6, 14, 6 } });
+        }
+
+        for (int scale : { 1, 2 })
+        {
+            Result result;
+            result.width  = 256 * scale;
+            result.height = 128 * scale;
+            result.numOccludees = NumOccludees;
+            OcclusionBuffer single(result.width, result.height);
+            OcclusionBuffer jobs(result.width, result.height, &jobSystem);
+
+            result.renderMs     = Time([&] { RenderGeometry(single, viewProjection, occluders); }) * 1000;
+            result.renderJobsMs = Time([&] { RenderGeometry(jobs,   viewProjection, occluders); }) * 1000;
+            result.testMs       = Time([&] { single.TestBoxes(occludees.data(), NumOccludees, visible.data()); }) * 1000;
+            result.testJobsMs   = Time([&] { jobs.TestBoxes(occludees.data(), NumOccludees, visible.data()); }) * 1000;
+
+            RenderGeometry(single, viewProjection, occluders);
+            single.TestBoxes(occludees.data(), NumOccludees, visible.data());
+            result.numTriangles  = single.Stats().numTriangles;
+            result.numRasterised = single.Stats().numRasterised;
+            result.numHidden     = single.Stats().numHidden;
+            gResults.push_back(result);
+
+            std::fprintf(stderr, "%4dx%-4d %9d %10d %11.3f %11.3f %10d %12.3f %12.3f %7.1f%%\n", result.width,
+                         result.height, result.numTriangles, result.numRasterised, result.renderMs, result.renderJobsMs,
+                         result.numOccludees, result.testMs, result.testJobsMs, 100.0 * result.numHidden / NumOccludees);
+        }
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Output
+-----------------------------------------------------------------------------------------*/
+
+void WriteJSON(FILE* file)
+{
+    std::fprintf(file, "{\n  \"check_failures\": %d,\n  \"simd\": \"%s\",\n  \"workers\": %d,\n  \"results\": [\n",
+                 gNumFailures, MATH_SIMD_NAME, gNumWorkers);
+    for (size_t i = 0; i < gResults.size(); ++i)
+    {
+        const Result& r = gResults[i];
+        std::fprintf(file, "    { \"width\": %d, \"height\": %d, \"triangles\": %d, \"rasterised\": %d, \"render_ms\": %.4f, "
+                           "\"render_jobs_ms\": %.4f, \"occludees\": %d, \"test_ms\": %.4f, \"test_jobs_ms\": %.4f, \"hidden\": %d }%s\n",
+                     r.width, r.height, r.numTriangles, r.numRasterised, r.renderMs, r.renderJobsMs, r.numOccludees,
+                     r.testMs, r.testJobsMs, r.numHidden, i + 1 < gResults.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    const char* outFile = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0)
+        {
+            gMinSeconds = 0.02;
+        }
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            outFile = argv[++i];
+        }
+        else
+        {
+            std::fprintf(stderr, "Usage: %s [--quick] [--out results.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    RunChecks();
+    std::fprintf(stderr, gNumFailures == 0 ? "All checks passed\n" : "%d checks FAILED\n", gNumFailures);
+
+    RunBenchmarks();
+
+    FILE* file = outFile ? std::fopen(outFile, "w") : stdout;
+    if (file == nullptr)
+    {
+        std::fprintf(stderr, "Could not open %s\n", outFile);
+        return 1;
+    }
+    WriteJSON(file);
+    if (outFile)  std::fclose(file);
+    return gNumFailures == 0 ? 0 : 1;
+}
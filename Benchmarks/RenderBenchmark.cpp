@@ -0,0 +1,1029 @@
+//--------------------------------------------------------------------------------------
+// Checks and benchmark for the CPU side of rendering, using the headless render device
+//--------------------------------------------------------------------------------------
+// Standalone program, not part of the Visual Studio project (it has its own main). Uses the headless render device
+// instead of Direct3D, so builds and runs on any platform, e.g. on Linux from this folder:
+//     g++ -O2 -std=c++17 -I.. -I../Math RenderBenchmark.cpp ../HeadlessRenderDevice.cpp ../RenderDevice.cpp ../RenderQueue.cpp ../RenderStateCache.cpp ../ConstantUploadBuffer.cpp ../Math/CFrustum.cpp -o RenderBenchmark
+//
+// Usage: RenderBenchmark [--quick] [--objects N] [--out results.json]
+// First checks the headless device catches the mistakes it should and records calls correctly, that the render
+// queue sorts items and skips repeated state, that the state cache drops exactly the calls that change nothing, and
+// that the constant upload buffer binds the right constants with and without constant buffer ranges.
+// Any failure is reported and the program returns 1.
+//
+// Then renders a synthetic scene the way Scene.cpp does: two shadow map passes from spotlights then the main camera
+// pass, each culling a crowd of objects against the frustum and submitting the visible ones to a render queue (see
+// RenderQueue.h), which draws objects sharing mesh and material instanced. The world matrices of objects drawn
+// separately are sent in a constant upload buffer (see ConstantUploadBuffer.h), once a frame however many passes draw
+// them, and each draw binds its own. Scene.cpp itself can't be built here as loading meshes and textures needs Windows, so the scene is rebuilt from the same calls. For comparison the scene
+// is also rendered "direct", the way Scene.cpp did before the render queue: each object binds its shaders and
+// texture, updates and binds the per-model constants, then Mesh::Render sets the buffers and draws. Both go through a
+// state cache (see RenderStateCache.h) as in the game. Reports the time per frame and per object drawn, the number of
+// draw calls, the number of each kind of call per frame reaching the device and the number of calls the cache
+// filtered out, for both.
+// Results are written as JSON (to stdout, or the file given with --out), a readable table to stderr. The top level
+// results are for the render queue, the "direct" object holds the same results rendering directly.
+
+#include "HeadlessRenderDevice.h"
+#include "RenderQueue.h"
+#include "RenderStateCache.h"
+#include "ConstantUploadBuffer.h"
+#include "CFrustum.h"
+#include "CMatrix4x4.h"
+#include "CMatrix3x4.h"
+#include "MathHelpers.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <random>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/*-----------------------------------------------------------------------------------------
+    Checks
+-----------------------------------------------------------------------------------------*/
+
+int gNumFailures = 0;
+
+void Check(bool passed, const char* description)
+{
+    if (!passed)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", description);
+        ++gNumFailures;
+    }
+}
+
+// True if the device has reported an error containing the given text
+bool HasError(const HeadlessRenderDevice& device, const char* text)
+{
+    for (const std::string& message : device.ErrorMessages())
+    {
+        if (message.find(text) != std::string::npos)  return true;
+    }
+    return false;
+}
+
+void RunChecks()
+{
+    const unsigned int indices[] = { 0, 1, 2 };
+    const float vertices[3 * 8] = {};
+    const float colour[4] = { 0, 0, 0, 1 };
+
+    // Drawing with nothing set up
+    {
+        HeadlessRenderDevice device;
+        device.DrawIndexed(3, 0, 0);
+        Check(HasError(device, "no vertex shader") && HasError(device, "no index buffer") && HasError(device, "no viewport"),
+              "Draw with nothing bound is reported");
+    }
+
+    // A correct draw gives no errors, and is recorded in order
+    {
+        HeadlessRenderDevice device(true);
+        ID3D11Buffer* vertexBuffer   = device.CreateVertexBuffer(vertices, sizeof(vertices));
+        ID3D11Buffer* indexBuffer    = device.CreateIndexBuffer(indices, sizeof(indices));
+        ID3D11Buffer* constantBuffer = device.CreateConstantBuffer(20);
+        auto renderTarget = device.CreateHandle<ID3D11RenderTargetView>();
+        auto depthStencil = device.CreateHandle<ID3D11DepthStencilView>();
+
+        device.OMSetRenderTargets(1, &renderTarget, depthStencil);
+        device.ClearRenderTargetView(renderTarget, colour);
+        device.ClearDepthStencilView(depthStencil, 1.0f);
+        device.RSSetViewport({ 0, 0, 640, 480 });
+        device.VSSetShader(device.CreateHandle<ID3D11VertexShader>());
+        device.PSSetShader(device.CreateHandle<ID3D11PixelShader>());
+        const float constants[5] = { 1, 2, 3, 4, 5 };
+        device.UpdateConstantBuffer(constantBuffer, constants, sizeof(constants));
+        device.VSSetConstantBuffers(0, 1, &constantBuffer);
+        device.IASetVertexBuffer(vertexBuffer, 32);
+        device.IASetInputLayout(device.CreateHandle<ID3D11InputLayout>());
+        device.IASetIndexBuffer(indexBuffer);
+        device.IASetPrimitiveTopology(PrimitiveTopology::TriangleList);
+        device.DrawIndexed(3, 0, 0);
+
+        Check(device.NumErrors() == 0, "Correct draw gives no errors");
+        Check(device.Commands().size() == 13 && device.Commands().back().call == RenderCall::DrawIndexed &&
+              device.Commands()[6].call == RenderCall::UpdateConstantBuffer, "Calls recorded in order");
+        Check(device.NumCalls(RenderCall::DrawIndexed) == 1 && device.NumIndicesDrawn() == 3 &&
+              device.NumConstantBytes() == sizeof(constants), "Calls counted");
+        const void* data = device.ConstantBufferData(constantBuffer);
+        Check(data != nullptr && std::memcmp(data, constants, sizeof(constants)) == 0, "Constant buffer content updated");
+        device.DrawIndexedInstanced(3, 4, 0, 0, 0);
+        Check(device.NumErrors() == 0 && device.NumCalls(RenderCall::DrawIndexedInstanced) == 1 && device.NumIndicesDrawn() == 15,
+              "Instanced draw counts the indices of every instance");
+
+        // Mistakes with buffers and slots
+        device.DrawIndexed(3, 1, 0);
+        Check(HasError(device, "past the end of the index buffer"), "Index buffer overrun is reported");
+        device.DrawIndexedInstanced(3, 2, 1, 0, 0);
+        Check(HasError(device, "DrawIndexedInstanced: indices past the end"), "Index buffer overrun is reported for instanced draws");
+        device.UpdateConstantBuffer(vertexBuffer, constants, sizeof(constants));
+        Check(HasError(device, "wrong kind of buffer"), "Updating a vertex buffer as constants is reported");
+        device.UpdateConstantBuffer(constantBuffer, constants, 64);
+        Check(HasError(device, "larger than buffer"), "Constant update larger than the buffer is reported");
+        ID3D11ShaderResourceView* views[2] = {};
+        device.PSSetShaderResources(MAX_TEXTURE_SLOTS - 1, 2, views);
+        Check(HasError(device, "slots out of range"), "Texture slots out of range are reported");
+
+        device.ReleaseBuffer(constantBuffer);
+        device.UpdateConstantBuffer(constantBuffer, constants, sizeof(constants));
+        Check(HasError(device, "UpdateConstantBuffer: not a live buffer"), "Updating a released buffer is reported");
+        device.ReleaseBuffer(indexBuffer);
+        device.ResetResults();
+        device.DrawIndexed(3, 0, 0);
+        Check(device.NumErrors() == 1 && HasError(device, "no index buffer"), "Drawing with a released index buffer is reported");
+
+        device.ReleaseBuffer(vertexBuffer);
+        Check(device.NumBuffers() == 0, "Buffers released");
+    }
+
+    // State cache: repeated state is dropped, draws and changes are passed on
+    {
+        HeadlessRenderDevice device(true);
+        RenderStateCache cache(device.ImmediateContext());
+
+        auto shader = device.CreateHandle<ID3D11VertexShader>();
+        cache.VSSetShader(shader);
+        cache.VSSetShader(shader);
+        Check(device.NumCalls(RenderCall::VSSetShader) == 1 && cache.NumIssued(RenderCall::VSSetShader) == 1 &&
+              cache.NumFiltered(RenderCall::VSSetShader) == 1, "Repeated shader is filtered");
+
+        ID3D11ShaderResourceView* views[3] = { device.CreateHandle<ID3D11ShaderResourceView>(),
+                                               device.CreateHandle<ID3D11ShaderResourceView>(),
+                                               device.CreateHandle<ID3D11ShaderResourceView>() };
+        cache.PSSetShaderResources(2, 3, views);
+        views[1] = device.CreateHandle<ID3D11ShaderResourceView>();
+        cache.PSSetShaderResources(2, 3, views);
+        const RenderCommand& trimmed = device.Commands().back();
+        Check(trimmed.call == RenderCall::PSSetShaderResources && trimmed.object == views[1] && trimmed.a == 3 && trimmed.b == 1,
+              "Texture range is trimmed to the slots that change");
+        cache.PSSetShaderResources(3, 1, &views[1]);
+        Check(device.NumCalls(RenderCall::PSSetShaderResources) == 2, "Repeated texture is filtered");
+
+        // Setting render targets may unbind textures, so they must be set again
+        auto depthStencil = device.CreateHandle<ID3D11DepthStencilView>();
+        cache.OMSetRenderTargets(0, nullptr, depthStencil);
+        cache.PSSetShaderResources(3, 1, &views[1]);
+        Check(device.NumCalls(RenderCall::PSSetShaderResources) == 3, "Textures are set again after setting render targets");
+
+        cache.RSSetViewport({ 0, 0, 640, 480 });
+        cache.RSSetViewport({ 0, 0, 640, 480 });
+        cache.RSSetViewport({ 0, 0, 320, 240 });
+        cache.IASetPrimitiveTopology(PrimitiveTopology::TriangleList);
+        cache.IASetPrimitiveTopology(PrimitiveTopology::TriangleList);
+        cache.OMSetDepthStencilState(nullptr, 0);
+        cache.OMSetDepthStencilState(nullptr, 1);
+        cache.DrawIndexed(3, 0, 0);
+        cache.DrawIndexed(3, 0, 0);
+        Check(device.NumCalls(RenderCall::RSSetViewport) == 2 && device.NumCalls(RenderCall::IASetPrimitiveTopology) == 1 &&
+              device.NumCalls(RenderCall::OMSetDepthStencilState) == 2 && device.NumCalls(RenderCall::DrawIndexed) == 2,
+              "Viewport, topology and depth state only set on change, draws always passed on");
+        Check(cache.NumIssued() == device.NumCalls() && cache.NumFiltered() == 4, "Cache counts issued and filtered calls");
+
+        cache.Invalidate();
+        cache.VSSetShader(shader);
+        Check(device.NumCalls(RenderCall::VSSetShader) == 2, "Shader set again after invalidating");
+    }
+
+    // Binding parts of constant buffers: mistakes reported, and the state cache tells ranges apart
+    {
+        HeadlessRenderDevice device(true);
+        ID3D11Buffer* buffer = device.CreateConstantBuffer(1024); // 64 constants
+        unsigned int first = 16, num = 16;
+        device.VSSetConstantBuffers1(1, 1, &buffer, &first, &num);
+        first = 48;
+        device.PSSetConstantBuffers1(1, 1, &buffer, &first, &num);
+        Check(device.NumErrors() == 0 && device.NumCalls(RenderCall::VSSetConstantBuffers1) == 1 &&
+              device.NumCalls(RenderCall::PSSetConstantBuffers1) == 1, "Correct constant buffer ranges give no errors");
+        first = 8;
+        device.VSSetConstantBuffers1(1, 1, &buffer, &first, &num);
+        Check(HasError(device, "not a multiple of 16 constants"), "Misaligned constant buffer range is reported");
+        first = 0;  num = 0;
+        device.VSSetConstantBuffers1(1, 1, &buffer, &first, &num);
+        Check(HasError(device, "must be 16 to 4096 constants"), "Empty constant buffer range is reported");
+        first = 48;  num = 32;
+        device.VSSetConstantBuffers1(1, 1, &buffer, &first, &num);
+        Check(HasError(device, "past the end of the buffer"), "Constant buffer range past the end is reported");
+
+        HeadlessRenderDevice noRanges(false, false);
+        ID3D11Buffer* otherBuffer = noRanges.CreateConstantBuffer(1024);
+        first = 0;  num = 16;
+        noRanges.VSSetConstantBuffers1(1, 1, &otherBuffer, &first, &num);
+        Check(!noRanges.SupportsConstantBufferRanges() && HasError(noRanges, "ranges not supported"),
+              "Constant buffer range on a device without them is reported");
+        noRanges.ReleaseBuffer(otherBuffer);
+
+        device.ResetResults();
+        RenderStateCache cache(device.ImmediateContext());
+        ID3D11Buffer* buffers[2] = { buffer, buffer };
+        unsigned int firsts[2] = { 0, 16 }, nums[2] = { 16, 16 };
+        cache.VSSetConstantBuffers1(1, 2, buffers, firsts, nums);
+        cache.VSSetConstantBuffers1(1, 2, buffers, firsts, nums);
+        firsts[1] = 32;
+        cache.VSSetConstantBuffers1(1, 2, buffers, firsts, nums);
+        const RenderCommand& trimmed = device.Commands().back();
+        Check(device.NumCalls(RenderCall::VSSetConstantBuffers1) == 2 && trimmed.a == 2 && trimmed.b == 1,
+              "Repeated constant buffer ranges are filtered, changed ones trimmed");
+        cache.VSSetConstantBuffers(2, 1, &buffer);
+        cache.VSSetConstantBuffers(2, 1, &buffer);
+        cache.VSSetConstantBuffers1(2, 1, &buffer, &firsts[1], &nums[1]);
+        Check(device.NumCalls(RenderCall::VSSetConstantBuffers) == 1 && device.NumCalls(RenderCall::VSSetConstantBuffers1) == 3,
+              "Binding the whole of a buffer and part of it are told apart");
+        Check(device.NumErrors() == 0, "State cache passes on correct constant buffer ranges");
+        device.ReleaseBuffer(buffer);
+    }
+
+    // Render queue: order of items and state set
+    {
+        HeadlessRenderDevice device(true);
+        gRenderDevice  = &device;
+        gRenderContext = device.ImmediateContext();
+
+        auto renderTarget = device.CreateHandle<ID3D11RenderTargetView>();
+        device.OMSetRenderTargets(1, &renderTarget, nullptr);
+        device.RSSetViewport({ 0, 0, 640, 480 });
+
+        RenderGeometry geometry[2];
+        for (RenderGeometry& g : geometry)
+        {
+            g = { device.CreateHandle<ID3D11InputLayout>(), device.CreateVertexBuffer(vertices, sizeof(vertices)),
+                  device.CreateIndexBuffer(indices, sizeof(indices)), 32, 3, NewGeometrySortId() };
+        }
+
+        RenderMaterials materials;
+        RenderMaterial opaque;
+        opaque.vertexShader = device.CreateHandle<ID3D11VertexShader>();
+        opaque.pixelShader  = device.CreateHandle<ID3D11PixelShader>();
+        opaque.textures[0]  = device.CreateHandle<ID3D11ShaderResourceView>();
+        opaque.samplers[0]  = device.CreateHandle<ID3D11SamplerState>();
+        int opaqueA = materials.Add(opaque);
+        opaque.textures[0] = device.CreateHandle<ID3D11ShaderResourceView>();
+        int opaqueB = materials.Add(opaque);
+        RenderMaterial blended = opaque;
+        blended.blendMode  = BlendMode::AlphaBlended;
+        blended.blendState = device.CreateHandle<ID3D11BlendState>();
+        int blendedMaterial = materials.Add(blended);
+
+        auto variantTexture = device.CreateHandle<ID3D11ShaderResourceView>();
+        int variant = materials.WithTexture(opaqueA, variantTexture);
+        Check(variant != opaqueA && materials.WithTexture(opaqueA, variantTexture) == variant &&
+              materials.WithTexture(opaqueA, materials[opaqueA].textures[0]) == opaqueA &&
+              materials.ShaderId(variant) == materials.ShaderId(opaqueA), "Material texture variants are reused");
+
+        // Submitted in an order that needs sorting. Camera at the origin looking down z, so depth is z
+        RenderQueue queue(materials);
+        queue.Begin(MatrixTranslation({ 0, 0, 0 }));
+        auto at = [](float z) { return AffineWorld({ 0, 0, z }, { 0, 0, 0 }, { 1, 1, 1 }); };
+        queue.Submit(blendedMaterial, geometry[0], at(10));  // 0
+        queue.Submit(opaqueB,         geometry[1], at(5));   // 1
+        queue.Submit(opaqueA,         geometry[0], at(20));  // 2
+        queue.Submit(blendedMaterial, geometry[0], at(30));  // 3
+        queue.Submit(opaqueA,         geometry[0], at(2));   // 4
+        queue.Submit(opaqueA,         geometry[1], at(1), { 1, 1, 1 }, 1); // 5, later pass
+        queue.Submit(opaqueB,         geometry[1], at(-5));  // 6, behind the camera
+
+        std::vector<float> drawnZ;
+        queue.Execute([&](const RenderItem& item) { drawnZ.push_back(item.worldMatrix.e32); });
+        const std::vector<float> expectedZ = { 2, 20, -5, 5, 30, 10, 1 };
+        Check(drawnZ == expectedZ, "Queue groups opaque items by material and geometry front to back, then blended back to front, then later passes");
+
+        // Each state is set only when it changes: shaders once, textures for the 3 changes of texture (the blended
+        // material has opaqueB's), 3 blend states (opaque, blended, opaque again), geometry 4 times, topology once
+        Check(device.NumErrors() == 0, "Queue renders without errors");
+        Check(device.NumCalls(RenderCall::DrawIndexed) == 7 && device.NumCalls(RenderCall::VSSetShader) == 1 &&
+              device.NumCalls(RenderCall::PSSetShader) == 1 && device.NumCalls(RenderCall::PSSetShaderResources) == 3 &&
+              device.NumCalls(RenderCall::PSSetSamplers) == 1 && device.NumCalls(RenderCall::OMSetBlendState) == 3 &&
+              device.NumCalls(RenderCall::IASetVertexBuffer) == 4 && device.NumCalls(RenderCall::IASetInputLayout) == 4 &&
+              device.NumCalls(RenderCall::IASetPrimitiveTopology) == 1, "Queue only sets state that changes");
+
+        for (RenderGeometry& g : geometry)
+        {
+            device.ReleaseBuffer(g.vertexBuffer);
+            device.ReleaseBuffer(g.indexBuffer);
+        }
+        gRenderDevice  = nullptr;
+        gRenderContext = nullptr;
+    }
+
+    // Render queue: runs of items with the same material and geometry are drawn instanced
+    {
+        HeadlessRenderDevice device(true);
+        gRenderDevice  = &device;
+        gRenderContext = device.ImmediateContext();
+
+        auto renderTarget = device.CreateHandle<ID3D11RenderTargetView>();
+        device.OMSetRenderTargets(1, &renderTarget, nullptr);
+        device.RSSetViewport({ 0, 0, 640, 480 });
+
+        RenderGeometry geometry[2];
+        for (RenderGeometry& g : geometry)
+        {
+            g = { device.CreateHandle<ID3D11InputLayout>(), device.CreateVertexBuffer(vertices, sizeof(vertices)),
+                  device.CreateIndexBuffer(indices, sizeof(indices)), 32, 3, NewGeometrySortId() };
+        }
+        ID3D11Buffer* instanceBuffer = device.CreateConstantBuffer(sizeof(RenderInstance) * MAX_RENDER_INSTANCES);
+
+        RenderMaterials materials;
+        RenderMaterial instanced;
+        instanced.vertexShader          = device.CreateHandle<ID3D11VertexShader>();
+        instanced.instancedVertexShader = device.CreateHandle<ID3D11VertexShader>();
+        instanced.pixelShader           = device.CreateHandle<ID3D11PixelShader>();
+        int instancedMaterial = materials.Add(instanced);
+        RenderMaterial notInstanced = instanced;
+        notInstanced.instancedVertexShader = nullptr;
+        int notInstancedMaterial = materials.Add(notInstanced);
+
+        RenderQueue queue(materials);
+        queue.SetInstanceBuffer(instanceBuffer);
+        queue.Begin(MatrixTranslation({ 0, 0, 0 }));
+        auto at = [](float z) { return AffineWorld({ 0, 0, z }, { 0, 0, 0 }, { 1, 1, 1 }); };
+        const unsigned int numCrowd = MAX_RENDER_INSTANCES + 5;
+        for (unsigned int i = 0; i < numCrowd; ++i)
+        {
+            queue.Submit(instancedMaterial, geometry[0], at(1.0f + i), { 1, 0, static_cast<float>(i) });
+        }
+        queue.Submit(instancedMaterial,    geometry[1], at(5));
+        queue.Submit(notInstancedMaterial, geometry[0], at(5));
+        queue.Submit(notInstancedMaterial, geometry[0], at(6));
+
+        int numSeparate = 0;
+        queue.Execute([&](const RenderItem&) { ++numSeparate; });
+
+        // The crowd is split into two instanced draws as it is more than the buffer holds, the last is of 5 items.
+        // The lone item and the material without an instanced shader are drawn separately, with the normal shader
+        Check(device.NumErrors() == 0, "Instanced queue renders without errors");
+        Check(device.NumCalls(RenderCall::DrawIndexedInstanced) == 2 && device.NumCalls(RenderCall::DrawIndexed) == 3 &&
+              numSeparate == 3 && queue.NumDraws() == 5 && device.NumIndicesDrawn() == 3 * (numCrowd + 3),
+              "Runs of the same material and geometry are drawn instanced, up to the buffer size at a time");
+        Check(device.NumCalls(RenderCall::UpdateConstantBuffer) == 2 && device.NumConstantBytes() ==
+              static_cast<long long>(sizeof(RenderInstance)) * numCrowd, "Instance buffer updated with each run");
+
+        int numInstancedShaderDraws = 0;
+        ID3D11VertexShader* currentShader = nullptr;
+        for (const RenderCommand& command : device.Commands())
+        {
+            if (command.call == RenderCall::VSSetShader)  currentShader = static_cast<ID3D11VertexShader*>(const_cast<void*>(command.object));
+            if (command.call == RenderCall::DrawIndexedInstanced && currentShader == instanced.instancedVertexShader)  ++numInstancedShaderDraws;
+            if (command.call == RenderCall::DrawIndexed && currentShader == instanced.vertexShader)  ++numInstancedShaderDraws;
+        }
+        Check(numInstancedShaderDraws == 5, "Instanced draws use the instanced vertex shader, others the normal one");
+
+        // Instances are in depth order, front to back for opaque items
+        const RenderInstance* instances = static_cast<const RenderInstance*>(device.ConstantBufferData(instanceBuffer));
+        Check(instances != nullptr && instances[0].worldMatrix.e32 == 1.0f + MAX_RENDER_INSTANCES &&
+              instances[4].worldMatrix.e32 == 1.0f + MAX_RENDER_INSTANCES + 4 && instances[4].colour.z == MAX_RENDER_INSTANCES + 4,
+              "Instance buffer holds the world matrices and colours of the run in order");
+
+        for (RenderGeometry& g : geometry)
+        {
+            device.ReleaseBuffer(g.vertexBuffer);
+            device.ReleaseBuffer(g.indexBuffer);
+        }
+        device.ReleaseBuffer(instanceBuffer);
+        gRenderDevice  = nullptr;
+        gRenderContext = nullptr;
+    }
+
+    // Constant upload buffer: each upload appends the elements added since the last one, objects keep one element a
+    // frame, and elements are bound as ranges or copied to a small buffer when bound without them
+    for (bool ranges : { true, false })
+    {
+        HeadlessRenderDevice device(true, ranges);
+        gRenderDevice  = &device;
+        gRenderContext = device.ImmediateContext();
+        {
+            struct Element { float value[5]; }; // Not a multiple of 16 bytes
+            ConstantUploadBuffer upload(sizeof(Element), 2);
+            Check(upload.UsesRanges() == ranges, "Upload buffer uses ranges if the device supports them");
+
+            // A first pass adds objects 0 and 1 and an element without an object, a second pass objects 1 and 2
+            upload.Begin(4);
+            Check(upload.Capacity() >= 4, "Upload buffer grows on Begin to hold an element for each object");
+            const Element e0 = { { 0, 1, 2, 3, 4 } }, e1 = { { 10, 11, 12, 13, 14 } }, e2 = { { 20, 21, 22, 23, 24 } };
+            int firstPass[3] = { upload.Add(0, &e0, sizeof(e0)), upload.Add(1, &e1, sizeof(e1)), upload.Add(-1, &e1, sizeof(e1)) };
+            upload.Upload();
+            int secondPass[2] = { upload.Add(1, &e0, sizeof(e0)), upload.Add(2, &e2, sizeof(e2)) };
+            upload.Upload();
+            upload.Upload(); // Nothing new, so nothing sent
+            Check(firstPass[0] == 0 && firstPass[1] == 1 && firstPass[2] == 2 && secondPass[0] == 1 && secondPass[1] == 3 &&
+                  upload.Element(2) == 3 && upload.Element(3) == -1, "Objects keep their element for the frame, others get new ones");
+            Check(upload.Add(-1, &e0, sizeof(e0)) == -1, "Upload buffer refuses elements past its capacity");
+
+            upload.Bind(1, secondPass[1]);
+            Check(device.NumErrors() == 0, "Upload buffer used without errors");
+            const RenderCommand& bind = device.Commands().back();
+            const float* data = static_cast<const float*>(device.ConstantBufferData(static_cast<ID3D11Buffer*>(const_cast<void*>(bind.object))));
+            if (ranges)
+            {
+                // Elements are 256 bytes apart, the second pass only sends its new element, after the first pass's
+                const RenderCommand& append = device.Commands()[device.Commands().size() - 3];
+                Check(device.NumCalls(RenderCall::AppendConstantBuffer) == 2 && device.NumCalls(RenderCall::UpdateConstantBuffer) == 0 &&
+                      device.NumConstantBytes() == 4 * 256 && append.call == RenderCall::AppendConstantBuffer &&
+                      append.a == 3 * 256 && append.b == 256, "Each upload appends only the new elements");
+                Check(bind.call == RenderCall::PSSetConstantBuffers1 && data != nullptr && data[3 * 64] == 20 &&
+                      data[3 * 64 + 4] == 24 && data[1 * 64] == 10, "Elements are bound as ranges of the one buffer");
+            }
+            else
+            {
+                Check(device.NumCalls(RenderCall::AppendConstantBuffer) == 0 && device.NumCalls(RenderCall::UpdateConstantBuffer) == 1 &&
+                      device.NumConstantBytes() == sizeof(Element) && bind.call == RenderCall::PSSetConstantBuffers &&
+                      data != nullptr && data[0] == 20 && data[4] == 24,
+                      "Without ranges the upload buffer copies each element to a small buffer when it is bound");
+            }
+
+            // The next frame starts again from the beginning of the buffer
+            upload.Begin(4);
+            Check(upload.Add(2, &e2, sizeof(e2)) == 0 && upload.Element(1) == -1, "Begin starts a new frame");
+            upload.Upload();
+            Check(!ranges || device.Commands().back().a == 0, "The first upload of a frame replaces the last frame's");
+        }
+        Check(device.NumBuffers() == 0, "Upload buffer releases its buffers");
+
+        // Render queue with an upload buffer: separate draws bind their own element, and the constants of an object
+        // drawn in two passes are only uploaded once
+        {
+            auto renderTarget = device.CreateHandle<ID3D11RenderTargetView>();
+            device.OMSetRenderTargets(1, &renderTarget, nullptr);
+            device.RSSetViewport({ 0, 0, 640, 480 });
+            RenderGeometry geometry = { device.CreateHandle<ID3D11InputLayout>(), device.CreateVertexBuffer(vertices, sizeof(vertices)),
+                                        device.CreateIndexBuffer(indices, sizeof(indices)), 32, 3, NewGeometrySortId() };
+            RenderMaterials materials;
+            RenderMaterial material;
+            material.vertexShader = device.CreateHandle<ID3D11VertexShader>();
+            material.pixelShader  = device.CreateHandle<ID3D11PixelShader>();
+            int notInstanced = materials.Add(material);
+
+            ConstantUploadBuffer upload(sizeof(RenderInstance), 8);
+            RenderQueue queue(materials);
+            queue.SetConstantUpload(&upload, 1);
+            auto at = [](float z) { return AffineWorld({ 0, 0, z }, { 0, 0, 0 }, { 1, 1, 1 }); };
+            int numSeparate = 0;
+            auto updateConstants = [&](const RenderItem&) { ++numSeparate; };
+
+            upload.Begin(2);
+            device.ResetResults();
+            queue.Begin(MatrixTranslation({ 0, 0, 0 }));
+            queue.Submit(notInstanced, geometry, at(1), { 1, 1, 1 }, 0, 0);
+            queue.Submit(notInstanced, geometry, at(2), { 1, 1, 1 }, 0, 1);
+            queue.Execute(updateConstants);
+            queue.Begin(MatrixTranslation({ 0, 0, 0 }));
+            queue.Submit(notInstanced, geometry, at(2), { 1, 1, 1 }, 0, 1);
+            queue.Submit(notInstanced, geometry, at(3));
+            queue.Execute(updateConstants);
+
+            RenderCall bindCall = ranges ? RenderCall::VSSetConstantBuffers1 : RenderCall::VSSetConstantBuffers;
+            long long elementSize = ranges ? 256 : sizeof(RenderInstance);
+            Check(device.NumErrors() == 0 && numSeparate == 0 && device.NumCalls(bindCall) == 4,
+                  "Queue binds the upload buffer element of each separate draw");
+            Check(ranges ? (device.NumCalls(RenderCall::AppendConstantBuffer) == 2 && device.NumConstantBytes() == 3 * elementSize)
+                         : (device.NumConstantBytes() == 4 * elementSize), // Copied on every bind
+                  "Constants of an object drawn in two passes are only uploaded once");
+            if (ranges)
+            {
+                const void* buffer = nullptr;
+                for (const RenderCommand& command : device.Commands())
+                {
+                    if (command.call == RenderCall::AppendConstantBuffer)  buffer = command.object;
+                }
+                const RenderInstance* instances = static_cast<const RenderInstance*>(device.ConstantBufferData(
+                                                      static_cast<ID3D11Buffer*>(const_cast<void*>(buffer))));
+                const size_t stride = 256 / sizeof(RenderInstance);
+                Check(instances != nullptr && instances[0].worldMatrix.e32 == 1 && instances[stride].worldMatrix.e32 == 2 &&
+                      instances[2 * stride].worldMatrix.e32 == 3, "Upload buffer holds each item's world matrix");
+            }
+
+            // When the upload buffer is full the queue falls back to the caller's function
+            upload.Begin(0);
+            for (unsigned int i = 0; i < upload.Capacity(); ++i)  upload.Add(-1, &i, sizeof(i));
+            queue.Begin(MatrixTranslation({ 0, 0, 0 }));
+            queue.Submit(notInstanced, geometry, at(1));
+            queue.Execute(updateConstants);
+            Check(numSeparate == 1, "Queue sends constants itself when the upload buffer is full");
+
+            device.ReleaseBuffer(geometry.vertexBuffer);
+            device.ReleaseBuffer(geometry.indexBuffer);
+        }
+        gRenderDevice  = nullptr;
+        gRenderContext = nullptr;
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Synthetic scene
+-----------------------------------------------------------------------------------------*/
+
+// Same sizes as PerFrameConstants and PerModelConstants in Common.h (which can't be included outside Windows)
+struct FrameConstants
+{
+    CMatrix4x4 viewMatrix;
+    CMatrix4x4 projectionMatrix;
+    CMatrix4x4 viewProjectionMatrix;
+    float      lightsAndSettings[120];
+};
+struct ModelConstants
+{
+    CMatrix3x4 worldMatrix;
+    CVector3   objectColour;
+    float      padding;
+};
+
+// Handles and buffers for a mesh, rendered like Mesh::Render
+struct BenchMesh
+{
+    RenderGeometry geometry;
+
+    void Render() const
+    {
+        gRenderContext->IASetVertexBuffer(geometry.vertexBuffer, geometry.vertexSize);
+        gRenderContext->IASetInputLayout(geometry.layout);
+        gRenderContext->IASetIndexBuffer(geometry.indexBuffer);
+        gRenderContext->IASetPrimitiveTopology(PrimitiveTopology::TriangleList);
+        gRenderContext->DrawIndexed(geometry.numIndices, 0, 0);
+    }
+};
+
+// The shaders and texture an object is rendered with
+struct BenchMaterial
+{
+    ID3D11VertexShader*       vertexShader;
+    ID3D11VertexShader*       instancedVertexShader; // Only used by the render queue
+    ID3D11PixelShader*        pixelShader;
+    ID3D11ShaderResourceView* diffuseSpecularMap;
+};
+
+struct BenchScene
+{
+    // Objects in the crowd, in structure of arrays form as in EntityStore
+    std::vector<CMatrix3x4>     worldMatrices;
+    std::vector<BoundingSphere> worldBounds;
+    std::vector<int>            meshes;
+    std::vector<int>            materials;
+
+    std::vector<BenchMesh>     meshList;
+    std::vector<BenchMaterial> materialList;
+
+    // The same materials for the render queue, along with the depth-only material for shadow maps
+    RenderMaterials  renderMaterials;
+    std::vector<int> queueMaterials; // Index in renderMaterials of each material in materialList
+    int              depthOnlyMaterial;
+    RenderQueue      queue{ renderMaterials };
+
+    // Cameras: two spotlights for the shadow maps then the main camera
+    CMatrix4x4 viewMatrices[3];
+    CMatrix4x4 viewProjections[3];
+
+    // Fixed resources, as created in InitGeometry / InitScene
+    ID3D11Buffer*             perFrameConstantBuffer;
+    ID3D11Buffer*             perModelConstantBuffer;
+    ID3D11Buffer*             perInstanceConstantBuffer;
+    ID3D11VertexShader*       basicTransformVertexShader;
+    ID3D11VertexShader*       basicTransformInstancedVertexShader;
+    ID3D11PixelShader*        depthOnlyPixelShader;
+    ID3D11DepthStencilView*   shadowMapDepthStencils[2];
+    ID3D11ShaderResourceView* shadowMapSRVs[2];
+    ID3D11RenderTargetView*   backBuffer;
+    ID3D11DepthStencilView*   depthStencil;
+    ID3D11SamplerState*       anisotropicSampler;
+    ID3D11SamplerState*       trilinearSampler;
+    ID3D11BlendState*         noBlendingState;
+    ID3D11DepthStencilState*  useDepthBufferState;
+    ID3D11RasterizerState*    cullBackState;
+
+    // Per-model constants of separate draws, shared between passes. Only used by the render queue
+    std::unique_ptr<ConstantUploadBuffer> modelConstantsUpload;
+
+    // Scratch space for culling
+    std::vector<uint32_t> visibleBits;
+};
+
+FrameConstants gFrameConstants;
+ModelConstants gModelConstants;
+
+const int NumMeshes    = 20;
+const int NumMaterials = 40;
+const int NumShaders   = 6;
+const float SceneSize  = 1000;
+const int ShadowMapSize = 2048;
+
+
+void CreateScene(BenchScene& scene, HeadlessRenderDevice& device, int numObjects)
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-SceneSize / 2, SceneSize / 2);
+    std::uniform_real_distribution<float> angle(0, 2 * PI);
+    std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+    // Meshes of a few hundred to a few thousand triangles
+    std::vector<unsigned int> indices(30000);
+    std::vector<float> vertices(8 * 10000);
+    for (int i = 0; i < NumMeshes; ++i)
+    {
+        unsigned int numIndices = 3 * (300 + 500 * i);
+        scene.meshList.push_back({ { device.CreateHandle<ID3D11InputLayout>(),
+                                     device.CreateVertexBuffer(vertices.data(), static_cast<unsigned int>(vertices.size() * sizeof(float))),
+                                     device.CreateIndexBuffer(indices.data(), numIndices * sizeof(unsigned int)),
+                                     8 * sizeof(float), numIndices, NewGeometrySortId() } });
+    }
+
+    std::vector<ID3D11VertexShader*> vertexShaders;
+    std::vector<ID3D11VertexShader*> instancedVertexShaders;
+    std::vector<ID3D11PixelShader*>  pixelShaders;
+    for (int i = 0; i < NumShaders; ++i)
+    {
+        vertexShaders.push_back(device.CreateHandle<ID3D11VertexShader>());
+        instancedVertexShaders.push_back(device.CreateHandle<ID3D11VertexShader>());
+        pixelShaders.push_back(device.CreateHandle<ID3D11PixelShader>());
+    }
+    for (int i = 0; i < NumMaterials; ++i)
+    {
+        scene.materialList.push_back({ vertexShaders[i % NumShaders], instancedVertexShaders[i % NumShaders],
+                                       pixelShaders[i % NumShaders], device.CreateHandle<ID3D11ShaderResourceView>() });
+    }
+
+    for (int i = 0; i < numObjects; ++i)
+    {
+        CMatrix3x4 world = AffineWorld({ position(random), 0, position(random) }, { 0, angle(random), 0 }, CVector3{ 1, 1, 1 } * scale(random));
+        scene.worldMatrices.push_back(world);
+        scene.worldBounds.push_back(TransformSphere({ { 0, 5, 0 }, 8 }, world));
+        scene.meshes.push_back(static_cast<int>(random() % NumMeshes));
+        scene.materials.push_back(static_cast<int>(random() % NumMaterials));
+    }
+
+    // Main camera near the edge of the crowd looking across it, two spotlights above looking down into it
+    CMatrix4x4 cameraWorld = MatrixRotationX(ToRadians(15)) * MatrixTranslation({ 0, 40, -SceneSize / 2 });
+    scene.viewMatrices[2]    = InverseAffine(cameraWorld);
+    scene.viewProjections[2] = scene.viewMatrices[2] * MatrixPerspective(ToRadians(60), 16.0f / 9.0f, 0.1f, 10000.0f);
+    for (int i = 0; i < 2; ++i)
+    {
+        CMatrix4x4 lightWorld = MatrixRotationX(ToRadians(60)) * MatrixRotationY(ToRadians(i * 120.0f - 60)) *
+                                MatrixTranslation({ i * 200.0f - 100, 150, -100 });
+        scene.viewMatrices[i]    = InverseAffine(lightWorld);
+        scene.viewProjections[i] = scene.viewMatrices[i] * MatrixPerspective(ToRadians(90), 1, 1, 1000);
+    }
+
+    scene.perFrameConstantBuffer     = device.CreateConstantBuffer(sizeof(FrameConstants));
+    scene.perModelConstantBuffer     = device.CreateConstantBuffer(sizeof(ModelConstants));
+    scene.perInstanceConstantBuffer  = device.CreateConstantBuffer(sizeof(RenderInstance) * MAX_RENDER_INSTANCES);
+    scene.modelConstantsUpload       = std::make_unique<ConstantUploadBuffer>(static_cast<unsigned int>(sizeof(ModelConstants)), numObjects);
+    scene.basicTransformVertexShader = device.CreateHandle<ID3D11VertexShader>();
+    scene.basicTransformInstancedVertexShader = device.CreateHandle<ID3D11VertexShader>();
+    scene.depthOnlyPixelShader       = device.CreateHandle<ID3D11PixelShader>();
+    for (int i = 0; i < 2; ++i)
+    {
+        scene.shadowMapDepthStencils[i] = device.CreateHandle<ID3D11DepthStencilView>();
+        scene.shadowMapSRVs[i]          = device.CreateHandle<ID3D11ShaderResourceView>();
+    }
+    scene.backBuffer          = device.CreateHandle<ID3D11RenderTargetView>();
+    scene.depthStencil        = device.CreateHandle<ID3D11DepthStencilView>();
+    scene.anisotropicSampler  = device.CreateHandle<ID3D11SamplerState>();
+    scene.trilinearSampler    = device.CreateHandle<ID3D11SamplerState>();
+    scene.noBlendingState     = device.CreateHandle<ID3D11BlendState>();
+    scene.useDepthBufferState = device.CreateHandle<ID3D11DepthStencilState>();
+    scene.cullBackState       = device.CreateHandle<ID3D11RasterizerState>();
+
+    // Render queue materials, as CreateRenderMaterials in Scene.cpp
+    scene.queue.SetInstanceBuffer(scene.perInstanceConstantBuffer);
+    scene.queue.SetConstantUpload(scene.modelConstantsUpload.get(), 1);
+    RenderMaterial material;
+    material.blendState            = scene.noBlendingState;
+    material.depthStencilState     = scene.useDepthBufferState;
+    material.rasterizerState       = scene.cullBackState;
+    material.vertexShader          = scene.basicTransformVertexShader;
+    material.instancedVertexShader = scene.basicTransformInstancedVertexShader;
+    material.pixelShader           = scene.depthOnlyPixelShader;
+    scene.depthOnlyMaterial = scene.renderMaterials.Add(material);
+    material.samplers[0] = scene.anisotropicSampler;
+    for (const BenchMaterial& benchMaterial : scene.materialList)
+    {
+        material.vertexShader          = benchMaterial.vertexShader;
+        material.instancedVertexShader = benchMaterial.instancedVertexShader;
+        material.pixelShader           = benchMaterial.pixelShader;
+        material.textures[0]           = benchMaterial.diffuseSpecularMap;
+        scene.queueMaterials.push_back(scene.renderMaterials.Add(material));
+    }
+}
+
+
+// Render the visible objects from one camera, as RenderDepthBufferFromLight (depthOnly) or RenderSceneFromCamera
+// do: per-frame constants first, then the visible objects are submitted to the render queue, which sorts and renders
+// them, drawing objects sharing mesh and material instanced and binding the per-model constants for the others
+void RenderPassQueued(BenchScene& scene, int camera, bool depthOnly)
+{
+    gFrameConstants.viewProjectionMatrix = scene.viewProjections[camera];
+    UpdateConstantBuffer(scene.perFrameConstantBuffer, gFrameConstants);
+    gRenderContext->VSSetConstantBuffers(0, 1, &scene.perFrameConstantBuffer);
+    gRenderContext->PSSetConstantBuffers(0, 1, &scene.perFrameConstantBuffer);
+
+    CFrustum frustum = FrustumFromMatrix(scene.viewProjections[camera]);
+    int numObjects = static_cast<int>(scene.worldBounds.size());
+    scene.visibleBits.resize((numObjects + 31) / 32);
+    TestSpheres(frustum, scene.worldBounds.data(), numObjects, scene.visibleBits.data());
+
+    scene.queue.Begin(scene.viewMatrices[camera]);
+    for (int i = 0; i < numObjects; ++i)
+    {
+        if ((scene.visibleBits[i / 32] & (1u << (i % 32))) == 0)  continue;
+        int material = depthOnly ? scene.depthOnlyMaterial : scene.queueMaterials[scene.materials[i]];
+        scene.queue.Submit(material, scene.meshList[scene.meshes[i]].geometry, scene.worldMatrices[i], { 1, 1, 1 }, 0, i);
+    }
+
+    // As ExecuteRenderQueue
+    gRenderContext->VSSetConstantBuffers(1, 1, &scene.perModelConstantBuffer);
+    gRenderContext->PSSetConstantBuffers(1, 1, &scene.perModelConstantBuffer);
+    gRenderContext->VSSetConstantBuffers(2, 1, &scene.perInstanceConstantBuffer);
+    scene.queue.Execute([&](const RenderItem& item)
+    {
+        gModelConstants.worldMatrix  = item.worldMatrix;
+        gModelConstants.objectColour = item.colour;
+        UpdateConstantBuffer(scene.perModelConstantBuffer, gModelConstants);
+        gRenderContext->VSSetConstantBuffers(1, 1, &scene.perModelConstantBuffer);
+        gRenderContext->PSSetConstantBuffers(1, 1, &scene.perModelConstantBuffer);
+    });
+}
+
+// Render the visible objects from one camera the way Scene.cpp did before the render queue: each model binds what
+// it needs (shaders and texture, per-model constants) and is drawn, in the order of the objects
+void RenderPassDirect(BenchScene& scene, int camera, bool depthOnly)
+{
+    gFrameConstants.viewProjectionMatrix = scene.viewProjections[camera];
+    UpdateConstantBuffer(scene.perFrameConstantBuffer, gFrameConstants);
+    gRenderContext->VSSetConstantBuffers(0, 1, &scene.perFrameConstantBuffer);
+    gRenderContext->PSSetConstantBuffers(0, 1, &scene.perFrameConstantBuffer);
+
+    if (depthOnly)
+    {
+        gRenderContext->VSSetShader(scene.basicTransformVertexShader);
+        gRenderContext->PSSetShader(scene.depthOnlyPixelShader);
+    }
+    gRenderContext->OMSetBlendState(scene.noBlendingState);
+    gRenderContext->OMSetDepthStencilState(scene.useDepthBufferState, 0);
+    gRenderContext->RSSetState(scene.cullBackState);
+    if (!depthOnly)  gRenderContext->PSSetSamplers(0, 1, &scene.anisotropicSampler);
+
+    CFrustum frustum = FrustumFromMatrix(scene.viewProjections[camera]);
+    int numObjects = static_cast<int>(scene.worldBounds.size());
+    scene.visibleBits.resize((numObjects + 31) / 32);
+    TestSpheres(frustum, scene.worldBounds.data(), numObjects, scene.visibleBits.data());
+
+    for (int i = 0; i < numObjects; ++i)
+    {
+        if ((scene.visibleBits[i / 32] & (1u << (i % 32))) == 0)  continue;
+
+        if (!depthOnly)
+        {
+            const BenchMaterial& material = scene.materialList[scene.materials[i]];
+            gRenderContext->VSSetShader(material.vertexShader);
+            gRenderContext->PSSetShader(material.pixelShader);
+            gRenderContext->PSSetShaderResources(0, 1, &material.diffuseSpecularMap);
+        }
+
+        // As Model::Render
+        gModelConstants.worldMatrix = scene.worldMatrices[i];
+        UpdateConstantBuffer(scene.perModelConstantBuffer, gModelConstants);
+        gRenderContext->VSSetConstantBuffers(1, 1, &scene.perModelConstantBuffer);
+        gRenderContext->PSSetConstantBuffers(1, 1, &scene.perModelConstantBuffer);
+        scene.meshList[scene.meshes[i]].Render();
+    }
+}
+
+// As RenderScene: shadow maps from both lights then the main scene
+void RenderFrame(BenchScene& scene, bool useQueue)
+{
+    auto RenderPass = useQueue ? RenderPassQueued : RenderPassDirect;
+    if (useQueue)  scene.modelConstantsUpload->Begin(static_cast<unsigned int>(scene.worldBounds.size())); // As RenderScene
+
+    RenderViewport vp;
+    vp.width  = static_cast<float>(ShadowMapSize);
+    vp.height = static_cast<float>(ShadowMapSize);
+    gRenderContext->RSSetViewport(vp);
+    for (int light = 0; light < 2; ++light)
+    {
+        gRenderContext->OMSetRenderTargets(0, nullptr, scene.shadowMapDepthStencils[light]);
+        gRenderContext->ClearDepthStencilView(scene.shadowMapDepthStencils[light], 1.0f);
+        RenderPass(scene, light, true);
+    }
+
+    const float backgroundColour[4] = { 0.3f, 0.3f, 0.4f, 1.0f };
+    gRenderContext->OMSetRenderTargets(1, &scene.backBuffer, scene.depthStencil);
+    gRenderContext->ClearRenderTargetView(scene.backBuffer, backgroundColour);
+    gRenderContext->ClearDepthStencilView(scene.depthStencil, 1.0f);
+    vp.width  = 1920;
+    vp.height = 1080;
+    gRenderContext->RSSetViewport(vp);
+    gRenderContext->PSSetShaderResources(1, 1, &scene.shadowMapSRVs[0]);
+    gRenderContext->PSSetShaderResources(2, 1, &scene.shadowMapSRVs[1]);
+    gRenderContext->PSSetSamplers(1, 1, &scene.trilinearSampler);
+    RenderPass(scene, 2, false);
+
+    ID3D11ShaderResourceView* nullView = nullptr;
+    gRenderContext->PSSetShaderResources(1, 1, &nullView);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Benchmark
+-----------------------------------------------------------------------------------------*/
+
+double gMinSeconds = 0.5;
+int    gNumObjects = 20000;
+
+struct FrameResult
+{
+    double    msPerFrame;
+    double    nsPerObject;   // Per object drawn, however many draw calls that takes
+    long long drawsPerFrame; // Instanced or not
+    long long indicesPerFrame;
+    long long callsPerFrame[static_cast<int>(RenderCall::NumCalls)];
+    long long totalCallsPerFrame;
+    long long filteredCallsPerFrame; // Dropped by the state cache, so not included above
+    long long constantBytesPerFrame;
+    int       numErrors;
+};
+FrameResult gQueueResult;
+FrameResult gDirectResult;
+long long   gObjectsPerFrame; // Drawn in all passes
+int         gVisiblePerPass[3]; // Inside the frustum of each pass (two shadow maps then the main camera)
+double      gMsCulling;       // Part of the frame spent culling
+
+
+// Time a function, repeating it for at least the minimum time and returning the average seconds per call
+template <class Function>
+double Time(Function function)
+{
+    using Clock = std::chrono::steady_clock;
+    function(); // Warm up
+    long long repeats = 0;
+    auto start = Clock::now();
+    double seconds = 0;
+    do
+    {
+        function();
+        ++repeats;
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (seconds < gMinSeconds);
+    return seconds / repeats;
+}
+
+
+// Count and check the calls of a single frame, then time frames
+void MeasureFrames(HeadlessRenderDevice& device, RenderStateCache& cache, BenchScene& scene, bool useQueue, FrameResult& result)
+{
+    device.ResetResults();
+    cache.ResetCounts();
+    RenderFrame(scene, useQueue);
+    result.filteredCallsPerFrame = cache.NumFiltered();
+    for (int call = 0; call < static_cast<int>(RenderCall::NumCalls); ++call)
+    {
+        result.callsPerFrame[call] = device.NumCalls(static_cast<RenderCall>(call));
+    }
+    result.totalCallsPerFrame    = device.NumCalls();
+    result.constantBytesPerFrame = device.NumConstantBytes();
+    result.numErrors             = device.NumErrors();
+    for (const std::string& message : device.ErrorMessages())  std::fprintf(stderr, "Render error: %s\n", message.c_str());
+    Check(device.NumErrors() == 0, useQueue ? "Benchmark scene renders without errors (queue)" : "Benchmark scene renders without errors (direct)");
+    result.drawsPerFrame   = device.NumCalls(RenderCall::DrawIndexed) + device.NumCalls(RenderCall::DrawIndexedInstanced);
+    result.indicesPerFrame = device.NumIndicesDrawn();
+
+    double seconds = Time([&] { RenderFrame(scene, useQueue); });
+    result.msPerFrame = seconds * 1000;
+}
+
+
+void RunBenchmark()
+{
+    HeadlessRenderDevice device;
+    RenderStateCache     cache(device.ImmediateContext());
+    gRenderDevice  = &device;
+    gRenderContext = &cache;
+
+    BenchScene scene;
+    CreateScene(scene, device, gNumObjects);
+
+    MeasureFrames(device, cache, scene, true,  gQueueResult);
+    MeasureFrames(device, cache, scene, false, gDirectResult);
+    Check(gQueueResult.indicesPerFrame == gDirectResult.indicesPerFrame, "Queue and direct rendering draw the same objects");
+
+    // Rendering direct draws each object separately
+    gObjectsPerFrame = gDirectResult.drawsPerFrame;
+    for (FrameResult* result : { &gQueueResult, &gDirectResult })
+    {
+        result->nsPerObject = gObjectsPerFrame > 0 ? result->msPerFrame * 1e6 / gObjectsPerFrame : 0;
+    }
+
+    double cullSeconds = Time([&]
+    {
+        for (int camera = 0; camera < 3; ++camera)
+        {
+            CFrustum frustum = FrustumFromMatrix(scene.viewProjections[camera]);
+            TestSpheres(frustum, scene.worldBounds.data(), gNumObjects, scene.visibleBits.data());
+        }
+    });
+    gMsCulling = cullSeconds * 1000;
+    for (int camera = 0; camera < 3; ++camera)
+    {
+        CFrustum frustum = FrustumFromMatrix(scene.viewProjections[camera]);
+        TestSpheres(frustum, scene.worldBounds.data(), gNumObjects, scene.visibleBits.data());
+        gVisiblePerPass[camera] = 0;
+        for (int i = 0; i < gNumObjects; ++i)  gVisiblePerPass[camera] += (scene.visibleBits[i / 32] >> (i % 32)) & 1;
+    }
+
+    std::fprintf(stderr, "%d objects, %lld drawn per frame (3 passes: %d + %d shadow, %d main)\n", gNumObjects, gObjectsPerFrame,
+                 gVisiblePerPass[0], gVisiblePerPass[1], gVisiblePerPass[2]);
+    std::fprintf(stderr, "%-24s %12s %12s\n", "", "queue", "direct");
+    std::fprintf(stderr, "%-24s %12.3f %12.3f\n%-24s %12.1f %12.1f\n", "ms/frame", gQueueResult.msPerFrame, gDirectResult.msPerFrame,
+                 "ns/object", gQueueResult.nsPerObject, gDirectResult.nsPerObject);
+    std::fprintf(stderr, "%-24s %12lld %12lld\n", "Draws", gQueueResult.drawsPerFrame, gDirectResult.drawsPerFrame);
+    std::fprintf(stderr, "%-24s %12.3f\n", "ms culling", gMsCulling);
+    for (int call = 0; call < static_cast<int>(RenderCall::NumCalls); ++call)
+    {
+        std::fprintf(stderr, "%-24s %12lld %12lld\n", RenderCallName(static_cast<RenderCall>(call)),
+                     gQueueResult.callsPerFrame[call], gDirectResult.callsPerFrame[call]);
+    }
+    std::fprintf(stderr, "%-24s %12lld %12lld\n", "All calls", gQueueResult.totalCallsPerFrame, gDirectResult.totalCallsPerFrame);
+    std::fprintf(stderr, "%-24s %12lld %12lld\n", "Filtered by cache", gQueueResult.filteredCallsPerFrame, gDirectResult.filteredCallsPerFrame);
+    std::fprintf(stderr, "%-24s %12lld %12lld\n", "Constant bytes", gQueueResult.constantBytesPerFrame, gDirectResult.constantBytesPerFrame);
+
+    scene.modelConstantsUpload.reset(); // Releases buffers through gRenderDevice
+    gRenderDevice  = nullptr;
+    gRenderContext = nullptr;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Output
+-----------------------------------------------------------------------------------------*/
+
+// Write the fields of a result, each line starting with the given indent
+void WriteResultJSON(FILE* file, const FrameResult& result, const char* indent)
+{
+    std::fprintf(file, "%s\"ms_per_frame\": %.4f,\n%s\"ns_per_object\": %.1f,\n%s\"draws_per_frame\": %lld,\n%s\"render_errors\": %d,\n"
+                       "%s\"constant_bytes_per_frame\": %lld,\n%s\"calls_per_frame\": %lld,\n%s\"filtered_calls_per_frame\": %lld,\n"
+                       "%s\"calls\": {\n",
+                 indent, result.msPerFrame, indent, result.nsPerObject, indent, result.drawsPerFrame, indent, result.numErrors,
+                 indent, result.constantBytesPerFrame, indent, result.totalCallsPerFrame, indent, result.filteredCallsPerFrame, indent);
+    const int numCalls = static_cast<int>(RenderCall::NumCalls);
+    for (int call = 0; call < numCalls; ++call)
+    {
+        std::fprintf(file, "%s  \"%s\": %lld%s\n", indent, RenderCallName(static_cast<RenderCall>(call)), result.callsPerFrame[call],
+                     call + 1 < numCalls ? "," : "");
+    }
+    std::fprintf(file, "%s}", indent);
+}
+
+void WriteJSON(FILE* file)
+{
+    std::fprintf(file, "{\n  \"check_failures\": %d,\n  \"objects\": %d,\n  \"objects_drawn_per_frame\": %lld,\n  \"ms_culling\": %.4f,\n",
+                 gNumFailures, gNumObjects, gObjectsPerFrame, gMsCulling);
+    std::fprintf(file, "  \"visible_per_pass\": [%d, %d, %d],\n", gVisiblePerPass[0], gVisiblePerPass[1], gVisiblePerPass[2]);
+    WriteResultJSON(file, gQueueResult, "  ");
+    std::fprintf(file, ",\n  \"direct\": {\n");
+    WriteResultJSON(file, gDirectResult, "    ");
+    std::fprintf(file, "\n  }\n}\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    const char* outFile = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0)
+        {
+            gMinSeconds = 0.05;
+        }
+        else if (std::strcmp(argv[i], "--objects") == 0 && i + 1 < argc)
+        {
+            gNumObjects = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            outFile = argv[++i];
+        }
+        else
+        {
+            std::fprintf(stderr, "Usage: %s [--quick] [--objects N] [--out results.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    RunChecks();
+    std::fprintf(stderr, gNumFailures == 0 ? "All checks passed\n" : "%d checks FAILED\n", gNumFailures);
+
+    RunBenchmark();
+
+    FILE* file = outFile ? std::fopen(outFile, "w") : stdout;
+    if (file == nullptr)
+    {
+        std::fprintf(stderr, "Could not open %s\n", outFile);
+        return 1;
+    }
+    WriteJSON(file);
+    if (outFile)  std::fclose(file);
+    return gNumFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,656 @@
+//--------------------------------------------------------------------------------------
+// Checks and benchmark for the spatial structures used to find objects by position
+//--------------------------------------------------------------------------------------
+// Standalone program, not part of the Visual Studio project (it has its own main). Only needs the spatial structures
+// and the maths code, so builds on any platform, e.g. on Linux from this folder:
+//     g++ -O2 -std=c++17 -I.. -I../Math SpatialBenchmark.cpp ../BoundingVolumeHierarchy.cpp ../SpatialGrid.cpp ../Math/CFrustum.cpp -o SpatialBenchmark
+//
+// Usage: SpatialBenchmark [--quick] [--out results.json]
+// First checks that bounding volume hierarchy (see BoundingVolumeHierarchy.h) and spatial grid (SpatialGrid.h)
+// queries find exactly the objects that testing every object finds, for frustum, sphere, box and ray queries. The
+// hierarchy is checked before and after objects move or are removed, and moving objects a long way must trigger a
+// rebuild. The grid is checked as objects are inserted, moved within and between cells and removed. Querying both
+// into one list must find each object once when moving objects are handed from the hierarchy to the grid. Any failure
+// is reported and the program returns 1.
+//
+// Then compares the time of each kind of query using the hierarchy with testing every object ("brute force", with
+// the batched SIMD frustum test from CFrustum.h), for scenes of 1k, 10k, 100k and 1M objects. Objects are scattered
+// over a ground area that grows with their number, so the camera and queries see a similar number whatever the size,
+// as when a world gets bigger rather than more crowded. Also times building the hierarchy and refitting it after 1%
+// of the objects move.
+// Finally a crowd of 10k objects moves through a static scene of 100k, with 10 to 10k of the crowd moving each frame.
+// Compares the time to keep the grid up to date with refitting a hierarchy holding everything, and the time of a
+// frustum query of the static hierarchy plus the grid with brute force.
+// Results are written as JSON (to stdout, or the file given with --out), a readable table to stderr.
+
+#include "BoundingVolumeHierarchy.h"
+#include "SpatialGrid.h"
+#include "CFrustum.h"
+#include "CMatrix4x4.h"
+#include "MathHelpers.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+
+/*-----------------------------------------------------------------------------------------
+    Test scenes
+-----------------------------------------------------------------------------------------*/
+
+// Objects of various sizes scattered over a square of ground, about one per 100 square units
+struct Scene
+{
+    float size;
+    std::vector<BoundingBox> bounds;
+};
+
+Scene MakeScene(int numObjects, unsigned int seed)
+{
+    Scene scene;
+    scene.size = std::sqrt(static_cast<float>(numObjects)) * 10;
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> position(-scene.size / 2, scene.size / 2);
+    std::uniform_real_distribution<float> height(0, 20);
+    std::uniform_real_distribution<float> extent(0.5f, 5);
+    scene.bounds.resize(numObjects);
+    for (BoundingBox& box : scene.bounds)
+    {
+        box = { { position(random), height(random), position(random) }, { extent(random), extent(random), extent(random) } };
+    }
+    return scene;
+}
+
+// Camera standing at the middle of one edge of the scene, looking into it with a far clip of 500
+CFrustum SceneFrustum(const Scene& scene, float turn = 0)
+{
+    CMatrix4x4 cameraWorld = MatrixRotationX(ToRadians(10)) * MatrixRotationY(turn) * MatrixTranslation({ 0, 30, -scene.size / 2 });
+    return FrustumFromMatrix(InverseAffine(cameraWorld) * MatrixPerspective(ToRadians(60), 16.0f / 9.0f, 0.1f, 500));
+}
+
+
+// Brute force versions of each query, testing every object
+void BruteForceFrustum(const std::vector<BoundingBox>& bounds, const CFrustum& frustum, std::vector<uint32_t>& bits,
+                       std::vector<int>& results)
+{
+    const int numObjects = static_cast<int>(bounds.size());
+    bits.resize((numObjects + 31) / 32);
+    TestBoxes(frustum, bounds.data(), numObjects, bits.data());
+    for (int word = 0; word < static_cast<int>(bits.size()); ++word)
+    {
+        for (uint32_t visible = bits[word]; visible; visible &= visible - 1)
+        {
+            int bit = 0;
+            while (!(visible & (1u << bit)))  ++bit;
+            results.push_back(word * 32 + bit);
+        }
+    }
+}
+
+void BruteForceSphere(const std::vector<BoundingBox>& bounds, const BoundingSphere& sphere, std::vector<int>& results)
+{
+    for (int i = 0; i < static_cast<int>(bounds.size()); ++i)
+    {
+        if (SphereOverlapsBox(sphere, bounds[i]))  results.push_back(i);
+    }
+}
+
+void BruteForceBox(const std::vector<BoundingBox>& bounds, const BoundingBox& box, std::vector<int>& results)
+{
+    for (int i = 0; i < static_cast<int>(bounds.size()); ++i)
+    {
+        if (BoxesOverlap(box, bounds[i]))  results.push_back(i);
+    }
+}
+
+void BruteForceRay(const std::vector<BoundingBox>& bounds, const Ray& ray, float maxDistance, std::vector<int>& results)
+{
+    for (int i = 0; i < static_cast<int>(bounds.size()); ++i)
+    {
+        if (RayHitsBox(ray, bounds[i], maxDistance))  results.push_back(i);
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Checks
+-----------------------------------------------------------------------------------------*/
+
+int gNumFailures = 0;
+
+void Check(bool passed, const char* description)
+{
+    if (!passed)
+    {
+        std::fprintf(stderr, "FAILED: %s\n", description);
+        ++gNumFailures;
+    }
+}
+
+// True if the two lists hold the same objects, in any order
+bool SameObjects(std::vector<int> a, std::vector<int> b)
+{
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    return a == b;
+}
+
+
+// Run a variety of each kind of query on a spatial structure and by brute force, checking they find the same objects.
+// Objects the structure shouldn't find (e.g. removed from it) can be given bounds far outside the scene
+template <class Structure>
+void CheckQueries(const Structure& structure, const char* name, const std::vector<BoundingBox>& bounds, float sceneSize,
+                  std::mt19937& random, const char* when)
+{
+    std::uniform_real_distribution<float> position(-sceneSize / 2, sceneSize / 2);
+    std::uniform_real_distribution<float> unit(-1, 1);
+    std::uniform_real_distribution<float> size(0, 60);
+    bool frustumsMatch = true, spheresMatch = true, boxesMatch = true, raysMatch = true, anyFound = false;
+    std::vector<uint32_t> bits;
+    for (int test = 0; test < 20; ++test)
+    {
+        std::vector<int> expected, found;
+        BruteForceFrustum(bounds, SceneFrustum({ sceneSize, {} }, test * 0.3f), bits, expected);
+        structure.QueryFrustum(SceneFrustum({ sceneSize, {} }, test * 0.3f), found);
+        frustumsMatch = frustumsMatch && SameObjects(expected, found);
+        anyFound = anyFound || !expected.empty();
+
+        BoundingSphere sphere = { { position(random), 10, position(random) }, size(random) };
+        expected.clear();  found.clear();
+        BruteForceSphere(bounds, sphere, expected);
+        structure.QuerySphere(sphere, found);
+        spheresMatch = spheresMatch && SameObjects(expected, found);
+
+        BoundingBox box = { { position(random), 10, position(random) }, { size(random), size(random), size(random) } };
+        expected.clear();  found.clear();
+        BruteForceBox(bounds, box, expected);
+        structure.QueryBox(box, found);
+        boxesMatch = boxesMatch && SameObjects(expected, found);
+
+        // Some rays along an axis, to exercise the zero direction components
+        Ray ray = { { position(random), 10, position(random) }, { unit(random), unit(random) * 0.1f, unit(random) } };
+        if (test % 4 == 0)  ray.direction = { 0, 0, 1 };
+        if (test % 4 == 1)  ray.direction = { -1, 0, 0 };
+        expected.clear();  found.clear();
+        BruteForceRay(bounds, ray, sceneSize / 2, expected);
+        structure.QueryRay(ray, sceneSize / 2, found);
+        raysMatch = raysMatch && SameObjects(expected, found);
+    }
+
+    char description[100];
+    std::snprintf(description, sizeof(description), "%s frustum query finds the same objects as brute force (%s)", name, when);
+    Check(frustumsMatch && anyFound, description);
+    std::snprintf(description, sizeof(description), "%s sphere query finds the same objects as brute force (%s)", name, when);
+    Check(spheresMatch, description);
+    std::snprintf(description, sizeof(description), "%s box query finds the same objects as brute force (%s)", name, when);
+    Check(boxesMatch, description);
+    std::snprintf(description, sizeof(description), "%s ray query finds the same objects as brute force (%s)", name, when);
+    Check(raysMatch, description);
+}
+
+
+void RunChecks()
+{
+    // Empty and tiny hierarchies
+    {
+        BoundingVolumeHierarchy bvh;
+        bvh.Build(nullptr, 0);
+        std::vector<int> found;
+        bvh.QueryBox({ { 0, 0, 0 }, { 1000, 1000, 1000 } }, found);
+        Check(found.empty() && bvh.NumNodes() == 0 && !bvh.Update(), "Empty BVH finds nothing");
+
+        BoundingBox one = { { 1, 2, 3 }, { 1, 1, 1 } };
+        bvh.Build(&one, 1);
+        bvh.QuerySphere({ { 1, 2, 5 }, 1.5f }, found);
+        bvh.QueryRay({ { 1, 2, 5 }, { 0, 0, 1 } }, 100, found);
+        Check(found.size() == 1 && found[0] == 0 && bvh.NumNodes() == 1, "BVH of one object");
+    }
+
+    // Many objects in exactly the same place can't be split by position, but still give small leaves
+    {
+        std::vector<BoundingBox> same(100, BoundingBox{ { 5, 5, 5 }, { 1, 1, 1 } });
+        BoundingVolumeHierarchy bvh;
+        bvh.Build(same.data(), static_cast<int>(same.size()));
+        std::vector<int> found;
+        bvh.QueryBox({ { 6, 6, 6 }, { 0.5f, 0.5f, 0.5f } }, found);
+        Check(found.size() == 100 && bvh.NumNodes() > 25, "BVH of objects in the same place");
+    }
+
+    // Queries match brute force on a scene, then after moving some objects a little and refitting
+    std::mt19937 random(1);
+    Scene scene = MakeScene(5000, 2);
+    BoundingVolumeHierarchy bvh;
+    bvh.Build(scene.bounds.data(), static_cast<int>(scene.bounds.size()));
+    Check(bvh.Cost() == bvh.BuildCost() && bvh.Cost() > 0 && !bvh.NeedsRebuild(), "BVH cost after build");
+    CheckQueries(bvh, "BVH", scene.bounds, scene.size, random, "built");
+
+    std::uniform_real_distribution<float> nudge(-3, 3);
+    for (int i = 0; i < static_cast<int>(scene.bounds.size()); i += 7)
+    {
+        scene.bounds[i].centre += CVector3{ nudge(random), nudge(random), nudge(random) };
+        bvh.SetBounds(i, scene.bounds[i]);
+    }
+    bool rebuilt = bvh.Update();
+    Check(!rebuilt && bvh.Cost() >= bvh.BuildCost() * 0.9f, "Small moves refit the BVH without rebuilding");
+    Check(Length(bvh.Bounds(7).centre - scene.bounds[7].centre) < 1e-4f && Length(bvh.Bounds(8).centre - scene.bounds[8].centre) < 1e-4f,
+          "BVH holds the new bounds of moved objects");
+    CheckQueries(bvh, "BVH", scene.bounds, scene.size, random, "refit");
+
+    // Scattering objects across the scene stretches the nodes until a rebuild is needed
+    std::uniform_real_distribution<float> position(-scene.size / 2, scene.size / 2);
+    for (int i = 0; i < static_cast<int>(scene.bounds.size()); i += 2)
+    {
+        scene.bounds[i].centre = { position(random), 10, position(random) };
+        bvh.SetBounds(i, scene.bounds[i]);
+    }
+    bvh.Refit();
+    Check(bvh.NeedsRebuild(), "Scattered objects make the BVH need a rebuild");
+    rebuilt = bvh.Update();
+    Check(rebuilt && !bvh.NeedsRebuild() && bvh.Cost() == bvh.BuildCost(), "Update rebuilds a poor BVH");
+    CheckQueries(bvh, "BVH", scene.bounds, scene.size, random, "rebuilt");
+
+    // Removed objects aren't found, and stay out of the tree when it is rebuilt until they are given bounds again
+    const CVector3 farAway = { 1e7f, 1e7f, 1e7f };
+    std::vector<BoundingBox> expected = scene.bounds;
+    for (int i = 0; i < static_cast<int>(scene.bounds.size()); i += 3)
+    {
+        bvh.Remove(i);
+        expected[i].centre = farAway;
+    }
+    bvh.Update();
+    Check(bvh.IsRemoved(3) && !bvh.IsRemoved(4) && bvh.Bounds(3).extents.x < 0, "BVH marks removed objects");
+    CheckQueries(bvh, "BVH", expected, scene.size, random, "removed");
+    std::vector<BoundingBox> current(scene.bounds.size());
+    for (int i = 0; i < static_cast<int>(current.size()); ++i)  current[i] = bvh.Bounds(i);
+    bvh.Build(current.data(), static_cast<int>(current.size()));
+    CheckQueries(bvh, "BVH", expected, scene.size, random, "rebuilt without removed");
+    bvh.SetBounds(3, scene.bounds[3]);
+    expected[3] = scene.bounds[3];
+    Check(bvh.NeedsRebuild() && bvh.Update() && !bvh.IsRemoved(3), "BVH rebuilds to add back an object removed before it was built");
+    CheckQueries(bvh, "BVH", expected, scene.size, random, "added back");
+
+
+    // Spatial grid: queries match brute force after inserting objects, moving them within and between cells, and
+    // removing them
+    {
+        SpatialGrid grid(20);
+        Scene crowd = MakeScene(3000, 5);
+        for (int i = 0; i < static_cast<int>(crowd.bounds.size()); ++i)  grid.Insert(i, crowd.bounds[i]);
+        Check(grid.NumObjects() == 3000 && grid.Contains(2999) && !grid.Contains(3000) && grid.NumOccupiedCells() > 100,
+              "Grid holds inserted objects");
+        CheckQueries(grid, "Grid", crowd.bounds, crowd.size, random, "inserted");
+
+        std::uniform_real_distribution<float> jump(-100, 100);
+        for (int i = 0; i < static_cast<int>(crowd.bounds.size()); ++i)
+        {
+            if (i % 5 == 0)  crowd.bounds[i].centre += CVector3{ jump(random), 0, jump(random) };
+            else             crowd.bounds[i].centre += CVector3{ nudge(random), nudge(random), nudge(random) };
+            grid.Move(i, crowd.bounds[i]);
+        }
+        Check(Length(grid.Bounds(5).centre - crowd.bounds[5].centre) < 1e-4f, "Grid holds the new bounds of moved objects");
+        CheckQueries(grid, "Grid", crowd.bounds, crowd.size, random, "moved");
+
+        for (int i = 0; i < static_cast<int>(crowd.bounds.size()); i += 4)
+        {
+            grid.Remove(i);
+            crowd.bounds[i].centre = farAway;
+        }
+        grid.Remove(0); // Already removed
+        Check(grid.NumObjects() == 2250 && !grid.Contains(4) && grid.Contains(5), "Grid removes objects");
+        CheckQueries(grid, "Grid", crowd.bounds, crowd.size, random, "removed");
+
+        // A small grid with one object per cell, removing objects frees their cells
+        SpatialGrid small(10);
+        for (int i = 0; i < 8; ++i)  small.Insert(i * 2, { { i * 10.0f + 5, 5, 5 }, { 1, 1, 1 } });
+        small.Insert(1, { { 15, 5, 5 }, { 1, 1, 1 } }); // Shares the cell of object 2
+        Check(small.NumOccupiedCells() == 8, "Grid only stores occupied cells");
+        small.Remove(1);
+        small.Remove(2);
+        small.Remove(4);
+        small.Move(6, { { 75, 5, 5 }, { 1, 1, 1 } }); // Into the cell of object 14
+        std::vector<int> found;
+        small.QueryBox({ { 40, 5, 5 }, { 40, 1, 1 } }, found);
+        Check(small.NumOccupiedCells() == 5 && SameObjects(found, { 0, 6, 8, 10, 12, 14 }), "Grid frees empty cells");
+        small.Clear();
+        found.clear();
+        small.QueryBox({ { 40, 5, 5 }, { 40, 1, 1 } }, found);
+        Check(small.NumObjects() == 0 && small.NumOccupiedCells() == 0 && found.empty(), "Grid clears");
+    }
+
+    // Hierarchy and grid together: objects handed from the hierarchy to the grid when they start moving are found
+    // exactly once when both are queried into the same list
+    {
+        struct Combined
+        {
+            const BoundingVolumeHierarchy& bvh;
+            const SpatialGrid&             grid;
+            void QueryFrustum(const CFrustum& f, std::vector<int>& r) const     { bvh.QueryFrustum(f, r);   grid.QueryFrustum(f, r); }
+            void QuerySphere(const BoundingSphere& s, std::vector<int>& r) const { bvh.QuerySphere(s, r);    grid.QuerySphere(s, r); }
+            void QueryBox(const BoundingBox& b, std::vector<int>& r) const       { bvh.QueryBox(b, r);       grid.QueryBox(b, r); }
+            void QueryRay(const Ray& ray, float d, std::vector<int>& r) const    { bvh.QueryRay(ray, d, r);  grid.QueryRay(ray, d, r); }
+        };
+        Scene mixed = MakeScene(5000, 6);
+        BoundingVolumeHierarchy staticObjects;
+        SpatialGrid             movingObjects(20);
+        staticObjects.Build(mixed.bounds.data(), static_cast<int>(mixed.bounds.size()));
+        for (int frame = 0; frame < 3; ++frame)
+        {
+            for (int i = frame; i < static_cast<int>(mixed.bounds.size()); i += 10)
+            {
+                mixed.bounds[i].centre += CVector3{ nudge(random), 0, nudge(random) };
+                if (!staticObjects.IsRemoved(i))  staticObjects.Remove(i);
+                movingObjects.Insert(i, mixed.bounds[i]);
+            }
+            staticObjects.Update();
+        }
+        Check(movingObjects.NumObjects() == 1500, "Moving objects handed to the grid");
+        CheckQueries(Combined{ staticObjects, movingObjects }, "BVH + grid", mixed.bounds, mixed.size, random, "merged");
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Benchmarks
+-----------------------------------------------------------------------------------------*/
+
+double gMinSeconds = 0.2;
+
+struct QueryTimes
+{
+    double bvhUs;
+    double bruteForceUs;
+    double averageFound;
+};
+
+struct SizeResult
+{
+    int        numObjects;
+    int        numNodes;
+    double     buildMs;
+    double     refitMs;     // After 1% of objects move
+    QueryTimes frustum;
+    QueryTimes sphere;
+    QueryTimes box;
+    QueryTimes ray;
+};
+
+std::vector<SizeResult> gResults;
+
+// A static scene in a hierarchy plus a crowd of moving objects, some of which move each frame
+struct MovingResult
+{
+    int    numStatic;
+    int    numMoving;
+    int    numMovedPerFrame;
+    double gridUpdateUs;    // Moving the objects that moved in the grid
+    double bvhUpdateUs;     // Alternative: everything in one hierarchy, refit (or rebuilt) each frame
+    double bvhRebuildsPerFrame;
+    double mergedFrustumUs; // Querying the static hierarchy and the grid
+    double bruteForceFrustumUs;
+};
+
+std::vector<MovingResult> gMovingResults;
+
+
+// Time a function, repeating it for at least the minimum time and returning the average seconds per call
+template <class Function>
+double Time(Function function)
+{
+    using Clock = std::chrono::steady_clock;
+    function(); // Warm up
+    long long repeats = 0;
+    auto start = Clock::now();
+    double seconds = 0;
+    do
+    {
+        function();
+        ++repeats;
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (seconds < gMinSeconds);
+    return seconds / repeats;
+}
+
+
+// Time a kind of query over a fixed set of query shapes, using the hierarchy and brute force
+template <class Shape, class BVHQuery, class BruteForceQuery>
+QueryTimes TimeQueries(const std::vector<Shape>& shapes, BVHQuery bvhQuery, BruteForceQuery bruteForceQuery)
+{
+    std::vector<int> results;
+    size_t numFound = 0;
+    double bvhSeconds = Time([&]
+    {
+        numFound = 0;
+        for (const Shape& shape : shapes)
+        {
+            results.clear();
+            bvhQuery(shape, results);
+            numFound += results.size();
+        }
+    });
+    double bruteForceSeconds = Time([&]
+    {
+        for (const Shape& shape : shapes)
+        {
+            results.clear();
+            bruteForceQuery(shape, results);
+        }
+    });
+    double numShapes = static_cast<double>(shapes.size());
+    return { bvhSeconds * 1e6 / numShapes, bruteForceSeconds * 1e6 / numShapes, numFound / numShapes };
+}
+
+
+void RunBenchmarks()
+{
+    std::fprintf(stderr, "\n%-9s %8s %9s %8s | %-27s | %-27s | %-27s | %-27s\n", "Objects", "Nodes", "Build ms", "Refit ms",
+                 "Frustum us (BVH/brute/found)", "Sphere us", "Box us", "Ray us");
+    for (int numObjects : { 1000, 10000, 100000, 1000000 })
+    {
+        Scene scene = MakeScene(numObjects, 3);
+        SizeResult result = {};
+        result.numObjects = numObjects;
+
+        BoundingVolumeHierarchy bvh;
+        result.buildMs = Time([&] { bvh.Build(scene.bounds.data(), numObjects); }) * 1000;
+        result.numNodes = bvh.NumNodes();
+
+        // Move 1% of the objects a little, and refit. Moving back and forth so the tree doesn't drift
+        std::vector<int> moved;
+        for (int i = 0; i < numObjects; i += 100)  moved.push_back(i);
+        float offset = 1;
+        result.refitMs = Time([&]
+        {
+            for (int i : moved)
+            {
+                BoundingBox box = scene.bounds[i];
+                box.centre.x += offset;
+                bvh.SetBounds(i, box);
+            }
+            offset = -offset;
+            bvh.Update();
+        }) * 1000;
+        bvh.Build(scene.bounds.data(), numObjects);
+
+        // Query shapes: camera frustums turned to different angles, and spheres, boxes and rays at random positions
+        std::mt19937 random(4);
+        std::uniform_real_distribution<float> position(-scene.size / 2, scene.size / 2);
+        std::uniform_real_distribution<float> unit(-1, 1);
+        std::vector<CFrustum>       frustums;
+        std::vector<BoundingSphere> spheres;
+        std::vector<BoundingBox>    boxes;
+        std::vector<Ray>            rays;
+        for (int i = 0; i < 8; ++i)  frustums.push_back(SceneFrustum(scene, (i - 4) * 0.1f));
+        for (int i = 0; i < 64; ++i)
+        {
+            spheres.push_back({ { position(random), 10, position(random) }, 30 });
+            boxes.push_back({ { position(random), 10, position(random) }, { 30, 10, 30 } });
+            rays.push_back({ { position(random), 10, position(random) }, Normalise(CVector3{ unit(random), 0, unit(random) }) });
+        }
+
+        std::vector<uint32_t> bits;
+        result.frustum = TimeQueries(frustums, [&](const CFrustum& f, std::vector<int>& r) { bvh.QueryFrustum(f, r); },
+                                               [&](const CFrustum& f, std::vector<int>& r) { BruteForceFrustum(scene.bounds, f, bits, r); });
+        result.sphere  = TimeQueries(spheres, [&](const BoundingSphere& s, std::vector<int>& r) { bvh.QuerySphere(s, r); },
+                                              [&](const BoundingSphere& s, std::vector<int>& r) { BruteForceSphere(scene.bounds, s, r); });
+        result.box     = TimeQueries(boxes, [&](const BoundingBox& b, std::vector<int>& r) { bvh.QueryBox(b, r); },
+                                            [&](const BoundingBox& b, std::vector<int>& r) { BruteForceBox(scene.bounds, b, r); });
+        result.ray     = TimeQueries(rays, [&](const Ray& ray, std::vector<int>& r) { bvh.QueryRay(ray, 200, r); },
+                                           [&](const Ray& ray, std::vector<int>& r) { BruteForceRay(scene.bounds, ray, 200, r); });
+        gResults.push_back(result);
+
+        auto print = [](const QueryTimes& q) { std::fprintf(stderr, " | %8.1f %9.1f %8.1f", q.bvhUs, q.bruteForceUs, q.averageFound); };
+        std::fprintf(stderr, "%-9d %8d %9.2f %8.3f", numObjects, result.numNodes, result.buildMs, result.refitMs);
+        print(result.frustum);
+        print(result.sphere);
+        print(result.box);
+        print(result.ray);
+        std::fprintf(stderr, "\n");
+    }
+
+    // Moving crowd: 100k static objects and 10k moving ones, each frame moving some of the crowd a small step. The
+    // grid only does work for the objects that moved, the alternative of keeping everything in one hierarchy has to
+    // refit the whole tree, and rebuild it when the crowd has wandered far enough
+    std::fprintf(stderr, "\n%-9s %9s %14s %14s %14s %16s %16s\n", "Static", "Moving", "Moved/frame", "Grid us",
+                 "BVH us", "BVH rebuilds", "Frustum us (BVH+grid/brute)");
+    const int NumStatic = 100000, NumMoving = 10000;
+    for (int numMovedPerFrame : { 10, 100, 1000, 10000 })
+    {
+        Scene scene = MakeScene(NumStatic + NumMoving, 7);
+        MovingResult result = {};
+        result.numStatic        = NumStatic;
+        result.numMoving        = NumMoving;
+        result.numMovedPerFrame = numMovedPerFrame;
+
+        BoundingVolumeHierarchy staticObjects;
+        staticObjects.Build(scene.bounds.data(), NumStatic);
+        SpatialGrid movingObjects(20);
+        for (int i = NumStatic; i < NumStatic + NumMoving; ++i)  movingObjects.Insert(i, scene.bounds[i]);
+        BoundingVolumeHierarchy everything;
+        everything.Build(scene.bounds.data(), NumStatic + NumMoving);
+
+        // Each frame the next few of the crowd take a step in a random direction
+        std::mt19937 random(8);
+        std::uniform_real_distribution<float> step(-1, 1);
+        auto moveCrowd = [&](int& next, auto moved)
+        {
+            for (int m = 0; m < numMovedPerFrame; ++m)
+            {
+                int i = NumStatic + next;
+                next = (next + 1) % NumMoving;
+                scene.bounds[i].centre += CVector3{ step(random), 0, step(random) };
+                moved(i);
+            }
+        };
+        int nextInGrid = 0, nextInBVH = 0;
+        result.gridUpdateUs = Time([&] { moveCrowd(nextInGrid, [&](int i) { movingObjects.Move(i, scene.bounds[i]); }); }) * 1e6;
+        int numFrames = 0, numRebuilds = 0;
+        result.bvhUpdateUs = Time([&]
+        {
+            moveCrowd(nextInBVH, [&](int i) { everything.SetBounds(i, scene.bounds[i]); });
+            if (everything.Update())  ++numRebuilds;
+            ++numFrames;
+        }) * 1e6;
+        result.bvhRebuildsPerFrame = static_cast<double>(numRebuilds) / numFrames;
+
+        // The crowd is where the grid has it (the BVH above moved it further), bring the grid up to date for the query
+        for (int i = NumStatic; i < NumStatic + NumMoving; ++i)  movingObjects.Move(i, scene.bounds[i]);
+        std::vector<int> results;
+        std::vector<uint32_t> bits;
+        CFrustum frustum = SceneFrustum(scene);
+        result.mergedFrustumUs = Time([&]
+        {
+            results.clear();
+            staticObjects.QueryFrustum(frustum, results);
+            movingObjects.QueryFrustum(frustum, results);
+        }) * 1e6;
+        result.bruteForceFrustumUs = Time([&]
+        {
+            results.clear();
+            BruteForceFrustum(scene.bounds, frustum, bits, results);
+        }) * 1e6;
+        gMovingResults.push_back(result);
+
+        std::fprintf(stderr, "%-9d %9d %14d %14.1f %14.1f %16.3f %13.1f %13.1f\n", NumStatic, NumMoving, numMovedPerFrame,
+                     result.gridUpdateUs, result.bvhUpdateUs, result.bvhRebuildsPerFrame, result.mergedFrustumUs,
+                     result.bruteForceFrustumUs);
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Output
+-----------------------------------------------------------------------------------------*/
+
+void WriteQuery(FILE* file, const char* name, const QueryTimes& q, bool last)
+{
+    std::fprintf(file, "\"%s\": { \"bvh_us\": %.2f, \"brute_force_us\": %.2f, \"speedup\": %.2f, \"average_found\": %.1f }%s",
+                 name, q.bvhUs, q.bruteForceUs, q.bruteForceUs / q.bvhUs, q.averageFound, last ? "" : ", ");
+}
+
+void WriteJSON(FILE* file)
+{
+    std::fprintf(file, "{\n  \"check_failures\": %d,\n  \"sizes\": [\n", gNumFailures);
+    for (size_t i = 0; i < gResults.size(); ++i)
+    {
+        const SizeResult& r = gResults[i];
+        std::fprintf(file, "    { \"objects\": %d, \"nodes\": %d, \"build_ms\": %.3f, \"refit_ms\": %.4f, ",
+                     r.numObjects, r.numNodes, r.buildMs, r.refitMs);
+        WriteQuery(file, "frustum", r.frustum, false);
+        WriteQuery(file, "sphere", r.sphere, false);
+        WriteQuery(file, "box", r.box, false);
+        WriteQuery(file, "ray", r.ray, true);
+        std::fprintf(file, " }%s\n", i + 1 < gResults.size() ? "," : "");
+    }
+    std::fprintf(file, "  ],\n  \"moving\": [\n");
+    for (size_t i = 0; i < gMovingResults.size(); ++i)
+    {
+        const MovingResult& r = gMovingResults[i];
+        std::fprintf(file, "    { \"static\": %d, \"moving\": %d, \"moved_per_frame\": %d, \"grid_update_us\": %.2f, "
+                           "\"bvh_update_us\": %.2f, \"bvh_rebuilds_per_frame\": %.4f, \"merged_frustum_us\": %.2f, "
+                           "\"brute_force_frustum_us\": %.2f }%s\n",
+                     r.numStatic, r.numMoving, r.numMovedPerFrame, r.gridUpdateUs, r.bvhUpdateUs, r.bvhRebuildsPerFrame,
+                     r.mergedFrustumUs, r.bruteForceFrustumUs, i + 1 < gMovingResults.size() ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    const char* outFile = nullptr;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0)
+        {
+            gMinSeconds = 0.02;
+        }
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            outFile = argv[++i];
+        }
+        else
+        {
+            std::fprintf(stderr, "Usage: %s [--quick] [--out results.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    RunChecks();
+    std::fprintf(stderr, gNumFailures == 0 ? "All checks passed\n" : "%d checks FAILED\n", gNumFailures);
+
+    RunBenchmarks();
+
+    FILE* file = outFile ? std::fopen(outFile, "w") : stdout;
+    if (file == nullptr)
+    {
+        std::fprintf(stderr, "Could not open %s\n", outFile);
+        return 1;
+    }
+    WriteJSON(file);
+    if (outFile)  std::fclose(file);
+    return gNumFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,472 @@
+//--------------------------------------------------------------------------------------
+// Bounding volume hierarchy - finds the objects in a region of space without testing every one
+//--------------------------------------------------------------------------------------
+// Binned SAH build, refit and stackless queries, see header for details
+
+#include "BoundingVolumeHierarchy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+
+// Relative costs of testing a node's box and an object's bounds, for the SAH
+static const float NODE_COST   = 1.0f;
+static const float OBJECT_COST = 1.0f;
+
+// Leaves hold at most this many objects, fewer if splitting them further is cheaper
+static const uint32_t MAX_LEAF_OBJECTS = 4;
+
+// Number of slices each axis is divided into when looking for the best split. Trying every possible split gives
+// little better trees for a lot more work
+static const int NUM_BINS = 16;
+
+// Update rebuilds the tree once refitting has made it this much more costly than when it was built
+static const float REBUILD_COST_RATIO = 1.5f;
+
+
+// Helpers for boxes held as minimum and maximum corners
+static inline CVector3 Min(const CVector3& a, const CVector3& b)
+{
+    return { std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z) };
+}
+
+static inline CVector3 Max(const CVector3& a, const CVector3& b)
+{
+    return { std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z) };
+}
+
+static inline float HalfSurfaceArea(const CVector3& min, const CVector3& max)
+{
+    CVector3 size = Max(max - min, { 0, 0, 0 });
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+// Removed objects are given an inside out box, which leaves other boxes unchanged when combined with them. Nodes with
+// only removed objects are left with such a box too
+static const CVector3 EMPTY_MIN = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+static const CVector3 EMPTY_MAX = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+static inline bool IsEmpty(const CVector3& min, const CVector3& max)
+{
+    return min.x > max.x;
+}
+
+static inline float Component(const CVector3& v, int axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// Result of comparing a node's box with a query region
+enum class Overlap { Outside, Partial, Inside };
+
+
+/*-----------------------------------------------------------------------------------------
+    Building
+-----------------------------------------------------------------------------------------*/
+
+void BoundingVolumeHierarchy::Build(const BoundingBox* bounds, int numObjects)
+{
+    // Objects with negative extents are kept after those in the tree, so they can be given bounds later
+    mEntries.resize(numObjects);
+    mObjectEntries.resize(numObjects);
+    int numInTree = 0;
+    for (int i = 0; i < numObjects; ++i)
+    {
+        const BoundingBox& box = bounds[i];
+        if (box.extents.x >= 0 && box.extents.y >= 0 && box.extents.z >= 0)
+        {
+            mEntries[numInTree++] = { box.centre - box.extents, i, box.centre + box.extents, 0 };
+        }
+    }
+    int numRemoved = 0;
+    for (int i = 0; i < numObjects; ++i)
+    {
+        const BoundingBox& box = bounds[i];
+        if (box.extents.x < 0 || box.extents.y < 0 || box.extents.z < 0)
+        {
+            mEntries[numInTree + numRemoved++] = { EMPTY_MIN, i, EMPTY_MAX, 0 };
+        }
+    }
+
+    // A tree of n leaves has 2n - 1 nodes, with at least one object per leaf
+    mNodes.clear();
+    mNodes.reserve(numInTree * 2 + 1);
+    mCost = 0;
+    if (numInTree > 0)
+    {
+        mCost = BuildNode(0, static_cast<uint32_t>(numInTree));
+        float rootArea = HalfSurfaceArea(mNodes[0].min, mNodes[0].max);
+        mCost = rootArea > 0 ? mCost / rootArea : static_cast<float>(numInTree) * OBJECT_COST;
+    }
+    mNodes.push_back({ { 0, 0, 0 }, static_cast<uint32_t>(numInTree), { 0, 0, 0 }, 0 }); // Ends the last node's objects
+
+    for (int i = 0; i < numObjects; ++i)  mObjectEntries[mEntries[i].object] = i;
+    mBuildCost    = mCost;
+    mNeedsRefit   = false;
+    mNeedsRebuild = false;
+}
+
+
+// Build the subtree over entries [first, first + count). Returns its cost scaled by the area of the root, i.e. the sum
+// over its nodes of the node's area times the cost of testing its box (and its objects for leaves)
+float BoundingVolumeHierarchy::BuildNode(uint32_t first, uint32_t count)
+{
+    const uint32_t index = static_cast<uint32_t>(mNodes.size());
+    mNodes.push_back({});
+
+    CVector3 min = mEntries[first].min, max = mEntries[first].max;
+    CVector3 centreMin = (min + max) * 0.5f, centreMax = centreMin;
+    for (uint32_t i = first + 1; i < first + count; ++i)
+    {
+        min = Min(min, mEntries[i].min);
+        max = Max(max, mEntries[i].max);
+        CVector3 centre = (mEntries[i].min + mEntries[i].max) * 0.5f;
+        centreMin = Min(centreMin, centre);
+        centreMax = Max(centreMax, centre);
+    }
+    mNodes[index].min   = min;
+    mNodes[index].max   = max;
+    mNodes[index].first = first;
+
+    const float area     = HalfSurfaceArea(min, max);
+    const float leafCost = area * (NODE_COST + count * OBJECT_COST);
+    auto makeLeaf = [&]
+    {
+        mNodes[index].next = index + 1;
+        return leafCost;
+    };
+    if (count == 1)  return makeLeaf();
+
+    // Sort the object centres into bins along each axis and find the split between bins with the lowest cost: the
+    // area of each side times the number of objects on it
+    float    bestCost  = INFINITY;
+    int      bestAxis  = -1;
+    int      bestSplit = 0; // Bins below this go on the left
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float axisMin = Component(centreMin, axis);
+        float axisMax = Component(centreMax, axis);
+        if (axisMax <= axisMin)  continue; // All centres in one place along this axis
+
+        struct Bin { CVector3 min, max; uint32_t count = 0; };
+        Bin bins[NUM_BINS];
+        float scale = NUM_BINS / (axisMax - axisMin);
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            float centre = Component((mEntries[i].min + mEntries[i].max) * 0.5f, axis);
+            int b = std::min(static_cast<int>((centre - axisMin) * scale), NUM_BINS - 1);
+            bins[b].min = bins[b].count ? Min(bins[b].min, mEntries[i].min) : mEntries[i].min;
+            bins[b].max = bins[b].count ? Max(bins[b].max, mEntries[i].max) : mEntries[i].max;
+            ++bins[b].count;
+        }
+
+        // Sweep from the right to find the area and count of everything above each split, then from the left
+        float    rightCost[NUM_BINS];
+        CVector3 sweepMin = {}, sweepMax = {};
+        uint32_t sweepCount = 0;
+        for (int b = NUM_BINS - 1; b > 0; --b)
+        {
+            if (bins[b].count)
+            {
+                sweepMin = sweepCount ? Min(sweepMin, bins[b].min) : bins[b].min;
+                sweepMax = sweepCount ? Max(sweepMax, bins[b].max) : bins[b].max;
+                sweepCount += bins[b].count;
+            }
+            rightCost[b] = sweepCount ? HalfSurfaceArea(sweepMin, sweepMax) * sweepCount : 0;
+        }
+        sweepCount = 0;
+        for (int b = 0; b < NUM_BINS - 1; ++b)
+        {
+            if (bins[b].count)
+            {
+                sweepMin = sweepCount ? Min(sweepMin, bins[b].min) : bins[b].min;
+                sweepMax = sweepCount ? Max(sweepMax, bins[b].max) : bins[b].max;
+                sweepCount += bins[b].count;
+            }
+            if (sweepCount == 0 || sweepCount == count)  continue;
+            float cost = HalfSurfaceArea(sweepMin, sweepMax) * sweepCount + rightCost[b + 1];
+            if (cost < bestCost)
+            {
+                bestCost  = cost;
+                bestAxis  = axis;
+                bestSplit = b + 1;
+            }
+        }
+    }
+
+    // Keep as a leaf if small enough and splitting doesn't help. If the centres can't be separated (e.g. all objects
+    // in the same place) but there are too many for a leaf, split them in half as they are
+    uint32_t leftCount;
+    if (bestAxis < 0)
+    {
+        if (count <= MAX_LEAF_OBJECTS)  return makeLeaf();
+        leftCount = count / 2;
+    }
+    else
+    {
+        // The node's box is tested either way, so compare testing its objects with testing two more boxes and the
+        // objects of each side that a query reaching them would test
+        float splitCost = area * 2 * NODE_COST + bestCost * OBJECT_COST;
+        if (count <= MAX_LEAF_OBJECTS && splitCost >= area * count * OBJECT_COST)  return makeLeaf();
+
+        float axisMin = Component(centreMin, bestAxis);
+        float scale   = NUM_BINS / (Component(centreMax, bestAxis) - axisMin);
+        Entry* middle = std::partition(&mEntries[first], &mEntries[first] + count, [&](const Entry& entry)
+        {
+            float centre = Component((entry.min + entry.max) * 0.5f, bestAxis);
+            return std::min(static_cast<int>((centre - axisMin) * scale), NUM_BINS - 1) < bestSplit;
+        });
+        leftCount = static_cast<uint32_t>(middle - &mEntries[first]);
+    }
+
+    float cost = area * NODE_COST;
+    cost += BuildNode(first, leftCount);
+    cost += BuildNode(first + leftCount, count - leftCount);
+    mNodes[index].next = static_cast<uint32_t>(mNodes.size());
+    return cost;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Moving objects
+-----------------------------------------------------------------------------------------*/
+
+void BoundingVolumeHierarchy::SetBounds(int object, const BoundingBox& bounds)
+{
+    Entry& entry = mEntries[mObjectEntries[object]];
+    entry.min = bounds.centre - bounds.extents;
+    entry.max = bounds.centre + bounds.extents;
+    mNeedsRefit = true;
+
+    // Objects that were removed when the tree was built aren't in it, so can only be added back by rebuilding
+    if (static_cast<uint32_t>(mObjectEntries[object]) >= mNodes.back().first)  mNeedsRebuild = true;
+}
+
+
+void BoundingVolumeHierarchy::Remove(int object)
+{
+    Entry& entry = mEntries[mObjectEntries[object]];
+    entry.min = EMPTY_MIN;
+    entry.max = EMPTY_MAX;
+    mNeedsRefit = true;
+}
+
+
+bool BoundingVolumeHierarchy::IsRemoved(int object) const
+{
+    const Entry& entry = mEntries[mObjectEntries[object]];
+    return IsEmpty(entry.min, entry.max);
+}
+
+
+// Children always follow their parent in the array, so going backwards visits children before parents and each node
+// can be grown around its children's new boxes
+void BoundingVolumeHierarchy::Refit()
+{
+    if (!mNeedsRefit)  return;
+
+    float cost = 0;
+    for (int i = NumNodes() - 1; i >= 0; --i)
+    {
+        Node& node = mNodes[i];
+        float testCost = NODE_COST;
+        if (node.next == static_cast<uint32_t>(i) + 1)
+        {
+            uint32_t end = mNodes[node.next].first;
+            node.min = mEntries[node.first].min;
+            node.max = mEntries[node.first].max;
+            for (uint32_t e = node.first + 1; e < end; ++e)
+            {
+                node.min = Min(node.min, mEntries[e].min);
+                node.max = Max(node.max, mEntries[e].max);
+            }
+            testCost += (end - node.first) * OBJECT_COST;
+        }
+        else
+        {
+            const Node& left  = mNodes[i + 1];
+            const Node& right = mNodes[left.next];
+            node.min = Min(left.min, right.min);
+            node.max = Max(left.max, right.max);
+        }
+        cost += HalfSurfaceArea(node.min, node.max) * testCost;
+    }
+
+    float rootArea = NumNodes() > 0 ? HalfSurfaceArea(mNodes[0].min, mNodes[0].max) : 0;
+    mCost = rootArea > 0 ? cost / rootArea : mBuildCost;
+    mNeedsRefit = false;
+}
+
+
+bool BoundingVolumeHierarchy::NeedsRebuild() const
+{
+    return mNeedsRebuild || mCost > mBuildCost * REBUILD_COST_RATIO;
+}
+
+
+bool BoundingVolumeHierarchy::Update()
+{
+    Refit();
+    if (!NeedsRebuild())  return false;
+
+    // Removed objects have negative extents so stay out of the new tree
+    std::vector<BoundingBox> bounds(NumObjects());
+    for (int i = 0; i < NumObjects(); ++i)  bounds[i] = Bounds(i);
+    Build(bounds.data(), NumObjects());
+    return true;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Queries
+-----------------------------------------------------------------------------------------*/
+
+void BoundingVolumeHierarchy::AddAll(uint32_t node, std::vector<int>& results) const
+{
+    uint32_t end = mNodes[mNodes[node].next].first;
+    for (uint32_t e = mNodes[node].first; e < end; ++e)
+    {
+        if (!IsEmpty(mEntries[e].min, mEntries[e].max))  results.push_back(mEntries[e].object);
+    }
+}
+
+
+template <class Classify, class Test>
+void BoundingVolumeHierarchy::Query(Classify classify, Test test, std::vector<int>& results) const
+{
+    const uint32_t numNodes = static_cast<uint32_t>(NumNodes());
+    uint32_t i = 0;
+    while (i < numNodes)
+    {
+        const Node& node = mNodes[i];
+        Overlap overlap = IsEmpty(node.min, node.max) ? Overlap::Outside : classify(node.min, node.max);
+        if (overlap == Overlap::Outside)
+        {
+            i = node.next;
+            continue;
+        }
+        if (overlap == Overlap::Inside)
+        {
+            AddAll(i, results);
+            i = node.next;
+            continue;
+        }
+        if (node.next == i + 1)
+        {
+            uint32_t end = mNodes[node.next].first;
+            for (uint32_t e = node.first; e < end; ++e)
+            {
+                const Entry& entry = mEntries[e];
+                if (!IsEmpty(entry.min, entry.max) && test(entry))  results.push_back(entry.object);
+            }
+        }
+        ++i; // First child, or the next node after a leaf
+    }
+}
+
+
+void BoundingVolumeHierarchy::QueryFrustum(const CFrustum& frustum, std::vector<int>& results) const
+{
+    // Distance of the box centre from each plane, compared with the distance from the centre to the corner furthest
+    // along the plane normal (as IsVisible in CFrustum.h)
+    auto classify = [&](const CVector3& min, const CVector3& max)
+    {
+        CVector3 centre  = (min + max) * 0.5f;
+        CVector3 extents = (max - min) * 0.5f;
+        Overlap overlap = Overlap::Inside;
+        for (const FrustumPlane& plane : frustum.planes)
+        {
+            const CVector3& n = plane.normal;
+            float radius   = extents.x * std::abs(n.x) + extents.y * std::abs(n.y) + extents.z * std::abs(n.z);
+            float distance = Dot(n, centre) + plane.distance;
+            if (distance < -radius)  return Overlap::Outside;
+            if (distance < radius)   overlap = Overlap::Partial;
+        }
+        return overlap;
+    };
+    auto test = [&](const Entry& entry)
+    {
+        return IsVisible(frustum, BoundingBox{ (entry.min + entry.max) * 0.5f, (entry.max - entry.min) * 0.5f });
+    };
+    Query(classify, test, results);
+}
+
+
+void BoundingVolumeHierarchy::QuerySphere(const BoundingSphere& sphere, std::vector<int>& results) const
+{
+    const float radiusSquared = sphere.radius * sphere.radius;
+    auto classify = [&](const CVector3& min, const CVector3& max)
+    {
+        // Nearest point of the box to the centre of the sphere, and furthest corner
+        CVector3 nearest = Max(min, Min(sphere.centre, max));
+        CVector3 toNearest = nearest - sphere.centre;
+        if (Dot(toNearest, toNearest) > radiusSquared)  return Overlap::Outside;
+        CVector3 toFar = { std::max(sphere.centre.x - min.x, max.x - sphere.centre.x),
+                           std::max(sphere.centre.y - min.y, max.y - sphere.centre.y),
+                           std::max(sphere.centre.z - min.z, max.z - sphere.centre.z) };
+        return Dot(toFar, toFar) <= radiusSquared ? Overlap::Inside : Overlap::Partial;
+    };
+    auto test = [&](const Entry& entry)
+    {
+        CVector3 nearest = Max(entry.min, Min(sphere.centre, entry.max)) - sphere.centre;
+        return Dot(nearest, nearest) <= radiusSquared;
+    };
+    Query(classify, test, results);
+}
+
+
+void BoundingVolumeHierarchy::QueryBox(const BoundingBox& box, std::vector<int>& results) const
+{
+    const CVector3 boxMin = box.centre - box.extents;
+    const CVector3 boxMax = box.centre + box.extents;
+    auto overlaps = [&](const CVector3& min, const CVector3& max)
+    {
+        return min.x <= boxMax.x && max.x >= boxMin.x && min.y <= boxMax.y && max.y >= boxMin.y &&
+               min.z <= boxMax.z && max.z >= boxMin.z;
+    };
+    auto classify = [&](const CVector3& min, const CVector3& max)
+    {
+        if (!overlaps(min, max))  return Overlap::Outside;
+        bool inside = min.x >= boxMin.x && max.x <= boxMax.x && min.y >= boxMin.y && max.y <= boxMax.y &&
+                      min.z >= boxMin.z && max.z <= boxMax.z;
+        return inside ? Overlap::Inside : Overlap::Partial;
+    };
+    auto test = [&](const Entry& entry) { return overlaps(entry.min, entry.max); };
+    Query(classify, test, results);
+}
+
+
+void BoundingVolumeHierarchy::QueryRay(const Ray& ray, float maxDistance, std::vector<int>& results) const
+{
+    // Slab test as RayHitsBox (Bounds.h), with the divisions done once. A zero direction component gives an infinite
+    // reciprocal, which puts the slab either everywhere or nowhere along the ray as required, except when the origin is
+    // exactly on a face, giving 0 * infinity. Nudging zero components to a tiny value avoids that
+    auto reciprocal = [](float d) { return 1.0f / (d != 0 ? d : 1e-30f); };
+    const CVector3 inverse = { reciprocal(ray.direction.x), reciprocal(ray.direction.y), reciprocal(ray.direction.z) };
+    auto hits = [&](const CVector3& min, const CVector3& max)
+    {
+        float tx1 = (min.x - ray.origin.x) * inverse.x, tx2 = (max.x - ray.origin.x) * inverse.x;
+        float ty1 = (min.y - ray.origin.y) * inverse.y, ty2 = (max.y - ray.origin.y) * inverse.y;
+        float tz1 = (min.z - ray.origin.z) * inverse.z, tz2 = (max.z - ray.origin.z) * inverse.z;
+        float enter = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), 0.0f));
+        float leave = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::min(std::max(tz1, tz2), maxDistance));
+        return enter <= leave;
+    };
+
+    // A ray can't contain a box, so nodes are never entirely inside
+    auto classify = [&](const CVector3& min, const CVector3& max) { return hits(min, max) ? Overlap::Partial : Overlap::Outside; };
+    auto test = [&](const Entry& entry) { return hits(entry.min, entry.max); };
+    Query(classify, test, results);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Data access
+-----------------------------------------------------------------------------------------*/
+
+BoundingBox BoundingVolumeHierarchy::Bounds(int object) const
+{
+    const Entry& entry = mEntries[mObjectEntries[object]];
+    return { (entry.min + entry.max) * 0.5f, (entry.max - entry.min) * 0.5f };
+}
@@ -0,0 +1,138 @@
+//--------------------------------------------------------------------------------------
+// Bounding volume hierarchy - finds the objects in a region of space without testing every one
+//--------------------------------------------------------------------------------------
+// A tree of boxes over the world bounds of many objects (e.g. every placement in a scene). Each node's box encloses
+// everything below it, so a query skips whole groups of objects when it misses their node. Queries find the objects
+// whose bounds are inside a frustum, overlap a sphere or box, or are hit by a ray. The numbers of the objects found are
+// appended to a vector, so results from several structures can be gathered in one list.
+//
+// The tree is built with the surface area heuristic (SAH): the chance of a query reaching a node is taken to be in
+// proportion to its surface area, and each node is split where the expected cost of testing the two halves is lowest.
+// Nodes are held in one array in depth-first order. A node's first child follows it and each node holds the index to
+// skip to when a query misses it, so queries read forward through the array with no stack. The objects under any node
+// are a contiguous range, so a node entirely inside the query region adds all its objects without testing them.
+//
+// Intended for objects that rarely move. Moving an object only changes its bounds; Refit then regrows the node boxes
+// in one pass without changing the shape of the tree. After many moves the shape can become poor, with boxes stretched
+// over objects that have moved apart, so the refit also finds the SAH cost of the tree and Update rebuilds it once the
+// cost is well above what it was when built.
+//
+// Only uses the maths headers, so also builds outside Windows (see Benchmarks/SpatialBenchmark.cpp)
+
+#ifndef _BOUNDING_VOLUME_HIERARCHY_H_INCLUDED_
+#define _BOUNDING_VOLUME_HIERARCHY_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CFrustum.h"
+#include "Bounds.h"
+
+#include <vector>
+#include <cstdint>
+
+
+class BoundingVolumeHierarchy
+{
+public:
+    // Building //
+
+    // Build the tree over the given bounds, object i has bounds[i]. Replaces any existing tree. Objects with negative
+    // extents are left out as if removed
+    void Build(const BoundingBox* bounds, int numObjects);
+
+
+    // Moving objects //
+
+    // Change the bounds of an object. The tree is unchanged until the next Refit or Update, queries before then may
+    // miss the object in its new position. Setting the bounds of a removed object adds it back, but if it was removed
+    // before the tree was last built it is only found again after the next rebuild
+    void SetBounds(int object, const BoundingBox& bounds);
+
+    // Stop an object being found by queries, e.g. when it starts moving and is handed to a structure better suited
+    // to moving objects (see SpatialGrid.h). Its place in the tree is kept until the next rebuild
+    void Remove(int object);
+    bool IsRemoved(int object) const;
+
+    // Regrow the node boxes around the current bounds of the objects, if any have changed since the last refit
+    void Refit();
+
+    // True if refitting has made the tree enough worse than when it was built that a rebuild is worthwhile (SAH cost
+    // more than half as much again), or if an object left out of the tree has been given bounds
+    bool NeedsRebuild() const;
+
+    // Refit the tree, or rebuild it if it has become poor. Call once after moving objects, before any queries. Returns
+    // true if the tree was rebuilt
+    bool Update();
+
+
+    // Queries //
+    // Each appends the numbers of the objects found to results, in no particular order
+
+    // Objects whose bounds are at least partly inside the frustum (conservative in the same way as IsVisible)
+    void QueryFrustum(const CFrustum& frustum, std::vector<int>& results) const;
+
+    // Objects whose bounds overlap the sphere / box
+    void QuerySphere(const BoundingSphere& sphere, std::vector<int>& results) const;
+    void QueryBox(const BoundingBox& box, std::vector<int>& results) const;
+
+    // Objects whose bounds are hit by the ray within the given distance along it
+    void QueryRay(const Ray& ray, float maxDistance, std::vector<int>& results) const;
+
+
+    // Data access //
+
+    int NumObjects() const  { return static_cast<int>(mObjectEntries.size()); }
+    int NumNodes() const    { return mNodes.empty() ? 0 : static_cast<int>(mNodes.size()) - 1; }
+
+    // Bounds of an object, inside out (negative extents) if it has been removed
+    BoundingBox Bounds(int object) const;
+
+    // SAH cost of the tree now (as of the last refit) and when it was last built. Relative to testing a node, and
+    // assuming every query reaches the root
+    float Cost() const       { return mCost; }
+    float BuildCost() const  { return mBuildCost; }
+
+
+private:
+    // A node's box, the position in mEntries of its first object and the index of the node following its subtree.
+    // A leaf's next node is the one after it (an interior node is followed by its children). A node's objects run up
+    // to the first object of its next node. 32 bytes so two nodes share a cache line
+    struct Node
+    {
+        CVector3 min;
+        uint32_t first;
+        CVector3 max;
+        uint32_t next;
+    };
+
+    // The bounds of an object, in the order the leaves hold them
+    struct Entry
+    {
+        CVector3 min;
+        int      object;
+        CVector3 max;
+        int      padding;
+    };
+
+    // Build the subtree over entries [first, first + count), returning its cost
+    float BuildNode(uint32_t first, uint32_t count);
+
+    // Add the objects under a node to results without testing them
+    void AddAll(uint32_t node, std::vector<int>& results) const;
+
+    // Walk the tree, calling classify(min, max) for each node reached, which returns whether the node's box is
+    // outside, partly inside or entirely inside the query region, and test(entry) for each object of partly inside leaves
+    template <class Classify, class Test>
+    void Query(Classify classify, Test test, std::vector<int>& results) const;
+
+    std::vector<Node>  mNodes;         // Depth-first, followed by an extra node whose first is the number of objects in the tree
+    std::vector<Entry> mEntries;       // Objects in the tree in leaf order, then those left out when it was built
+    std::vector<int>   mObjectEntries; // Position of each object in mEntries
+
+    float mCost         = 0;
+    float mBuildCost    = 0;
+    bool  mNeedsRefit   = false;
+    bool  mNeedsRebuild = false;
+};
+
+
+#endif //_BOUNDING_VOLUME_HIERARCHY_H_INCLUDED_
@@ -10,24 +10,34 @@ void Camera::Control(float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode
                                       KeyCode moveForward, KeyCode moveBackward, KeyCode moveLeft, KeyCode moveRight)
 {
 	//**** ROTATION ****
+	// Look up/down around the camera's own X axis, turn left/right around the world Y axis
+	float rotation = ROTATION_SPEED * frameTime; // Use of frameTime to ensure same speed on different machines
 	if (KeyHeld(turnDown))
 	{
-		mRotation.x += ROTATION_SPEED * frameTime; // Use of frameTime to ensure same speed on different machines
+		mRotation = QuaternionRotationAxis({ 1, 0, 0 }, rotation) * mRotation;
 	}
 	if (KeyHeld(turnUp))
 	{
-		mRotation.x -= ROTATION_SPEED * frameTime;
+		mRotation = QuaternionRotationAxis({ 1, 0, 0 }, -rotation) * mRotation;
 	}
 	if (KeyHeld(turnRight))
 	{
-		mRotation.y += ROTATION_SPEED * frameTime;
+		mRotation = mRotation * QuaternionRotationAxis({ 0, 1, 0 }, rotation);
 	}
 	if (KeyHeld(turnLeft))
 	{
-		mRotation.y -= ROTATION_SPEED * frameTime;
+		mRotation = mRotation * QuaternionRotationAxis({ 0, 1, 0 }, -rotation);
+	}
+	if (KeyHeld(turnDown) || KeyHeld(turnUp) || KeyHeld(turnRight) || KeyHeld(turnLeft))
+	{
+		mRotation = Normalise<MathPrecision::Fast>(mRotation); // Remove any drift from repeated multiplies (fast version is easily accurate enough)
+		mViewDirty = true;
 	}
 
 	//**** LOCAL MOVEMENT ****
+	if (!KeyHeld(moveRight) && !KeyHeld(moveLeft) && !KeyHeld(moveForward) && !KeyHeld(moveBackward))  return;
+	UpdateMatrices(); // Local axes are read from the world matrix, make sure it includes any rotation above
+	mViewDirty = true;
 	if (KeyHeld(moveRight))
 	{
 		mPosition.x += MOVEMENT_SPEED * frameTime * mWorldMatrix.e00; // See comments on local movement in UpdateCube code above
@@ -55,28 +65,41 @@ void Camera::Control(float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode
 }
 
 
-// Update the matrices used for the camera in the rendering pipeline
-void Camera::UpdateMatrices()
+// Update the matrices used for the camera in the rendering pipeline. Nothing is done if the camera hasn't changed
+// since the last update, which is most calls as several passes read the matrices each frame
+void Camera::UpdateMatrices() const
 {
-    // "World" matrix for the camera - treat it like a model at first
-    mWorldMatrix = MatrixRotationZ(mRotation.z) * MatrixRotationX(mRotation.x) * MatrixRotationY(mRotation.y) * MatrixTranslation(mPosition);
+    if (!mViewDirty && !mProjectionDirty)  return;
 
-    // View matrix is the usual matrix used for the camera in shaders, it is the inverse of the world matrix (see lectures)
-    mViewMatrix = InverseAffine(mWorldMatrix);
+    if (mViewDirty)
+    {
+        // "World" matrix for the camera - treat it like a model at first
+        // Same as MatrixRotation(mRotation) * MatrixTranslation(mPosition)
+        mWorldMatrix = AffineWorld(mPosition, mRotation, { 1, 1, 1 });
 
-    // Projection matrix, how to flatten the 3D world onto the screen (needs field of view, near and far clip, aspect ratio)
-    float tanFOVx = std::tan(mFOVx * 0.5f);
-    float scaleX = 1.0f / tanFOVx;
-    float scaleY = mAspectRatio / tanFOVx;
-    float scaleZa = mFarClip / (mFarClip - mNearClip);
-    float scaleZb = -mNearClip * scaleZa;
+        // View matrix is the usual matrix used for the camera in shaders, it is the inverse of the world matrix (see lectures)
+        mViewMatrix = InverseAffine(mWorldMatrix);
+    }
 
-    mProjectionMatrix = CMatrix4x4{ scaleX,   0.0f,    0.0f,   0.0f,
-                                      0.0f, scaleY,    0.0f,   0.0f,
-                                      0.0f,   0.0f, scaleZa,   1.0f,
-                                      0.0f,   0.0f, scaleZb,   0.0f };
+    if (mProjectionDirty)
+    {
+        // Projection matrix, how to flatten the 3D world onto the screen (needs field of view, near and far clip, aspect ratio)
+        mProjectionMatrix = MatrixPerspective(mFOVx, mAspectRatio, mNearClip, mFarClip);
+    }
 
     // The view-projection matrix combines the two matrices usually used for the camera into one, which can save a multiply in the shaders (optional)
     mViewProjectionMatrix = mViewMatrix * mProjectionMatrix;
+    mFrustum = FrustumFromMatrix(mViewProjectionMatrix);
+
+    mViewDirty = false;
+    mProjectionDirty = false;
+}
+
+
+// Copy of the camera's current matrices and settings for render passes to use
+CameraSnapshot Camera::Snapshot() const
+{
+    UpdateMatrices();
+    return { ToMatrix4x4(mViewMatrix), mProjectionMatrix, mViewProjectionMatrix, mFrustum, mPosition, mNearClip, mFarClip };
 }
 
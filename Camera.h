@@ -2,10 +2,15 @@
 // Class encapsulating a camera
 //--------------------------------------------------------------------------------------
 // Holds position, rotation, near/far clip and field of view. These to a view and projection matrices as required
+// The matrices are cached and only rebuilt after the settings they depend on change. Render passes take a
+// CameraSnapshot, a read-only copy of everything they need from the camera for one frame
 
 #include "Common.h"
 #include "CVector3.h"
 #include "CMatrix4x4.h"
+#include "CMatrix3x4.h"
+#include "CFrustum.h"
+#include "CQuaternion.h"
 #include "MathHelpers.h"
 #include "Input.h"
 
@@ -13,6 +18,20 @@
 #define _CAMERA_H_INCLUDED_
 
 
+// Everything a render pass needs from a camera, copied once per frame. Passes only ever read from this so they
+// can't change the camera or each other's view of it
+struct CameraSnapshot
+{
+	CMatrix4x4 viewMatrix;
+	CMatrix4x4 projectionMatrix;
+	CMatrix4x4 viewProjectionMatrix;
+	CFrustum   frustum;
+	CVector3   position;
+	float      nearClip;
+	float      farClip;
+};
+
+
 class Camera
 {
 public:
@@ -23,7 +42,7 @@ public:
 	// Constructor - initialise all settings, sensible defaults provided for everything.
 	Camera(CVector3 position = {0,0,0}, CVector3 rotation = {0,0,0}, 
            float fov = PI/3, float aspectRatio = 4.0f / 3.0f, float nearClip = 0.1f, float farClip = 10000.0f)
-        : mPosition(position), mRotation(rotation), mFOVx(fov), mAspectRatio(aspectRatio), mNearClip(nearClip), mFarClip(farClip)
+        : mPosition(position), mRotation(QuaternionFromEuler(rotation)), mFOVx(fov), mAspectRatio(aspectRatio), mNearClip(nearClip), mFarClip(farClip)
     {
     }
 
@@ -38,35 +57,46 @@ public:
 	//-------------------------------------
 
 	// Getters / setters
-	CVector3 Position()  { return mPosition; }
-	CVector3 Rotation()  { return mRotation;	}
-	void SetPosition(CVector3 position)  { mPosition = position; }
-	void SetRotation(CVector3 rotation)  { mRotation = rotation; }
+	CVector3    Position()     { return mPosition; }
+	CQuaternion Orientation()  { return mRotation; }
+	void SetPosition   (CVector3 position)        { mPosition = position;    mViewDirty = true; }
+	void SetOrientation(CQuaternion orientation)  { mRotation = orientation; mViewDirty = true; }
+
+	// Rotation as Euler angles (Z, then X, then Y). Getting the rotation this way is relatively expensive
+	CVector3 Rotation()                  { return mRotation.GetEulerAngles(); }
+	void SetRotation(CVector3 rotation)  { mRotation = QuaternionFromEuler(rotation); mViewDirty = true; }
 
 	float FOV()       { return mFOVx;     }
 	float NearClip()  { return mNearClip; }
 	float FarClip()   { return mFarClip;  }
 
-	void SetFOV     (float fov     )  { mFOVx     = fov;      }
-	void SetNearClip(float nearClip)  { mNearClip = nearClip; }
-	void SetFarClip (float farClip )  { mFarClip  = farClip;  }
+	void SetFOV     (float fov     )  { mFOVx     = fov;      mProjectionDirty = true; }
+	void SetNearClip(float nearClip)  { mNearClip = nearClip; mProjectionDirty = true; }
+	void SetFarClip (float farClip )  { mFarClip  = farClip;  mProjectionDirty = true; }
+
+	// Read only access to camera matrices, updated on request from position, rotation and camera settings only
+	// if they have changed since the matrices were last used
+	CMatrix4x4        ViewMatrix()           const  { UpdateMatrices(); return ToMatrix4x4(mViewMatrix); }
+	const CMatrix4x4& ProjectionMatrix()     const  { UpdateMatrices(); return mProjectionMatrix;        }
+	const CMatrix4x4& ViewProjectionMatrix() const  { UpdateMatrices(); return mViewProjectionMatrix;    }
 
-	// Read only access to camera matrices, updated on request from position, rotation and camera settings
-	CMatrix4x4 ViewMatrix()            { UpdateMatrices(); return mViewMatrix;           }
-	CMatrix4x4 ProjectionMatrix()      { UpdateMatrices(); return mProjectionMatrix;     }
-	CMatrix4x4 ViewProjectionMatrix()  { UpdateMatrices(); return mViewProjectionMatrix; }
+	// Volume of space visible to the camera, for culling models that can't be seen (see CFrustum.h)
+	const CFrustum& Frustum() const  { UpdateMatrices(); return mFrustum; }
+
+	// Copy of the camera's current matrices and settings for render passes to use
+	CameraSnapshot Snapshot() const;
 
 	
 //-------------------------------------
 // Private members
 //-------------------------------------
 private:
-	// Update the matrices used for the camera in the rendering pipeline
-	void UpdateMatrices();
+	// Update the matrices used for the camera in the rendering pipeline, only those that are out of date
+	void UpdateMatrices() const;
 
 	// Postition and rotations for the camera (rarely scale cameras)
-	CVector3 mPosition;
-	CVector3 mRotation;
+	CVector3    mPosition;
+	CQuaternion mRotation;
 
 	// Camera settings: field of view, aspect ratio, near and far clip plane distances.
 	// Note that the FOVx angle is measured in radians (radians = degrees * PI/180) from left to right of screen
@@ -76,12 +106,18 @@ private:
 	float mFarClip;
 
 	// Current view, projection and combined view-projection matrices (DirectX matrix type)
-	CMatrix4x4 mWorldMatrix; // Easiest to treat the camera like a model and give it a "world" matrix...
-	CMatrix4x4 mViewMatrix;  // ...then the view matrix used in the shaders is the inverse of its world matrix
-
-	CMatrix4x4 mProjectionMatrix;     // Projection matrix holds the field of view and near/far clip distances
-	CMatrix4x4 mViewProjectionMatrix; // Combine (multiply) the view and projection matrices together, which
-	                                  // can sometimes save a matrix multiply in the shader (optional)
+	// Mutable as they are a cache: rebuilding them when they are read doesn't change the camera
+	mutable CMatrix3x4 mWorldMatrix; // Easiest to treat the camera like a model and give it a "world" matrix...
+	mutable CMatrix3x4 mViewMatrix;  // ...then the view matrix used in the shaders is the inverse of its world matrix (both affine)
+
+	mutable CMatrix4x4 mProjectionMatrix;     // Projection matrix holds the field of view and near/far clip distances
+	mutable CMatrix4x4 mViewProjectionMatrix; // Combine (multiply) the view and projection matrices together, which
+	                                          // can sometimes save a matrix multiply in the shader (optional)
+	mutable CFrustum   mFrustum;              // Planes of the view-projection matrix, for culling
+
+	// Set when position / rotation or the projection settings change, so only the affected matrices are rebuilt
+	mutable bool mViewDirty       = true;
+	mutable bool mProjectionDirty = true;
 };
 
 
@@ -0,0 +1,7 @@
+//--------------------------------------------------------------------------------------
+// Cell Shading Outline Vertex Shader - instanced version
+//--------------------------------------------------------------------------------------
+// The same shader reading the world matrix of each instance from the instance buffer (see Instancing in Common.hlsli)
+
+#define INSTANCED
+#include "CellShadingOutline_vs.hlsl"
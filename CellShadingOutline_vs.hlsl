@@ -12,8 +12,9 @@ BasicPixelShaderInput main(BasicVertex modelVertex)
 	BasicPixelShaderInput output;
 
 	// Transform model vertex position to world space using the world matrix passed from C++
+	float4x3 worldMatrix = ModelWorldMatrix(modelVertex); // Per-model or per-instance, see Common.hlsli
 	float4 modelPosition = float4(modelVertex.position, 1);
-	float4 worldPosition = mul(gWorldMatrix, modelPosition);
+	float4 worldPosition = float4(mul(modelPosition, worldMatrix), 1);
 
 	// Next the usual transform from world space to camera space - but we don't go any further here - this will be used to help expand the outline
 	// The result "viewPosition" is the xyz position of the vertex as seen from the camera. The z component is the distance from the camera - that's useful...
@@ -21,7 +22,7 @@ BasicPixelShaderInput main(BasicVertex modelVertex)
 
 	// Transform model normal to world space. We will use the normal to expand the geometry, not for lighting
 	float4 modelNormal = float4(modelVertex.normal, 0.0f); // Set 4th element to 0.0 this time as normals are vectors
-	float4 worldNormal = normalize(mul(gWorldMatrix, modelNormal)); // Normalise in case of world matrix scaling
+	float4 worldNormal = normalize(float4(mul(modelNormal, worldMatrix), 0)); // Normalise in case of world matrix scaling
 
 	// Now we return to the world position of this vertex and expand it along the world normal - that will expand the geometry outwards.
 	// Use the distance from the camera to decide how much to expand. Use this distance together with a sqrt to creates an outline that
@@ -16,15 +16,16 @@ LightingPixelShaderInput main(BasicVertex modelVertex)
     // Multiply by the world matrix passed from C++ to transform the model vertex position into world space. 
     // In a similar way use the view matrix to transform the vertex from world space into view space (camera's point of view)
     // and then use the projection matrix to transform the vertex to 2D projection space (project onto the 2D screen)
-    float4 worldPosition = mul(gWorldMatrix, modelPosition);
+    float4x3 worldMatrix = ModelWorldMatrix(modelVertex); // Per-model or per-instance, see Common.hlsli
+    float4 worldPosition = float4(mul(modelPosition, worldMatrix), 1);
     float4 viewPosition = mul(gViewMatrix, worldPosition);
     output.projectedPosition = mul(gProjectionMatrix, viewPosition);
 
     // Also transform model normals into world space using world matrix - lighting will be calculated in world space
     // Pass this normal to the pixel shader as it is needed to calculate per-pixel lighting
     float4 modelNormal = float4(modelVertex.normal, 0);      // For normals add a 0 in the 4th element to indicate it is a vector
-    output.worldNormal = mul(gWorldMatrix, modelNormal).xyz; // Only needed the 4th element to do this multiplication by 4x4 matrix...
-                                                             //... it is not needed for lighting so discard afterwards with the .xyz
+    output.worldNormal = mul(modelNormal, worldMatrix);      // The 0 in the 4th element means the translation is not applied,...
+                                                             //... the result is already x,y,z only (see gWorldMatrix in Common.hlsli)
     output.worldPosition = worldPosition.xyz; // Also pass world position to pixel shader for lighting
 
     // Pass texture coordinates (UVs) on to the pixel shader, the vertex shader doesn't need them
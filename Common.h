@@ -13,6 +13,8 @@
 
 #include "CVector3.h"
 #include "CMatrix4x4.h"
+#include "CMatrix3x4.h"
+#include "RenderDevice.h"
 
 
 //--------------------------------------------------------------------------------------
@@ -38,6 +40,10 @@ extern IDXGISwapChain*         gSwapChain;
 extern ID3D11RenderTargetView* gBackBufferRenderTarget;  // Back buffer is where we render to
 extern ID3D11DepthStencilView* gDepthStencil;            // The depth buffer contains a depth for each back buffer pixel
 
+// Per-frame rendering goes through gRenderDevice and gRenderContext (declared in RenderDevice.h), which pass the
+// calls on to the device and context above. gRenderContext drops calls that change nothing (see RenderStateCache.h),
+// so anything using gD3DContext directly for rendering must call gRenderStateCache->Invalidate() afterwards
+
 // Input constsnts
 extern const float ROTATION_SPEED;
 extern const float MOVEMENT_SPEED;
@@ -47,6 +53,10 @@ extern const float MOVEMENT_SPEED;
 // when a serious error occurs
 extern std::string gLastError;
 
+// Job system for spreading work across CPU cores (see Utility/JobSystem.h). Created at the start of InitGeometry
+class JobSystem;
+extern JobSystem* gJobSystem;
+
 
 
 //--------------------------------------------------------------------------------------
@@ -111,9 +121,10 @@ extern ID3D11Buffer*     gPerFrameConstantBuffer; // This variable controls the
 
 // This is the matrix that positions the next thing to be rendered in the scene. Unlike the structure above this data can be
 // updated and sent to the GPU several times every frame (once per model). However, apart from that it works in the same way.
+// The render queue writes RenderInstance structures as these constants (see RenderQueue.h), so the two must match
 struct PerModelConstants
 {
-    CMatrix4x4 worldMatrix;
+    CMatrix3x4 worldMatrix;  // Affine so the last column isn't sent, matches float4x3 in the shaders
     CVector3   objectColour; // Allows each light model to be tinted to match the light colour they cast
     float      padding6;
 };
@@ -14,6 +14,9 @@ struct BasicVertex
     float3 position : position;
     float3 normal   : normal;
     float2 uv       : uv;
+#ifdef INSTANCED
+    uint   instance : SV_InstanceID; // Which instance of an instanced draw this vertex is for, given by the GPU not the mesh
+#endif
 };
 
 //Includes a tangent variable for normal and parallax mapping
@@ -134,8 +137,47 @@ cbuffer PerFrameConstants : register(b0) // The b0 gives this constant buffer th
 // These variables must match exactly the gPerModelConstants structure in Scene.cpp
 cbuffer PerModelConstants : register(b1) // The b1 gives this constant buffer the number 1 - used in the C++ code
 {
-    float4x4 gWorldMatrix;
+    // World matrices are affine - the last column is always (0,0,0,1) - so only the other three columns are sent (CMatrix3x4 in
+    // C++). Each column is one float4 register, and unlike the float4x4 matrices above this is *not* transposed, so multiply
+    // with the vector first: mul(float4(position, 1), gWorldMatrix) gives the world position as a float3
+    float4x3 gWorldMatrix;
 
     float3   gObjectColour;
     float    padding6;  // See notes on padding in structure above
 }
+
+
+//--------------------------------------------------------------------------------------
+// Instancing
+//--------------------------------------------------------------------------------------
+
+// Runs of models sharing a mesh and material can be drawn with one instanced draw call (see RenderQueue.h). Each
+// instance then takes its world matrix and colour from the array below rather than the per-model constants above.
+// Vertex shaders supporting this are compiled twice, the instanced version is a file that defines INSTANCED then
+// includes the normal one (e.g. ShadowMappingInstanced_vs.hlsl). They get the world matrix with ModelWorldMatrix
+#ifdef INSTANCED
+static const uint MAX_INSTANCES = 1024; // Must match MAX_RENDER_INSTANCES in RenderQueue.h
+
+// Must match RenderInstance in RenderQueue.h
+struct InstanceConstants
+{
+    float4x3 worldMatrix;
+    float3   colour;
+    float    padding;
+};
+
+cbuffer PerInstanceConstants : register(b2)
+{
+    InstanceConstants gInstances[MAX_INSTANCES];
+}
+#endif
+
+// World matrix for a vertex, from the instance it belongs to in instanced shaders, otherwise the per-model constants
+float4x3 ModelWorldMatrix(BasicVertex modelVertex)
+{
+#ifdef INSTANCED
+    return gInstances[modelVertex.instance].worldMatrix;
+#else
+    return gWorldMatrix;
+#endif
+}
@@ -0,0 +1,137 @@
+//--------------------------------------------------------------------------------------
+// Constant upload buffer - per-draw constants for a whole frame in one large buffer
+//--------------------------------------------------------------------------------------
+
+#include "ConstantUploadBuffer.h"
+#include "RenderStateCache.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+
+// Bytes in one constant (a float4), the unit binding ranges are measured in
+static const unsigned int CONSTANT_SIZE = 16;
+
+
+/*-----------------------------------------------------------------------------------------
+    Construction / destruction
+-----------------------------------------------------------------------------------------*/
+
+ConstantUploadBuffer::ConstantUploadBuffer(unsigned int elementSize, unsigned int capacity)
+    : mElementSize(elementSize), mUseRanges(gRenderDevice->SupportsConstantBufferRanges())
+{
+    if (elementSize == 0 || elementSize > MAX_CONSTANT_BUFFER_RANGE * CONSTANT_SIZE)
+    {
+        throw std::runtime_error("Constant upload buffer element size must be 1 byte to 64KB");
+    }
+
+    // Ranges must start on (and be a multiple of) 16 constants
+    const unsigned int alignment = mUseRanges ? CONSTANT_BUFFER_RANGE_ALIGNMENT * CONSTANT_SIZE : CONSTANT_SIZE;
+    mStride = alignment * ((elementSize + alignment - 1) / alignment);
+
+    if (!mUseRanges)
+    {
+        mElementBuffer = gRenderDevice->CreateConstantBuffer(mElementSize);
+        if (mElementBuffer == nullptr)  throw std::runtime_error("Failure creating constant upload buffer");
+    }
+    if (!CreateBuffer(std::max(capacity, 1u)))
+    {
+        gRenderDevice->ReleaseBuffer(mElementBuffer);
+        throw std::runtime_error("Failure creating constant upload buffer");
+    }
+}
+
+ConstantUploadBuffer::~ConstantUploadBuffer()
+{
+    gRenderDevice->ReleaseBuffer(mBuffer);
+    gRenderDevice->ReleaseBuffer(mElementBuffer);
+}
+
+
+bool ConstantUploadBuffer::CreateBuffer(unsigned int capacity)
+{
+    ID3D11Buffer* buffer = nullptr;
+    if (mUseRanges)
+    {
+        buffer = gRenderDevice->CreateConstantBuffer(capacity * mStride);
+        if (buffer == nullptr)  return false;
+    }
+
+    // The released buffer may still be bound, and a new buffer could be given its address, so the state cache must
+    // forget what it knows (see RenderStateCache.h)
+    if (mBuffer)
+    {
+        gRenderDevice->ReleaseBuffer(mBuffer);
+        if (gRenderStateCache)  gRenderStateCache->Invalidate();
+    }
+    mBuffer   = buffer;
+    mCapacity = capacity;
+    mData.assign(static_cast<size_t>(capacity) * mStride, 0);
+    return true;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Usage
+-----------------------------------------------------------------------------------------*/
+
+bool ConstantUploadBuffer::Begin(unsigned int numObjects /*= 0*/)
+{
+    mNumElements = 0;
+    mNumUploaded = 0;
+    mObjectElements.assign(numObjects, -1);
+    if (numObjects <= mCapacity)  return true;
+
+    // Grow by at least half again so a slowly growing scene doesn't recreate the buffer every frame
+    return CreateBuffer(std::max(numObjects, mCapacity + mCapacity / 2));
+}
+
+
+int ConstantUploadBuffer::Add(int object, const void* data, unsigned int size)
+{
+    bool hasObject = (object >= 0 && static_cast<size_t>(object) < mObjectElements.size());
+    if (hasObject && mObjectElements[object] >= 0)  return mObjectElements[object];
+    if (mNumElements == mCapacity)  return -1;
+
+    int element = static_cast<int>(mNumElements++);
+    std::memcpy(&mData[static_cast<size_t>(element) * mStride], data, std::min(size, mElementSize));
+    if (hasObject)  mObjectElements[object] = element;
+    return element;
+}
+
+
+int ConstantUploadBuffer::Element(int object) const
+{
+    if (object < 0 || static_cast<size_t>(object) >= mObjectElements.size())  return -1;
+    return mObjectElements[object];
+}
+
+
+void ConstantUploadBuffer::Upload()
+{
+    if (!mUseRanges || mNumUploaded == mNumElements)  return;
+
+    // The first upload of the frame discards the last frame's elements, later ones leave the earlier elements alone
+    unsigned int offset = mNumUploaded * mStride;
+    gRenderContext->AppendConstantBuffer(mBuffer, offset, &mData[offset], (mNumElements - mNumUploaded) * mStride);
+    mNumUploaded = mNumElements;
+}
+
+
+void ConstantUploadBuffer::Bind(unsigned int slot, int element)
+{
+    if (mUseRanges)
+    {
+        unsigned int firstConstant = static_cast<unsigned int>(element) * (mStride / CONSTANT_SIZE);
+        unsigned int numConstants  = mStride / CONSTANT_SIZE;
+        gRenderContext->VSSetConstantBuffers1(slot, 1, &mBuffer, &firstConstant, &numConstants);
+        gRenderContext->PSSetConstantBuffers1(slot, 1, &mBuffer, &firstConstant, &numConstants);
+    }
+    else
+    {
+        gRenderContext->UpdateConstantBuffer(mElementBuffer, &mData[static_cast<size_t>(element) * mStride], mElementSize);
+        gRenderContext->VSSetConstantBuffers(slot, 1, &mElementBuffer);
+        gRenderContext->PSSetConstantBuffers(slot, 1, &mElementBuffer);
+    }
+}
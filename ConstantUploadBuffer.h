@@ -0,0 +1,100 @@
+//--------------------------------------------------------------------------------------
+// Constant upload buffer - per-draw constants for a whole frame in one large buffer
+//--------------------------------------------------------------------------------------
+// Rather than updating a small constant buffer before every draw (a Map / Unmap each time), the constants of each
+// draw (e.g. a model's world matrix) are added as an element of one large buffer, all the elements added for a pass
+// are sent to the GPU with a single update, and each draw binds its own element. The buffer is filled from the start
+// each frame, each pass appending to what is already there while earlier passes may still be reading it.
+//
+// Elements can be given the index of the object they belong to. An object only gets one element per frame, so the
+// constants of an object drawn in several passes (shadow maps, portal, main view) are only sent once and shared.
+//
+// Binding and appending to part of a constant buffer needs Direct3D 11.1 (IRenderDevice::SupportsConstantBufferRanges).
+// Each element then starts on a 256-byte boundary as that API requires. Without it the buffer falls back to copying
+// each element into a small constant buffer when it is bound, the same cost as updating constants per draw.
+//
+// Typical use:
+//     upload.Begin(numObjects);                         // Start of the frame
+//     ...
+//     element = upload.Add(object, &constants, size);   // For each draw in a pass, -1 if the buffer is full
+//     upload.Upload();
+//     upload.Bind(1, element);                          // Before each draw
+//
+// This file only uses the render device interface (RenderDevice.h), so also builds outside Windows (see Benchmarks)
+
+#ifndef _CONSTANT_UPLOAD_BUFFER_H_INCLUDED_
+#define _CONSTANT_UPLOAD_BUFFER_H_INCLUDED_
+
+#include "RenderDevice.h"
+
+#include <vector>
+#include <cstdint>
+
+
+class ConstantUploadBuffer
+{
+public:
+    // Construction / destruction //
+
+    // Elements hold up to elementSize bytes, at most 64KB (the most a shader can read from one buffer). There is
+    // initially space for the given number of elements. Uses gRenderDevice, which must exist as long as the buffer.
+    // Will throw a std::runtime_error exception on failure (since constructors can't return errors)
+    ConstantUploadBuffer(unsigned int elementSize, unsigned int capacity);
+    ~ConstantUploadBuffer();
+
+    ConstantUploadBuffer(const ConstantUploadBuffer&) = delete;
+    ConstantUploadBuffer& operator=(const ConstantUploadBuffer&) = delete;
+
+
+    // Usage //
+
+    // Start a new frame, discarding all elements. Objects numbered 0 to numObjects-1 can be given elements, and the
+    // buffer grows to hold one for each if needed. Returns false if a larger buffer couldn't be created, in which
+    // case the old size is kept
+    bool Begin(unsigned int numObjects = 0);
+
+    // Add an element holding the given data (up to the element size) and return its index, or -1 if the buffer is
+    // full. If the object already has an element this frame its index is returned and the data is ignored, so the
+    // constants of an object must be the same in every pass. Pass an object of -1 for a new element every time
+    int Add(int object, const void* data, unsigned int size);
+
+    // Element of an object this frame, -1 if none
+    int Element(int object) const;
+
+    // Send the elements added since the last upload to the GPU with a single update. Call after adding elements and
+    // before binding them
+    void Upload();
+
+    // Make the given element the constant buffer in a slot of the vertex and pixel shaders
+    void Bind(unsigned int slot, int element);
+
+
+    // Data access //
+
+    unsigned int NumElements() const  { return mNumElements; }
+    unsigned int Capacity() const     { return mCapacity; }
+
+    // Whether elements are bound as ranges of the one buffer, rather than copied to a small buffer when bound
+    bool UsesRanges() const  { return mUseRanges; }
+
+
+private:
+    // Create the buffer holding all elements, returning false on failure
+    bool CreateBuffer(unsigned int capacity);
+
+    unsigned int mElementSize;
+    unsigned int mStride;       // Bytes from one element to the next, a multiple of 256 if using ranges
+    unsigned int mCapacity    = 0;
+    unsigned int mNumElements = 0;
+    unsigned int mNumUploaded = 0; // Elements already sent to the GPU this frame
+    bool         mUseRanges;
+
+    std::vector<uint8_t> mData;           // CPU copy of the elements, mCapacity * mStride bytes
+    std::vector<int>     mObjectElements; // Element of each object this frame, -1 if none
+
+    ID3D11Buffer* mBuffer        = nullptr; // All elements, only used with ranges
+    ID3D11Buffer* mElementBuffer = nullptr; // One element, only used without ranges
+};
+
+
+#endif //_CONSTANT_UPLOAD_BUFFER_H_INCLUDED_
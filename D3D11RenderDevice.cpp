@@ -0,0 +1,237 @@
+//--------------------------------------------------------------------------------------
+// Direct3D 11 render device - passes render device calls straight on to Direct3D
+//--------------------------------------------------------------------------------------
+
+#include "D3D11RenderDevice.h"
+
+#include <cstring>
+
+
+/*-----------------------------------------------------------------------------------------
+    Render context
+-----------------------------------------------------------------------------------------*/
+
+D3D11RenderContext::D3D11RenderContext(ID3D11DeviceContext* context)
+    : mContext(context), mContext1(nullptr)
+{
+    // Fails on the original Windows 7 runtime, leaving mContext1 null
+    mContext->QueryInterface(__uuidof(ID3D11DeviceContext1), reinterpret_cast<void**>(&mContext1));
+}
+
+D3D11RenderContext::~D3D11RenderContext()
+{
+    if (mContext1)  mContext1->Release();
+}
+
+
+void D3D11RenderContext::VSSetShader(ID3D11VertexShader* shader)
+{
+    mContext->VSSetShader(shader, nullptr, 0);
+}
+
+void D3D11RenderContext::PSSetShader(ID3D11PixelShader* shader)
+{
+    mContext->PSSetShader(shader, nullptr, 0);
+}
+
+void D3D11RenderContext::VSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers)
+{
+    mContext->VSSetConstantBuffers(slot, count, buffers);
+}
+
+void D3D11RenderContext::PSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers)
+{
+    mContext->PSSetConstantBuffers(slot, count, buffers);
+}
+
+void D3D11RenderContext::VSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                                               const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+    if (mContext1)  mContext1->VSSetConstantBuffers1(slot, count, buffers, firstConstants, numConstants);
+}
+
+void D3D11RenderContext::PSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                                               const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+    if (mContext1)  mContext1->PSSetConstantBuffers1(slot, count, buffers, firstConstants, numConstants);
+}
+
+void D3D11RenderContext::PSSetShaderResources(unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views)
+{
+    mContext->PSSetShaderResources(slot, count, views);
+}
+
+void D3D11RenderContext::PSSetSamplers(unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers)
+{
+    mContext->PSSetSamplers(slot, count, samplers);
+}
+
+
+void D3D11RenderContext::OMSetBlendState(ID3D11BlendState* state)
+{
+    mContext->OMSetBlendState(state, nullptr, 0xffffff);
+}
+
+void D3D11RenderContext::OMSetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef)
+{
+    mContext->OMSetDepthStencilState(state, stencilRef);
+}
+
+void D3D11RenderContext::RSSetState(ID3D11RasterizerState* state)
+{
+    mContext->RSSetState(state);
+}
+
+
+void D3D11RenderContext::OMSetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* renderTargets,
+                                            ID3D11DepthStencilView* depthStencil)
+{
+    mContext->OMSetRenderTargets(count, renderTargets, depthStencil);
+}
+
+void D3D11RenderContext::ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const float colour[4])
+{
+    mContext->ClearRenderTargetView(renderTarget, colour);
+}
+
+void D3D11RenderContext::ClearDepthStencilView(ID3D11DepthStencilView* depthStencil, float depth)
+{
+    mContext->ClearDepthStencilView(depthStencil, D3D11_CLEAR_DEPTH, depth, 0);
+}
+
+void D3D11RenderContext::RSSetViewport(const RenderViewport& viewport)
+{
+    D3D11_VIEWPORT vp;
+    vp.TopLeftX = viewport.topLeftX;
+    vp.TopLeftY = viewport.topLeftY;
+    vp.Width    = viewport.width;
+    vp.Height   = viewport.height;
+    vp.MinDepth = viewport.minDepth;
+    vp.MaxDepth = viewport.maxDepth;
+    mContext->RSSetViewports(1, &vp);
+}
+
+
+void D3D11RenderContext::IASetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride)
+{
+    UINT offset = 0;
+    mContext->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
+}
+
+void D3D11RenderContext::IASetInputLayout(ID3D11InputLayout* layout)
+{
+    mContext->IASetInputLayout(layout);
+}
+
+void D3D11RenderContext::IASetIndexBuffer(ID3D11Buffer* buffer)
+{
+    mContext->IASetIndexBuffer(buffer, DXGI_FORMAT_R32_UINT, 0);
+}
+
+void D3D11RenderContext::IASetPrimitiveTopology(PrimitiveTopology topology)
+{
+    switch (topology)
+    {
+    case PrimitiveTopology::TriangleList:  mContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);   break;
+    case PrimitiveTopology::TriangleStrip: mContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);  break;
+    case PrimitiveTopology::LineList:      mContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST);       break;
+    case PrimitiveTopology::PointList:     mContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);      break;
+    }
+}
+
+void D3D11RenderContext::DrawIndexed(unsigned int numIndices, unsigned int startIndex, int baseVertex)
+{
+    mContext->DrawIndexed(numIndices, startIndex, baseVertex);
+}
+
+void D3D11RenderContext::DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances, unsigned int startIndex,
+                                              int baseVertex, unsigned int startInstance)
+{
+    mContext->DrawIndexedInstanced(numIndices, numInstances, startIndex, baseVertex, startInstance);
+}
+
+
+void D3D11RenderContext::UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size)
+{
+    D3D11_MAPPED_SUBRESOURCE cb;
+    if (FAILED(mContext->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &cb)))  return;
+    std::memcpy(cb.pData, data, size);
+    mContext->Unmap(buffer, 0);
+}
+
+void D3D11RenderContext::AppendConstantBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size)
+{
+    // No-overwrite promises the GPU may still be reading the earlier parts of the buffer, so they aren't disturbed
+    D3D11_MAP mapType = (offset == 0) ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+    D3D11_MAPPED_SUBRESOURCE cb;
+    if (FAILED(mContext->Map(buffer, 0, mapType, 0, &cb)))  return;
+    std::memcpy(static_cast<uint8_t*>(cb.pData) + offset, data, size);
+    mContext->Unmap(buffer, 0);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Render device
+-----------------------------------------------------------------------------------------*/
+
+D3D11RenderDevice::D3D11RenderDevice(ID3D11Device* device, ID3D11DeviceContext* context)
+    : mDevice(device), mImmediateContext(context), mConstantBufferRanges(false)
+{
+    // The 11.1 context methods exist on any 11.1 runtime, but the driver must also support constant buffer offsets
+    // and mapping constant buffers without overwriting
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+    if (mImmediateContext.HasContext1() &&
+        SUCCEEDED(mDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+    {
+        mConstantBufferRanges = (options.ConstantBufferOffsetting != FALSE && options.MapNoOverwriteOnDynamicConstantBuffer != FALSE);
+    }
+}
+
+
+// Create and return a constant buffer of the given size. Returns nullptr on failure
+ID3D11Buffer* D3D11RenderDevice::CreateConstantBuffer(unsigned int size)
+{
+    D3D11_BUFFER_DESC cbDesc;
+    cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    cbDesc.ByteWidth = 16 * ((size + 15) / 16);     // Constant buffer size must be a multiple of 16 - this maths rounds up to the nearest multiple
+    cbDesc.Usage = D3D11_USAGE_DYNAMIC;             // Indicates that the buffer is frequently updated
+    cbDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE; // CPU is only going to write to the constants (not read them)
+    cbDesc.MiscFlags = 0;
+    cbDesc.StructureByteStride = 0;
+    ID3D11Buffer* constantBuffer;
+    if (FAILED(mDevice->CreateBuffer(&cbDesc, nullptr, &constantBuffer)))  return nullptr;
+    return constantBuffer;
+}
+
+ID3D11Buffer* D3D11RenderDevice::CreateVertexBuffer(const void* data, unsigned int size)
+{
+    return CreateFixedBuffer(D3D11_BIND_VERTEX_BUFFER, data, size);
+}
+
+ID3D11Buffer* D3D11RenderDevice::CreateIndexBuffer(const void* data, unsigned int size)
+{
+    return CreateFixedBuffer(D3D11_BIND_INDEX_BUFFER, data, size);
+}
+
+void D3D11RenderDevice::ReleaseBuffer(ID3D11Buffer* buffer)
+{
+    if (buffer)  buffer->Release();
+}
+
+
+ID3D11Buffer* D3D11RenderDevice::CreateFixedBuffer(UINT bindFlags, const void* data, unsigned int size)
+{
+    D3D11_BUFFER_DESC bufferDesc;
+    bufferDesc.BindFlags = bindFlags;
+    bufferDesc.Usage = D3D11_USAGE_DEFAULT; // Content is given now and never changes
+    bufferDesc.ByteWidth = size;
+    bufferDesc.CPUAccessFlags = 0;
+    bufferDesc.MiscFlags = 0;
+    bufferDesc.StructureByteStride = 0;
+    D3D11_SUBRESOURCE_DATA initData = {};
+    initData.pSysMem = data;
+
+    ID3D11Buffer* buffer;
+    if (FAILED(mDevice->CreateBuffer(&bufferDesc, &initData, &buffer)))  return nullptr;
+    return buffer;
+}
@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// Direct3D 11 render device - passes render device calls straight on to Direct3D
+//--------------------------------------------------------------------------------------
+// See RenderDevice.h. Created by InitDirect3D once the Direct3D device exists. Binding parts of constant buffers uses
+// the Direct3D 11.1 interfaces, where the runtime and driver provide them
+
+#ifndef _D3D11_RENDER_DEVICE_H_INCLUDED_
+#define _D3D11_RENDER_DEVICE_H_INCLUDED_
+
+#include "RenderDevice.h"
+
+#include <d3d11_1.h>
+
+
+class D3D11RenderContext : public IRenderContext
+{
+public:
+    // The context is not owned. Its Direct3D 11.1 interface is used if available
+    D3D11RenderContext(ID3D11DeviceContext* context);
+    ~D3D11RenderContext();
+
+    D3D11RenderContext(const D3D11RenderContext&) = delete;
+    D3D11RenderContext& operator=(const D3D11RenderContext&) = delete;
+
+    // Whether the Direct3D 11.1 interface is available
+    bool HasContext1() const  { return mContext1 != nullptr; }
+
+
+    void VSSetShader(ID3D11VertexShader* shader) override;
+    void PSSetShader(ID3D11PixelShader*  shader) override;
+    void VSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers) override;
+    void PSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers) override;
+    void VSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                               const unsigned int* firstConstants, const unsigned int* numConstants) override;
+    void PSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                               const unsigned int* firstConstants, const unsigned int* numConstants) override;
+    void PSSetShaderResources(unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views) override;
+    void PSSetSamplers(unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers) override;
+
+    void OMSetBlendState(ID3D11BlendState* state) override;
+    void OMSetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef) override;
+    void RSSetState(ID3D11RasterizerState* state) override;
+
+    void OMSetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* renderTargets,
+                            ID3D11DepthStencilView* depthStencil) override;
+    void ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const float colour[4]) override;
+    void ClearDepthStencilView(ID3D11DepthStencilView* depthStencil, float depth) override;
+    void RSSetViewport(const RenderViewport& viewport) override;
+
+    void IASetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride) override;
+    void IASetInputLayout(ID3D11InputLayout* layout) override;
+    void IASetIndexBuffer(ID3D11Buffer* buffer) override;
+    void IASetPrimitiveTopology(PrimitiveTopology topology) override;
+    void DrawIndexed(unsigned int numIndices, unsigned int startIndex, int baseVertex) override;
+    void DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances, unsigned int startIndex,
+                              int baseVertex, unsigned int startInstance) override;
+
+    void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size) override;
+    void AppendConstantBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size) override;
+
+private:
+    ID3D11DeviceContext*  mContext;  // Not owned
+    ID3D11DeviceContext1* mContext1; // Owned, nullptr if Direct3D 11.1 isn't available
+};
+
+
+class D3D11RenderDevice : public IRenderDevice
+{
+public:
+    // The device and context are not owned, they are released by ShutdownDirect3D
+    D3D11RenderDevice(ID3D11Device* device, ID3D11DeviceContext* context);
+
+    ID3D11Buffer* CreateConstantBuffer(unsigned int size) override;
+    bool SupportsConstantBufferRanges() const override  { return mConstantBufferRanges; }
+    ID3D11Buffer* CreateVertexBuffer(const void* data, unsigned int size) override;
+    ID3D11Buffer* CreateIndexBuffer (const void* data, unsigned int size) override;
+    void ReleaseBuffer(ID3D11Buffer* buffer) override;
+
+    IRenderContext* ImmediateContext() override  { return &mImmediateContext; }
+
+private:
+    // Create a fixed buffer with the given bind flags holding a copy of the data
+    ID3D11Buffer* CreateFixedBuffer(UINT bindFlags, const void* data, unsigned int size);
+
+    ID3D11Device*      mDevice; // Not owned
+    D3D11RenderContext mImmediateContext;
+    bool               mConstantBufferRanges;
+};
+
+
+#endif //_D3D11_RENDER_DEVICE_H_INCLUDED_
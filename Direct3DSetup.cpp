@@ -5,6 +5,8 @@
 #include "Direct3DSetup.h"
 #include "Shader.h"
 #include "Common.h"
+#include "D3D11RenderDevice.h"
+#include "RenderStateCache.h"
 #include <d3d11.h>
 #include <vector>
 
@@ -63,6 +65,12 @@ bool InitDirect3D()
         return false;
     }
 
+    // Rendering code uses the device and context through the render device interface (see RenderDevice.h). Calls
+    // go through a cache that drops those that would not change anything (see RenderStateCache.h)
+    gRenderDevice     = new D3D11RenderDevice(gD3DDevice, gD3DContext);
+    gRenderStateCache = new RenderStateCache(gRenderDevice->ImmediateContext());
+    gRenderContext    = gRenderStateCache;
+
 
     // Get a "render target view" of back-buffer - standard behaviour
     ID3D11Texture2D* backBuffer;
@@ -127,6 +135,12 @@ void ShutdownDirect3D()
     // Release each Direct3D object to return resources to the system. Missing these out will cause memory
     // leaks. Check documentation to see which objects need to be released when adding new features in your
     // own projects.
+    delete gRenderStateCache;
+    delete gRenderDevice;
+    gRenderStateCache = nullptr;
+    gRenderDevice     = nullptr;
+    gRenderContext    = nullptr;
+
     if (gD3DContext)
     {
         gD3DContext->ClearState(); // This line is also needed to reset the GPU before shutting down DirectX
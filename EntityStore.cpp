@@ -0,0 +1,287 @@
+//--------------------------------------------------------------------------------------
+// Data-oriented storage for large numbers of simple scene objects
+//--------------------------------------------------------------------------------------
+// Each part of every entity is held in its own packed array, see header for details
+
+#include "EntityStore.h"
+
+#include "Mesh.h"
+#include "RenderQueue.h"
+#include "Texture.h"
+#include "TransformBatch.h"
+
+#include <algorithm>
+
+
+/*-----------------------------------------------------------------------------------------
+    Creation / destruction
+-----------------------------------------------------------------------------------------*/
+
+// Add an entity using the given mesh and texture. Returns a handle to access it later
+EntityHandle EntityStore::Create(Mesh* mesh, Texture* texture, CVector3 position, CVector3 rotation, float scale)
+{
+    return Create(mesh, texture, position, QuaternionFromEuler(rotation), scale);
+}
+
+EntityHandle EntityStore::Create(Mesh* mesh, Texture* texture, CVector3 position, CQuaternion orientation, float scale)
+{
+    // Reuse a slot from a destroyed entity if possible, its generation has already been moved on
+    uint32_t slot;
+    if (!mFreeSlots.empty())
+    {
+        slot = mFreeSlots.back();
+        mFreeSlots.pop_back();
+    }
+    else
+    {
+        slot = static_cast<uint32_t>(mSlotIndexes.size());
+        mSlotIndexes.push_back(0);
+        mSlotGenerations.push_back(1);
+    }
+    int index = NumEntities();
+    mSlotIndexes[slot] = static_cast<uint32_t>(index);
+
+    int bucket = FindBucket(mesh);
+    if (bucket < 0)
+    {
+        bucket = static_cast<int>(mMeshBuckets.size());
+        mMeshBuckets.push_back({ mesh, {} });
+    }
+    mBucketPositions.push_back(static_cast<int>(mMeshBuckets[bucket].entities.size()));
+    mMeshBuckets[bucket].entities.push_back(index);
+
+    mPositionX.push_back(position.x);     mPositionY.push_back(position.y);     mPositionZ.push_back(position.z);
+    mRotationX.push_back(orientation.x);  mRotationY.push_back(orientation.y);  mRotationZ.push_back(orientation.z);
+    mRotationW.push_back(orientation.w);
+    mScaleX.push_back(scale);             mScaleY.push_back(scale);             mScaleZ.push_back(scale);
+
+    mWorldMatrices.push_back(AffineIdentity());
+    mLocalBounds.push_back(SphereFromBox(mesh->Bounds()));
+    mWorldBounds.push_back(mLocalBounds.back());
+    mMeshes.push_back(mesh);
+    mTextures.push_back(texture);
+    mDirty.push_back(1);
+    mSlots.push_back(slot);
+    mAnyDirty = true;
+
+    return { slot, mSlotGenerations[slot] };
+}
+
+
+// Make space for the given total number of entities
+void EntityStore::Reserve(int numEntities)
+{
+    auto reserve = [numEntities](auto& array) { array.reserve(numEntities); };
+    reserve(mPositionX);  reserve(mPositionY);  reserve(mPositionZ);
+    reserve(mRotationX);  reserve(mRotationY);  reserve(mRotationZ);  reserve(mRotationW);
+    reserve(mScaleX);     reserve(mScaleY);     reserve(mScaleZ);
+    reserve(mWorldMatrices);
+    reserve(mLocalBounds);
+    reserve(mWorldBounds);
+    reserve(mMeshes);
+    reserve(mTextures);
+    reserve(mDirty);
+    reserve(mSlots);
+    reserve(mBucketPositions);
+    reserve(mSlotIndexes);
+    reserve(mSlotGenerations);
+}
+
+
+// Remove an entity. The last entity in the arrays is moved into its place to keep them packed
+void EntityStore::Destroy(EntityHandle entity)
+{
+    if (!IsValid(entity))  return;
+
+    int index = Index(entity);
+
+    // Take the entity out of its mesh's bucket, filling the gap with the last entity in the bucket. Then point the
+    // bucket entry of the last entity in the arrays at the position it is about to be moved to
+    std::vector<int>& bucket = mMeshBuckets[FindBucket(mMeshes[index])].entities;
+    mBucketPositions[bucket.back()] = mBucketPositions[index];
+    bucket[mBucketPositions[index]] = bucket.back();
+    bucket.pop_back();
+    int last = NumEntities() - 1;
+    if (index != last)  mMeshBuckets[FindBucket(mMeshes[last])].entities[mBucketPositions[last]] = index;
+
+    auto moveLast = [index](auto& array) { array[index] = array.back();  array.pop_back(); };
+    moveLast(mPositionX);  moveLast(mPositionY);  moveLast(mPositionZ);
+    moveLast(mRotationX);  moveLast(mRotationY);  moveLast(mRotationZ);  moveLast(mRotationW);
+    moveLast(mScaleX);     moveLast(mScaleY);     moveLast(mScaleZ);
+    moveLast(mWorldMatrices);
+    moveLast(mLocalBounds);
+    moveLast(mWorldBounds);
+    moveLast(mMeshes);
+    moveLast(mTextures);
+    moveLast(mDirty);
+    moveLast(mSlots);
+    moveLast(mBucketPositions);
+
+    // Point the moved entity's slot at its new position (unless the removed entity was the last one) and list it as
+    // moved, since its bounds are now at that position. Anything listed at the old last position is gone
+    if (index < NumEntities())
+    {
+        mSlotIndexes[mSlots[index]] = index;
+        mMoved.push_back(index);
+    }
+    mMoved.erase(std::remove(mMoved.begin(), mMoved.end(), NumEntities()), mMoved.end());
+
+    ++mSlotGenerations[entity.slot];
+    if (mSlotGenerations[entity.slot] == 0)  mSlotGenerations[entity.slot] = 1; // Generation 0 is reserved for null handles
+    mFreeSlots.push_back(entity.slot);
+}
+
+
+// Remove all entities, all handles become invalid. The arrays are emptied in one go rather than destroying entities
+// one at a time, only the slots need visiting to move their generations on
+void EntityStore::Clear()
+{
+    for (uint32_t slot : mSlots)
+    {
+        ++mSlotGenerations[slot];
+        if (mSlotGenerations[slot] == 0)  mSlotGenerations[slot] = 1; // Generation 0 is reserved for null handles
+        mFreeSlots.push_back(slot);
+    }
+
+    auto clear = [](auto& array) { array.clear(); };
+    clear(mPositionX);  clear(mPositionY);  clear(mPositionZ);
+    clear(mRotationX);  clear(mRotationY);  clear(mRotationZ);  clear(mRotationW);
+    clear(mScaleX);     clear(mScaleY);     clear(mScaleZ);
+    clear(mWorldMatrices);
+    clear(mLocalBounds);
+    clear(mWorldBounds);
+    clear(mMeshes);
+    clear(mTextures);
+    clear(mDirty);
+    clear(mSlots);
+    clear(mBucketPositions);
+    clear(mMoved);
+    clear(mMeshBuckets); // The meshes may be about to be deleted
+    mAnyDirty = false;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Update and rendering
+-----------------------------------------------------------------------------------------*/
+
+// Rebuild the world matrices and world space bounds of all entities that have moved since the last update
+// Entities are checked in blocks and each block with any change is rebuilt as a whole with SIMD - moving entities
+// tend to be created together so are usually in the same blocks
+bool EntityStore::UpdateWorldMatrices()
+{
+    if (!mAnyDirty)  return false;
+
+    const int BlockSize = 64;
+    for (int blockStart = 0; blockStart < NumEntities(); blockStart += BlockSize)
+    {
+        int blockCount = std::min(BlockSize, NumEntities() - blockStart);
+        uint8_t* dirty = mDirty.data() + blockStart;
+        if (std::find(dirty, dirty + blockCount, 1) == dirty + blockCount)  continue;
+
+        QuaternionTransformArrays arrays = { &mPositionX[blockStart], &mPositionY[blockStart], &mPositionZ[blockStart],
+                                             &mRotationX[blockStart], &mRotationY[blockStart], &mRotationZ[blockStart],
+                                             &mRotationW[blockStart],
+                                             &mScaleX   [blockStart], &mScaleY   [blockStart], &mScaleZ   [blockStart] };
+        BuildWorldMatrices(arrays, blockCount, &mWorldMatrices[blockStart]);
+
+        for (int i = blockStart; i < blockStart + blockCount; ++i)
+        {
+            mWorldBounds[i] = TransformSphere(mLocalBounds[i], mWorldMatrices[i]);
+            if (mDirty[i])  mMoved.push_back(i);
+        }
+        std::fill(dirty, dirty + blockCount, 0);
+    }
+    mAnyDirty = false;
+    return true;
+}
+
+
+// Submit entities using the given mesh (or all entities) to a render queue, optionally only those marked visible
+void EntityStore::Submit(RenderQueue& queue, int material, const Mesh* mesh, bool useMaterials,
+                         const uint32_t* visibleBits, int firstObject) const
+{
+    // Entities sharing a texture are usually created together, so only look up the material when the texture changes
+    const Texture* currentTexture  = nullptr;
+    int            currentMaterial = material;
+    auto submitEntity = [&](int i)
+    {
+        if (visibleBits != nullptr && (visibleBits[i / 32] & (1u << (i % 32))) == 0)  return;
+
+        if (useMaterials && mTextures[i] != nullptr && mTextures[i] != currentTexture)
+        {
+            currentTexture  = mTextures[i];
+            currentMaterial = queue.Materials().WithTexture(material, mTextures[i]->GetDiffuseSpecularMapSRV());
+        }
+
+        queue.Submit(currentMaterial, mMeshes[i]->Geometry(), mWorldMatrices[i], { 1, 1, 1 }, 0, (firstObject >= 0) ? firstObject + i : -1);
+    };
+
+    if (mesh == nullptr)
+    {
+        for (int i = 0; i < NumEntities(); ++i)  submitEntity(i);
+    }
+    else
+    {
+        int bucket = FindBucket(mesh);
+        if (bucket < 0)  return;
+        for (int i : mMeshBuckets[bucket].entities)  submitEntity(i);
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Data access
+-----------------------------------------------------------------------------------------*/
+
+int EntityStore::FindBucket(const Mesh* mesh) const
+{
+    for (size_t bucket = 0; bucket < mMeshBuckets.size(); ++bucket)
+    {
+        if (mMeshBuckets[bucket].mesh == mesh)  return static_cast<int>(bucket);
+    }
+    return -1;
+}
+
+bool EntityStore::IsValid(EntityHandle entity) const
+{
+    return entity.generation != 0 && entity.slot < mSlotGenerations.size() && mSlotGenerations[entity.slot] == entity.generation;
+}
+
+CVector3 EntityStore::Position(EntityHandle entity) const
+{
+    int index = Index(entity);
+    return { mPositionX[index], mPositionY[index], mPositionZ[index] };
+}
+
+void EntityStore::SetPosition(EntityHandle entity, CVector3 position)
+{
+    int index = Index(entity);
+    mPositionX[index] = position.x;  mPositionY[index] = position.y;  mPositionZ[index] = position.z;
+    MarkDirty(index);
+}
+
+void EntityStore::SetOrientation(EntityHandle entity, CQuaternion orientation)
+{
+    int index = Index(entity);
+    mRotationX[index] = orientation.x;  mRotationY[index] = orientation.y;  mRotationZ[index] = orientation.z;
+    mRotationW[index] = orientation.w;
+    MarkDirty(index);
+}
+
+void EntityStore::SetRotation(EntityHandle entity, CVector3 rotation)
+{
+    SetOrientation(entity, QuaternionFromEuler(rotation));
+}
+
+void EntityStore::SetScale(EntityHandle entity, float scale)
+{
+    int index = Index(entity);
+    mScaleX[index] = scale;  mScaleY[index] = scale;  mScaleZ[index] = scale;
+    MarkDirty(index);
+}
+
+const CMatrix3x4& EntityStore::WorldMatrix(EntityHandle entity) const
+{
+    return mWorldMatrices[Index(entity)];
+}
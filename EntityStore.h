@@ -0,0 +1,143 @@
+//--------------------------------------------------------------------------------------
+// Data-oriented storage for large numbers of simple scene objects
+//--------------------------------------------------------------------------------------
+// An alternative to the Model class for crowds of objects (rows of tanks, armies of sprites, forests). Rather than
+// each object being a separate allocation reached through a pointer, each part of every object (position, rotation,
+// world matrix, mesh, texture, bounds...) is held in its own tightly packed array, so updating, culling and rendering
+// are straight passes through memory. Positions, rotations and scales are stored structure-of-arrays style so world
+// matrices are built directly from them with BuildWorldMatrices (TransformBatch.h).
+//
+// Objects ("entities") are referred to by handles. Removing an entity moves the last entity into its place to keep
+// the arrays packed, but handles stay valid. Each handle carries a generation number so a handle to a removed entity
+// is detected even if its slot has been reused.
+
+#include "Common.h"
+#include "CVector3.h"
+#include "CMatrix3x4.h"
+#include "CQuaternion.h"
+#include "Bounds.h"
+
+#include <vector>
+#include <cstdint>
+
+#ifndef _ENTITY_STORE_H_INCLUDED_
+#define _ENTITY_STORE_H_INCLUDED_
+
+class Mesh;
+class Texture;
+class RenderQueue;
+
+
+// Handle to an entity in an EntityStore. A default constructed handle refers to no entity
+struct EntityHandle
+{
+    uint32_t slot       = 0;
+    uint32_t generation = 0; // Generation 0 is never used by a live entity
+};
+
+
+class EntityStore
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+    // Add an entity using the given mesh and texture (texture may be nullptr if the entity is always rendered with
+    // the current texture). Returns a handle to access it later
+    EntityHandle Create(Mesh* mesh, Texture* texture, CVector3 position = { 0,0,0 }, CVector3 rotation = { 0,0,0 }, float scale = 1);
+    EntityHandle Create(Mesh* mesh, Texture* texture, CVector3 position, CQuaternion orientation, float scale);
+
+    // Make space for the given total number of entities, to avoid repeated reallocation when creating many at once
+    void Reserve(int numEntities);
+
+    // Remove an entity. Its handle (and any copies) become invalid, does nothing if the handle is already invalid
+    void Destroy(EntityHandle entity);
+
+    // Remove all entities, all handles become invalid
+    void Clear();
+
+    // Rebuild the world matrices and world space bounds of all entities that have moved since the last update.
+    // Call once per frame after moving entities and before culling or rendering. Returns true if any had moved
+    bool UpdateWorldMatrices();
+
+    // Submit entities using the given mesh, or all entities if mesh is nullptr, to a render queue, optionally only
+    // those marked in a bit array (bit (i % 32) of visibleBits[i / 32] set if the entity in position i of the arrays
+    // is visible). Entities are rendered with the given material, or if useMaterials is true a copy of it with each
+    // entity's texture in slot 0 (see RenderMaterials::WithTexture). If firstObject is given entity i is submitted as
+    // object firstObject + i so passes share its constants (see RenderQueue::Submit)
+    void Submit(RenderQueue& queue, int material, const Mesh* mesh = nullptr, bool useMaterials = false,
+                const uint32_t* visibleBits = nullptr, int firstObject = -1) const;
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+    int  NumEntities() const  { return static_cast<int>(mMeshes.size()); }
+    bool IsValid(EntityHandle entity) const;
+
+    // Getters / setters for individual entities - the handle must be valid
+    CVector3 Position(EntityHandle entity) const;
+    void SetPosition   (EntityHandle entity, CVector3 position);
+    void SetOrientation(EntityHandle entity, CQuaternion orientation);
+    void SetRotation   (EntityHandle entity, CVector3 rotation);
+    void SetScale      (EntityHandle entity, float scale);
+
+    // World matrix as of the last UpdateWorldMatrices
+    const CMatrix3x4& WorldMatrix(EntityHandle entity) const;
+
+    // World space bounds of every entity as of the last UpdateWorldMatrices, in array order (as the bits for Submit)
+    const BoundingSphere* WorldBounds() const  { return mWorldBounds.data(); }
+
+    // Positions in the arrays of the entities whose bounds UpdateWorldMatrices has changed since the list was last
+    // cleared, so structures tracking the entities only need to update those that moved. An entity updated more than
+    // once may be listed more than once. Destroy lists the entity it moves into the removed entity's position
+    const std::vector<int>& MovedEntities() const  { return mMoved; }
+    void ClearMovedEntities()  { mMoved.clear(); }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+    int  Index(EntityHandle entity) const  { return static_cast<int>(mSlotIndexes[entity.slot]); }
+    void MarkDirty(int index)  { mDirty[index] = 1;  mAnyDirty = true; }
+
+    // Position in mMeshBuckets of the given mesh's entities, -1 if no entity has used it
+    int FindBucket(const Mesh* mesh) const;
+
+    // Entity data, one element per entity. Positions, rotations (quaternions) and scales are split into components
+    std::vector<float> mPositionX, mPositionY, mPositionZ;
+    std::vector<float> mRotationX, mRotationY, mRotationZ, mRotationW;
+    std::vector<float> mScaleX,    mScaleY,    mScaleZ;
+
+    std::vector<CMatrix3x4>     mWorldMatrices;
+    std::vector<BoundingSphere> mLocalBounds;   // From the mesh, in model space
+    std::vector<BoundingSphere> mWorldBounds;   // Updated along with the world matrix
+    std::vector<Mesh*>          mMeshes;
+    std::vector<Texture*>       mTextures;
+    std::vector<uint8_t>        mDirty;         // Non-zero if the world matrix needs rebuilding
+    std::vector<uint32_t>       mSlots;         // Slot of the handle that refers to each entity
+    std::vector<int>            mMoved;         // See MovedEntities
+    std::vector<int>            mBucketPositions; // Position of each entity in its mesh's bucket below
+    bool mAnyDirty = false;
+
+    // Positions in the arrays above of the entities using each mesh, in no particular order, so Submit only visits
+    // the entities of the mesh asked for. There are few meshes, so buckets are found by searching the list
+    struct MeshBucket
+    {
+        const Mesh*      mesh;
+        std::vector<int> entities;
+    };
+    std::vector<MeshBucket> mMeshBuckets;
+
+    // Handle slots. Each holds the current position of its entity in the arrays above and a generation number,
+    // which is incremented when the entity is destroyed to invalidate existing handles
+    std::vector<uint32_t> mSlotIndexes;
+    std::vector<uint32_t> mSlotGenerations;
+    std::vector<uint32_t> mFreeSlots;
+};
+
+
+#endif //_ENTITY_STORE_H_INCLUDED_
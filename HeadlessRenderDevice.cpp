@@ -0,0 +1,415 @@
+//--------------------------------------------------------------------------------------
+// Headless render device - checks and records render device calls without a GPU
+//--------------------------------------------------------------------------------------
+
+#include "HeadlessRenderDevice.h"
+
+#include <cstring>
+
+
+// Only keep messages for the first few mistakes, the same mistake is usually repeated every frame
+static const int MAX_ERROR_MESSAGES = 20;
+
+
+/*-----------------------------------------------------------------------------------------
+    Construction / destruction
+-----------------------------------------------------------------------------------------*/
+
+HeadlessRenderDevice::HeadlessRenderDevice(bool recordCommands, bool constantBufferRanges)
+    : mRecordCommands(recordCommands), mConstantBufferRanges(constantBufferRanges)
+{
+}
+
+HeadlessRenderDevice::~HeadlessRenderDevice()
+{
+    for (Buffer* buffer : mBuffers)  delete buffer;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Device
+-----------------------------------------------------------------------------------------*/
+
+ID3D11Buffer* HeadlessRenderDevice::CreateConstantBuffer(unsigned int size)
+{
+    return reinterpret_cast<ID3D11Buffer*>(CreateBuffer(BufferType::Constant, nullptr, 16 * ((size + 15) / 16)));
+}
+
+ID3D11Buffer* HeadlessRenderDevice::CreateVertexBuffer(const void* data, unsigned int size)
+{
+    return reinterpret_cast<ID3D11Buffer*>(CreateBuffer(BufferType::Vertex, data, size));
+}
+
+ID3D11Buffer* HeadlessRenderDevice::CreateIndexBuffer(const void* data, unsigned int size)
+{
+    return reinterpret_cast<ID3D11Buffer*>(CreateBuffer(BufferType::Index, data, size));
+}
+
+void HeadlessRenderDevice::ReleaseBuffer(ID3D11Buffer* handle)
+{
+    if (handle == nullptr)  return;
+    Buffer* buffer = reinterpret_cast<Buffer*>(handle);
+    if (mBuffers.erase(buffer) == 0)
+    {
+        Error("ReleaseBuffer: not a live buffer (released twice?)");
+        return;
+    }
+
+    // Direct3D keeps bound buffers alive, but there is no need to imitate that - drawing with a buffer the program
+    // has released is a mistake anyway
+    if (mVertexBuffer == buffer)  mVertexBuffer = nullptr;
+    if (mIndexBuffer  == buffer)  mIndexBuffer  = nullptr;
+    delete buffer;
+}
+
+
+// Only constant buffers keep their data, vertex and index buffers just need their size for checks
+HeadlessRenderDevice::Buffer* HeadlessRenderDevice::CreateBuffer(BufferType type, const void* data, unsigned int size)
+{
+    if (size == 0)
+    {
+        Error("Create buffer: size is zero");
+        return nullptr;
+    }
+    if (type != BufferType::Constant && data == nullptr)
+    {
+        Error("Create buffer: fixed buffer created without data");
+        return nullptr;
+    }
+
+    Buffer* buffer = new Buffer{ type, size, {} };
+    if (type == BufferType::Constant)  buffer->data.resize(size);
+    mBuffers.insert(buffer);
+    return buffer;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Shaders and their resources
+-----------------------------------------------------------------------------------------*/
+
+void HeadlessRenderDevice::VSSetShader(ID3D11VertexShader* shader)
+{
+    Record(RenderCall::VSSetShader, shader);
+    mVertexShader = shader;
+}
+
+void HeadlessRenderDevice::PSSetShader(ID3D11PixelShader* shader)
+{
+    Record(RenderCall::PSSetShader, shader); // Null is fine, e.g. for depth-only rendering
+}
+
+void HeadlessRenderDevice::VSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers)
+{
+    CheckConstantBuffers(RenderCall::VSSetConstantBuffers, slot, count, buffers);
+}
+
+void HeadlessRenderDevice::PSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers)
+{
+    CheckConstantBuffers(RenderCall::PSSetConstantBuffers, slot, count, buffers);
+}
+
+void HeadlessRenderDevice::VSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                                                 const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+    CheckConstantBuffers(RenderCall::VSSetConstantBuffers1, slot, count, buffers, firstConstants, numConstants);
+}
+
+void HeadlessRenderDevice::PSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                                                 const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+    CheckConstantBuffers(RenderCall::PSSetConstantBuffers1, slot, count, buffers, firstConstants, numConstants);
+}
+
+void HeadlessRenderDevice::PSSetShaderResources(unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views)
+{
+    Record(RenderCall::PSSetShaderResources, count > 0 ? views[0] : nullptr, slot, count);
+    CheckSlots(RenderCall::PSSetShaderResources, slot, count, MAX_TEXTURE_SLOTS);
+}
+
+void HeadlessRenderDevice::PSSetSamplers(unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers)
+{
+    Record(RenderCall::PSSetSamplers, count > 0 ? samplers[0] : nullptr, slot, count);
+    CheckSlots(RenderCall::PSSetSamplers, slot, count, MAX_SAMPLER_SLOTS);
+}
+
+
+void HeadlessRenderDevice::CheckConstantBuffers(RenderCall call, unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                                                const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+    Record(call, count > 0 ? buffers[0] : nullptr, slot, count);
+    if (!CheckSlots(call, slot, count, MAX_CONSTANT_BUFFER_SLOTS))  return;
+
+    const std::string callName = RenderCallName(call);
+    bool ranges = (firstConstants != nullptr || numConstants != nullptr);
+    if (ranges && !mConstantBufferRanges)
+    {
+        Error(callName + ": constant buffer ranges not supported");
+        return;
+    }
+    if (ranges && (firstConstants == nullptr || numConstants == nullptr))
+    {
+        Error(callName + ": first and number of constants must both be given");
+        return;
+    }
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        Buffer* buffer = FindBuffer(buffers[i], BufferType::Constant, callName.c_str());
+        if (buffer == nullptr || !ranges)  continue;
+
+        unsigned int first = firstConstants[i];
+        unsigned int num   = numConstants[i];
+        if (first % CONSTANT_BUFFER_RANGE_ALIGNMENT != 0 || num % CONSTANT_BUFFER_RANGE_ALIGNMENT != 0)
+        {
+            Error(callName + ": constant buffer range not a multiple of 16 constants");
+        }
+        else if (num == 0 || num > MAX_CONSTANT_BUFFER_RANGE)
+        {
+            Error(callName + ": constant buffer range must be 16 to 4096 constants");
+        }
+        else if (first > buffer->size / 16 || num > buffer->size / 16 - first)
+        {
+            Error(callName + ": constant buffer range past the end of the buffer");
+        }
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Fixed function states
+-----------------------------------------------------------------------------------------*/
+
+void HeadlessRenderDevice::OMSetBlendState(ID3D11BlendState* state)
+{
+    Record(RenderCall::OMSetBlendState, state);
+}
+
+void HeadlessRenderDevice::OMSetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef)
+{
+    Record(RenderCall::OMSetDepthStencilState, state, stencilRef);
+}
+
+void HeadlessRenderDevice::RSSetState(ID3D11RasterizerState* state)
+{
+    Record(RenderCall::RSSetState, state);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Render targets
+-----------------------------------------------------------------------------------------*/
+
+void HeadlessRenderDevice::OMSetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* renderTargets,
+                                              ID3D11DepthStencilView* depthStencil)
+{
+    Record(RenderCall::OMSetRenderTargets, count > 0 ? static_cast<const void*>(renderTargets[0]) : depthStencil, count);
+    if (count > MAX_RENDER_TARGETS)  Error("OMSetRenderTargets: too many render targets");
+    mTargetSet = (count > 0 && renderTargets[0] != nullptr) || depthStencil != nullptr;
+}
+
+void HeadlessRenderDevice::ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const float colour[4])
+{
+    Record(RenderCall::ClearRenderTargetView, renderTarget);
+    if (renderTarget == nullptr || colour == nullptr)  Error("ClearRenderTargetView: null render target or colour");
+}
+
+void HeadlessRenderDevice::ClearDepthStencilView(ID3D11DepthStencilView* depthStencil, float depth)
+{
+    Record(RenderCall::ClearDepthStencilView, depthStencil);
+    if (depthStencil == nullptr)  Error("ClearDepthStencilView: null depth buffer");
+    if (depth < 0 || depth > 1)   Error("ClearDepthStencilView: depth outside 0 to 1");
+}
+
+void HeadlessRenderDevice::RSSetViewport(const RenderViewport& viewport)
+{
+    Record(RenderCall::RSSetViewport);
+    if (viewport.width <= 0 || viewport.height <= 0)  Error("RSSetViewport: empty viewport");
+    mViewportSet = true;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Geometry and drawing
+-----------------------------------------------------------------------------------------*/
+
+void HeadlessRenderDevice::IASetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride)
+{
+    Record(RenderCall::IASetVertexBuffer, buffer, stride);
+    mVertexBuffer = FindBuffer(buffer, BufferType::Vertex, "IASetVertexBuffer");
+    if (mVertexBuffer != nullptr && (stride == 0 || mVertexBuffer->size % stride != 0))
+    {
+        Error("IASetVertexBuffer: buffer size is not a multiple of the vertex stride");
+    }
+}
+
+void HeadlessRenderDevice::IASetInputLayout(ID3D11InputLayout* layout)
+{
+    Record(RenderCall::IASetInputLayout, layout);
+    mInputLayout = layout;
+}
+
+void HeadlessRenderDevice::IASetIndexBuffer(ID3D11Buffer* buffer)
+{
+    Record(RenderCall::IASetIndexBuffer, buffer);
+    mIndexBuffer = FindBuffer(buffer, BufferType::Index, "IASetIndexBuffer");
+}
+
+void HeadlessRenderDevice::IASetPrimitiveTopology(PrimitiveTopology topology)
+{
+    Record(RenderCall::IASetPrimitiveTopology, nullptr, static_cast<unsigned int>(topology));
+    mTopologySet = true;
+}
+
+void HeadlessRenderDevice::DrawIndexed(unsigned int numIndices, unsigned int startIndex, int /*baseVertex*/)
+{
+    Record(RenderCall::DrawIndexed, nullptr, numIndices, startIndex);
+    mNumIndicesDrawn += numIndices;
+    CheckDraw("DrawIndexed", numIndices, startIndex);
+}
+
+void HeadlessRenderDevice::DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances, unsigned int startIndex,
+                                                int /*baseVertex*/, unsigned int /*startInstance*/)
+{
+    Record(RenderCall::DrawIndexedInstanced, nullptr, numIndices, numInstances);
+    mNumIndicesDrawn += static_cast<long long>(numIndices) * numInstances;
+    CheckDraw("DrawIndexedInstanced", numIndices, startIndex);
+}
+
+void HeadlessRenderDevice::CheckDraw(const std::string& callName, unsigned int numIndices, unsigned int startIndex)
+{
+    if (mVertexShader == nullptr)  Error(callName + ": no vertex shader");
+    if (mInputLayout  == nullptr)  Error(callName + ": no input layout");
+    if (mVertexBuffer == nullptr)  Error(callName + ": no vertex buffer");
+    if (mIndexBuffer  == nullptr)  Error(callName + ": no index buffer");
+    if (!mTopologySet)             Error(callName + ": no primitive topology");
+    if (!mTargetSet)               Error(callName + ": no render target or depth buffer");
+    if (!mViewportSet)             Error(callName + ": no viewport");
+    if (mIndexBuffer != nullptr && (static_cast<unsigned long long>(startIndex) + numIndices) * 4 > mIndexBuffer->size)
+    {
+        Error(callName + ": indices past the end of the index buffer");
+    }
+}
+
+
+void HeadlessRenderDevice::UpdateConstantBuffer(ID3D11Buffer* handle, const void* data, unsigned int size)
+{
+    Record(RenderCall::UpdateConstantBuffer, handle, size);
+    mNumConstantBytes += size;
+
+    if (handle == nullptr)
+    {
+        Error("UpdateConstantBuffer: null buffer");
+        return;
+    }
+    Buffer* buffer = FindBuffer(handle, BufferType::Constant, "UpdateConstantBuffer");
+    if (buffer == nullptr)  return;
+    if (size > buffer->size)
+    {
+        Error("UpdateConstantBuffer: data larger than buffer");
+        return;
+    }
+    std::memcpy(buffer->data.data(), data, size);
+    buffer->appendEnd = size;
+}
+
+void HeadlessRenderDevice::AppendConstantBuffer(ID3D11Buffer* handle, unsigned int offset, const void* data, unsigned int size)
+{
+    Record(RenderCall::AppendConstantBuffer, handle, offset, size);
+    mNumConstantBytes += size;
+
+    if (!mConstantBufferRanges)
+    {
+        Error("AppendConstantBuffer: not supported");
+        return;
+    }
+    if (handle == nullptr)
+    {
+        Error("AppendConstantBuffer: null buffer");
+        return;
+    }
+    Buffer* buffer = FindBuffer(handle, BufferType::Constant, "AppendConstantBuffer");
+    if (buffer == nullptr)  return;
+    if (offset > buffer->size || size > buffer->size - offset)
+    {
+        Error("AppendConstantBuffer: data past the end of the buffer");
+        return;
+    }
+    if (offset != 0 && offset < buffer->appendEnd)
+    {
+        Error("AppendConstantBuffer: overwrites constants that may be in use");
+        return;
+    }
+    std::memcpy(buffer->data.data() + offset, data, size);
+    buffer->appendEnd = offset + size;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Results
+-----------------------------------------------------------------------------------------*/
+
+long long HeadlessRenderDevice::NumCalls() const
+{
+    long long total = 0;
+    for (long long count : mCallCounts)  total += count;
+    return total;
+}
+
+void HeadlessRenderDevice::ResetResults()
+{
+    for (long long& count : mCallCounts)  count = 0;
+    mNumIndicesDrawn  = 0;
+    mNumConstantBytes = 0;
+    mCommands.clear();
+    mNumErrors = 0;
+    mErrorMessages.clear();
+}
+
+const void* HeadlessRenderDevice::ConstantBufferData(ID3D11Buffer* handle) const
+{
+    Buffer* buffer = reinterpret_cast<Buffer*>(handle);
+    if (mBuffers.count(buffer) == 0 || buffer->type != BufferType::Constant)  return nullptr;
+    return buffer->data.data();
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Private functions
+-----------------------------------------------------------------------------------------*/
+
+HeadlessRenderDevice::Buffer* HeadlessRenderDevice::FindBuffer(ID3D11Buffer* handle, BufferType type, const char* callName)
+{
+    if (handle == nullptr)  return nullptr;
+    Buffer* buffer = reinterpret_cast<Buffer*>(handle);
+    if (mBuffers.count(buffer) == 0)
+    {
+        Error(std::string(callName) + ": not a live buffer");
+        return nullptr;
+    }
+    if (buffer->type != type)
+    {
+        Error(std::string(callName) + ": wrong kind of buffer");
+        return nullptr;
+    }
+    return buffer;
+}
+
+bool HeadlessRenderDevice::CheckSlots(RenderCall call, unsigned int slot, unsigned int count, unsigned int maxSlots)
+{
+    if (slot < maxSlots && count <= maxSlots - slot)  return true;
+    Error(std::string(RenderCallName(call)) + ": slots out of range");
+    return false;
+}
+
+void HeadlessRenderDevice::Record(RenderCall call, const void* object, unsigned int a, unsigned int b)
+{
+    ++mCallCounts[static_cast<int>(call)];
+    if (mRecordCommands)  mCommands.push_back({ call, object, a, b });
+}
+
+void HeadlessRenderDevice::Error(const std::string& message)
+{
+    ++mNumErrors;
+    if (mErrorMessages.size() < MAX_ERROR_MESSAGES)  mErrorMessages.push_back(message);
+}
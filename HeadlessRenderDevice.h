@@ -0,0 +1,182 @@
+//--------------------------------------------------------------------------------------
+// Headless render device - checks and records render device calls without a GPU
+//--------------------------------------------------------------------------------------
+// Implements both the device and its context (see RenderDevice.h) with no graphics API at all, so builds and runs on
+// any platform. Used to run the CPU side of rendering in benchmarks and checks:
+// - Every call is counted, and optionally recorded in order as a list of commands
+// - Calls are checked for mistakes Direct3D would quietly ignore or the debug layer would report: slots out of
+//   range, wrong kinds of buffer, updating a released or unknown buffer, drawing without a vertex shader, input
+//   layout, buffers, topology, render target or viewport set, reading past the end of the index buffer, or binding
+//   misaligned or out of range parts of constant buffers, or appending over constants already written. Mistakes are
+//   counted and the first few are kept as messages
+// - Buffers are real (constant buffer content is copied on update, as Direct3D would), but shaders, states, textures
+//   and render targets are just handles made by CreateHandle, which are never dereferenced
+
+#ifndef _HEADLESS_RENDER_DEVICE_H_INCLUDED_
+#define _HEADLESS_RENDER_DEVICE_H_INCLUDED_
+
+#include "RenderDevice.h"
+
+#include <vector>
+#include <string>
+#include <unordered_set>
+#include <cstdint>
+
+
+// A recorded call. Object is the (first) object passed, the meaning of a and b depends on the call: slot and count
+// for arrays of objects, number of indices and start index for draws (number of indices and instances for instanced
+// draws), size for constant buffer updates (offset and size for appends)
+struct RenderCommand
+{
+    RenderCall   call;
+    const void*  object;
+    unsigned int a;
+    unsigned int b;
+};
+
+
+class HeadlessRenderDevice : public IRenderDevice, public IRenderContext
+{
+public:
+
+    // Construction / destruction //
+
+    // Pass true to record every call as a RenderCommand, otherwise calls are only counted and checked. The device can
+    // claim not to support binding parts of constant buffers, to exercise code that must work without them
+    HeadlessRenderDevice(bool recordCommands = false, bool constantBufferRanges = true);
+    ~HeadlessRenderDevice();
+
+    HeadlessRenderDevice(const HeadlessRenderDevice&) = delete;
+    HeadlessRenderDevice& operator=(const HeadlessRenderDevice&) = delete;
+
+    // Make a unique handle to stand in for a Direct3D object this device doesn't create (shaders, states, textures
+    // etc.), e.g. CreateHandle<ID3D11PixelShader>(). Handles need no releasing
+    template <class T>
+    T* CreateHandle()  { return reinterpret_cast<T*>(++mNextHandle * 16); }
+
+
+    // IRenderDevice //
+
+    ID3D11Buffer* CreateConstantBuffer(unsigned int size) override;
+    bool SupportsConstantBufferRanges() const override  { return mConstantBufferRanges; }
+    ID3D11Buffer* CreateVertexBuffer(const void* data, unsigned int size) override;
+    ID3D11Buffer* CreateIndexBuffer (const void* data, unsigned int size) override;
+    void ReleaseBuffer(ID3D11Buffer* buffer) override;
+
+    IRenderContext* ImmediateContext() override  { return this; }
+
+
+    // IRenderContext //
+
+    void VSSetShader(ID3D11VertexShader* shader) override;
+    void PSSetShader(ID3D11PixelShader*  shader) override;
+    void VSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers) override;
+    void PSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers) override;
+    void VSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                               const unsigned int* firstConstants, const unsigned int* numConstants) override;
+    void PSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                               const unsigned int* firstConstants, const unsigned int* numConstants) override;
+    void PSSetShaderResources(unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views) override;
+    void PSSetSamplers(unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers) override;
+
+    void OMSetBlendState(ID3D11BlendState* state) override;
+    void OMSetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef) override;
+    void RSSetState(ID3D11RasterizerState* state) override;
+
+    void OMSetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* renderTargets,
+                            ID3D11DepthStencilView* depthStencil) override;
+    void ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const float colour[4]) override;
+    void ClearDepthStencilView(ID3D11DepthStencilView* depthStencil, float depth) override;
+    void RSSetViewport(const RenderViewport& viewport) override;
+
+    void IASetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride) override;
+    void IASetInputLayout(ID3D11InputLayout* layout) override;
+    void IASetIndexBuffer(ID3D11Buffer* buffer) override;
+    void IASetPrimitiveTopology(PrimitiveTopology topology) override;
+    void DrawIndexed(unsigned int numIndices, unsigned int startIndex, int baseVertex) override;
+    void DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances, unsigned int startIndex,
+                              int baseVertex, unsigned int startInstance) override;
+
+    void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size) override;
+    void AppendConstantBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size) override;
+
+
+    // Results //
+
+    // Number of calls of the given kind, draws, indices drawn and bytes of constants updated since the last reset
+    long long NumCalls(RenderCall call) const  { return mCallCounts[static_cast<int>(call)]; }
+    long long NumCalls() const; // All kinds
+    long long NumIndicesDrawn() const  { return mNumIndicesDrawn; }
+    long long NumConstantBytes() const { return mNumConstantBytes; }
+
+    // Recorded calls (only if recording was requested)
+    const std::vector<RenderCommand>& Commands() const  { return mCommands; }
+
+    // Number of mistakes found, and messages for the first few
+    int NumErrors() const  { return mNumErrors; }
+    const std::vector<std::string>& ErrorMessages() const  { return mErrorMessages; }
+
+    // Reset the counts, recorded calls and mistakes. Bound state and buffers are unchanged
+    void ResetResults();
+
+    // Number of buffers created and not yet released
+    int NumBuffers() const  { return static_cast<int>(mBuffers.size()); }
+
+    // Current content of a constant buffer, or nullptr if it isn't one
+    const void* ConstantBufferData(ID3D11Buffer* buffer) const;
+
+
+private:
+    enum class BufferType { Constant, Vertex, Index };
+
+    // The object behind each ID3D11Buffer handle this device gives out
+    struct Buffer
+    {
+        BufferType           type;
+        unsigned int         size;
+        std::vector<uint8_t> data;          // Constant buffers only
+        unsigned int         appendEnd = 0; // End of the data written since the content was last discarded
+    };
+
+    Buffer* CreateBuffer(BufferType type, const void* data, unsigned int size);
+
+    // Return the buffer for a handle, or nullptr (and record an error) if the handle isn't a live buffer of the
+    // given type. Null handles are allowed for binding and give nullptr without an error
+    Buffer* FindBuffer(ID3D11Buffer* handle, BufferType type, const char* callName);
+
+    // Ranges are optional, null for binding whole buffers
+    void CheckConstantBuffers(RenderCall call, unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                              const unsigned int* firstConstants = nullptr, const unsigned int* numConstants = nullptr);
+    bool CheckSlots(RenderCall call, unsigned int slot, unsigned int count, unsigned int maxSlots);
+    void CheckDraw(const std::string& callName, unsigned int numIndices, unsigned int startIndex);
+
+    void Record(RenderCall call, const void* object = nullptr, unsigned int a = 0, unsigned int b = 0);
+    void Error(const std::string& message);
+
+
+    // Results
+    bool                       mRecordCommands;
+    bool                       mConstantBufferRanges;
+    long long                  mCallCounts[static_cast<int>(RenderCall::NumCalls)] = {};
+    long long                  mNumIndicesDrawn  = 0;
+    long long                  mNumConstantBytes = 0;
+    std::vector<RenderCommand> mCommands;
+    int                        mNumErrors = 0;
+    std::vector<std::string>   mErrorMessages;
+
+    // Live buffers and handle numbering
+    std::unordered_set<Buffer*> mBuffers;
+    uintptr_t                   mNextHandle = 0;
+
+    // Bound state needed to check draws
+    ID3D11VertexShader* mVertexShader = nullptr;
+    ID3D11InputLayout*  mInputLayout  = nullptr;
+    Buffer*             mVertexBuffer = nullptr;
+    Buffer*             mIndexBuffer  = nullptr;
+    bool                mTopologySet  = false;
+    bool                mTargetSet    = false;
+    bool                mViewportSet  = false;
+};
+
+
+#endif //_HEADLESS_RENDER_DEVICE_H_INCLUDED_
@@ -0,0 +1,134 @@
+//--------------------------------------------------------------------------------------
+// Bounding volumes - spheres and axis-aligned boxes
+//--------------------------------------------------------------------------------------
+// Simple shapes that enclose a mesh or model, used for quick visibility and overlap tests (see CFrustum.h), and rays
+// for picking and line of sight tests against them
+// All code is in this header and constexpr
+
+#ifndef _BOUNDS_H_DEFINED_
+#define _BOUNDS_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix3x4.h"
+
+
+// A sphere. Exactly four floats so the SIMD code can load a whole sphere into one register
+struct BoundingSphere
+{
+    CVector3 centre;
+    float    radius;
+};
+
+// An axis-aligned box, held as its centre and the distance from the centre to each face (half the size)
+// This form is the cheapest to test against planes and to transform
+struct BoundingBox
+{
+    CVector3 centre;
+    CVector3 extents;
+};
+
+// A ray starting at origin and going on forever in the given direction. Distances along the ray are measured in
+// multiples of the direction, so are true distances if it is unit length
+struct Ray
+{
+    CVector3 origin;
+    CVector3 direction;
+};
+
+
+// Return the box enclosing the given minimum and maximum corners
+constexpr BoundingBox BoxFromMinMax(const CVector3& minimum, const CVector3& maximum)
+{
+    return { (minimum + maximum) * 0.5f, (maximum - minimum) * 0.5f };
+}
+
+// Return the sphere enclosing the given box
+constexpr BoundingSphere SphereFromBox(const BoundingBox& box)
+{
+    return { box.centre, Length(box.extents) };
+}
+
+// Return the box enclosing the given sphere
+constexpr BoundingBox BoxFromSphere(const BoundingSphere& sphere)
+{
+    return { sphere.centre, { sphere.radius, sphere.radius, sphere.radius } };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Overlap tests
+-----------------------------------------------------------------------------------------*/
+
+// Return true if the two boxes overlap (touching counts)
+constexpr bool BoxesOverlap(const BoundingBox& a, const BoundingBox& b)
+{
+    auto abs = [](float x) { return x < 0 ? -x : x; };
+    return abs(a.centre.x - b.centre.x) <= a.extents.x + b.extents.x &&
+           abs(a.centre.y - b.centre.y) <= a.extents.y + b.extents.y &&
+           abs(a.centre.z - b.centre.z) <= a.extents.z + b.extents.z;
+}
+
+// Return true if the sphere and box overlap: the point in the box nearest the centre of the sphere is within its radius
+constexpr bool SphereOverlapsBox(const BoundingSphere& sphere, const BoundingBox& box)
+{
+    auto outside = [](float d, float e) { d = d < 0 ? -d : d;  return d > e ? d - e : 0.0f; };
+    float dx = outside(sphere.centre.x - box.centre.x, box.extents.x);
+    float dy = outside(sphere.centre.y - box.centre.y, box.extents.y);
+    float dz = outside(sphere.centre.z - box.centre.z, box.extents.z);
+    return dx * dx + dy * dy + dz * dz <= sphere.radius * sphere.radius;
+}
+
+// Return true if the ray hits the box within the given distance along it (a ray starting inside the box hits it).
+// Finds where the ray enters and leaves the slab between each pair of opposite faces, it hits the box if it is in all
+// three slabs at once
+constexpr bool RayHitsBox(const Ray& ray, const BoundingBox& box, float maxDistance)
+{
+    float enter = 0;
+    float leave = maxDistance;
+    const float origin[3]    = { ray.origin.x - box.centre.x, ray.origin.y - box.centre.y, ray.origin.z - box.centre.z };
+    const float direction[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+    const float extents[3]   = { box.extents.x, box.extents.y, box.extents.z };
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (direction[axis] == 0)
+        {
+            // Parallel to the slab, so always or never in it
+            if (origin[axis] < -extents[axis] || origin[axis] > extents[axis])  return false;
+            continue;
+        }
+        float t1 = (-extents[axis] - origin[axis]) / direction[axis];
+        float t2 = ( extents[axis] - origin[axis]) / direction[axis];
+        if (t1 > t2)  { float t = t1;  t1 = t2;  t2 = t; }
+        if (t1 > enter)  enter = t1;
+        if (t2 < leave)  leave = t2;
+        if (enter > leave)  return false;
+    }
+    return true;
+}
+
+
+// Return the axis-aligned box enclosing the given box after it has been transformed by the given matrix
+// (e.g. model space bounds to world space bounds). The extents are transformed by the absolute value of each
+// matrix element, which gives the tightest box that fits around the rotated one
+constexpr BoundingBox TransformBox(const BoundingBox& box, const CMatrix3x4& m)
+{
+    auto abs = [](float x) { return x < 0 ? -x : x; };
+    const CVector3& e = box.extents;
+    return { TransformPoint(box.centre, m),
+             { e.x * abs(m.e00) + e.y * abs(m.e10) + e.z * abs(m.e20),
+               e.x * abs(m.e01) + e.y * abs(m.e11) + e.z * abs(m.e21),
+               e.x * abs(m.e02) + e.y * abs(m.e12) + e.z * abs(m.e22) } };
+}
+
+// Return the sphere enclosing the given sphere after it has been transformed by the given matrix. The radius
+// is scaled by the largest axis scale so the sphere still encloses the model when the scaling is not uniform
+constexpr BoundingSphere TransformSphere(const BoundingSphere& sphere, const CMatrix3x4& m)
+{
+    CVector3 scale = m.GetScale();
+    float maxScale = scale.x > scale.y ? scale.x : scale.y;
+    maxScale = maxScale > scale.z ? maxScale : scale.z;
+    return { TransformPoint(sphere.centre, m), sphere.radius * maxScale };
+}
+
+
+#endif // _BOUNDS_H_DEFINED_
@@ -0,0 +1,234 @@
+//--------------------------------------------------------------------------------------
+// Batched frustum tests
+//--------------------------------------------------------------------------------------
+
+#include "CFrustum.h"
+#include "MathSIMD.h"
+#include <cmath>
+
+
+/*-----------------------------------------------------------------------------------------
+    SIMD tests
+-----------------------------------------------------------------------------------------*/
+// Bounds are loaded "structure-of-arrays" style - one register with the centre x of each bound, one with the
+// centre y etc. - then tested against each plane, which is broadcast across registers once before the tests
+
+#if defined(MATH_SIMD_AVX)
+
+const int SIMDWidth = 8;
+
+// Each plane element copied across a whole register
+struct SIMDPlanes
+{
+    __m256 normalX[6], normalY[6], normalZ[6], distance[6];
+    __m256 absNormalX[6], absNormalY[6], absNormalZ[6];
+};
+
+static inline void LoadPlanes(const CFrustum& frustum, SIMDPlanes& p)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        const FrustumPlane& plane = frustum.planes[i];
+        p.normalX[i]    = _mm256_set1_ps(plane.normal.x);
+        p.normalY[i]    = _mm256_set1_ps(plane.normal.y);
+        p.normalZ[i]    = _mm256_set1_ps(plane.normal.z);
+        p.distance[i]   = _mm256_set1_ps(plane.distance);
+        p.absNormalX[i] = _mm256_set1_ps(std::abs(plane.normal.x));
+        p.absNormalY[i] = _mm256_set1_ps(std::abs(plane.normal.y));
+        p.absNormalZ[i] = _mm256_set1_ps(std::abs(plane.normal.z));
+    }
+}
+
+// Test eight bounds given their centres and the distance they reach towards each plane. Returns the visible ones as
+// the low 8 bits. The distance is summed in the same order as IsVisible so the results match exactly
+template <class RadiusFunction>
+static inline uint32_t TestBoundsSIMD(const SIMDPlanes& p, __m256 x, __m256 y, __m256 z, RadiusFunction radius)
+{
+    __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int i = 0; i < 6; ++i)
+    {
+        __m256 distance = _mm256_add_ps(_mm256_mul_ps(x, p.normalX[i]), _mm256_mul_ps(y, p.normalY[i]));
+        distance = _mm256_add_ps(_mm256_add_ps(distance, _mm256_mul_ps(z, p.normalZ[i])), p.distance[i]);
+        visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, _mm256_sub_ps(_mm256_setzero_ps(), radius(i)), _CMP_GE_OQ));
+    }
+    return static_cast<uint32_t>(_mm256_movemask_ps(visible));
+}
+
+static inline uint32_t TestSpheresSIMD(const SIMDPlanes& p, const BoundingSphere* spheres)
+{
+    // A sphere is four floats, so load spheres 0-3 into the lower halves of four registers and 4-7 into the upper
+    // halves, then transpose within each half
+    __m256 s[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        s[i] = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&spheres[i].centre.x)), _mm_loadu_ps(&spheres[i + 4].centre.x), 1);
+    }
+    __m256 t0 = _mm256_unpacklo_ps(s[0], s[1]);
+    __m256 t1 = _mm256_unpacklo_ps(s[2], s[3]);
+    __m256 t2 = _mm256_unpackhi_ps(s[0], s[1]);
+    __m256 t3 = _mm256_unpackhi_ps(s[2], s[3]);
+    __m256 x = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1,0,1,0));
+    __m256 y = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3,2,3,2));
+    __m256 z = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1,0,1,0));
+    __m256 r = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3,2,3,2));
+
+    return TestBoundsSIMD(p, x, y, z, [&](int) { return r; });
+}
+
+static inline uint32_t TestBoxesSIMD(const SIMDPlanes& p, const BoundingBox* b)
+{
+    __m256 cX = _mm256_set_ps(b[7].centre.x,  b[6].centre.x,  b[5].centre.x,  b[4].centre.x,  b[3].centre.x,  b[2].centre.x,  b[1].centre.x,  b[0].centre.x);
+    __m256 cY = _mm256_set_ps(b[7].centre.y,  b[6].centre.y,  b[5].centre.y,  b[4].centre.y,  b[3].centre.y,  b[2].centre.y,  b[1].centre.y,  b[0].centre.y);
+    __m256 cZ = _mm256_set_ps(b[7].centre.z,  b[6].centre.z,  b[5].centre.z,  b[4].centre.z,  b[3].centre.z,  b[2].centre.z,  b[1].centre.z,  b[0].centre.z);
+    __m256 eX = _mm256_set_ps(b[7].extents.x, b[6].extents.x, b[5].extents.x, b[4].extents.x, b[3].extents.x, b[2].extents.x, b[1].extents.x, b[0].extents.x);
+    __m256 eY = _mm256_set_ps(b[7].extents.y, b[6].extents.y, b[5].extents.y, b[4].extents.y, b[3].extents.y, b[2].extents.y, b[1].extents.y, b[0].extents.y);
+    __m256 eZ = _mm256_set_ps(b[7].extents.z, b[6].extents.z, b[5].extents.z, b[4].extents.z, b[3].extents.z, b[2].extents.z, b[1].extents.z, b[0].extents.z);
+
+    // Distance from the centre of each box to its corner furthest along the plane normal
+    return TestBoundsSIMD(p, cX, cY, cZ, [&](int i)
+    {
+        return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(eX, p.absNormalX[i]), _mm256_mul_ps(eY, p.absNormalY[i])), _mm256_mul_ps(eZ, p.absNormalZ[i]));
+    });
+}
+
+#elif defined(MATH_SIMD_SSE)
+
+const int SIMDWidth = 4;
+
+// Each plane element copied across a whole register
+struct SIMDPlanes
+{
+    __m128 normalX[6], normalY[6], normalZ[6], distance[6];
+    __m128 absNormalX[6], absNormalY[6], absNormalZ[6];
+};
+
+static inline void LoadPlanes(const CFrustum& frustum, SIMDPlanes& p)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        const FrustumPlane& plane = frustum.planes[i];
+        p.normalX[i]    = _mm_set1_ps(plane.normal.x);
+        p.normalY[i]    = _mm_set1_ps(plane.normal.y);
+        p.normalZ[i]    = _mm_set1_ps(plane.normal.z);
+        p.distance[i]   = _mm_set1_ps(plane.distance);
+        p.absNormalX[i] = _mm_set1_ps(std::abs(plane.normal.x));
+        p.absNormalY[i] = _mm_set1_ps(std::abs(plane.normal.y));
+        p.absNormalZ[i] = _mm_set1_ps(std::abs(plane.normal.z));
+    }
+}
+
+// Test four bounds given their centres and the distance they reach towards each plane. Returns the visible ones as
+// the low 4 bits. The distance is summed in the same order as IsVisible so the results match exactly
+template <class RadiusFunction>
+static inline uint32_t TestBoundsSIMD(const SIMDPlanes& p, __m128 x, __m128 y, __m128 z, RadiusFunction radius)
+{
+    __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int i = 0; i < 6; ++i)
+    {
+        __m128 distance = _mm_add_ps(_mm_mul_ps(x, p.normalX[i]), _mm_mul_ps(y, p.normalY[i]));
+        distance = _mm_add_ps(_mm_add_ps(distance, _mm_mul_ps(z, p.normalZ[i])), p.distance[i]);
+        visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, _mm_sub_ps(_mm_setzero_ps(), radius(i))));
+    }
+    return static_cast<uint32_t>(_mm_movemask_ps(visible));
+}
+
+static inline uint32_t TestSpheresSIMD(const SIMDPlanes& p, const BoundingSphere* spheres)
+{
+    // A sphere is four floats, so load each into a register and transpose
+    __m128 x = _mm_loadu_ps(&spheres[0].centre.x);
+    __m128 y = _mm_loadu_ps(&spheres[1].centre.x);
+    __m128 z = _mm_loadu_ps(&spheres[2].centre.x);
+    __m128 r = _mm_loadu_ps(&spheres[3].centre.x);
+    _MM_TRANSPOSE4_PS(x, y, z, r);
+
+    return TestBoundsSIMD(p, x, y, z, [&](int) { return r; });
+}
+
+static inline uint32_t TestBoxesSIMD(const SIMDPlanes& p, const BoundingBox* b)
+{
+    __m128 cX = _mm_set_ps(b[3].centre.x,  b[2].centre.x,  b[1].centre.x,  b[0].centre.x);
+    __m128 cY = _mm_set_ps(b[3].centre.y,  b[2].centre.y,  b[1].centre.y,  b[0].centre.y);
+    __m128 cZ = _mm_set_ps(b[3].centre.z,  b[2].centre.z,  b[1].centre.z,  b[0].centre.z);
+    __m128 eX = _mm_set_ps(b[3].extents.x, b[2].extents.x, b[1].extents.x, b[0].extents.x);
+    __m128 eY = _mm_set_ps(b[3].extents.y, b[2].extents.y, b[1].extents.y, b[0].extents.y);
+    __m128 eZ = _mm_set_ps(b[3].extents.z, b[2].extents.z, b[1].extents.z, b[0].extents.z);
+
+    // Distance from the centre of each box to its corner furthest along the plane normal
+    return TestBoundsSIMD(p, cX, cY, cZ, [&](int i)
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(eX, p.absNormalX[i]), _mm_mul_ps(eY, p.absNormalY[i])), _mm_mul_ps(eZ, p.absNormalZ[i]));
+    });
+}
+
+#endif
+
+
+/*-----------------------------------------------------------------------------------------
+    Batched tests
+-----------------------------------------------------------------------------------------*/
+
+// Select the SIMD test for each type of bound
+#if defined(MATH_SIMD_SSE)
+static inline uint32_t TestSIMD(const SIMDPlanes& p, const BoundingSphere* spheres) { return TestSpheresSIMD(p, spheres); }
+static inline uint32_t TestSIMD(const SIMDPlanes& p, const BoundingBox*    boxes)   { return TestBoxesSIMD(p, boxes);     }
+#endif
+
+// Test any number of bounds (spheres or boxes), 32 to each output value. Each group of 32 is tested as many at a time
+// as possible with SIMD, and any remaining ones (or all of them without SIMD) one at a time
+template <class Bound>
+static void TestBounds(const CFrustum& frustum, const Bound* bounds, int numBounds, uint32_t* visibleBitsOut)
+{
+#if defined(MATH_SIMD_SSE)
+    SIMDPlanes planes;
+    LoadPlanes(frustum, planes);
+#endif
+
+    for (int start = 0; start < numBounds; start += 32)
+    {
+        const Bound* group = bounds + start;
+        int count = numBounds - start < 32 ? numBounds - start : 32;
+
+        uint32_t visibleBits = 0;
+        int i = 0;
+#if defined(MATH_SIMD_SSE)
+        for (; i + SIMDWidth <= count; i += SIMDWidth)
+        {
+            visibleBits |= TestSIMD(planes, group + i) << i;
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            if (IsVisible(frustum, group[i]))  visibleBits |= 1u << i;
+        }
+        visibleBitsOut[start / 32] = visibleBits;
+    }
+}
+
+
+// Test up to 32 spheres against the frustum. Returns a bitmask with bit i set if sphere i is visible
+uint32_t TestSpheres(const CFrustum& frustum, const BoundingSphere* spheres, int numSpheres)
+{
+    uint32_t visibleBits = 0;
+    TestBounds(frustum, spheres, numSpheres, &visibleBits);
+    return visibleBits;
+}
+
+// Test up to 32 boxes against the frustum. Returns a bitmask with bit i set if box i is visible
+uint32_t TestBoxes(const CFrustum& frustum, const BoundingBox* boxes, int numBoxes)
+{
+    uint32_t visibleBits = 0;
+    TestBounds(frustum, boxes, numBoxes, &visibleBits);
+    return visibleBits;
+}
+
+// Test any number of spheres
+void TestSpheres(const CFrustum& frustum, const BoundingSphere* spheres, int numSpheres, uint32_t* visibleBitsOut)
+{
+    TestBounds(frustum, spheres, numSpheres, visibleBitsOut);
+}
+
+// Test any number of boxes
+void TestBoxes(const CFrustum& frustum, const BoundingBox* boxes, int numBoxes, uint32_t* visibleBitsOut)
+{
+    TestBounds(frustum, boxes, numBoxes, visibleBitsOut);
+}
@@ -0,0 +1,117 @@
+//--------------------------------------------------------------------------------------
+// Frustum class - the volume of space visible to a camera, for visibility culling
+//--------------------------------------------------------------------------------------
+// Built from any view-projection matrix (camera, or a light's view and projection for shadow maps), it holds the six
+// planes bounding the visible volume. Models whose bounds (Bounds.h) are entirely outside any one plane can't be seen
+// and don't need to be rendered.
+//
+// Single tests are constexpr in this header. The batched tests, which check several bounds at once with SIMD
+// instructions and return a bitmask of the visible ones, are in CFrustum.cpp
+
+#ifndef _CFRUSTUM_H_DEFINED_
+#define _CFRUSTUM_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "Bounds.h"
+#include <cstdint>
+
+
+// A plane holding all points p where Dot(normal, p) + distance = 0. With a unit length normal, Dot(normal, p) + distance
+// is the signed distance of p from the plane
+struct FrustumPlane
+{
+    CVector3 normal;
+    float    distance;
+};
+
+
+class CFrustum
+{
+// Concrete class - public access
+public:
+    // The planes are in the order left, right, bottom, top, near, far. Normals point into the frustum so
+    // positive distances are on the visible side
+    FrustumPlane planes[6];
+};
+
+
+/*-----------------------------------------------------------------------------------------
+    Construction
+-----------------------------------------------------------------------------------------*/
+
+// Return the frustum for the given view-projection matrix (or just a projection matrix to get a frustum in camera space)
+// Each plane is a sum or difference of two columns of the matrix: a point is inside when its projected x, y and z
+// are within -w to w (0 to w for z, Direct3D convention)
+constexpr CFrustum FrustumFromMatrix(const CMatrix4x4& m)
+{
+    const float planes[6][4] =
+    {
+        { m.e03 + m.e00, m.e13 + m.e10, m.e23 + m.e20, m.e33 + m.e30 }, // Left:   -w <= x
+        { m.e03 - m.e00, m.e13 - m.e10, m.e23 - m.e20, m.e33 - m.e30 }, // Right:   x <= w
+        { m.e03 + m.e01, m.e13 + m.e11, m.e23 + m.e21, m.e33 + m.e31 }, // Bottom: -w <= y
+        { m.e03 - m.e01, m.e13 - m.e11, m.e23 - m.e21, m.e33 - m.e31 }, // Top:     y <= w
+        { m.e02,         m.e12,         m.e22,         m.e32         }, // Near:    0 <= z
+        { m.e03 - m.e02, m.e13 - m.e12, m.e23 - m.e22, m.e33 - m.e32 }, // Far:     z <= w
+    };
+
+    // Normalise the planes so the tests give true distances (needed to compare against sphere radii)
+    CFrustum frustum = {};
+    for (int i = 0; i < 6; ++i)
+    {
+        CVector3 normal = { planes[i][0], planes[i][1], planes[i][2] };
+        float invLength = InvSqrt(Dot(normal, normal));
+        frustum.planes[i] = { normal * invLength, planes[i][3] * invLength };
+    }
+    return frustum;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Single tests
+-----------------------------------------------------------------------------------------*/
+
+// Return true if the given sphere is at least partly inside the frustum
+// Conservative near the corners of the frustum: a sphere just outside two planes at once may be reported as visible
+constexpr bool IsVisible(const CFrustum& frustum, const BoundingSphere& sphere)
+{
+    for (const FrustumPlane& plane : frustum.planes)
+    {
+        if (Dot(plane.normal, sphere.centre) + plane.distance < -sphere.radius)  return false;
+    }
+    return true;
+}
+
+// Return true if the given box is at least partly inside the frustum (conservative in the same way as above)
+constexpr bool IsVisible(const CFrustum& frustum, const BoundingBox& box)
+{
+    for (const FrustumPlane& plane : frustum.planes)
+    {
+        // Distance from the centre of the box to its corner furthest along the plane normal
+        const CVector3& n = plane.normal;
+        float radius = box.extents.x * (n.x < 0 ? -n.x : n.x) + box.extents.y * (n.y < 0 ? -n.y : n.y) +
+                       box.extents.z * (n.z < 0 ? -n.z : n.z);
+        if (Dot(n, box.centre) + plane.distance < -radius)  return false;
+    }
+    return true;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Batched tests
+-----------------------------------------------------------------------------------------*/
+// Four (SSE) or eight (AVX) bounds are tested at once. Results are the same as the single tests above
+
+// Test up to 32 spheres against the frustum. Returns a bitmask with bit i set if sphere i is visible
+uint32_t TestSpheres(const CFrustum& frustum, const BoundingSphere* spheres, int numSpheres);
+
+// Test up to 32 boxes against the frustum. Returns a bitmask with bit i set if box i is visible
+uint32_t TestBoxes(const CFrustum& frustum, const BoundingBox* boxes, int numBoxes);
+
+// Test any number of spheres / boxes. Bit (i % 32) of visibleBitsOut[i / 32] is set if bound i is visible, the
+// array must hold at least (count + 31) / 32 values
+void TestSpheres(const CFrustum& frustum, const BoundingSphere* spheres, int numSpheres, uint32_t* visibleBitsOut);
+void TestBoxes(const CFrustum& frustum, const BoundingBox* boxes, int numBoxes, uint32_t* visibleBitsOut);
+
+
+#endif // _CFRUSTUM_H_DEFINED_
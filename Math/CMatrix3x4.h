@@ -0,0 +1,222 @@
+//--------------------------------------------------------------------------------------
+// Matrix3x4 class to hold affine 3D transformations (world matrices, view matrices)
+//--------------------------------------------------------------------------------------
+// An affine matrix (any mix of scaling, rotation and translation) always has (0,0,0,1) in its last column
+// so there is no need to store or calculate it. This class holds the other 12 elements, saving a quarter of the
+// memory / upload bandwidth of CMatrix4x4, and the multiply, inverse and transform functions skip all the work
+// on the missing column.
+//
+// The elements have the same names and meaning as in CMatrix4x4 (eRC is row R, column C, and rows are the X, Y, Z
+// axes and position), but they are *stored* column by column: the first four floats are e00, e10, e20, e30.
+// That makes each stored column a 4-float SIMD register, and matches the HLSL float4x3 type in a constant buffer
+// (see Common.hlsli), which is used as mul(float4(position, 1), gWorldMatrix)
+//
+// All code is in this header and constexpr where possible (see CMatrix4x4.h)
+
+#ifndef _CMATRIX3X4_H_DEFINED_
+#define _CMATRIX3X4_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+
+
+// Matrix class. Aligned to 16 bytes so each stored column sits in a single SIMD register
+class alignas(16) CMatrix3x4
+{
+// Concrete class - public access
+public:
+	// Matrix elements, in memory order. Fourth column is always (0,0,0,1) and not stored
+	float e00, e10, e20, e30;
+	float e01, e11, e21, e31;
+	float e02, e12, e22, e32;
+
+
+    /*-----------------------------------------------------------------------------------------
+        Member functions
+    -----------------------------------------------------------------------------------------*/
+
+	// Set a single row (range 0-3) of the matrix using a CVector3
+    // Can be used to set position or x,y,z axes in a matrix
+    constexpr void SetRow(int iRow, const CVector3& v)
+    {
+        switch (iRow)
+        {
+            case 0:  e00 = v.x;  e01 = v.y;  e02 = v.z;  break;
+            case 1:  e10 = v.x;  e11 = v.y;  e12 = v.z;  break;
+            case 2:  e20 = v.x;  e21 = v.y;  e22 = v.z;  break;
+            default: e30 = v.x;  e31 = v.y;  e32 = v.z;  break;
+        }
+    }
+
+    // Get a single row (range 0-3) of the matrix into a CVector3
+    // Can be used to access position or x,y,z axes from a matrix
+    constexpr CVector3 GetRow(int iRow) const
+    {
+        switch (iRow)
+        {
+            case 0:  return { e00, e01, e02 };
+            case 1:  return { e10, e11, e12 };
+            case 2:  return { e20, e21, e22 };
+            default: return { e30, e31, e32 };
+        }
+    }
+
+    // Helper functions
+    constexpr CVector3 GetXAxis() const { return GetRow(0); }
+    constexpr CVector3 GetYAxis() const { return GetRow(1); }
+    constexpr CVector3 GetZAxis() const { return GetRow(2); }
+    constexpr CVector3 GetPosition() const  { return GetRow(3); }
+    constexpr CVector3 GetScale() const  { return { Length(GetXAxis()), Length(GetYAxis()) , Length(GetZAxis()) }; }
+
+    // Post-multiply this matrix by the given one
+    constexpr CMatrix3x4& operator*=(const CMatrix3x4& m);
+};
+
+
+// SIMD versions of some of the functions below, used at runtime
+#include "CMatrix3x4SIMD.h"
+
+
+/*-----------------------------------------------------------------------------------------
+    Conversion
+-----------------------------------------------------------------------------------------*/
+
+// Return the full 4x4 version of the given affine matrix
+constexpr CMatrix4x4 ToMatrix4x4(const CMatrix3x4& m)
+{
+    return CMatrix4x4{ m.e00, m.e01, m.e02, 0,
+                       m.e10, m.e11, m.e12, 0,
+                       m.e20, m.e21, m.e22, 0,
+                       m.e30, m.e31, m.e32, 1 };
+}
+
+// Return the affine part of the given 4x4 matrix. The last column is dropped, so only use with matrices that are
+// known to be affine (e.g. not projection matrices)
+constexpr CMatrix3x4 ToAffine(const CMatrix4x4& m)
+{
+    return CMatrix3x4{ m.e00, m.e10, m.e20, m.e30,
+                       m.e01, m.e11, m.e21, m.e31,
+                       m.e02, m.e12, m.e22, m.e32 };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Operators
+-----------------------------------------------------------------------------------------*/
+
+// Matrix-matrix multiplication. 36 multiplies against 64 for the 4x4 version
+constexpr CMatrix3x4 operator*(const CMatrix3x4& m1, const CMatrix3x4& m2)
+{
+#if defined(MATH_SIMD_SSE) || defined(MATH_SIMD_NEON)
+    if (!MATH_IS_CONSTANT_EVALUATED())  return MultiplySIMD(m1, m2);
+#endif
+
+    // Same as the 4x4 multiply with the known 0s and 1 in the last column of both matrices taken out
+    return CMatrix3x4{ m1.e00*m2.e00 + m1.e01*m2.e10 + m1.e02*m2.e20,
+                       m1.e10*m2.e00 + m1.e11*m2.e10 + m1.e12*m2.e20,
+                       m1.e20*m2.e00 + m1.e21*m2.e10 + m1.e22*m2.e20,
+                       m1.e30*m2.e00 + m1.e31*m2.e10 + m1.e32*m2.e20 + m2.e30,
+
+                       m1.e00*m2.e01 + m1.e01*m2.e11 + m1.e02*m2.e21,
+                       m1.e10*m2.e01 + m1.e11*m2.e11 + m1.e12*m2.e21,
+                       m1.e20*m2.e01 + m1.e21*m2.e11 + m1.e22*m2.e21,
+                       m1.e30*m2.e01 + m1.e31*m2.e11 + m1.e32*m2.e21 + m2.e31,
+
+                       m1.e00*m2.e02 + m1.e01*m2.e12 + m1.e02*m2.e22,
+                       m1.e10*m2.e02 + m1.e11*m2.e12 + m1.e12*m2.e22,
+                       m1.e20*m2.e02 + m1.e21*m2.e12 + m1.e22*m2.e22,
+                       m1.e30*m2.e02 + m1.e31*m2.e12 + m1.e32*m2.e22 + m2.e32 };
+}
+
+// Post-multiply this matrix by the given one
+constexpr CMatrix3x4& CMatrix3x4::operator*=(const CMatrix3x4& m)
+{
+    *this = *this * m;
+    return *this;
+}
+
+// Affine matrix multiplied by a general 4x4 matrix, e.g. view matrix * projection matrix. The result is not affine
+constexpr CMatrix4x4 operator*(const CMatrix3x4& m1, const CMatrix4x4& m2)
+{
+    return ToMatrix4x4(m1) * m2;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+  Vector transformation
+-----------------------------------------------------------------------------------------*/
+
+// Transform a point by the given matrix (the translation is applied)
+constexpr CVector3 TransformPoint(const CVector3& p, const CMatrix3x4& m)
+{
+    return { p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30,
+             p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31,
+             p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32 };
+}
+
+// Transform a vector (direction) by the given matrix (the translation is ignored)
+constexpr CVector3 TransformVector(const CVector3& v, const CMatrix3x4& m)
+{
+    return { v.x * m.e00 + v.y * m.e10 + v.z * m.e20,
+             v.x * m.e01 + v.y * m.e11 + v.z * m.e21,
+             v.x * m.e02 + v.y * m.e12 + v.z * m.e22 };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+  Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return an identity matrix
+constexpr CMatrix3x4 AffineIdentity()
+{
+    return CMatrix3x4{ 1, 0, 0, 0,
+                       0, 1, 0, 0,
+                       0, 0, 1, 0 };
+}
+
+// Return a world matrix for the given position, rotation (Euler angles in radians) and scaling
+// Same as the CMatrix4x4 version of MatrixWorld. See CQuaternion.h for a quaternion version
+template <MathPrecision Precision = MathPrecision::Precise>
+constexpr CMatrix3x4 AffineWorld(const CVector3& p, const CVector3& r, const CVector3& s)
+{
+    return ToAffine(MatrixWorld<Precision>(p, r, s));
+}
+
+
+// Return the inverse of the given matrix
+// Advanced calulation needed to get the view matrix from the camera's positioning matrix
+constexpr CMatrix3x4 InverseAffine(const CMatrix3x4& m)
+{
+#if defined(MATH_SIMD_SSE)
+    if (!MATH_IS_CONSTANT_EVALUATED())  return InverseAffineSIMD(m);
+#endif
+
+    // Calculate determinant of upper left 3x3
+    float det0 = m.e11*m.e22 - m.e12*m.e21;
+    float det1 = m.e12*m.e20 - m.e10*m.e22;
+    float det2 = m.e10*m.e21 - m.e11*m.e20;
+    float det = m.e00*det0 + m.e01*det1 + m.e02*det2;
+
+    // Calculate inverse of upper left 3x3
+    float invDet = 1.0f / det;
+    float i00 = invDet * det0;
+    float i10 = invDet * det1;
+    float i20 = invDet * det2;
+
+    float i01 = invDet * (m.e21*m.e02 - m.e22*m.e01);
+    float i11 = invDet * (m.e22*m.e00 - m.e20*m.e02);
+    float i21 = invDet * (m.e20*m.e01 - m.e21*m.e00);
+
+    float i02 = invDet * (m.e01*m.e12 - m.e02*m.e11);
+    float i12 = invDet * (m.e02*m.e10 - m.e00*m.e12);
+    float i22 = invDet * (m.e00*m.e11 - m.e01*m.e10);
+
+    // Transform negative translation by inverted 3x3 to get inverse (stored column by column)
+    return CMatrix3x4{ i00, i10, i20, -m.e30*i00 - m.e31*i10 - m.e32*i20,
+                       i01, i11, i21, -m.e30*i01 - m.e31*i11 - m.e32*i21,
+                       i02, i12, i22, -m.e30*i02 - m.e31*i12 - m.e32*i22 };
+}
+
+
+#endif // _CMATRIX3X4_H_DEFINED_
@@ -0,0 +1,125 @@
+//--------------------------------------------------------------------------------------
+// SIMD implementation of the CMatrix3x4 functions that benefit from it
+//--------------------------------------------------------------------------------------
+// Included by CMatrix3x4.h, not intended to be used directly. Uses the helpers from CMatrix4x4SIMD.h
+// The matrix is stored column by column, so these functions work on columns where the 4x4 versions work on rows
+
+#ifndef _CMATRIX3X4_SIMD_H_DEFINED_
+#define _CMATRIX3X4_SIMD_H_DEFINED_
+
+#include "MathSIMD.h"
+
+
+/*-----------------------------------------------------------------------------------------
+    SIMD helpers
+-----------------------------------------------------------------------------------------*/
+
+#if defined(MATH_SIMD_SSE)
+
+// Return a stored column (range 0-2) of the matrix in an SSE register
+inline __m128 LoadColumn(const CMatrix3x4& m, int column)
+{
+    return _mm_loadu_ps(&m.e00 + column * 4);
+}
+
+inline void StoreColumn(CMatrix3x4& m, int column, __m128 v)
+{
+    _mm_storeu_ps(&m.e00 + column * 4, v);
+}
+
+// The missing fourth column of an affine matrix
+inline __m128 AffineColumn3()
+{
+    return _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+}
+
+#elif defined(MATH_SIMD_NEON)
+
+inline float32x4_t LoadColumn(const CMatrix3x4& m, int column)
+{
+    return vld1q_f32(&m.e00 + column * 4);
+}
+
+inline void StoreColumn(CMatrix3x4& m, int column, float32x4_t v)
+{
+    vst1q_f32(&m.e00 + column * 4, v);
+}
+
+inline float32x4_t AffineColumn3()
+{
+    const float column[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    return vld1q_f32(column);
+}
+
+#endif
+
+
+/*-----------------------------------------------------------------------------------------
+    Runtime implementations
+-----------------------------------------------------------------------------------------*/
+
+#if defined(MATH_SIMD_SSE) || defined(MATH_SIMD_NEON)
+
+// Matrix-matrix multiplication
+inline CMatrix3x4 MultiplySIMD(const CMatrix3x4& m1, const CMatrix3x4& m2)
+{
+    CMatrix3x4 mOut;
+
+    // Each output column is m1 times the matching column of m2 (as a column vector), which is a combination
+    // of the columns of m1 - including the missing fourth column, scaled by the translation element of m2
+    auto c0 = LoadColumn(m1, 0);
+    auto c1 = LoadColumn(m1, 1);
+    auto c2 = LoadColumn(m1, 2);
+    auto c3 = AffineColumn3();
+    StoreColumn(mOut, 0, CombineRows(LoadColumn(m2, 0), c0, c1, c2, c3));
+    StoreColumn(mOut, 1, CombineRows(LoadColumn(m2, 1), c0, c1, c2, c3));
+    StoreColumn(mOut, 2, CombineRows(LoadColumn(m2, 2), c0, c1, c2, c3));
+
+    return mOut;
+}
+
+#endif
+
+
+#if defined(MATH_SIMD_SSE)
+
+// Return the inverse of the given matrix
+inline CMatrix3x4 InverseAffineSIMD(const CMatrix3x4& m)
+{
+    CMatrix3x4 mOut;
+
+    // The rows of the inverse of the upper left 3x3 are the cross products of pairs of its columns, divided by the
+    // determinant. The translation in the w elements of the columns doesn't affect the cross products
+    __m128 col0 = LoadColumn(m, 0);
+    __m128 col1 = LoadColumn(m, 1);
+    __m128 col2 = LoadColumn(m, 2);
+    __m128 row0 = Cross3(col1, col2);
+    __m128 row1 = Cross3(col2, col0);
+    __m128 row2 = Cross3(col0, col1);
+
+    // Determinant is the dot product of the first column and the first row calculated above (w of row0 is 0)
+    __m128 det = _mm_mul_ps(col0, row0);
+    det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(2,3,0,1)));
+    det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(1,0,3,2)));
+    __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    __m128 inv0 = _mm_mul_ps(row0, invDet);
+    __m128 inv1 = _mm_mul_ps(row1, invDet);
+    __m128 inv2 = _mm_mul_ps(row2, invDet);
+
+    // Transform negative translation (gathered from the w elements) by inverted 3x3
+    __m128 translation = _mm_shuffle_ps(_mm_unpackhi_ps(col0, col1), col2, _MM_SHUFFLE(3,3,3,2));
+    translation = _mm_sub_ps(_mm_setzero_ps(), CombineRows(translation, inv0, inv1, inv2, _mm_setzero_ps()));
+
+    // Transpose rows into stored columns, the translation becomes the w elements
+    _MM_TRANSPOSE4_PS(inv0, inv1, inv2, translation);
+    StoreColumn(mOut, 0, inv0);
+    StoreColumn(mOut, 1, inv1);
+    StoreColumn(mOut, 2, inv2);
+
+    return mOut;
+}
+
+#endif
+
+
+#endif // _CMATRIX3X4_SIMD_H_DEFINED_
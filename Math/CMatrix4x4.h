@@ -1,7 +1,10 @@
 //--------------------------------------------------------------------------------------
 // Matrix4x4 class (cut down version) to hold matrices for 3D
 //--------------------------------------------------------------------------------------
-// Code in .cpp file
+// All code is in this header and constexpr where possible, so matrices built from constants (projection
+// matrices, fixed transforms) are calculated at compile time and everything else can be inlined. The
+// multiply, inverse and transform functions use SIMD instructions at runtime where available (see
+// MathSIMD.h and CMatrix4x4SIMD.h), falling back to plain C++ otherwise.
 
 #ifndef _CMATRIX4X4_H_DEFINED_
 #define _CMATRIX4X4_H_DEFINED_
@@ -11,7 +14,9 @@
 
 
 // Matrix class
-class CMatrix4x4
+// Aligned to 16 bytes so each row sits in a single SIMD register. The SIMD code doesn't *require* the
+// alignment (unaligned loads are used), but aligned rows never split across a cache line
+class alignas(16) CMatrix4x4
 {
 // Concrete class - public access
 public:
@@ -28,37 +33,130 @@ public:
 
 	// Set a single row (range 0-3) of the matrix using a CVector3. Fourth element left unchanged
     // Can be used to set position or x,y,z axes in a matrix
-    void SetRow(int iRow, const CVector3& v);
+    constexpr void SetRow(int iRow, const CVector3& v)
+    {
+        // Select the row by name rather than pointer arithmetic from e00, which the compiler can't evaluate
+        switch (iRow)
+        {
+            case 0:  e00 = v.x;  e01 = v.y;  e02 = v.z;  break;
+            case 1:  e10 = v.x;  e11 = v.y;  e12 = v.z;  break;
+            case 2:  e20 = v.x;  e21 = v.y;  e22 = v.z;  break;
+            default: e30 = v.x;  e31 = v.y;  e32 = v.z;  break;
+        }
+    }
 
     // Get a single row (range 0-3) of the matrix into a CVector3. Fourth element is ignored
     // Can be used to access position or x,y,z axes from a matrix
-    CVector3 GetRow(int iRow) const;
+    constexpr CVector3 GetRow(int iRow) const
+    {
+        switch (iRow)
+        {
+            case 0:  return { e00, e01, e02 };
+            case 1:  return { e10, e11, e12 };
+            case 2:  return { e20, e21, e22 };
+            default: return { e30, e31, e32 };
+        }
+    }
 
     // Helper functions
-    CVector3 GetXAxis() const { return GetRow(0); }
-    CVector3 GetYAxis() const { return GetRow(1); }
-    CVector3 GetZAxis() const { return GetRow(2); }
-    CVector3 GetPosition() const  { return GetRow(3); }
-    CVector3 GetEulerAngles();
-    CVector3 GetScale() const  { return { Length(GetXAxis()), Length(GetYAxis()) , Length(GetZAxis()) }; }
+    constexpr CVector3 GetXAxis() const { return GetRow(0); }
+    constexpr CVector3 GetYAxis() const { return GetRow(1); }
+    constexpr CVector3 GetZAxis() const { return GetRow(2); }
+    constexpr CVector3 GetPosition() const  { return GetRow(3); }
+    CVector3 GetEulerAngles() const;
+    constexpr CVector3 GetScale() const  { return { Length(GetXAxis()), Length(GetYAxis()) , Length(GetZAxis()) }; }
 
     // Post-multiply this matrix by the given one
-    CMatrix4x4& operator*=(const CMatrix4x4& m);
+    constexpr CMatrix4x4& operator*=(const CMatrix4x4& m);
 
     // Make this matrix an affine 3D transformation matrix to face from current position to given
     // target (in the Z direction). Can pass up vector for the constructed matrix and specify
     // handedness (right-handed Z axis will face away from target)
     // Will retain the matrix's current scaling
-    void FaceTarget(const CVector3& target);
+    constexpr void FaceTarget(const CVector3& target);
 };
 
 
+// SIMD versions of some of the functions below, used at runtime
+#include "CMatrix4x4SIMD.h"
+
+
 /*-----------------------------------------------------------------------------------------
     Operators
 -----------------------------------------------------------------------------------------*/
 
 // Matrix-matrix multiplication
-CMatrix4x4 operator*(const CMatrix4x4& m1, const CMatrix4x4& m2);
+constexpr CMatrix4x4 operator*(const CMatrix4x4& m1, const CMatrix4x4& m2)
+{
+#if !defined(MATH_SIMD_SCALAR)
+    if (!MATH_IS_CONSTANT_EVALUATED())  return MultiplySIMD(m1, m2);
+#endif
+
+    return CMatrix4x4{ m1.e00*m2.e00 + m1.e01*m2.e10 + m1.e02*m2.e20 + m1.e03*m2.e30,
+                       m1.e00*m2.e01 + m1.e01*m2.e11 + m1.e02*m2.e21 + m1.e03*m2.e31,
+                       m1.e00*m2.e02 + m1.e01*m2.e12 + m1.e02*m2.e22 + m1.e03*m2.e32,
+                       m1.e00*m2.e03 + m1.e01*m2.e13 + m1.e02*m2.e23 + m1.e03*m2.e33,
+
+                       m1.e10*m2.e00 + m1.e11*m2.e10 + m1.e12*m2.e20 + m1.e13*m2.e30,
+                       m1.e10*m2.e01 + m1.e11*m2.e11 + m1.e12*m2.e21 + m1.e13*m2.e31,
+                       m1.e10*m2.e02 + m1.e11*m2.e12 + m1.e12*m2.e22 + m1.e13*m2.e32,
+                       m1.e10*m2.e03 + m1.e11*m2.e13 + m1.e12*m2.e23 + m1.e13*m2.e33,
+
+                       m1.e20*m2.e00 + m1.e21*m2.e10 + m1.e22*m2.e20 + m1.e23*m2.e30,
+                       m1.e20*m2.e01 + m1.e21*m2.e11 + m1.e22*m2.e21 + m1.e23*m2.e31,
+                       m1.e20*m2.e02 + m1.e21*m2.e12 + m1.e22*m2.e22 + m1.e23*m2.e32,
+                       m1.e20*m2.e03 + m1.e21*m2.e13 + m1.e22*m2.e23 + m1.e23*m2.e33,
+
+                       m1.e30*m2.e00 + m1.e31*m2.e10 + m1.e32*m2.e20 + m1.e33*m2.e30,
+                       m1.e30*m2.e01 + m1.e31*m2.e11 + m1.e32*m2.e21 + m1.e33*m2.e31,
+                       m1.e30*m2.e02 + m1.e31*m2.e12 + m1.e32*m2.e22 + m1.e33*m2.e32,
+                       m1.e30*m2.e03 + m1.e31*m2.e13 + m1.e32*m2.e23 + m1.e33*m2.e33 };
+}
+
+// Post-multiply this matrix by the given one
+constexpr CMatrix4x4& CMatrix4x4::operator*=(const CMatrix4x4& m)
+{
+    // The binary version reads both matrices fully before writing the result so it is safe even when
+    // multiplying by self, and it is already the SIMD path
+    *this = *this * m;
+    return *this;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+  Vector transformation
+-----------------------------------------------------------------------------------------*/
+
+// Transform a point by the given matrix (treats the point as a row vector with w = 1, so the translation is applied)
+constexpr CVector3 TransformPoint(const CVector3& p, const CMatrix4x4& m)
+{
+    return { p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30,
+             p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31,
+             p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32 };
+}
+
+// Transform a vector (direction) by the given matrix (treats the vector as having w = 0, so the translation is ignored)
+constexpr CVector3 TransformVector(const CVector3& v, const CMatrix4x4& m)
+{
+    return { v.x * m.e00 + v.y * m.e10 + v.z * m.e20,
+             v.x * m.e01 + v.y * m.e11 + v.z * m.e21,
+             v.x * m.e02 + v.y * m.e12 + v.z * m.e22 };
+}
+
+// Transform an array of points by the given matrix. In and out arrays can be the same
+// A single point is too little work for SIMD to pay off (the shuffling in and out of registers costs more
+// than the 9 multiplies), but over an array the matrix rows stay in registers for the whole loop
+inline void TransformPoints(const CVector3* pointsIn, CVector3* pointsOut, int numPoints, const CMatrix4x4& m)
+{
+#if defined(MATH_SIMD_SSE) || defined(MATH_SIMD_NEON)
+    TransformPointsSIMD(pointsIn, pointsOut, numPoints, m);
+#else
+    for (int i = 0; i < numPoints; ++i)
+    {
+        pointsOut[i] = TransformPoint(pointsIn[i], m);
+    }
+#endif
+}
 
 
 /*-----------------------------------------------------------------------------------------
@@ -68,35 +166,226 @@ CMatrix4x4 operator*(const CMatrix4x4& m1, const CMatrix4x4& m2);
 // The following functions create a new matrix holding a particular transformation
 // They can be used as temporaries in calculations, e.g.
 //     CMatrix4x4 m = MatrixScaling( 3.0f ) * MatrixTranslation( CVector3(10.0f, -10.0f, 20.0f) );
+// or as compile-time constants, e.g.
+//     constexpr CMatrix4x4 m = MatrixRotationY( ToRadians(90.0f) );
 
 // Return an identity matrix
-CMatrix4x4 MatrixIdentity();
+constexpr CMatrix4x4 MatrixIdentity()
+{
+    return CMatrix4x4{ 1, 0, 0, 0,
+                       0, 1, 0, 0,
+                       0, 0, 1, 0,
+                       0, 0, 0, 1 };
+}
 
 // Return a translation matrix of the given vector
-CMatrix4x4 MatrixTranslation(const CVector3& t);
+constexpr CMatrix4x4 MatrixTranslation(const CVector3& t)
+{
+    return CMatrix4x4  { 1,   0,   0,  0,
+                         0,   1,   0,  0,
+                         0,   0,   1,  0,
+                       t.x, t.y, t.z,  1 };
+}
 
 
 // Return an X-axis rotation matrix of the given angle (in radians)
-CMatrix4x4 MatrixRotationX(float x);
+template <MathPrecision Precision = MathPrecision::Precise>
+constexpr CMatrix4x4 MatrixRotationX(float x)
+{
+    float sX = 0, cX = 0;
+    SinCos<Precision>(x, sX, cX);
+
+    return CMatrix4x4{ 1,   0,   0,  0,
+                       0,  cX,  sX,  0,
+                       0, -sX,  cX,  0,
+                       0,   0,   0,  1 };
+}
 
 // Return a Y-axis rotation matrix of the given angle (in radians)
-CMatrix4x4 MatrixRotationY(float y);
+template <MathPrecision Precision = MathPrecision::Precise>
+constexpr CMatrix4x4 MatrixRotationY(float y)
+{
+    float sY = 0, cY = 0;
+    SinCos<Precision>(y, sY, cY);
+
+    return CMatrix4x4{ cY,   0, -sY,  0,
+                        0,   1,   0,  0,
+                       sY,   0,  cY,  0,
+                        0,   0,   0,  1 };
+}
 
 // Return a Z-axis rotation matrix of the given angle (in radians)
-CMatrix4x4 MatrixRotationZ(float z);
+template <MathPrecision Precision = MathPrecision::Precise>
+constexpr CMatrix4x4 MatrixRotationZ(float z)
+{
+    float sZ = 0, cZ = 0;
+    SinCos<Precision>(z, sZ, cZ);
+
+    return CMatrix4x4{ cZ,  sZ,  0,  0,
+                      -sZ,  cZ,  0,  0,
+                        0,   0,  1,  0,
+                        0,   0,  0,  1 };
+}
 
 
 // Return a matrix that is a scaling in X,Y and Z of the values in the given vector
-CMatrix4x4 MatrixScaling(const CVector3& s);
+constexpr CMatrix4x4 MatrixScaling(const CVector3& s)
+{
+    return CMatrix4x4{ s.x,   0,   0,  0,
+                       0,   s.y,   0,  0,
+                       0,     0, s.z,  0,
+                       0,     0,   0,  1 };
+}
 
 // Return a matrix that is a uniform scaling of the given amount
-CMatrix4x4 MatrixScaling(const float s);
+constexpr CMatrix4x4 MatrixScaling(const float s)
+{
+    return CMatrix4x4{ s, 0, 0, 0,
+                       0, s, 0, 0,
+                       0, 0, s, 0,
+                       0, 0, 0, 1 };
+}
+
+
+// Return a world matrix for the given position, rotation (Euler angles in radians) and scaling. Gives the same result as
+//     MatrixScaling(s) * MatrixRotationZ(r.z) * MatrixRotationX(r.x) * MatrixRotationY(r.y) * MatrixTranslation(p)
+// but is built directly from a closed-form expression instead of four matrix multiplies
+// See TransformBatch.h to build many world matrices at once
+template <MathPrecision Precision = MathPrecision::Precise>
+constexpr CMatrix4x4 MatrixWorld(const CVector3& p, const CVector3& r, const CVector3& s)
+{
+    float sX = 0, cX = 0, sY = 0, cY = 0, sZ = 0, cZ = 0;
+    SinCos<Precision>(r.x, sX, cX);
+    SinCos<Precision>(r.y, sY, cY);
+    SinCos<Precision>(r.z, sZ, cZ);
+
+    // Rows of the rotation Z * X * Y multiplied out, each scaled by the matching axis scale
+    return CMatrix4x4{ s.x * (cZ * cY + sZ * sX * sY),  s.x * sZ * cX,  s.x * (sZ * sX * cY - cZ * sY),  0,
+                       s.y * (cZ * sX * sY - sZ * cY),  s.y * cZ * cX,  s.y * (sZ * sY + cZ * sX * cY),  0,
+                       s.z * cX * sY,                  -s.z * sX,       s.z * cX * cY,                   0,
+                       p.x,                             p.y,            p.z,                             1 };
+}
+
+
+// Return a perspective projection matrix (the "projection matrix" used by cameras)
+// - FOVx is the viewing angle from left->right in radians (high values give a fish-eye look),
+// - Aspect ratio is screen width / height (like 4:3, 16:9)
+// - near and far clip are the range of z distances that can be rendered
+constexpr CMatrix4x4 MatrixPerspective(float FOVx, float aspectRatio, float nearClip, float farClip)
+{
+    float tanFOVx = Tan(FOVx * 0.5f);
+    float scaleX = 1.0f / tanFOVx;
+    float scaleY = aspectRatio / tanFOVx;
+    float scaleZa = farClip / (farClip - nearClip);
+    float scaleZb = -nearClip * scaleZa;
+
+    return CMatrix4x4{ scaleX,   0.0f,    0.0f,   0.0f,
+                         0.0f, scaleY,    0.0f,   0.0f,
+                         0.0f,   0.0f, scaleZa,   1.0f,
+                         0.0f,   0.0f, scaleZb,   0.0f };
+}
 
 
 
 // Return the inverse of given matrix assuming that it is an affine matrix
 // Advanced calulation needed to get the view matrix from the camera's positioning matrix
-CMatrix4x4 InverseAffine(const CMatrix4x4& m);
+constexpr CMatrix4x4 InverseAffine(const CMatrix4x4& m)
+{
+#if defined(MATH_SIMD_SSE)
+    if (!MATH_IS_CONSTANT_EVALUATED())  return InverseAffineSIMD(m);
+#endif
+
+    // Calculate determinant of upper left 3x3
+    float det0 = m.e11*m.e22 - m.e12*m.e21;
+    float det1 = m.e12*m.e20 - m.e10*m.e22;
+    float det2 = m.e10*m.e21 - m.e11*m.e20;
+    float det = m.e00*det0 + m.e01*det1 + m.e02*det2;
+
+    // Calculate inverse of upper left 3x3
+    float invDet = 1.0f / det;
+    float i00 = invDet * det0;
+    float i10 = invDet * det1;
+    float i20 = invDet * det2;
+
+    float i01 = invDet * (m.e21*m.e02 - m.e22*m.e01);
+    float i11 = invDet * (m.e22*m.e00 - m.e20*m.e02);
+    float i21 = invDet * (m.e20*m.e01 - m.e21*m.e00);
+
+    float i02 = invDet * (m.e01*m.e12 - m.e02*m.e11);
+    float i12 = invDet * (m.e02*m.e10 - m.e00*m.e12);
+    float i22 = invDet * (m.e00*m.e11 - m.e01*m.e10);
+
+    // Transform negative translation by inverted 3x3 to get inverse. Fill in right column for affine matrix
+    return CMatrix4x4{ i00, i01, i02, 0.0f,
+                       i10, i11, i12, 0.0f,
+                       i20, i21, i22, 0.0f,
+                       -m.e30*i00 - m.e31*i10 - m.e32*i20,  -m.e30*i01 - m.e31*i11 - m.e32*i21,  -m.e30*i02 - m.e31*i12 - m.e32*i22,  1.0f };
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Member functions using the non-member functions above
+-----------------------------------------------------------------------------------------*/
+
+// Make this matrix an affine 3D transformation matrix to face from current position to given target (in the Z direction)
+// Will retain the matrix's current scaling
+constexpr void CMatrix4x4::FaceTarget(const CVector3& target)
+{
+    // Use cross product of target direction and up vector to give third axis, then orthogonalise
+    CVector3 axisZ = Normalise(target - GetPosition());
+    if (IsZero(Length(axisZ))) return;
+    CVector3 axisX = Normalise(Cross({0, 1, 0}, axisZ));
+    if (IsZero(Length(axisX))) return;
+    CVector3 axisY = Cross(axisZ, axisX); // Will already be normalised
+
+    // Set rows of matrix, restoring existing scale. Position will be unchanged, 4th column
+    // taken from unit matrix
+    CVector3 scale = GetScale();
+    SetRow(0, axisX * scale.x);
+    SetRow(1, axisY * scale.y);
+    SetRow(2, axisZ * scale.z);
+}
+
+
+// Return the rotation stored in this matrix as Euler angles
+// Not constexpr as there is no compile-time atan2
+inline CVector3 CMatrix4x4::GetEulerAngles() const
+{
+	// Calculate matrix scaling
+	float scaleX = sqrt( e00*e00 + e01*e01 + e02*e02 );
+	float scaleY = sqrt( e10*e10 + e11*e11 + e12*e12 );
+	float scaleZ = sqrt( e20*e20 + e21*e21 + e22*e22 );
+
+	// Calculate inverse scaling to extract rotational values only
+	float invScaleX = 1.0f / scaleX;
+	float invScaleY = 1.0f / scaleY;
+	float invScaleZ = 1.0f / scaleZ;
+
+	float sX, cX, sY, cY, sZ, cZ;
+
+    sX = -e21 * invScaleZ;
+    cX = sqrt( 1.0f - sX*sX );
+
+    // If no gimbal lock...
+    if (abs(cX) > 0.001f)
+    {
+	    float invCX = 1.0f / cX;
+	    sZ = e01 * invCX * invScaleX;
+	    cZ = e11 * invCX * invScaleY;
+	    sY = e20 * invCX * invScaleZ;
+	    cY = e22 * invCX * invScaleZ;
+    }
+    else
+    {
+	    // Gimbal lock - force Z angle to 0
+	    sZ = 0.0f;
+	    cZ = 1.0f;
+	    sY = -e02 * invScaleX;
+	    cY =  e00 * invScaleX;
+    }
+
+	return { std::atan2(sX, cX), std::atan2(sY, cY), std::atan2(sZ, cZ) };
+}
 
 
 #endif // _CMATRIX4X4_H_DEFINED_
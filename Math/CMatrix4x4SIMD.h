@@ -0,0 +1,200 @@
+//--------------------------------------------------------------------------------------
+// SIMD implementation of the CMatrix4x4 functions that benefit from it
+//--------------------------------------------------------------------------------------
+// Included by CMatrix4x4.h, not intended to be used directly. The constexpr functions in CMatrix4x4.h
+// call these at runtime and use the plain C++ code when evaluated by the compiler (or when there is
+// no SIMD instruction set available, see MathSIMD.h)
+
+#ifndef _CMATRIX4X4_SIMD_H_DEFINED_
+#define _CMATRIX4X4_SIMD_H_DEFINED_
+
+#include "MathSIMD.h"
+
+
+/*-----------------------------------------------------------------------------------------
+    SIMD helpers
+-----------------------------------------------------------------------------------------*/
+// Each matrix row is four floats so fits a single 4-wide register. Loads/stores are unaligned in case a
+// matrix is placed somewhere that doesn't honour the alignas(16) (e.g. an over-aligned type in a heap
+// allocation under older C++ standards). On current CPUs an unaligned load of aligned data costs nothing
+
+#if defined(MATH_SIMD_SSE)
+
+// Return a row of the matrix in an SSE register
+inline __m128 LoadRow(const CMatrix4x4& m, int row)
+{
+    return _mm_loadu_ps(&m.e00 + row * 4);
+}
+
+inline void StoreRow(CMatrix4x4& m, int row, __m128 v)
+{
+    _mm_storeu_ps(&m.e00 + row * 4, v);
+}
+
+// Linear combination of rows: v.x * r0 + v.y * r1 + v.z * r2 + v.w * r3. This is a row vector times matrix
+inline __m128 CombineRows(__m128 v, __m128 r0, __m128 r1, __m128 r2, __m128 r3)
+{
+    __m128 result =                   _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(0,0,0,0)), r0);
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1,1,1,1)), r1));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2,2,2,2)), r2));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3,3,3,3)), r3));
+    return result;
+}
+
+// Cross product of the x,y,z parts of two registers, w of the result is 0
+inline __m128 Cross3(__m128 a, __m128 b)
+{
+    __m128 aYZX = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,0,2,1));
+    __m128 bZXY = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3,1,0,2));
+    __m128 aZXY = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,1,0,2));
+    __m128 bYZX = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3,0,2,1));
+    return _mm_sub_ps(_mm_mul_ps(aYZX, bZXY), _mm_mul_ps(aZXY, bYZX));
+}
+
+#elif defined(MATH_SIMD_NEON)
+
+inline float32x4_t LoadRow(const CMatrix4x4& m, int row)
+{
+    return vld1q_f32(&m.e00 + row * 4);
+}
+
+inline void StoreRow(CMatrix4x4& m, int row, float32x4_t v)
+{
+    vst1q_f32(&m.e00 + row * 4, v);
+}
+
+// Linear combination of rows: v.x * r0 + v.y * r1 + v.z * r2 + v.w * r3. This is a row vector times matrix
+inline float32x4_t CombineRows(float32x4_t v, float32x4_t r0, float32x4_t r1, float32x4_t r2, float32x4_t r3)
+{
+    float32x4_t result = vmulq_laneq_f32(r0, v, 0);
+    result = vfmaq_laneq_f32(result, r1, v, 1);
+    result = vfmaq_laneq_f32(result, r2, v, 2);
+    result = vfmaq_laneq_f32(result, r3, v, 3);
+    return result;
+}
+
+#endif
+
+
+/*-----------------------------------------------------------------------------------------
+    Runtime implementations
+-----------------------------------------------------------------------------------------*/
+
+#if !defined(MATH_SIMD_SCALAR)
+
+// Matrix-matrix multiplication
+inline CMatrix4x4 MultiplySIMD(const CMatrix4x4& m1, const CMatrix4x4& m2)
+{
+    CMatrix4x4 mOut;
+
+#if defined(MATH_SIMD_AVX)
+
+    // Two rows of m1 per 256-bit register. Each row of m2 is duplicated into both 128-bit halves so
+    // the in-lane shuffles of the m1 rows pick the correct element for both output rows at once
+    __m256 b0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m2.e00));
+    __m256 b1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m2.e10));
+    __m256 b2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m2.e20));
+    __m256 b3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m2.e30));
+
+    for (int row = 0; row < 4; row += 2)
+    {
+        __m256 a = _mm256_loadu_ps(&m1.e00 + row * 4);
+        __m256 result =                      _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(0,0,0,0)), b0);
+        result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(1,1,1,1)), b1));
+        result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(2,2,2,2)), b2));
+        result = _mm256_add_ps(result, _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(3,3,3,3)), b3));
+        _mm256_storeu_ps(&mOut.e00 + row * 4, result);
+    }
+
+#elif defined(MATH_SIMD_SSE) || defined(MATH_SIMD_NEON)
+
+    // Each output row is the matching row of m1 (as a row vector) multiplied by m2
+    auto r0 = LoadRow(m2, 0);
+    auto r1 = LoadRow(m2, 1);
+    auto r2 = LoadRow(m2, 2);
+    auto r3 = LoadRow(m2, 3);
+    StoreRow(mOut, 0, CombineRows(LoadRow(m1, 0), r0, r1, r2, r3));
+    StoreRow(mOut, 1, CombineRows(LoadRow(m1, 1), r0, r1, r2, r3));
+    StoreRow(mOut, 2, CombineRows(LoadRow(m1, 2), r0, r1, r2, r3));
+    StoreRow(mOut, 3, CombineRows(LoadRow(m1, 3), r0, r1, r2, r3));
+
+#endif
+
+    return mOut;
+}
+
+#endif
+
+
+#if defined(MATH_SIMD_SSE)
+
+// Return the inverse of given matrix assuming that it is an affine matrix
+inline CMatrix4x4 InverseAffineSIMD(const CMatrix4x4& m)
+{
+    CMatrix4x4 mOut;
+
+    // The columns of the inverse of the upper left 3x3 are the cross products of pairs of its rows, divided by the determinant
+    __m128 row0 = LoadRow(m, 0);
+    __m128 row1 = LoadRow(m, 1);
+    __m128 row2 = LoadRow(m, 2);
+    __m128 col0 = Cross3(row1, row2);
+    __m128 col1 = Cross3(row2, row0);
+    __m128 col2 = Cross3(row0, row1);
+
+    // Determinant is the dot product of the first row and the first column calculated above (w of col0 is 0)
+    __m128 det = _mm_mul_ps(row0, col0);
+    det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(2,3,0,1)));
+    det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(1,0,3,2)));
+    __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+    // Transpose the columns into rows (w elements are all 0, so the fourth row becomes 0 too)
+    __m128 col3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(col0, col1, col2, col3);
+    __m128 inv0 = _mm_mul_ps(col0, invDet);
+    __m128 inv1 = _mm_mul_ps(col1, invDet);
+    __m128 inv2 = _mm_mul_ps(col2, invDet);
+
+    // Transform negative translation by inverted 3x3 to get inverse, w of 1 for the affine matrix
+    __m128 translation = CombineRows(LoadRow(m, 3), inv0, inv1, inv2, _mm_setzero_ps());
+    translation = _mm_sub_ps(_mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f), translation);
+
+    StoreRow(mOut, 0, inv0);
+    StoreRow(mOut, 1, inv1);
+    StoreRow(mOut, 2, inv2);
+    StoreRow(mOut, 3, translation);
+
+    return mOut;
+}
+
+#endif
+
+
+#if defined(MATH_SIMD_SSE) || defined(MATH_SIMD_NEON)
+
+// Transform an array of points by the given matrix. In and out arrays can be the same
+inline void TransformPointsSIMD(const CVector3* pointsIn, CVector3* pointsOut, int numPoints, const CMatrix4x4& m)
+{
+    auto r0 = LoadRow(m, 0);
+    auto r1 = LoadRow(m, 1);
+    auto r2 = LoadRow(m, 2);
+    auto r3 = LoadRow(m, 3);
+    for (int i = 0; i < numPoints; ++i)
+    {
+        // CVector3 is only 12 bytes so can't load 4 floats directly (would read past the end of the array)
+        // w is set to 1 so the translation row is added by the same combine used for matrices
+        const CVector3& p = pointsIn[i];
+        alignas(16) float result[4];
+#if defined(MATH_SIMD_SSE)
+        _mm_store_ps(result, CombineRows(_mm_set_ps(1.0f, p.z, p.y, p.x), r0, r1, r2, r3));
+#else
+        float in[4] = { p.x, p.y, p.z, 1.0f };
+        vst1q_f32(result, CombineRows(vld1q_f32(in), r0, r1, r2, r3));
+#endif
+        pointsOut[i] = { result[0], result[1], result[2] };
+    }
+}
+
+#endif
+
+
+#endif // _CMATRIX4X4_SIMD_H_DEFINED_
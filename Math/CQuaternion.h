@@ -0,0 +1,294 @@
+//--------------------------------------------------------------------------------------
+// Quaternion class (cut down version) to hold rotations
+//--------------------------------------------------------------------------------------
+// All code is in this header and constexpr where possible (see CMatrix4x4.h)
+// A unit quaternion holds a rotation in four floats. Unlike Euler angles it has no gimbal lock, can be
+// smoothly interpolated (slerp / nlerp), and converts to a matrix with no trigonometry at all. Unlike a
+// matrix it doesn't drift away from a pure rotation after many small changes (just renormalise it).
+//
+// Multiplication order matches the matrix classes: q1 * q2 is the rotation q1 followed by rotation q2,
+// so MatrixRotation(q1 * q2) == MatrixRotation(q1) * MatrixRotation(q2)
+
+#ifndef _CQUATERNION_H_DEFINED_
+#define _CQUATERNION_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "CMatrix3x4.h"
+
+
+class CQuaternion
+{
+// Concrete class - public access
+public:
+    // Quaternion components - x,y,z is the vector part (rotation axis * sin(angle/2)), w is cos(angle/2)
+    float x;
+    float y;
+    float z;
+    float w;
+
+    /*-----------------------------------------------------------------------------------------
+        Constructors
+    -----------------------------------------------------------------------------------------*/
+
+    // Default constructor - leaves values uninitialised (for performance)
+    CQuaternion() = default;
+
+    // Construct with 4 values
+    constexpr CQuaternion(const float xIn, const float yIn, const float zIn, const float wIn)
+        : x(xIn), y(yIn), z(zIn), w(wIn)
+    {
+    }
+
+
+    /*-----------------------------------------------------------------------------------------
+        Member functions
+    -----------------------------------------------------------------------------------------*/
+
+    // Post-multiply this quaternion by the given one (i.e. apply rotation q after this one)
+    constexpr CQuaternion& operator*= (const CQuaternion& q);
+
+    // Return the rotation stored in this quaternion as Euler angles (in the order used by Model: Z, then X, then Y)
+    // This is an expensive calculation, prefer to keep rotations as quaternions where possible
+    CVector3 GetEulerAngles() const;
+};
+
+
+/*-----------------------------------------------------------------------------------------
+    Operators
+-----------------------------------------------------------------------------------------*/
+
+// Quaternion-quaternion multiplication. Result is the rotation q1 followed by the rotation q2
+// This is the standard (Hamilton) quaternion product q2 q1 - the order is swapped so that quaternions
+// combine in the same order as the row-vector matrices used everywhere else
+constexpr CQuaternion operator* (const CQuaternion& q1, const CQuaternion& q2)
+{
+    return CQuaternion{ q2.w * q1.x + q2.x * q1.w + q2.y * q1.z - q2.z * q1.y,
+                        q2.w * q1.y - q2.x * q1.z + q2.y * q1.w + q2.z * q1.x,
+                        q2.w * q1.z + q2.x * q1.y - q2.y * q1.x + q2.z * q1.w,
+                        q2.w * q1.w - q2.x * q1.x - q2.y * q1.y - q2.z * q1.z };
+}
+
+// Post-multiply this quaternion by the given one (i.e. apply rotation q after this one)
+constexpr CQuaternion& CQuaternion::operator*= (const CQuaternion& q)
+{
+    *this = *this * q;
+    return *this;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Non-member functions
+-----------------------------------------------------------------------------------------*/
+
+// Return an identity quaternion (no rotation)
+constexpr CQuaternion QuaternionIdentity()
+{
+    return CQuaternion{ 0, 0, 0, 1 };
+}
+
+// Return a quaternion rotating by the given angle (in radians) around the given axis. Axis must be unit length
+constexpr CQuaternion QuaternionRotationAxis(const CVector3& axis, float angle)
+{
+    float s = Sin(angle * 0.5f);
+    float c = Cos(angle * 0.5f);
+    return CQuaternion{ axis.x * s, axis.y * s, axis.z * s, c };
+}
+
+// Return a quaternion holding the same rotation as the given Euler angles (in radians), applied in the order
+// used by Model: Z, then X, then Y. The same rotation as MatrixRotationZ(r.z) * MatrixRotationX(r.x) * MatrixRotationY(r.y)
+constexpr CQuaternion QuaternionFromEuler(const CVector3& r)
+{
+    float sX = Sin(r.x * 0.5f);
+    float cX = Cos(r.x * 0.5f);
+    float sY = Sin(r.y * 0.5f);
+    float cY = Cos(r.y * 0.5f);
+    float sZ = Sin(r.z * 0.5f);
+    float cZ = Cos(r.z * 0.5f);
+
+    // Z rotation * X rotation * Y rotation multiplied out
+    return CQuaternion{ cY * sX * cZ + sY * cX * sZ,
+                        sY * cX * cZ - cY * sX * sZ,
+                        cY * cX * sZ - sY * sX * cZ,
+                        cY * cX * cZ + sY * sX * sZ };
+}
+
+// Return a quaternion holding the rotation part of the given matrix. The matrix can contain scaling
+constexpr CQuaternion QuaternionFromMatrix(const CMatrix4x4& m)
+{
+    // Remove any scaling from the axes first
+    CVector3 axisX = Normalise(m.GetXAxis());
+    CVector3 axisY = Normalise(m.GetYAxis());
+    CVector3 axisZ = Normalise(m.GetZAxis());
+
+    // Work from the largest of the four components to avoid dividing by a value near zero
+    float trace = axisX.x + axisY.y + axisZ.z;
+    if (trace > 0.0f)
+    {
+        float s = 0.5f * InvSqrt(trace + 1.0f);
+        return CQuaternion{ (axisY.z - axisZ.y) * s, (axisZ.x - axisX.z) * s, (axisX.y - axisY.x) * s, 0.25f / s };
+    }
+    else if (axisX.x > axisY.y && axisX.x > axisZ.z)
+    {
+        float s = 0.5f * InvSqrt(1.0f + axisX.x - axisY.y - axisZ.z);
+        return CQuaternion{ 0.25f / s, (axisX.y + axisY.x) * s, (axisZ.x + axisX.z) * s, (axisY.z - axisZ.y) * s };
+    }
+    else if (axisY.y > axisZ.z)
+    {
+        float s = 0.5f * InvSqrt(1.0f + axisY.y - axisX.x - axisZ.z);
+        return CQuaternion{ (axisX.y + axisY.x) * s, 0.25f / s, (axisY.z + axisZ.y) * s, (axisZ.x - axisX.z) * s };
+    }
+    else
+    {
+        float s = 0.5f * InvSqrt(1.0f + axisZ.z - axisX.x - axisY.y);
+        return CQuaternion{ (axisZ.x + axisX.z) * s, (axisY.z + axisZ.y) * s, 0.25f / s, (axisX.y - axisY.x) * s };
+    }
+}
+
+// Return a quaternion that rotates the Z axis to face in the given direction, with the X axis kept
+// horizontal (same result as CMatrix4x4::FaceTarget). Returns identity if the direction is zero or vertical
+constexpr CQuaternion QuaternionLookRotation(const CVector3& facing)
+{
+    // Build the axes the same way as CMatrix4x4::FaceTarget
+    CVector3 axisZ = Normalise(facing);
+    if (IsZero(Length(axisZ)))  return QuaternionIdentity();
+    CVector3 axisX = Normalise(Cross({ 0, 1, 0 }, axisZ));
+    if (IsZero(Length(axisX)))  return QuaternionIdentity();
+    CVector3 axisY = Cross(axisZ, axisX);
+
+    return QuaternionFromMatrix(CMatrix4x4{ axisX.x, axisX.y, axisX.z, 0,
+                                            axisY.x, axisY.y, axisY.z, 0,
+                                            axisZ.x, axisZ.y, axisZ.z, 0,
+                                                  0,       0,       0, 1 });
+}
+
+
+// Dot product of two quaternions, measures how close two rotations are (1 or -1 for the same rotation)
+constexpr float Dot(const CQuaternion& q1, const CQuaternion& q2)
+{
+    return q1.x * q2.x + q1.y * q2.y + q1.z * q2.z + q1.w * q2.w;
+}
+
+// Return unit length quaternion with the same direction as given one. Use after many multiplies to remove drift
+// Pass MathPrecision::Fast as a template parameter to use the fast inverse square root (see MathHelpers.h)
+template <MathPrecision Precision = MathPrecision::Precise>
+constexpr CQuaternion Normalise(const CQuaternion& q)
+{
+    float lengthSq = Dot(q, q);
+    if (IsZero(lengthSq))
+    {
+        return QuaternionIdentity();
+    }
+    else
+    {
+        float invLength = InvSqrt<Precision>(lengthSq);
+        return CQuaternion{ q.x * invLength, q.y * invLength, q.z * invLength, q.w * invLength };
+    }
+}
+
+// Return the inverse of the given unit quaternion (the opposite rotation)
+constexpr CQuaternion Conjugate(const CQuaternion& q)
+{
+    return CQuaternion{ -q.x, -q.y, -q.z, q.w };
+}
+
+
+// Normalised linear interpolation between two unit quaternions, t from 0 to 1. Much cheaper than Slerp (no
+// trigonometry) and takes the same path, but the rotation speed varies slightly over t. Best for small steps
+constexpr CQuaternion Nlerp(const CQuaternion& q1, const CQuaternion& q2, float t)
+{
+    float w1 = 1.0f - t;
+    float w2 = Dot(q1, q2) < 0.0f ? -t : t; // q and -q are the same rotation, pick the one closest to q1 for the shortest path
+    return Normalise(CQuaternion{ q1.x * w1 + q2.x * w2, q1.y * w1 + q2.y * w2, q1.z * w1 + q2.z * w2, q1.w * w1 + q2.w * w2 });
+}
+
+// Spherical linear interpolation between two unit quaternions, t from 0 to 1. Constant rotation speed over t
+// and always takes the shortest path. Falls back to Nlerp for nearly identical rotations
+// Not constexpr as there is no compile-time acos
+inline CQuaternion Slerp(const CQuaternion& q1, const CQuaternion& q2, float t)
+{
+    // Shortest path, as Nlerp
+    float cosAngle = Dot(q1, q2);
+    float sign = 1.0f;
+    if (cosAngle < 0.0f)
+    {
+        cosAngle = -cosAngle;
+        sign = -1.0f;
+    }
+
+    // For very close rotations sin(angle) is near zero, but a straight line is then just as good
+    if (cosAngle > 0.9995f)  return Nlerp(q1, q2, t);
+
+    float angle = std::acos(cosAngle);
+    float invSinAngle = 1.0f / std::sin(angle);
+    float w1 = std::sin((1.0f - t) * angle) * invSinAngle;
+    float w2 = std::sin(t * angle) * invSinAngle * sign;
+    return CQuaternion{ q1.x * w1 + q2.x * w2, q1.y * w1 + q2.y * w2, q1.z * w1 + q2.z * w2, q1.w * w1 + q2.w * w2 };
+}
+
+
+// Rotate a vector by a unit quaternion
+constexpr CVector3 Rotate(const CVector3& v, const CQuaternion& q)
+{
+    // Expanded form of q v q*, fewer operations than two full quaternion multiplies
+    CVector3 qv = { q.x, q.y, q.z };
+    CVector3 t = 2.0f * Cross(qv, v);
+    return v + q.w * t + Cross(qv, t);
+}
+
+
+// Return a world matrix for the given position, rotation and scaling. Same result as
+//     MatrixScaling(s) * MatrixRotation(q) * MatrixTranslation(p)
+// but built directly. No trigonometry is needed, so this is cheaper than the Euler angle version of MatrixWorld
+constexpr CMatrix4x4 MatrixWorld(const CVector3& p, const CQuaternion& q, const CVector3& s)
+{
+    float xx = q.x * q.x,  yy = q.y * q.y,  zz = q.z * q.z;
+    float xy = q.x * q.y,  xz = q.x * q.z,  yz = q.y * q.z;
+    float wx = q.w * q.x,  wy = q.w * q.y,  wz = q.w * q.z;
+
+    // Rows of the rotation matrix, each scaled by the matching axis scale
+    return CMatrix4x4{ s.x * (1 - 2 * (yy + zz)),  s.x * 2 * (xy + wz),        s.x * 2 * (xz - wy),        0,
+                       s.y * 2 * (xy - wz),        s.y * (1 - 2 * (xx + zz)),  s.y * 2 * (yz + wx),        0,
+                       s.z * 2 * (xz + wy),        s.z * 2 * (yz - wx),        s.z * (1 - 2 * (xx + yy)),  0,
+                       p.x,                        p.y,                        p.z,                        1 };
+}
+
+// Affine matrix version of the above (see CMatrix3x4.h)
+constexpr CMatrix3x4 AffineWorld(const CVector3& p, const CQuaternion& q, const CVector3& s)
+{
+    float xx = q.x * q.x,  yy = q.y * q.y,  zz = q.z * q.z;
+    float xy = q.x * q.y,  xz = q.x * q.z,  yz = q.y * q.z;
+    float wx = q.w * q.x,  wy = q.w * q.y,  wz = q.w * q.z;
+
+    // Same elements as above, stored column by column
+    return CMatrix3x4{ s.x * (1 - 2 * (yy + zz)),  s.y * 2 * (xy - wz),        s.z * 2 * (xz + wy),        p.x,
+                       s.x * 2 * (xy + wz),        s.y * (1 - 2 * (xx + zz)),  s.z * 2 * (yz - wx),        p.y,
+                       s.x * 2 * (xz - wy),        s.y * 2 * (yz + wx),        s.z * (1 - 2 * (xx + yy)),  p.z };
+}
+
+// Blend between two affine world matrices (without shear), t from 0 to 1. Position and scale are blended linearly,
+// rotation with Nlerp so the result is not skewed or shrunk as a direct blend of the matrices would be. Intended
+// for small changes, such as between two steps of a simulation
+constexpr CMatrix3x4 InterpolateAffine(const CMatrix3x4& m1, const CMatrix3x4& m2, float t)
+{
+    CVector3 p1 = m1.GetPosition(), p2 = m2.GetPosition();
+    CVector3 s1 = m1.GetScale(),    s2 = m2.GetScale();
+    CQuaternion q = Nlerp(QuaternionFromMatrix(ToMatrix4x4(m1)), QuaternionFromMatrix(ToMatrix4x4(m2)), t);
+    return AffineWorld(p1 + (p2 - p1) * t, q, s1 + (s2 - s1) * t);
+}
+
+// Return a rotation matrix holding the same rotation as the given unit quaternion
+constexpr CMatrix4x4 MatrixRotation(const CQuaternion& q)
+{
+    return MatrixWorld({ 0, 0, 0 }, q, { 1, 1, 1 });
+}
+
+
+// Return the rotation stored in this quaternion as Euler angles (in the order used by Model: Z, then X, then Y)
+inline CVector3 CQuaternion::GetEulerAngles() const
+{
+    return MatrixRotation(*this).GetEulerAngles();
+}
+
+
+#endif // _CQUATERNION_H_DEFINED_
@@ -1,42 +1,268 @@
 //--------------------------------------------------------------------------------------
 // Math convenience functions
 //--------------------------------------------------------------------------------------
+// All functions are constexpr so they can be used to build constants at compile time. The trig and
+// square root functions use the standard library at runtime, and an exact-to-float-precision series
+// when evaluated by the compiler (the standard library versions are not constexpr)
+//
+// The trig and inverse square root functions also come in a faster, slightly less accurate form, selected
+// at each call site with a template parameter, e.g.
+//     float s = Sin(angle);                        // Precise (standard library)
+//     float s = Sin<MathPrecision::Fast>(angle);   // Fast approximation
+// 4-wide SIMD versions of the fast functions are in MathHelpersSIMD.h
 
 #ifndef _MATH_HELPERS_H_DEFINED_
 #define _MATH_HELPERS_H_DEFINED_
 
+#include "MathSIMD.h"
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 
 
 // Surprisingly, pi is not *officially* defined anywhere in C++
-const float PI = 3.14159265359f;
+constexpr float PI = 3.14159265359f;
 
 
 
 // Test if a float value is approximately 0
 // Epsilon value is the range around zero that is considered equal to zero
-const float EPSILON = 0.5e-6f; // For 32-bit floats, requires zero to 6 decimal places
-inline bool IsZero(const float x)
+constexpr float EPSILON = 0.5e-6f; // For 32-bit floats, requires zero to 6 decimal places
+constexpr bool IsZero(const float x)
 {
-    return std::abs(x) < EPSILON;
+    return (x < 0 ? -x : x) < EPSILON;
+}
+
+
+// True when the function calling it is being evaluated by the compiler (for a constexpr variable, static_assert etc.),
+// false when running. Lets a constexpr function use code the compiler can evaluate, but faster code (standard library,
+// SIMD) at runtime. Supported by Visual Studio 2019 16.5+, GCC 9+ and Clang 9+ in C++17 mode
+#define MATH_IS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+
+
+/*-----------------------------------------------------------------------------------------
+    Compile-time versions of standard library functions
+-----------------------------------------------------------------------------------------*/
+// Only used by the compiler so speed doesn't matter. Calculated in double precision so the float results match
+// the standard library to within rounding
+
+// Sine of an angle in radians using a Taylor series. The angle is first reduced to the range -PI/2 to PI/2
+constexpr double CompileTimeSin(double x)
+{
+    constexpr double pi = 3.14159265358979323846;
+    x -= 2 * pi * static_cast<long long>(x / (2 * pi)); // Range -2PI to 2PI
+    if (x >  pi)  x -= 2 * pi;                         // Range -PI to PI
+    if (x < -pi)  x += 2 * pi;
+    if (x >  pi / 2)  x =  pi - x;                     // Range -PI/2 to PI/2, sin(PI - x) = sin(x)
+    if (x < -pi / 2)  x = -pi - x;
+
+    // Terms up to x^21 / 21! leave an error far below double precision at PI/2
+    double x2 = x * x;
+    double term = x;
+    double sum = x;
+    for (int n = 2; n <= 20; n += 2)
+    {
+        term *= -x2 / (n * (n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+// Square root using Newton's method, starting from a guess of the right magnitude
+constexpr double CompileTimeSqrt(double x)
+{
+    if (x <= 0)  return 0;
+    double guess = 1;
+    while (guess * guess > x * 4)  guess *= 0.5;
+    while (guess * guess < x / 4)  guess *= 2;
+    for (int i = 0; i < 8; ++i)
+    {
+        guess = 0.5 * (guess + x / guess);
+    }
+    return guess;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Fast approximations
+-----------------------------------------------------------------------------------------*/
+// Runtime only, used by the functions below when MathPrecision::Fast is selected. Errors are measured against
+// double precision results over the ranges given and are quoted in ulps (units in the last place of a float
+// result, i.e. 1 ulp is the smallest possible difference between two floats of that size)
+
+// Accuracy of the functions below, chosen separately at each call site
+enum class MathPrecision
+{
+    Precise, // Standard library, within 1 ulp
+    Fast,    // Polynomial / hardware approximations, within a few ulps (see each function). Several times faster
+};
+
+// Sine and cosine of an angle in radians together
+// Max absolute error 8e-8 for angles up to +-10000 radians (accuracy falls away slowly beyond that), which is
+// within 2 ulp wherever the result is larger than 0.001
+inline void FastSinCos(float x, float& sinOut, float& cosOut)
+{
+    // Reduce the angle to the range -PI/4 to PI/4 by subtracting the nearest multiple of PI/2 (in three parts to keep
+    // precision for larger angles), the quadrant (which multiple of PI/2 was removed) picks the result and its sign
+    float q = static_cast<float>(static_cast<int32_t>(x * 0.636619772367581f + (x < 0 ? -0.5f : 0.5f)));
+    int quadrant = static_cast<int>(q);
+    float r = x - q * 1.5703125f;
+    r = r - q * 4.837512969970703125e-4f;
+    r = r - q * 7.54978995489188216e-8f;
+    float r2 = r * r;
+
+    // Polynomials for sin and cos of the reduced angle
+    float s = ((-1.9515295891e-4f * r2 + 8.3321608736e-3f) * r2 - 1.6666654611e-1f) * r2 * r + r;
+    float c = ((2.443315711809948e-5f * r2 - 1.388731625493765e-3f) * r2 + 4.166664568298827e-2f) * r2 * r2 - 0.5f * r2 + 1.0f;
+
+    if (quadrant & 1)  { float t = s;  s = c;  c = t; } // Odd quadrants swap sin and cos
+    sinOut = (quadrant & 2)       ? -s : s;
+    cosOut = ((quadrant + 1) & 2) ? -c : c;
+}
+
+// Arctangent of y/x giving an angle from -PI to PI in the correct quadrant (same as std::atan2)
+// Max absolute error 3e-7 radians, within 4 ulp for results larger than 0.1 radians
+inline float FastAtan2(float y, float x)
+{
+    float absX = std::abs(x);
+    float absY = std::abs(y);
+    float maxXY = absX > absY ? absX : absY;
+    float minXY = absX > absY ? absY : absX;
+
+    // Work with the ratio in the range 0 to 1, and above tan(PI/8) use atan(a) = PI/4 + atan((a-1)/(a+1)) to
+    // get into the range -0.414 to 0.414 where a short polynomial is accurate. Symmetry gives the other octants
+    float a = maxXY > 0.0f ? minXY / maxXY : 0.0f;
+    float offset = 0.0f;
+    if (a > 0.414213562f)
+    {
+        a = (a - 1.0f) / (a + 1.0f);
+        offset = 0.785398163f;
+    }
+    float a2 = a * a;
+    float r = offset + (((8.05374449538e-2f * a2 - 1.38776856032e-1f) * a2 + 1.99777106478e-1f) * a2 - 3.33329491539e-1f) * a2 * a + a;
+    if (absY > absX)      r = 1.57079632679f - r;
+    if (std::signbit(x))  r = 3.14159265359f - r;
+    return std::signbit(y) ? -r : r; // Sign of y, including -0 as std::atan2
+}
+
+// 1 / Sqrt. Max error 5 ulp with SSE, 3 ulp otherwise, for all positive normal floats
+// Uses the hardware estimate where available (12 bits on SSE) or the well known bit-pattern estimate otherwise,
+// then refines it with Newton-Raphson iterations
+inline float FastInvSqrt(float x)
+{
+#if defined(MATH_SIMD_SSE)
+    float estimate = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+    return estimate * (1.5f - 0.5f * x * estimate * estimate);
+#elif defined(MATH_SIMD_NEON)
+    float32x2_t v = vdup_n_f32(x);
+    float32x2_t estimate = vrsqrte_f32(v);
+    estimate = vmul_f32(estimate, vrsqrts_f32(vmul_f32(v, estimate), estimate));
+    estimate = vmul_f32(estimate, vrsqrts_f32(vmul_f32(v, estimate), estimate));
+    return vget_lane_f32(estimate, 0);
+#else
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    bits = 0x5f375a86 - (bits >> 1);
+    float estimate;
+    std::memcpy(&estimate, &bits, sizeof(estimate));
+    estimate = estimate * (1.5f - 0.5f * x * estimate * estimate);
+    estimate = estimate * (1.5f - 0.5f * x * estimate * estimate);
+    return estimate * (1.5f - 0.5f * x * estimate * estimate);
+#endif
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Trig and square root
+-----------------------------------------------------------------------------------------*/
+
+// Sine of an angle in radians
+template <MathPrecision Precision = MathPrecision::Precise>
+constexpr float Sin(const float x)
+{
+    if (MATH_IS_CONSTANT_EVALUATED())  return static_cast<float>(CompileTimeSin(x));
+    if constexpr (Precision == MathPrecision::Fast)
+    {
+        float s = 0, c = 0;
+        FastSinCos(x, s, c);
+        return s;
+    }
+    return std::sin(x);
+}
+
+// Cosine of an angle in radians
+template <MathPrecision Precision = MathPrecision::Precise>
+constexpr float Cos(const float x)
+{
+    if (MATH_IS_CONSTANT_EVALUATED())  return static_cast<float>(CompileTimeSin(static_cast<double>(x) + 1.57079632679489661923));
+    if constexpr (Precision == MathPrecision::Fast)
+    {
+        float s = 0, c = 0;
+        FastSinCos(x, s, c);
+        return c;
+    }
+    return std::cos(x);
+}
+
+// Sine and cosine of an angle in radians together, cheaper than calling both when using the fast version
+template <MathPrecision Precision = MathPrecision::Precise>
+constexpr void SinCos(const float x, float& sinOut, float& cosOut)
+{
+    if constexpr (Precision == MathPrecision::Fast)
+    {
+        if (!MATH_IS_CONSTANT_EVALUATED())
+        {
+            FastSinCos(x, sinOut, cosOut);
+            return;
+        }
+    }
+    sinOut = Sin(x);
+    cosOut = Cos(x);
+}
+
+// Tangent of an angle in radians
+constexpr float Tan(const float x)
+{
+    if (MATH_IS_CONSTANT_EVALUATED())  return static_cast<float>(CompileTimeSin(x) / CompileTimeSin(static_cast<double>(x) + 1.57079632679489661923));
+    return std::tan(x);
+}
+
+// Arctangent of y/x giving an angle from -PI to PI in the correct quadrant. Not constexpr (no compile-time version)
+template <MathPrecision Precision = MathPrecision::Precise>
+inline float Atan2(const float y, const float x)
+{
+    if constexpr (Precision == MathPrecision::Fast)  return FastAtan2(y, x);
+    return std::atan2(y, x);
+}
+
+// Square root
+constexpr float Sqrt(const float x)
+{
+    if (MATH_IS_CONSTANT_EVALUATED())  return static_cast<float>(CompileTimeSqrt(x));
+    return std::sqrt(x);
 }
 
 
 // 1 / Sqrt. Used often (e.g. normalising) and can be optimised, so it gets its own function
-inline float InvSqrt(const float x)
+template <MathPrecision Precision = MathPrecision::Precise>
+constexpr float InvSqrt(const float x)
 {
-    return 1.0f / std::sqrt(x);
+    if constexpr (Precision == MathPrecision::Fast)
+    {
+        if (!MATH_IS_CONSTANT_EVALUATED())  return FastInvSqrt(x);
+    }
+    return 1.0f / Sqrt(x);
 }
 
 
 // Pass an angle in degrees, returns the angle in radians
-inline float ToRadians(float d)
+constexpr float ToRadians(float d)
 {
     return  d * PI / 180.0f;
 }
 
 // Pass an angle in radians, returns the angle in degrees
-inline float ToDegrees(float r)
+constexpr float ToDegrees(float r)
 {
     return  r * 180.0f / PI;
 }
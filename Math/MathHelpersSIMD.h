@@ -0,0 +1,105 @@
+//--------------------------------------------------------------------------------------
+// 4-wide SIMD versions of the fast math functions
+//--------------------------------------------------------------------------------------
+// Each function works on four floats at once in an SSE register and gives the same results as the matching
+// scalar function in MathHelpers.h (e.g. FastSinCos4 and FastSinCos), with the same accuracy. For code that
+// processes many values at once such as TransformBatch.cpp. Only available when MATH_SIMD_SSE is defined,
+// other platforms should use the scalar versions
+
+#ifndef _MATH_HELPERS_SIMD_H_DEFINED_
+#define _MATH_HELPERS_SIMD_H_DEFINED_
+
+#include "MathSIMD.h"
+
+#if defined(MATH_SIMD_SSE)
+
+// Sine and cosine of four angles in radians at once. Same method and accuracy as FastSinCos
+// The angle is reduced to the range -PI/4 to PI/4 by subtracting the nearest multiple of PI/2 (in three parts
+// to keep precision for larger angles), then sin and cos of the reduced angle are found with small polynomials.
+// The quadrant (which multiple of PI/2 was removed) selects which result is sin/cos and their signs.
+inline void FastSinCos4(__m128 angle, __m128& sinOut, __m128& cosOut)
+{
+    const __m128 twoOverPi = _mm_set1_ps(0.636619772367581f);
+    const __m128 piOver2a  = _mm_set1_ps(1.5703125f);                  // PI/2 split into three parts, the first
+    const __m128 piOver2b  = _mm_set1_ps(4.837512969970703125e-4f);    // two have few enough bits that multiplying
+    const __m128 piOver2c  = _mm_set1_ps(7.54978995489188216e-8f);     // by the quadrant number is exact
+
+    // Quadrant number and reduced angle
+    __m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(angle, twoOverPi)); // Rounds to nearest
+    __m128  q = _mm_cvtepi32_ps(quadrant);
+    __m128  r = _mm_sub_ps(angle, _mm_mul_ps(q, piOver2a));
+    r = _mm_sub_ps(r, _mm_mul_ps(q, piOver2b));
+    r = _mm_sub_ps(r, _mm_mul_ps(q, piOver2c));
+    __m128  r2 = _mm_mul_ps(r, r);
+
+    // sin(r) = r + r^3 * (s1 + r^2 * (s2 + r^2 * s3))
+    __m128 s = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(-1.9515295891e-4f)), _mm_set1_ps(8.3321608736e-3f));
+    s = _mm_add_ps(_mm_mul_ps(s, r2), _mm_set1_ps(-1.6666654611e-1f));
+    s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, r2), r), r);
+
+    // cos(r) = 1 - r^2 / 2 + r^4 * (c1 + r^2 * (c2 + r^2 * c3))
+    __m128 c = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(2.443315711809948e-5f)), _mm_set1_ps(-1.388731625493765e-3f));
+    c = _mm_add_ps(_mm_mul_ps(c, r2), _mm_set1_ps(4.166664568298827e-2f));
+    c = _mm_mul_ps(_mm_mul_ps(c, r2), r2);
+    c = _mm_add_ps(_mm_sub_ps(c, _mm_mul_ps(r2, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+    // Odd quadrants swap sin and cos
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+    __m128 sinResult = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+    __m128 cosResult = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+
+    // Negate sin in quadrants 2 & 3 and cos in quadrants 1 & 2 by flipping the sign bit
+    __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+    __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+    sinOut = _mm_xor_ps(sinResult, sinSign);
+    cosOut = _mm_xor_ps(cosResult, cosSign);
+}
+
+// Arctangent of y/x for four pairs of values, giving angles from -PI to PI in the correct quadrant. Same method
+// and accuracy as FastAtan2
+inline __m128 FastAtan2_4(__m128 y, __m128 x)
+{
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 absX = _mm_andnot_ps(signMask, x);
+    __m128 absY = _mm_andnot_ps(signMask, y);
+    __m128 maxXY = _mm_max_ps(absX, absY);
+    __m128 minXY = _mm_min_ps(absX, absY);
+
+    // Ratio in the range 0 to 1 (0 when x and y are both 0, as std::atan2)
+    __m128 nonZero = _mm_cmpgt_ps(maxXY, _mm_setzero_ps());
+    __m128 a = _mm_and_ps(nonZero, _mm_div_ps(minXY, _mm_or_ps(maxXY, _mm_andnot_ps(nonZero, _mm_set1_ps(1.0f)))));
+
+    // Above tan(PI/8) use atan(a) = PI/4 + atan((a-1)/(a+1))
+    __m128 large = _mm_cmpgt_ps(a, _mm_set1_ps(0.414213562f));
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 reduced = _mm_div_ps(_mm_sub_ps(a, one), _mm_add_ps(a, one));
+    a = _mm_or_ps(_mm_and_ps(large, reduced), _mm_andnot_ps(large, a));
+    __m128 offset = _mm_and_ps(large, _mm_set1_ps(0.785398163f));
+
+    __m128 a2 = _mm_mul_ps(a, a);
+    __m128 p = _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(8.05374449538e-2f)), _mm_set1_ps(-1.38776856032e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(1.99777106478e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(-3.33329491539e-1f));
+    __m128 r = _mm_add_ps(offset, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, a2), a), a));
+
+    // Symmetry for the other octants: swap if |y| > |x|, reflect if x is negative, take the sign of y
+    __m128 swap = _mm_cmpgt_ps(absY, absX);
+    r = _mm_or_ps(_mm_and_ps(swap, _mm_sub_ps(_mm_set1_ps(1.57079632679f), r)), _mm_andnot_ps(swap, r));
+    __m128 negX = _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(x), 31)); // All bits set if the sign bit of x is set
+    r = _mm_or_ps(_mm_and_ps(negX, _mm_sub_ps(_mm_set1_ps(3.14159265359f), r)), _mm_andnot_ps(negX, r));
+    return _mm_xor_ps(r, _mm_and_ps(y, signMask)); // Sign of y, including -0 as std::atan2
+}
+
+
+// 1 / Sqrt of four values. Same method and accuracy as FastInvSqrt
+inline __m128 FastInvSqrt4(__m128 x)
+{
+    __m128 estimate = _mm_rsqrt_ps(x);
+    __m128 halfXEstimateSq = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), x), _mm_mul_ps(estimate, estimate));
+    return _mm_mul_ps(estimate, _mm_sub_ps(_mm_set1_ps(1.5f), halfXEstimateSq));
+}
+
+#endif
+
+
+#endif // _MATH_HELPERS_SIMD_H_DEFINED_
@@ -0,0 +1,46 @@
+//--------------------------------------------------------------------------------------
+// SIMD instruction set selection for the maths code
+//--------------------------------------------------------------------------------------
+// Selects the widest instruction set available to the compiler at build time. One of MATH_SIMD_AVX,
+// MATH_SIMD_SSE, MATH_SIMD_NEON or MATH_SIMD_SCALAR will be defined as 1. AVX builds also define MATH_SIMD_SSE,
+// so code with only an SSE version uses it under AVX too.
+// - AVX is used when the compiler targets it (e.g. /arch:AVX or /arch:AVX2 in Visual Studio, -mavx on GCC/Clang)
+// - SSE2 is always available on x64 and is used otherwise on Intel/AMD
+// - NEON is used on 64-bit ARM
+// - Anything else falls back to the plain C++ code
+// Define MATH_FORCE_SCALAR in the project settings to use the plain C++ code everywhere (useful for
+// checking results against the SIMD versions)
+
+#ifndef _MATH_SIMD_H_DEFINED_
+#define _MATH_SIMD_H_DEFINED_
+
+#if defined(MATH_FORCE_SCALAR)
+    #define MATH_SIMD_SCALAR 1
+#elif defined(__AVX__)
+    #define MATH_SIMD_AVX 1
+    #define MATH_SIMD_SSE 1 // AVX code also uses SSE instructions for 4-wide work
+    #include <immintrin.h>
+#elif defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define MATH_SIMD_SSE 1
+    #include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #define MATH_SIMD_NEON 1
+    #include <arm_neon.h>
+#else
+    #define MATH_SIMD_SCALAR 1
+#endif
+
+
+// Name of the selected instruction set, for display / logging
+#if defined(MATH_SIMD_AVX)
+    #define MATH_SIMD_NAME "AVX"
+#elif defined(MATH_SIMD_SSE)
+    #define MATH_SIMD_NAME "SSE2"
+#elif defined(MATH_SIMD_NEON)
+    #define MATH_SIMD_NAME "NEON"
+#else
+    #define MATH_SIMD_NAME "Scalar"
+#endif
+
+
+#endif // _MATH_SIMD_H_DEFINED_
@@ -0,0 +1,157 @@
+//--------------------------------------------------------------------------------------
+// Compile-time checks of the maths library
+//--------------------------------------------------------------------------------------
+// Nothing in this file runs - the static_asserts are checked by the compiler whenever the project is built,
+// so a change that breaks the constexpr maths (or gives wrong results at compile time) stops the build.
+
+#include "CVector2.h"
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "CMatrix3x4.h"
+#include "CQuaternion.h"
+#include "CFrustum.h"
+
+
+// Floats calculated in different ways rarely match exactly, compare to within a tolerance
+constexpr bool IsNear(float a, float b, float tolerance = 1e-6f)
+{
+    return (a > b ? a - b : b - a) <= tolerance;
+}
+
+constexpr bool IsNear(const CVector3& a, const CVector3& b, float tolerance = 1e-6f)
+{
+    return IsNear(a.x, b.x, tolerance) && IsNear(a.y, b.y, tolerance) && IsNear(a.z, b.z, tolerance);
+}
+
+constexpr bool IsNear(const CMatrix4x4& a, const CMatrix4x4& b, float tolerance = 1e-6f)
+{
+    return IsNear(a.GetRow(0), b.GetRow(0), tolerance) && IsNear(a.e03, b.e03, tolerance) &&
+           IsNear(a.GetRow(1), b.GetRow(1), tolerance) && IsNear(a.e13, b.e13, tolerance) &&
+           IsNear(a.GetRow(2), b.GetRow(2), tolerance) && IsNear(a.e23, b.e23, tolerance) &&
+           IsNear(a.GetRow(3), b.GetRow(3), tolerance) && IsNear(a.e33, b.e33, tolerance);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    MathHelpers
+-----------------------------------------------------------------------------------------*/
+
+static_assert(IsZero(0.0f) && IsZero(-1e-7f) && !IsZero(1e-5f), "IsZero");
+static_assert(IsNear(ToRadians(180.0f), PI) && IsNear(ToDegrees(PI / 2), 90.0f, 1e-5f), "Angle conversion");
+
+static_assert(IsNear(Sin(0.0f), 0.0f) && IsNear(Sin(PI / 6), 0.5f) && IsNear(Sin(-PI / 2), -1.0f), "Sin");
+static_assert(IsNear(Sin(100.0f), -0.50636564f), "Sin of large angle");
+static_assert(IsNear(Cos(0.0f), 1.0f) && IsNear(Cos(PI / 3), 0.5f) && IsNear(Cos(PI), -1.0f), "Cos");
+static_assert(IsNear(Tan(PI / 4), 1.0f), "Tan");
+static_assert(IsNear(Sqrt(2.0f), 1.41421356f) && Sqrt(0.0f) == 0.0f && IsNear(Sqrt(1e6f), 1000.0f), "Sqrt");
+static_assert(IsNear(InvSqrt(4.0f), 0.5f), "InvSqrt");
+
+// Fast versions use the precise compile-time code when evaluated by the compiler
+static_assert(Sin<MathPrecision::Fast>(PI / 6) == Sin(PI / 6) && InvSqrt<MathPrecision::Fast>(4.0f) == InvSqrt(4.0f), "Fast precision at compile time");
+
+
+/*-----------------------------------------------------------------------------------------
+    Vectors
+-----------------------------------------------------------------------------------------*/
+
+static_assert(Dot(CVector2{ 1, 2 } + CVector2{ 3, 4 }, CVector2{ 1, 1 }) == 10.0f, "CVector2 add / dot");
+static_assert(IsNear(Normalise(CVector2{ 3, 4 }).x, 0.6f), "CVector2 normalise");
+
+static_assert(Dot(CVector3{ 1, 2, 3 }, CVector3{ 4, 5, 6 }) == 32.0f, "CVector3 dot");
+static_assert(IsNear(Cross(CVector3{ 1, 0, 0 }, CVector3{ 0, 1, 0 }), CVector3{ 0, 0, 1 }), "CVector3 cross");
+static_assert(IsNear(CVector3{ 1, 2, 3 } * 2.0f - CVector3{ 1, 1, 1 }, CVector3{ 1, 3, 5 }), "CVector3 operators");
+static_assert(Length(CVector3{ 2, 3, 6 }) == 7.0f, "CVector3 length");
+static_assert(IsNear(Normalise(CVector3{ 0, 0, 5 }), CVector3{ 0, 0, 1 }), "CVector3 normalise");
+
+
+/*-----------------------------------------------------------------------------------------
+    Matrices
+-----------------------------------------------------------------------------------------*/
+
+static_assert(IsNear(MatrixIdentity() * MatrixTranslation({ 1, 2, 3 }), MatrixTranslation({ 1, 2, 3 })), "Identity multiply");
+static_assert(IsNear(TransformPoint({ 1, 1, 1 }, MatrixScaling(2.0f) * MatrixTranslation({ 1, 2, 3 })), CVector3{ 3, 4, 5 }), "Scale then translate");
+static_assert(IsNear(TransformVector({ 1, 1, 1 }, MatrixTranslation({ 1, 2, 3 })), CVector3{ 1, 1, 1 }), "Vectors ignore translation");
+static_assert(IsNear(TransformVector({ 0, 0, 1 }, MatrixRotationY(PI / 2)), CVector3{ 1, 0, 0 }), "Rotation Y direction");
+
+// Closed-form world matrix must match the product it replaces
+constexpr CVector3 testPosition = { 10, -20, 30 };
+constexpr CVector3 testRotation = { 0.3f, -1.2f, 2.5f };
+constexpr CVector3 testScale    = { 2, 3, 0.5f };
+static_assert(IsNear(MatrixWorld(testPosition, testRotation, testScale),
+                     MatrixScaling(testScale) * MatrixRotationZ(testRotation.z) * MatrixRotationX(testRotation.x) *
+                     MatrixRotationY(testRotation.y) * MatrixTranslation(testPosition), 1e-5f), "MatrixWorld");
+
+// Inverse of an affine matrix times the matrix is identity
+constexpr CMatrix4x4 testWorld = MatrixWorld(testPosition, testRotation, testScale);
+static_assert(IsNear(testWorld * InverseAffine(testWorld), MatrixIdentity(), 1e-5f), "InverseAffine");
+
+// Projection maps the near and far clip distances to depth 0 and 1
+constexpr CMatrix4x4 testProjection = MatrixPerspective(PI / 2, 1.0f, 1.0f, 100.0f);
+static_assert(IsNear(testProjection.e00, 1.0f) && IsNear(testProjection.e22 + testProjection.e32, 0.0f), "Projection near clip");
+static_assert(IsNear((100.0f * testProjection.e22 + testProjection.e32) / 100.0f, 1.0f), "Projection far clip");
+
+// FaceTarget points the Z axis at the target and keeps scale
+constexpr CMatrix4x4 FacedMatrix()
+{
+    CMatrix4x4 m = MatrixScaling(2.0f) * MatrixTranslation({ 1, 0, 1 });
+    m.FaceTarget({ 1, 0, 11 });
+    return m;
+}
+static_assert(IsNear(FacedMatrix().GetZAxis(), CVector3{ 0, 0, 2 }) && IsNear(FacedMatrix().GetScale(), CVector3{ 2, 2, 2 }), "FaceTarget");
+
+
+/*-----------------------------------------------------------------------------------------
+    Affine matrices
+-----------------------------------------------------------------------------------------*/
+
+constexpr CMatrix3x4 testAffine = ToAffine(testWorld);
+static_assert(IsNear(ToMatrix4x4(testAffine), testWorld) && IsNear(testAffine.GetPosition(), testPosition), "Affine conversion");
+static_assert(IsNear(ToMatrix4x4(testAffine * InverseAffine(testAffine)), MatrixIdentity(), 1e-5f), "Affine inverse");
+static_assert(IsNear(ToMatrix4x4(testAffine * ToAffine(MatrixRotationX(0.4f))), testWorld * MatrixRotationX(0.4f), 1e-5f), "Affine multiply");
+static_assert(IsNear(TransformPoint({ 1, 2, 3 }, testAffine), TransformPoint({ 1, 2, 3 }, testWorld), 1e-5f), "Affine transform point");
+static_assert(IsNear(testAffine * testProjection, testWorld * testProjection, 1e-5f), "Affine times projection");
+
+/*-----------------------------------------------------------------------------------------
+    Quaternions
+-----------------------------------------------------------------------------------------*/
+
+constexpr CQuaternion testQuaternion = QuaternionFromEuler(testRotation);
+static_assert(IsNear(MatrixRotation(testQuaternion), MatrixWorld({ 0, 0, 0 }, testRotation, { 1, 1, 1 }), 1e-5f), "Quaternion from Euler");
+static_assert(IsNear(MatrixWorld(testPosition, testQuaternion, testScale), testWorld, 1e-5f), "Quaternion MatrixWorld");
+static_assert(IsNear(ToMatrix4x4(AffineWorld(testPosition, testQuaternion, testScale)), testWorld, 1e-5f), "Quaternion AffineWorld");
+
+constexpr CQuaternion testQuaternion2 = QuaternionRotationAxis({ 0, 1, 0 }, 0.7f);
+static_assert(IsNear(MatrixRotation(testQuaternion * testQuaternion2),
+                     MatrixRotation(testQuaternion) * MatrixRotation(testQuaternion2), 1e-5f), "Quaternion multiply order");
+static_assert(IsNear(Rotate({ 1, 2, 3 }, testQuaternion), TransformVector({ 1, 2, 3 }, MatrixRotation(testQuaternion)), 1e-5f), "Quaternion rotate");
+static_assert(IsNear(Dot(QuaternionFromMatrix(testWorld), testQuaternion) * Dot(QuaternionFromMatrix(testWorld), testQuaternion), 1.0f, 1e-5f),
+              "Quaternion from matrix");
+static_assert(IsNear(Rotate({ 0, 0, 1 }, QuaternionLookRotation({ 3, 4, 5 })), Normalise(CVector3{ 3, 4, 5 }), 1e-5f), "Look rotation");
+
+
+/*-----------------------------------------------------------------------------------------
+    Bounds and frustum
+-----------------------------------------------------------------------------------------*/
+
+// Camera at the origin facing +Z with a 90 degree field of view, near clip 1 and far clip 100
+constexpr CFrustum testFrustum = FrustumFromMatrix(testProjection);
+static_assert(IsNear(testFrustum.planes[0].normal, Normalise(CVector3{ 1, 0, 1 }), 1e-5f) && IsNear(testFrustum.planes[4].distance, -1.0f, 1e-5f),
+              "Frustum planes");
+static_assert(IsVisible(testFrustum, BoundingSphere{ { 0, 0, 50 }, 1 }) && !IsVisible(testFrustum, BoundingSphere{ { 0, 0, -5 }, 1 }) &&
+              !IsVisible(testFrustum, BoundingSphere{ { 0, 0, 102 }, 1 }) && IsVisible(testFrustum, BoundingSphere{ { 0, 0, 100.5f }, 1 }),
+              "Frustum sphere near/far");
+static_assert(IsVisible(testFrustum, BoundingSphere{ { -11, 0, 10 }, 1 }) && !IsVisible(testFrustum, BoundingSphere{ { -12, 0, 10 }, 1 }),
+              "Frustum sphere side");
+static_assert(IsVisible(testFrustum, BoxFromMinMax({ 10, -1, 9 }, { 12, 1, 11 })) && !IsVisible(testFrustum, BoxFromMinMax({ 11, -1, 9 }, { 12, 1, 10 })),
+              "Frustum box side");
+static_assert(IsNear(TransformBox({ { 1, 0, 0 }, { 1, 2, 3 } }, ToAffine(MatrixRotationY(PI / 2) * MatrixTranslation({ 0, 5, 0 }))).extents,
+                     CVector3{ 3, 2, 1 }, 1e-5f), "TransformBox");
+static_assert(BoxesOverlap(BoxFromMinMax({ 0, 0, 0 }, { 2, 2, 2 }), BoxFromMinMax({ 2, 1, 1 }, { 3, 3, 3 })) &&
+              !BoxesOverlap(BoxFromMinMax({ 0, 0, 0 }, { 2, 2, 2 }), BoxFromMinMax({ 1, 2.5f, 1 }, { 3, 3, 3 })), "BoxesOverlap");
+static_assert(SphereOverlapsBox({ { 3, 3, 0 }, 1.5f }, BoxFromMinMax({ 0, 0, -1 }, { 2, 2, 1 })) &&
+              !SphereOverlapsBox({ { 3, 3, 0 }, 1.4f }, BoxFromMinMax({ 0, 0, -1 }, { 2, 2, 1 })), "SphereOverlapsBox");
+static_assert(RayHitsBox({ { 0, 0, -5 }, { 0, 0, 1 } }, { { 0, 0, 0 }, { 1, 1, 1 } }, 4.5f) &&
+              !RayHitsBox({ { 0, 0, -5 }, { 0, 0, 1 } }, { { 0, 0, 0 }, { 1, 1, 1 } }, 3.5f) &&
+              !RayHitsBox({ { 0, 0, -5 }, { 0, 0, -1 } }, { { 0, 0, 0 }, { 1, 1, 1 } }, 100) &&
+              !RayHitsBox({ { 0, 2, -5 }, { 0, 0, 1 } }, { { 0, 0, 0 }, { 1, 1, 1 } }, 100) &&
+              RayHitsBox({ { -5, -5, 0 }, { 1, 1, 0 } }, { { 0, 0, 0 }, { 1, 1, 1 } }, 100), "RayHitsBox");
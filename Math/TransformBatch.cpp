@@ -0,0 +1,203 @@
+//--------------------------------------------------------------------------------------
+// Batched world matrix building for large numbers of models
+//--------------------------------------------------------------------------------------
+
+#include "TransformBatch.h"
+#include "MathSIMD.h"
+#include "MathHelpersSIMD.h"
+
+
+#if defined(MATH_SIMD_SSE)
+
+/*-----------------------------------------------------------------------------------------
+    Four models at once
+-----------------------------------------------------------------------------------------*/
+
+// Write out the world matrices for four models given the upper 3x3 elements and positions, one model per lane
+static inline void StoreWorldMatrices4(__m128 e00, __m128 e01, __m128 e02, __m128 e10, __m128 e11, __m128 e12,
+                                       __m128 e20, __m128 e21, __m128 e22, __m128 pX, __m128 pY, __m128 pZ,
+                                       CMatrix3x4* worldMatricesOut)
+{
+    // CMatrix3x4 is stored column by column, so transposing a column's four elements across the four models
+    // gives that column for each model in turn
+    _MM_TRANSPOSE4_PS(e00, e10, e20, pX);
+    _MM_TRANSPOSE4_PS(e01, e11, e21, pY);
+    _MM_TRANSPOSE4_PS(e02, e12, e22, pZ);
+
+    __m128 columns[4][3] = { { e00, e01, e02 }, { e10, e11, e12 }, { e20, e21, e22 }, { pX, pY, pZ } };
+    for (int model = 0; model < 4; ++model)
+    {
+        float* matrix = &worldMatricesOut[model].e00;
+        _mm_storeu_ps(matrix,     columns[model][0]);
+        _mm_storeu_ps(matrix + 4, columns[model][1]);
+        _mm_storeu_ps(matrix + 8, columns[model][2]);
+    }
+}
+
+
+// Build the world matrices for four models. Each parameter holds one component for the four models
+static inline void BuildWorldMatrices4(__m128 pX, __m128 pY, __m128 pZ, __m128 rX, __m128 rY, __m128 rZ,
+                                       __m128 sX, __m128 sY, __m128 sZ, CMatrix3x4* worldMatricesOut)
+{
+    __m128 sinX, cosX, sinY, cosY, sinZ, cosZ;
+    FastSinCos4(rX, sinX, cosX);
+    FastSinCos4(rY, sinY, cosY);
+    FastSinCos4(rZ, sinZ, cosZ);
+
+    // Same closed-form expression as MatrixWorld, but each element is calculated for four models
+    __m128 sZsX = _mm_mul_ps(sinZ, sinX);
+    __m128 cZsX = _mm_mul_ps(cosZ, sinX);
+
+    __m128 e00 = _mm_mul_ps(sX, _mm_add_ps(_mm_mul_ps(cosZ, cosY), _mm_mul_ps(sZsX, sinY)));
+    __m128 e01 = _mm_mul_ps(sX, _mm_mul_ps(sinZ, cosX));
+    __m128 e02 = _mm_mul_ps(sX, _mm_sub_ps(_mm_mul_ps(sZsX, cosY), _mm_mul_ps(cosZ, sinY)));
+
+    __m128 e10 = _mm_mul_ps(sY, _mm_sub_ps(_mm_mul_ps(cZsX, sinY), _mm_mul_ps(sinZ, cosY)));
+    __m128 e11 = _mm_mul_ps(sY, _mm_mul_ps(cosZ, cosX));
+    __m128 e12 = _mm_mul_ps(sY, _mm_add_ps(_mm_mul_ps(sinZ, sinY), _mm_mul_ps(cZsX, cosY)));
+
+    __m128 e20 = _mm_mul_ps(sZ, _mm_mul_ps(cosX, sinY));
+    __m128 e21 = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(sZ, sinX));
+    __m128 e22 = _mm_mul_ps(sZ, _mm_mul_ps(cosX, cosY));
+
+    StoreWorldMatrices4(e00, e01, e02, e10, e11, e12, e20, e21, e22, pX, pY, pZ, worldMatricesOut);
+}
+
+
+// Build the world matrices for four models with quaternion rotations. Each parameter holds one component for the four models
+static inline void BuildWorldMatrices4(__m128 pX, __m128 pY, __m128 pZ, __m128 qX, __m128 qY, __m128 qZ, __m128 qW,
+                                       __m128 sX, __m128 sY, __m128 sZ, CMatrix3x4* worldMatricesOut)
+{
+    // Same expression as the quaternion version of MatrixWorld, but each element is calculated for four models
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 x2 = _mm_mul_ps(qX, two);
+    __m128 y2 = _mm_mul_ps(qY, two);
+    __m128 z2 = _mm_mul_ps(qZ, two);
+    __m128 xx = _mm_mul_ps(qX, x2),  yy = _mm_mul_ps(qY, y2),  zz = _mm_mul_ps(qZ, z2);
+    __m128 xy = _mm_mul_ps(qX, y2),  xz = _mm_mul_ps(qX, z2),  yz = _mm_mul_ps(qY, z2);
+    __m128 wx = _mm_mul_ps(qW, x2),  wy = _mm_mul_ps(qW, y2),  wz = _mm_mul_ps(qW, z2);
+
+    __m128 e00 = _mm_mul_ps(sX, _mm_sub_ps(one, _mm_add_ps(yy, zz)));
+    __m128 e01 = _mm_mul_ps(sX, _mm_add_ps(xy, wz));
+    __m128 e02 = _mm_mul_ps(sX, _mm_sub_ps(xz, wy));
+
+    __m128 e10 = _mm_mul_ps(sY, _mm_sub_ps(xy, wz));
+    __m128 e11 = _mm_mul_ps(sY, _mm_sub_ps(one, _mm_add_ps(xx, zz)));
+    __m128 e12 = _mm_mul_ps(sY, _mm_add_ps(yz, wx));
+
+    __m128 e20 = _mm_mul_ps(sZ, _mm_add_ps(xz, wy));
+    __m128 e21 = _mm_mul_ps(sZ, _mm_sub_ps(yz, wx));
+    __m128 e22 = _mm_mul_ps(sZ, _mm_sub_ps(one, _mm_add_ps(xx, yy)));
+
+    StoreWorldMatrices4(e00, e01, e02, e10, e11, e12, e20, e21, e22, pX, pY, pZ, worldMatricesOut);
+}
+
+#endif
+
+
+/*-----------------------------------------------------------------------------------------
+    Batch building
+-----------------------------------------------------------------------------------------*/
+
+// Build world matrices for numModels models from the given transform arrays. The result for each model is
+// the same as AffineWorld(position, rotation, scale) to within float rounding
+void BuildWorldMatrices(const TransformArrays& t, int numModels, CMatrix3x4* worldMatricesOut)
+{
+    int model = 0;
+
+#if defined(MATH_SIMD_SSE)
+
+    for (; model + 4 <= numModels; model += 4)
+    {
+        BuildWorldMatrices4(_mm_loadu_ps(t.positionX + model), _mm_loadu_ps(t.positionY + model), _mm_loadu_ps(t.positionZ + model),
+                            _mm_loadu_ps(t.rotationX + model), _mm_loadu_ps(t.rotationY + model), _mm_loadu_ps(t.rotationZ + model),
+                            _mm_loadu_ps(t.scaleX    + model), _mm_loadu_ps(t.scaleY    + model), _mm_loadu_ps(t.scaleZ    + model),
+                            worldMatricesOut + model);
+    }
+
+    // Any remaining models (fewer than four) are padded out to a full set so they get exactly the same
+    // calculation as the others
+    int remaining = numModels - model;
+    if (remaining > 0)
+    {
+        alignas(16) float in[9][4] = {};
+        for (int i = 0; i < remaining; ++i)
+        {
+            in[0][i] = t.positionX[model + i];  in[1][i] = t.positionY[model + i];  in[2][i] = t.positionZ[model + i];
+            in[3][i] = t.rotationX[model + i];  in[4][i] = t.rotationY[model + i];  in[5][i] = t.rotationZ[model + i];
+            in[6][i] = t.scaleX   [model + i];  in[7][i] = t.scaleY   [model + i];  in[8][i] = t.scaleZ   [model + i];
+        }
+        CMatrix3x4 out[4];
+        BuildWorldMatrices4(_mm_load_ps(in[0]), _mm_load_ps(in[1]), _mm_load_ps(in[2]),
+                            _mm_load_ps(in[3]), _mm_load_ps(in[4]), _mm_load_ps(in[5]),
+                            _mm_load_ps(in[6]), _mm_load_ps(in[7]), _mm_load_ps(in[8]), out);
+        for (int i = 0; i < remaining; ++i)
+        {
+            worldMatricesOut[model + i] = out[i];
+        }
+    }
+
+#else
+
+    for (; model < numModels; ++model)
+    {
+        worldMatricesOut[model] = AffineWorld({ t.positionX[model], t.positionY[model], t.positionZ[model] },
+                                              { t.rotationX[model], t.rotationY[model], t.rotationZ[model] },
+                                              { t.scaleX   [model], t.scaleY   [model], t.scaleZ   [model] });
+    }
+
+#endif
+}
+
+
+// Build world matrices for numModels models with quaternion rotations. The result for each model is the same
+// as AffineWorld(position, quaternion, scale) from CQuaternion.h
+void BuildWorldMatrices(const QuaternionTransformArrays& t, int numModels, CMatrix3x4* worldMatricesOut)
+{
+    int model = 0;
+
+#if defined(MATH_SIMD_SSE)
+
+    for (; model + 4 <= numModels; model += 4)
+    {
+        BuildWorldMatrices4(_mm_loadu_ps(t.positionX + model), _mm_loadu_ps(t.positionY + model), _mm_loadu_ps(t.positionZ + model),
+                            _mm_loadu_ps(t.rotationX + model), _mm_loadu_ps(t.rotationY + model), _mm_loadu_ps(t.rotationZ + model),
+                            _mm_loadu_ps(t.rotationW + model),
+                            _mm_loadu_ps(t.scaleX    + model), _mm_loadu_ps(t.scaleY    + model), _mm_loadu_ps(t.scaleZ    + model),
+                            worldMatricesOut + model);
+    }
+
+    // Remaining models padded out to a full set as above
+    int remaining = numModels - model;
+    if (remaining > 0)
+    {
+        alignas(16) float in[10][4] = {};
+        for (int i = 0; i < remaining; ++i)
+        {
+            in[0][i] = t.positionX[model + i];  in[1][i] = t.positionY[model + i];  in[2][i] = t.positionZ[model + i];
+            in[3][i] = t.rotationX[model + i];  in[4][i] = t.rotationY[model + i];  in[5][i] = t.rotationZ[model + i];
+            in[6][i] = t.rotationW[model + i];
+            in[7][i] = t.scaleX   [model + i];  in[8][i] = t.scaleY   [model + i];  in[9][i] = t.scaleZ   [model + i];
+        }
+        CMatrix3x4 out[4];
+        BuildWorldMatrices4(_mm_load_ps(in[0]), _mm_load_ps(in[1]), _mm_load_ps(in[2]),
+                            _mm_load_ps(in[3]), _mm_load_ps(in[4]), _mm_load_ps(in[5]), _mm_load_ps(in[6]),
+                            _mm_load_ps(in[7]), _mm_load_ps(in[8]), _mm_load_ps(in[9]), out);
+        for (int i = 0; i < remaining; ++i)
+        {
+            worldMatricesOut[model + i] = out[i];
+        }
+    }
+
+#else
+
+    for (; model < numModels; ++model)
+    {
+        worldMatricesOut[model] = AffineWorld({ t.positionX[model], t.positionY[model], t.positionZ[model] },
+                                              { t.rotationX[model], t.rotationY[model], t.rotationZ[model], t.rotationW[model] },
+                                              { t.scaleX   [model], t.scaleY   [model], t.scaleZ   [model] });
+    }
+
+#endif
+}
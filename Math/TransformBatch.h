@@ -0,0 +1,66 @@
+//--------------------------------------------------------------------------------------
+// Batched world matrix building for large numbers of models
+//--------------------------------------------------------------------------------------
+// Code in .cpp file
+// Building world matrices one model at a time wastes most of the work: each matrix is built from several
+// matrix multiplies and three separate sin/cos pairs. The functions here take the positions, rotations and
+// scales of many models stored "structure-of-arrays" (all x positions together, then all y positions etc.)
+// and build the world matrices with a closed-form expression, working on four models at once with SIMD
+// instructions, including the sin/cos calculation. Rotations can be given as Euler angles or as quaternions,
+// the quaternion version needs no sin/cos at all so is the faster of the two.
+
+#ifndef _TRANSFORM_BATCH_H_DEFINED_
+#define _TRANSFORM_BATCH_H_DEFINED_
+
+#include "CVector3.h"
+#include "CMatrix3x4.h"
+#include "CQuaternion.h"
+
+
+// Pointers to the transform data for a set of models in structure-of-arrays form. Each pointer is the start
+// of an array holding one float per model. Rotations are Euler angles in radians, applied in the same
+// order as Model (Z, then X, then Y). The arrays don't need any particular alignment
+struct TransformArrays
+{
+    const float* positionX;
+    const float* positionY;
+    const float* positionZ;
+
+    const float* rotationX;
+    const float* rotationY;
+    const float* rotationZ;
+
+    const float* scaleX;
+    const float* scaleY;
+    const float* scaleZ;
+};
+
+// As above but with rotations held as unit quaternions (see CQuaternion.h)
+struct QuaternionTransformArrays
+{
+    const float* positionX;
+    const float* positionY;
+    const float* positionZ;
+
+    const float* rotationX;
+    const float* rotationY;
+    const float* rotationZ;
+    const float* rotationW;
+
+    const float* scaleX;
+    const float* scaleY;
+    const float* scaleZ;
+};
+
+
+// Build world matrices for numModels models from the given transform arrays. The result for each model is
+// the same as AffineWorld(position, rotation, scale) to within float rounding (sin/cos are calculated with
+// polynomials instead of the standard library, accurate to a few units in the last place)
+void BuildWorldMatrices(const TransformArrays& transforms, int numModels, CMatrix3x4* worldMatricesOut);
+
+// Build world matrices for numModels models with quaternion rotations. The result for each model is the same
+// as AffineWorld(position, quaternion, scale) from CQuaternion.h
+void BuildWorldMatrices(const QuaternionTransformArrays& transforms, int numModels, CMatrix3x4* worldMatricesOut);
+
+
+#endif // _TRANSFORM_BATCH_H_DEFINED_
@@ -13,17 +13,18 @@
 #include "CVector3.h" 
 
 #include <assimp/Importer.hpp>
-#include <assimp/DefaultLogger.hpp>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
 #include <memory>
+#include <algorithm>
 
 
 // Pass the name of the mesh file to load. Uses assimp (http://www.assimp.org/) to support many file types
 // Optionally request tangents to be calculated (for normal and parallax mapping - see later lab)
+// Optionally keep a CPU-side copy of the positions and indices, for meshes used as occluders (see OcclusionBuffer.h)
 // Will throw a std::runtime_error exception on failure (since constructors can't return errors).
-Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
+Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/, bool keepPositions /*= false*/)
 {
     Assimp::Importer importer;
 
@@ -71,10 +72,9 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
   
     importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, removeComponents);
 
-    // Import mesh with assimp given above requirements - log output
-    Assimp::DefaultLogger::create("", Assimp::DefaultLogger::VERBOSE);
+    // Import mesh with assimp given above requirements. Assimp's logger is not used: it is a single object shared by
+    // the whole process and meshes may be loaded on several threads at once. Errors are still reported below
     const aiScene* scene = importer.ReadFile(fileName, assimpFlags);
-    Assimp::DefaultLogger::kill();
     if (scene == nullptr)  throw std::runtime_error("Error loading mesh (" + fileName + "). " + importer.GetErrorString());
     if (scene->mNumMeshes == 0)  throw std::runtime_error("No usable geometry in mesh: " + fileName);
 
@@ -118,14 +118,14 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
         offset += 8;
     }
 
-    mVertexSize = offset;
+    mGeometry.vertexSize = offset;
 
 
     // Create a "vertex layout" to describe to DirectX what is data in each vertex of this mesh
     auto shaderSignature = CreateSignatureForVertexLayout(vertexElements.data(), static_cast<int>(vertexElements.size()));
     HRESULT hr = gD3DDevice->CreateInputLayout(vertexElements.data(), static_cast<UINT>(vertexElements.size()),
                                                shaderSignature->GetBufferPointer(), shaderSignature->GetBufferSize(),
-                                               &mVertexLayout);
+                                               &mGeometry.layout);
     if (shaderSignature)  shaderSignature->Release();
     if (FAILED(hr))  throw std::runtime_error("Failure creating input layout for " + fileName);
 
@@ -136,32 +136,38 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
     // Create CPU-side buffers to hold current mesh data - exact content is flexible so can't use a structure for a vertex - so just a block of bytes
     // Note: for large arrays a unique_ptr is better than a vector because vectors default-initialise all the values which is a waste of time.
     mNumVertices = assimpMesh->mNumVertices;
-    mNumIndices  = assimpMesh->mNumFaces * 3;
-    auto vertices = std::make_unique<unsigned char[]>(mNumVertices * mVertexSize);
-    auto indices  = std::make_unique<unsigned char[]>(mNumIndices * 4); // Using 32 bit indexes (4 bytes) for each indeex
+    mGeometry.numIndices  = assimpMesh->mNumFaces * 3;
+    auto vertices = std::make_unique<unsigned char[]>(mNumVertices * mGeometry.vertexSize);
+    auto indices  = std::make_unique<unsigned char[]>(mGeometry.numIndices * 4); // Using 32 bit indexes (4 bytes) for each indeex
 
 
     //-----------------------------------
 
     // Copy mesh data from assimp to our CPU-side vertex buffer
 
+    // Also find the bounds of the mesh while going through the positions
     CVector3* assimpPosition = reinterpret_cast<CVector3*>(assimpMesh->mVertices);
+    CVector3 minPosition = *assimpPosition;
+    CVector3 maxPosition = *assimpPosition;
     unsigned char* position = vertices.get() + positionOffset;
-    unsigned char* positionEnd = position + mNumVertices * mVertexSize;
+    unsigned char* positionEnd = position + mNumVertices * mGeometry.vertexSize;
     while (position != positionEnd)
     {
         *(CVector3*)position = *assimpPosition;
-        position += mVertexSize;
+        minPosition = { std::min(minPosition.x, assimpPosition->x), std::min(minPosition.y, assimpPosition->y), std::min(minPosition.z, assimpPosition->z) };
+        maxPosition = { std::max(maxPosition.x, assimpPosition->x), std::max(maxPosition.y, assimpPosition->y), std::max(maxPosition.z, assimpPosition->z) };
+        position += mGeometry.vertexSize;
         ++assimpPosition;
     }
+    mBounds = BoxFromMinMax(minPosition, maxPosition);
 
     CVector3* assimpNormal = reinterpret_cast<CVector3*>(assimpMesh->mNormals);
     unsigned char* normal = vertices.get() + normalOffset;
-    unsigned char* normalEnd = normal + mNumVertices * mVertexSize;
+    unsigned char* normalEnd = normal + mNumVertices * mGeometry.vertexSize;
     while (normal != normalEnd)
     {
         *(CVector3*)normal = *assimpNormal;
-        normal += mVertexSize;
+        normal += mGeometry.vertexSize;
         ++assimpNormal;
     }
 
@@ -169,11 +175,11 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
     {
       CVector3* assimpTangent = reinterpret_cast<CVector3*>(assimpMesh->mTangents);
       unsigned char* tangent =  vertices.get() + tangentOffset;
-      unsigned char* tangentEnd = tangent + mNumVertices * mVertexSize;
+      unsigned char* tangentEnd = tangent + mNumVertices * mGeometry.vertexSize;
       while (tangent != tangentEnd)
       {
         *(CVector3*)tangent = *assimpTangent;
-        tangent += mVertexSize;
+        tangent += mGeometry.vertexSize;
         ++assimpTangent;
       }
     }
@@ -182,11 +188,11 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
     {
         aiVector3D* assimpUV = assimpMesh->mTextureCoords[0];
         unsigned char* uv = vertices.get() + uvOffset;
-        unsigned char* uvEnd = uv + mNumVertices * mVertexSize;
+        unsigned char* uvEnd = uv + mNumVertices * mGeometry.vertexSize;
         while (uv != uvEnd)
         {
             *(CVector2*)uv = CVector2(assimpUV->x, assimpUV->y);
-            uv += mVertexSize;
+            uv += mGeometry.vertexSize;
             ++assimpUV;
         }
     }
@@ -208,60 +214,27 @@ Mesh::Mesh(const std::string& fileName, bool requireTangents /*= false*/)
 
     //-----------------------------------
 
-    D3D11_BUFFER_DESC bufferDesc;
-    D3D11_SUBRESOURCE_DATA initData;
-
     // Create GPU-side vertex buffer and copy the vertices imported by assimp into it
-    bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Indicate it is a vertex buffer
-    bufferDesc.Usage = D3D11_USAGE_DEFAULT;          // Default usage for this buffer - we'll see other usages later
-    bufferDesc.ByteWidth = mNumVertices * mVertexSize; // Size of the buffer in bytes
-    bufferDesc.CPUAccessFlags = 0;
-    bufferDesc.MiscFlags = 0;
-    initData.pSysMem = vertices.get(); // Fill the new vertex buffer with data loaded by assimp
-    
-    hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &mVertexBuffer);
-    if (FAILED(hr))  throw std::runtime_error("Failure creating vertex buffer for " + fileName);
+    mGeometry.vertexBuffer = gRenderDevice->CreateVertexBuffer(vertices.get(), mNumVertices * mGeometry.vertexSize);
+    if (mGeometry.vertexBuffer == nullptr)  throw std::runtime_error("Failure creating vertex buffer for " + fileName);
 
+    // Create GPU-side index buffer and copy the indices imported by assimp into it
+    mGeometry.indexBuffer = gRenderDevice->CreateIndexBuffer(indices.get(), mGeometry.numIndices * sizeof(DWORD));
+    if (mGeometry.indexBuffer == nullptr)  throw std::runtime_error("Failure creating index buffer for " + fileName);
 
-    // Create GPU-side index buffer and copy the vertices imported by assimp into it
-    bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER; // Indicate it is an index buffer
-    bufferDesc.Usage = D3D11_USAGE_DEFAULT;         // Default usage for this buffer - we'll see other usages later
-    bufferDesc.ByteWidth = mNumIndices * sizeof(DWORD); // Size of the buffer in bytes
-    bufferDesc.CPUAccessFlags = 0;
-    bufferDesc.MiscFlags = 0;
-    initData.pSysMem = indices.get(); // Fill the new index buffer with data loaded by assimp
+    mGeometry.sortId = NewGeometrySortId();
 
-    hr = gD3DDevice->CreateBuffer(&bufferDesc, &initData, &mIndexBuffer);
-    if (FAILED(hr))  throw std::runtime_error("Failure creating index buffer for " + fileName);
+    if (keepPositions)
+    {
+        mPositions.assign(reinterpret_cast<CVector3*>(assimpMesh->mVertices), reinterpret_cast<CVector3*>(assimpMesh->mVertices) + mNumVertices);
+        mIndices.assign(reinterpret_cast<uint32_t*>(indices.get()), reinterpret_cast<uint32_t*>(indices.get()) + mGeometry.numIndices);
+    }
 }
 
 
 Mesh::~Mesh()
 {
-    if (mIndexBuffer)   mIndexBuffer ->Release();
-    if (mVertexBuffer)  mVertexBuffer->Release();
-    if (mVertexLayout)  mVertexLayout->Release();
-}
-
-
-// The render function assumes shaders, matrices, textures, samplers etc. have been set up already.
-// It simply draws this mesh with whatever settings the GPU is currently using.
-void Mesh::Render()
-{
-    // Set vertex buffer as next data source for GPU
-    UINT stride = mVertexSize;
-    UINT offset = 0;
-    gD3DContext->IASetVertexBuffers(0, 1, &mVertexBuffer, &stride, &offset);
-
-    // Indicate the layout of vertex buffer
-    gD3DContext->IASetInputLayout(mVertexLayout);
-
-    // Set index buffer as next data source for GPU, indicate it uses 32-bit integers
-    gD3DContext->IASetIndexBuffer(mIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
-
-    // Using triangle lists only in this class
-    gD3DContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-    // Render mesh
-    gD3DContext->DrawIndexed(mNumIndices, 0, 0);
+    gRenderDevice->ReleaseBuffer(mGeometry.indexBuffer);
+    gRenderDevice->ReleaseBuffer(mGeometry.vertexBuffer);
+    if (mGeometry.layout)  mGeometry.layout->Release();
 }
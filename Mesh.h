@@ -8,8 +8,12 @@
 // expected to select these things. A later lab will introduce a more robust loader.
 
 #include "common.h"
+#include "Bounds.h"
+#include "RenderQueue.h"
 
 #include <string>
+#include <vector>
+#include <cstdint>
 
 #ifndef _MESH_H_INCLUDED_
 #define _MESH_H_INCLUDED_
@@ -19,25 +23,32 @@ class Mesh
 public:
     // Pass the name of the mesh file to load. Uses assimp (http://www.assimp.org/) to support many file types
     // Optionally request tangents to be calculated (for normal and parallax mapping - see later lab)
+    // Optionally keep a CPU-side copy of the positions and indices, for meshes used as occluders (see OcclusionBuffer.h)
     // Will throw a std::runtime_error exception on failure (since constructors can't return errors).
-    Mesh(const std::string& fileName, bool requireTangents = false);
+    Mesh(const std::string& fileName, bool requireTangents = false, bool keepPositions = false);
     ~Mesh();
 
-    // The render function assumes shaders, matrices, textures, samplers etc. have been set up already.
-    // It simply draws this mesh with whatever settings the GPU is currently using.
-    void Render();
+    // Box enclosing all the vertices of the mesh, in model space
+    const BoundingBox& Bounds() const  { return mBounds; }
 
+    // Buffers and layout of the mesh, for submitting it to a RenderQueue
+    const RenderGeometry& Geometry() const  { return mGeometry; }
+
+    // Model space vertex positions and triangle list indices, empty unless keepPositions was set when loading
+    const std::vector<CVector3>& Positions() const  { return mPositions; }
+    const std::vector<uint32_t>& Indices() const    { return mIndices; }
 
-private:
-    unsigned int       mVertexSize;             // Size in bytes of a single vertex (depends on what it contains, uvs, tangents etc.)
-    ID3D11InputLayout* mVertexLayout = nullptr; // DirectX specification of data held in a single vertex
 
-    // GPU-side vertex and index buffers
+private:
+    // GPU-side vertex and index buffers, the DirectX specification of data held in a single vertex (layout) and the
+    // size in bytes of a single vertex (depends on what it contains, uvs, tangents etc.)
+    RenderGeometry     mGeometry;
     unsigned int       mNumVertices;
-    ID3D11Buffer*      mVertexBuffer = nullptr;
 
-    unsigned int       mNumIndices;
-    ID3D11Buffer*      mIndexBuffer  = nullptr;
+    BoundingBox        mBounds;
+
+    std::vector<CVector3> mPositions;
+    std::vector<uint32_t> mIndices;
 };
 
 
@@ -9,63 +9,95 @@
 #include "Common.h"
 #include "GraphicsHelpers.h"
 #include "Mesh.h"
+#include "RenderQueue.h"
+#include "TransformBatch.h"
+
+#include <algorithm>
+#include <atomic>
+
+
+// Count of world matrix rebuilds for diagnostics, see NumWorldMatrixRebuilds
+static std::atomic<int> gNumWorldMatrixRebuilds = 0; // Atomic as models may be updated on a simulation thread
 
-void Model::Render()
-{
-    UpdateWorldMatrix();
 
-    gPerModelConstants.worldMatrix = mWorldMatrix; // Update C++ side constant buffer
-    UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
+// Submit the model to a render queue, to be rendered with the given material when the queue is executed
+void Model::Submit(RenderQueue& queue, int material, CVector3 colour /*= { 1, 1, 1 }*/, int object /*= -1*/) const
+{
+    queue.Submit(material, mMesh->Geometry(), RenderMatrix(), colour, 0, object);
+}
 
-    // Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-    gD3DContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
-    gD3DContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
 
-    mMesh->Render();
+BoundingSphere Model::WorldBounds() const
+{
+    return TransformSphere(SphereFromBox(mMesh->Bounds()), RenderMatrix());
 }
 
 
 
+// Read which of the given control keys are held
+ModelControlKeys ReadControlKeys(KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,
+                                 KeyCode turnCW, KeyCode turnCCW, KeyCode moveForward, KeyCode moveBackward)
+{
+	return { KeyHeld( turnUp ), KeyHeld( turnDown ), KeyHeld( turnLeft ), KeyHeld( turnRight ),
+	         KeyHeld( turnCW ), KeyHeld( turnCCW ), KeyHeld( moveForward ), KeyHeld( moveBackward ) };
+}
+
+
 // Control the model's position and rotation using keys provided. Amount of motion performed depends on frame time
 void Model::Control(float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,
                                      KeyCode turnCW, KeyCode turnCCW, KeyCode moveForward, KeyCode moveBackward)
 {
-    UpdateWorldMatrix();
+	Control(frameTime, ReadControlKeys(turnUp, turnDown, turnLeft, turnRight, turnCW, turnCCW, moveForward, moveBackward));
+}
 
-	if (KeyHeld( turnDown ))
+// Control the model's position and rotation using key states read earlier
+void Model::Control(float frameTime, const ModelControlKeys& keys)
+{
+	// Pitch and roll are around the model's own X and Z axes (rotation before the current one), turning left/right
+	// is around the world Y axis (rotation after the current one) so the model doesn't lean over as it turns
+	float rotation = ROTATION_SPEED * frameTime;
+	if (keys.turnDown)
+	{
+		mRotation = QuaternionRotationAxis({ 1, 0, 0 }, rotation) * mRotation;
+	}
+	if (keys.turnUp)
 	{
-		mRotation.x += ROTATION_SPEED * frameTime;
+		mRotation = QuaternionRotationAxis({ 1, 0, 0 }, -rotation) * mRotation;
 	}
-	if (KeyHeld( turnUp ))
+	if (keys.turnRight)
 	{
-		mRotation.x -= ROTATION_SPEED * frameTime;
+		mRotation = mRotation * QuaternionRotationAxis({ 0, 1, 0 }, rotation);
 	}
-	if (KeyHeld( turnRight ))
+	if (keys.turnLeft)
 	{
-		mRotation.y += ROTATION_SPEED * frameTime;
+		mRotation = mRotation * QuaternionRotationAxis({ 0, 1, 0 }, -rotation);
 	}
-	if (KeyHeld( turnLeft ))
+	if (keys.turnCW)
 	{
-		mRotation.y -= ROTATION_SPEED * frameTime;
+		mRotation = QuaternionRotationAxis({ 0, 0, 1 }, rotation) * mRotation;
 	}
-	if (KeyHeld( turnCW ))
+	if (keys.turnCCW)
 	{
-		mRotation.z += ROTATION_SPEED * frameTime;
+		mRotation = QuaternionRotationAxis({ 0, 0, 1 }, -rotation) * mRotation;
 	}
-	if (KeyHeld( turnCCW ))
+	if (keys.turnDown || keys.turnUp || keys.turnRight || keys.turnLeft || keys.turnCW || keys.turnCCW)
 	{
-		mRotation.z -= ROTATION_SPEED * frameTime;
+		mRotation = Normalise<MathPrecision::Fast>(mRotation); // Remove any drift from repeated multiplies (fast version is easily accurate enough)
+		mWorldMatrixDirty = true;
 	}
 
 	// Local Z movement - move in the direction of the Z axis, get axis from world matrix
-    CVector3 localZDir = Normalise({ mWorldMatrix.e20, mWorldMatrix.e21, mWorldMatrix.e22 }); // normalise axis in case world matrix has scaling
-	if (KeyHeld( moveForward ))
+	if (!keys.moveForward && !keys.moveBackward)  return; // Avoid rebuilding the world matrix just to read the axis
+    const CMatrix3x4& worldMatrix = WorldMatrix();
+    CVector3 localZDir = Normalise({ worldMatrix.e20, worldMatrix.e21, worldMatrix.e22 }); // normalise axis in case world matrix has scaling
+	mWorldMatrixDirty = true;
+	if (keys.moveForward)
 	{
 		mPosition.x += localZDir.x * MOVEMENT_SPEED * frameTime;
 		mPosition.y += localZDir.y * MOVEMENT_SPEED * frameTime;
 		mPosition.z += localZDir.z * MOVEMENT_SPEED * frameTime;
 	}
-	if (KeyHeld( moveBackward ))
+	if (keys.moveBackward)
 	{
 		mPosition.x -= localZDir.x * MOVEMENT_SPEED * frameTime;
 		mPosition.y -= localZDir.y * MOVEMENT_SPEED * frameTime;
@@ -74,7 +106,75 @@ void Model::Control(float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode t
 }
 
 
-void Model::UpdateWorldMatrix()
+void Model::UpdateWorldMatrix() const
+{
+    // Same as MatrixScaling(mScale) * MatrixRotation(mRotation) * MatrixTranslation(mPosition)
+    mWorldMatrix = AffineWorld(mPosition, mRotation, mScale);
+
+    // Attached models are positioned relative to their parent
+    if (mParent != nullptr)
+    {
+        mWorldMatrix = mWorldMatrix * mParent->WorldMatrix();
+        mParentVersion = mParent->mWorldMatrixVersion;
+    }
+    mWorldMatrixDirty = false;
+    ++mWorldMatrixVersion;
+    ++gNumWorldMatrixRebuilds;
+}
+
+
+// Update the world matrices of many models at once. The changed models (unattached ones only, see ModelHierarchy)
+// are gathered and their transforms copied into structure-of-arrays form a block at a time (small enough to stay on
+// the stack and in cache), then built together with SIMD
+void Model::UpdateWorldMatrices(Model* const models[], int numModels)
+{
+    const int BlockSize = 64;
+    float transforms[10][BlockSize];
+    CMatrix3x4 worldMatrices[BlockSize];
+    QuaternionTransformArrays arrays = { transforms[0], transforms[1], transforms[2], transforms[3], transforms[4],
+                                         transforms[5], transforms[6], transforms[7], transforms[8], transforms[9] };
+
+    Model* blockModels[BlockSize];
+    int nextModel = 0;
+    while (nextModel < numModels)
+    {
+        // Gather the next block of models that need rebuilding
+        int blockCount = 0;
+        for (; nextModel < numModels && blockCount < BlockSize; ++nextModel)
+        {
+            if (models[nextModel]->mWorldMatrixDirty && models[nextModel]->mParent == nullptr)  blockModels[blockCount++] = models[nextModel];
+        }
+        if (blockCount == 0)  break;
+
+        for (int i = 0; i < blockCount; ++i)
+        {
+            const Model* model = blockModels[i];
+            transforms[0][i] = model->mPosition.x;  transforms[1][i] = model->mPosition.y;  transforms[2][i] = model->mPosition.z;
+            transforms[3][i] = model->mRotation.x;  transforms[4][i] = model->mRotation.y;  transforms[5][i] = model->mRotation.z;
+            transforms[6][i] = model->mRotation.w;
+            transforms[7][i] = model->mScale.x;     transforms[8][i] = model->mScale.y;     transforms[9][i] = model->mScale.z;
+        }
+
+        BuildWorldMatrices(arrays, blockCount, worldMatrices);
+
+        for (int i = 0; i < blockCount; ++i)
+        {
+            blockModels[i]->mWorldMatrix = worldMatrices[i];
+            blockModels[i]->mWorldMatrixDirty = false;
+            ++blockModels[i]->mWorldMatrixVersion;
+        }
+        gNumWorldMatrixRebuilds += blockCount;
+    }
+}
+
+
+// Diagnostics: number of world matrices rebuilt since the count was last reset
+int Model::NumWorldMatrixRebuilds()
+{
+    return gNumWorldMatrixRebuilds;
+}
+
+void Model::ResetWorldMatrixRebuilds()
 {
-    mWorldMatrix = MatrixScaling(mScale) * MatrixRotationZ(mRotation.z) * MatrixRotationX(mRotation.x) * MatrixRotationY(mRotation.y) * MatrixTranslation(mPosition);
+    gNumWorldMatrixRebuilds = 0;
 }
\ No newline at end of file
@@ -2,17 +2,36 @@
 // Class encapsulating a model
 //--------------------------------------------------------------------------------------
 // Holds a pointer to a mesh as well as position, rotation and scaling, which are converted to a world matrix when required
+// The world matrix is cached and only rebuilt after the position, rotation or scale changes - most models never move
+// A model can be attached to a parent with ModelHierarchy, its position, rotation and scale are then relative to the parent
+// Rotation is held as a quaternion, Euler angle getters/setters are provided for convenience
 // This is more of a convenience class, the Mesh class does most of the difficult work.
 
 #include "Common.h"
 #include "CVector3.h"
-#include "CMatrix4x4.h"
+#include "CMatrix3x4.h"
+#include "CQuaternion.h"
+#include "Bounds.h"
 #include "Input.h"
+#include <cstdint>
 
 #ifndef _MODEL_H_INCLUDED_
 #define _MODEL_H_INCLUDED_
 
 class Mesh;
+class RenderQueue;
+
+
+// Which of a model's control keys are held. Keys can be read on one thread to control a model updated on another
+struct ModelControlKeys
+{
+    bool turnUp, turnDown, turnLeft, turnRight, turnCW, turnCCW, moveForward, moveBackward;
+};
+
+// Read which of the given control keys are held (in the same order as Model::Control)
+ModelControlKeys ReadControlKeys(KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,
+                                 KeyCode turnCW, KeyCode turnCCW, KeyCode moveForward, KeyCode moveBackward);
+
 
 class Model
 {
@@ -22,26 +41,27 @@ public:
 	//-------------------------------------
 
     Model(Mesh* mesh, CVector3 position = { 0,0,0 }, CVector3 rotation = { 0,0,0 }, float scale = 1)
-        : mMesh(mesh), mPosition(position), mRotation(rotation), mScale({ scale, scale, scale })
+        : mMesh(mesh), mPosition(position), mRotation(QuaternionFromEuler(rotation)), mScale({ scale, scale, scale })
     {
     }
 
-    // The render function sets the world matrix in the per-frame constant buffer and makes that buffer available
-    // to vertex & pixel shader. Then it calls Mesh:Render, which renders the geometry with current GPU settings.
-    // So all other per-frame constants must have been set already along with shaders, textures, samplers, states etc.
-    void Render();
+    // Submit the model to a render queue, to be rendered with the given material (an index into the queue's
+    // RenderMaterials) when the queue is executed. Colour is passed on to the queue for shaders that tint the model.
+    // The object index, if given, lets passes share the model's constants (see RenderQueue::Submit)
+    void Submit(RenderQueue& queue, int material, CVector3 colour = { 1, 1, 1 }, int object = -1) const;
 
 
 	// Control the model's position and rotation using keys provided. Amount of motion performed depends on frame time
 	void Control( float frameTime, KeyCode turnUp, KeyCode turnDown, KeyCode turnLeft, KeyCode turnRight,  
 				  KeyCode turnCW, KeyCode turnCCW, KeyCode moveForward, KeyCode moveBackward );
+	void Control( float frameTime, const ModelControlKeys& keys );
 
 
+    // Rotate the model so its Z axis faces the given target point, keeping its X axis horizontal
     void FaceTarget(CVector3 target)
     {
-        UpdateWorldMatrix();
-        mWorldMatrix.FaceTarget(target);
-        mRotation = mWorldMatrix.GetEulerAngles();
+        mRotation = QuaternionLookRotation(target - mPosition);
+        mWorldMatrixDirty = true;
     }
 
 
@@ -50,36 +70,75 @@ public:
 	//-------------------------------------
 
 	// Getters / setters
-	CVector3 Position()  { return mPosition; }
-	CVector3 Rotation()  { return mRotation; }
-	CVector3 Scale()     { return mScale;    }
+	Mesh*       GetMesh() const  { return mMesh; }
+	CVector3    Position()     { return mPosition; }
+	CQuaternion Orientation()  { return mRotation; }
+	CVector3    Scale()        { return mScale;    }
+
+	void SetPosition   ( CVector3 position       )  { mPosition = position;    mWorldMatrixDirty = true; }
+	void SetOrientation( CQuaternion orientation )  { mRotation = orientation; mWorldMatrixDirty = true; }
 
-	void SetPosition( CVector3 position )  { mPosition = position; }
-	void SetRotation( CVector3 rotation )  { mRotation = rotation; }
+	// Rotation as Euler angles (Z, then X, then Y). Getting the rotation this way is relatively expensive
+	CVector3 Rotation()                   { return mRotation.GetEulerAngles(); }
+	void SetRotation( CVector3 rotation )  { mRotation = QuaternionFromEuler(rotation); mWorldMatrixDirty = true; }
 
 	// Two ways to set scale: x,y,z separately, or all to the same value
-	void SetScale   ( CVector3 scale    )  { mScale = scale;       } 
-	void SetScale   ( float scale       )  { mScale = { scale, scale, scale };}
+	void SetScale   ( CVector3 scale    )  { mScale = scale;                   mWorldMatrixDirty = true; }
+	void SetScale   ( float scale       )  { mScale = { scale, scale, scale }; mWorldMatrixDirty = true; }
 
-	// Read only access to model world matrix, updated on request
-	CMatrix4x4 WorldMatrix()  { UpdateWorldMatrix();  return mWorldMatrix; }
+	// Read only access to model world matrix, rebuilt on request only if the model has changed since it was last used
+	// For attached models the matrix is only up to date with parent movement after ModelHierarchy::Update
+	const CMatrix3x4& WorldMatrix() const  { if (mWorldMatrixDirty)  UpdateWorldMatrix();  return mWorldMatrix; }
+
+	// Matrix used for rendering. This is the world matrix unless a render matrix has been set, e.g. one blended between
+	// two steps of a fixed timestep simulation (see FixedTimestep.h). Once set it is used until cleared
+	const CMatrix3x4& RenderMatrix() const  { return mUseRenderMatrix ? mRenderMatrix : WorldMatrix(); }
+	void SetRenderMatrix(const CMatrix3x4& renderMatrix)  { mRenderMatrix = renderMatrix;  mUseRenderMatrix = true; }
+	void ClearRenderMatrix()  { mUseRenderMatrix = false; }
+
+	// Sphere enclosing the model as it is rendered (the mesh bounds transformed by the render matrix), for culling
+	BoundingSphere WorldBounds() const;
+
+	// Update the world matrices of many models at once, much faster than updating each model separately
+	// for large groups of models (e.g. crowds of the same mesh). Uses BuildWorldMatrices (TransformBatch.h)
+	// Only models that have changed are rebuilt. Attached models are skipped, ModelHierarchy::Update rebuilds them
+	static void UpdateWorldMatrices(Model* const models[], int numModels);
+
+	// Diagnostics: number of world matrices rebuilt (by any model) since the count was last reset. Reset once per
+	// frame to see how many models are actually changing
+	static int  NumWorldMatrixRebuilds();
+	static void ResetWorldMatrixRebuilds();
 
 
 	//-------------------------------------
 	// Private data / members
 	//-------------------------------------
 private:
-    void UpdateWorldMatrix();
+    friend class ModelHierarchy; // Sets parents and rebuilds the world matrices of attached models
+
+    void UpdateWorldMatrix() const;
 
     Mesh* mMesh;
 
 	// Position, rotation and scaling for the model
-	CVector3 mPosition;
-	CVector3 mRotation;
-	CVector3 mScale;
-
-	// World matrix for the model - built from the above
-	CMatrix4x4 mWorldMatrix;
+	CVector3    mPosition;
+	CQuaternion mRotation;
+	CVector3    mScale;
+
+	// World matrix for the model - built from the above. Always affine so the compact 3x4 matrix is used
+	// Mutable as it is a cache: rebuilding it when it is read doesn't change the model
+	mutable CMatrix3x4 mWorldMatrix;
+	mutable bool       mWorldMatrixDirty = true; // Set whenever position, rotation or scale change
+
+	// Incremented each time the world matrix is rebuilt. Attached models hold the parent's version their matrix was
+	// built from, so a parent that has moved can be detected however its matrix was rebuilt
+	mutable uint32_t mWorldMatrixVersion = 0;
+	mutable uint32_t mParentVersion      = 0;
+	const Model*     mParent = nullptr;
+
+	// Optional matrix to render with instead of the world matrix, see RenderMatrix
+	CMatrix3x4 mRenderMatrix;
+	bool       mUseRenderMatrix = false;
 };
 
 
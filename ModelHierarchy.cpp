@@ -0,0 +1,139 @@
+//--------------------------------------------------------------------------------------
+// Class holding parent/child attachments between models
+//--------------------------------------------------------------------------------------
+// Models are held in depth-first order so that all world matrices can be updated in one pass
+
+#include "ModelHierarchy.h"
+
+#include <algorithm>
+
+
+// Add a model to the hierarchy, attached to the given parent or as a root if the parent is nullptr. A model already
+// in the hierarchy is moved along with its children
+void ModelHierarchy::Add(Model* model, Model* parent)
+{
+    if (model == parent)  return;
+
+    // The model and its children, with parent indexes relative to the model and depths below it. A model already in
+    // the hierarchy is taken out with its whole subtree, then put back in its new place below
+    std::vector<Model*> subtreeModels  = { model };
+    std::vector<int>    subtreeParents = { -1 };
+    std::vector<int>    subtreeDepths  = { 0 };
+    int existing = IndexOf(model);
+    if (existing >= 0)
+    {
+        // The subtree ends at the next model that is no deeper than the model
+        int end = existing + 1;
+        while (end < NumModels() && mDepths[end] > mDepths[existing])  ++end;
+
+        int parentIndex = (parent != nullptr) ? IndexOf(parent) : -1;
+        if (parentIndex > existing && parentIndex < end)  return; // Parent is one of the model's children
+
+        Update();
+        DetachFromParent(model);
+        for (int i = existing + 1; i < end; ++i)
+        {
+            subtreeModels .push_back(mModels[i]);
+            subtreeParents.push_back(mParents[i] - existing);
+            subtreeDepths .push_back(mDepths[i] - mDepths[existing]);
+        }
+
+        // Models after the subtree move down into its place, update any parent indexes referring to them
+        mModels .erase(mModels.begin()  + existing, mModels.begin()  + end);
+        mParents.erase(mParents.begin() + existing, mParents.begin() + end);
+        mDepths .erase(mDepths.begin()  + existing, mDepths.begin()  + end);
+        for (int& parentOfModel : mParents)
+        {
+            if (parentOfModel >= end)  parentOfModel -= end - existing;
+        }
+    }
+
+    // Roots go at the end of the list
+    int parentIndex = -1;
+    int depth = 0;
+    int index = NumModels();
+    if (parent != nullptr)
+    {
+        parentIndex = IndexOf(parent);
+        if (parentIndex < 0)
+        {
+            Add(parent);
+            parentIndex = NumModels() - 1;
+        }
+
+        // Convert the model's current world transform to be relative to the parent. Scale is not separated out exactly
+        // if the parent has non-uniform scaling and the model is rotated relative to it
+        CMatrix3x4 localMatrix = model->WorldMatrix() * InverseAffine(parent->WorldMatrix());
+        model->mPosition = localMatrix.GetPosition();
+        model->mScale    = localMatrix.GetScale();
+        model->mRotation = QuaternionFromMatrix(ToMatrix4x4(localMatrix));
+        model->mParent   = parent;
+        model->mWorldMatrixDirty = true;
+
+        // Insert at the end of the parent's subtree to keep depth-first order. The subtree ends at the next model
+        // that is no deeper than the parent
+        depth = mDepths[parentIndex] + 1;
+        index = parentIndex + 1;
+        while (index < NumModels() && mDepths[index] >= depth)  ++index;
+    }
+
+    // Models after the insertion point move up, update any parent indexes referring to them
+    int count = static_cast<int>(subtreeModels.size());
+    for (int& parentOfModel : mParents)
+    {
+        if (parentOfModel >= index)  parentOfModel += count;
+    }
+    subtreeParents[0] = parentIndex;
+    for (int i = 1; i < count; ++i)  subtreeParents[i] += index;
+    for (int& subtreeDepth : subtreeDepths)  subtreeDepth += depth;
+    mModels .insert(mModels.begin()  + index, subtreeModels.begin(),  subtreeModels.end());
+    mParents.insert(mParents.begin() + index, subtreeParents.begin(), subtreeParents.end());
+    mDepths .insert(mDepths.begin()  + index, subtreeDepths.begin(),  subtreeDepths.end());
+}
+
+
+// Remove all models, they are detached from their parents but stay in the same place in the world
+void ModelHierarchy::Clear()
+{
+    Update();
+    for (Model* model : mModels)  DetachFromParent(model);
+    mModels.clear();
+    mParents.clear();
+    mDepths.clear();
+}
+
+
+// Bring the world matrices of all models in the hierarchy up to date. As parents come before their children, a
+// parent's matrix is always current by the time its children are reached
+void ModelHierarchy::Update()
+{
+    for (int i = 0; i < NumModels(); ++i)
+    {
+        const Model* model = mModels[i];
+        int parentIndex = mParents[i];
+        if (parentIndex >= 0 && model->mParentVersion != mModels[parentIndex]->mWorldMatrixVersion)
+        {
+            model->mWorldMatrixDirty = true;
+        }
+        if (model->mWorldMatrixDirty)  model->UpdateWorldMatrix();
+    }
+}
+
+
+int ModelHierarchy::IndexOf(const Model* model)
+{
+    auto found = std::find(mModels.begin(), mModels.end(), model);
+    return found != mModels.end() ? static_cast<int>(found - mModels.begin()) : -1;
+}
+
+
+// Make a model a root, keeping its current place in the world. Reverse of the conversion in Add
+void ModelHierarchy::DetachFromParent(Model* model)
+{
+    const CMatrix3x4& worldMatrix = model->mWorldMatrix;
+    model->mPosition = worldMatrix.GetPosition();
+    model->mScale    = worldMatrix.GetScale();
+    model->mRotation = QuaternionFromMatrix(ToMatrix4x4(worldMatrix));
+    model->mParent   = nullptr;
+    model->mWorldMatrixDirty = true;
+}
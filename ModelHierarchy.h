@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// Class holding parent/child attachments between models
+//--------------------------------------------------------------------------------------
+// Attached models (e.g. a hat on a character) follow their parent as it moves. Models are held in depth-first order,
+// every parent before its children, so all world matrices can be brought up to date in a single pass through the
+// list. Only models that have changed, or whose parent's matrix has changed, are rebuilt.
+//
+// The hierarchy does not own the models, they must be deleted separately (after clearing the hierarchy)
+
+#include "Model.h"
+#include <vector>
+
+#ifndef _MODEL_HIERARCHY_H_INCLUDED_
+#define _MODEL_HIERARCHY_H_INCLUDED_
+
+class ModelHierarchy
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+    // Add a model to the hierarchy, attached to the given parent or as a root if the parent is nullptr. A parent not
+    // yet in the hierarchy is added as a root first. The model keeps its current place in the world: its position,
+    // rotation and scale are converted to be relative to the parent (assumes the parent has uniform scaling).
+    // A model already in the hierarchy is moved to the new parent, taking its own children with it. Attaching a model
+    // to itself or to one of its own children would make a loop, so does nothing
+    void Add(Model* model, Model* parent = nullptr);
+
+    // Remove all models, they are detached from their parents but stay in the same place in the world
+    void Clear();
+
+    // Bring the world matrices of all models in the hierarchy up to date. Call once per frame after models have moved
+    void Update();
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+    int NumModels()  { return static_cast<int>(mModels.size()); }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+    int IndexOf(const Model* model);
+
+    // Make a model a root, keeping its current place in the world. Its world matrix must be up to date
+    static void DetachFromParent(Model* model);
+
+    // Models in depth-first order with the index of each model's parent (-1 for roots) and its depth in the tree
+    // (0 for roots). Parents always come before their children
+    std::vector<Model*> mModels;
+    std::vector<int>    mParents;
+    std::vector<int>    mDepths;
+};
+
+
+#endif //_MODEL_HIERARCHY_H_INCLUDED_
@@ -39,7 +39,7 @@ float4 main(NormalPixelShaderInput input) : SV_Target
 
 	// Now convert the texture normal into model space using the inverse tangent matrix, and then convert into world space using the world
 	// matrix. Normalise, because of the effects of texture filtering and in case the world matrix contains scaling
-	float3 worldNormal = normalize(mul((float3x3)gWorldMatrix, mul(textureNormal, invTangentMatrix)));
+	float3 worldNormal = normalize(mul(mul(textureNormal, invTangentMatrix), (float3x3)gWorldMatrix));
 
 	// Slight adjustment to calculated depth of pixels so they don't shadow themselves
 	const float DepthAdjust = 0.002f;
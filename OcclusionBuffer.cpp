@@ -0,0 +1,499 @@
+//--------------------------------------------------------------------------------------
+// Occlusion buffer - a small software depth buffer to find objects hidden behind others
+//--------------------------------------------------------------------------------------
+
+#include "OcclusionBuffer.h"
+#include "JobSystem.h"
+#include "MathSIMD.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <stdexcept>
+#include <string>
+
+
+/*-----------------------------------------------------------------------------------------
+    SIMD helpers
+-----------------------------------------------------------------------------------------*/
+// The rasteriser and the box test work on a row of SIMDWidth pixels at a time. Masks select the lanes where a test
+// passed. With no SIMD instructions a "row" is one pixel
+
+#if defined(MATH_SIMD_AVX)
+
+const int SIMDWidth = 8;
+using SIMDFloat = __m256;
+using SIMDMask  = __m256;
+
+static inline SIMDFloat SIMDSet(float f)                      { return _mm256_set1_ps(f); }
+static inline SIMDFloat SIMDLanes()                           { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+static inline SIMDFloat SIMDLoad(const float* p)              { return _mm256_loadu_ps(p); }
+static inline void      SIMDStore(float* p, SIMDFloat v)      { _mm256_storeu_ps(p, v); }
+static inline SIMDFloat SIMDAdd(SIMDFloat a, SIMDFloat b)     { return _mm256_add_ps(a, b); }
+static inline SIMDFloat SIMDMul(SIMDFloat a, SIMDFloat b)     { return _mm256_mul_ps(a, b); }
+static inline SIMDFloat SIMDMin(SIMDFloat a, SIMDFloat b)     { return _mm256_min_ps(a, b); }
+static inline SIMDFloat SIMDMax(SIMDFloat a, SIMDFloat b)     { return _mm256_max_ps(a, b); }
+static inline SIMDMask  SIMDLessEqual(SIMDFloat a, SIMDFloat b)  { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+static inline SIMDMask  SIMDAnd(SIMDMask a, SIMDMask b)       { return _mm256_and_ps(a, b); }
+static inline SIMDFloat SIMDSelect(SIMDMask m, SIMDFloat a, SIMDFloat b)  { return _mm256_blendv_ps(b, a, m); }
+static inline bool      SIMDAny(SIMDMask m)                   { return _mm256_movemask_ps(m) != 0; }
+
+#elif defined(MATH_SIMD_SSE)
+
+const int SIMDWidth = 4;
+using SIMDFloat = __m128;
+using SIMDMask  = __m128;
+
+static inline SIMDFloat SIMDSet(float f)                      { return _mm_set1_ps(f); }
+static inline SIMDFloat SIMDLanes()                           { return _mm_setr_ps(0, 1, 2, 3); }
+static inline SIMDFloat SIMDLoad(const float* p)              { return _mm_loadu_ps(p); }
+static inline void      SIMDStore(float* p, SIMDFloat v)      { _mm_storeu_ps(p, v); }
+static inline SIMDFloat SIMDAdd(SIMDFloat a, SIMDFloat b)     { return _mm_add_ps(a, b); }
+static inline SIMDFloat SIMDMul(SIMDFloat a, SIMDFloat b)     { return _mm_mul_ps(a, b); }
+static inline SIMDFloat SIMDMin(SIMDFloat a, SIMDFloat b)     { return _mm_min_ps(a, b); }
+static inline SIMDFloat SIMDMax(SIMDFloat a, SIMDFloat b)     { return _mm_max_ps(a, b); }
+static inline SIMDMask  SIMDLessEqual(SIMDFloat a, SIMDFloat b)  { return _mm_cmple_ps(a, b); }
+static inline SIMDMask  SIMDAnd(SIMDMask a, SIMDMask b)       { return _mm_and_ps(a, b); }
+static inline SIMDFloat SIMDSelect(SIMDMask m, SIMDFloat a, SIMDFloat b)  { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); } // SSE2 has no blend
+static inline bool      SIMDAny(SIMDMask m)                   { return _mm_movemask_ps(m) != 0; }
+
+#else
+
+const int SIMDWidth = 1;
+using SIMDFloat = float;
+using SIMDMask  = bool;
+
+static inline SIMDFloat SIMDSet(float f)                      { return f; }
+static inline SIMDFloat SIMDLanes()                           { return 0; }
+static inline SIMDFloat SIMDLoad(const float* p)              { return *p; }
+static inline void      SIMDStore(float* p, SIMDFloat v)      { *p = v; }
+static inline SIMDFloat SIMDAdd(SIMDFloat a, SIMDFloat b)     { return a + b; }
+static inline SIMDFloat SIMDMul(SIMDFloat a, SIMDFloat b)     { return a * b; }
+static inline SIMDFloat SIMDMin(SIMDFloat a, SIMDFloat b)     { return std::min(a, b); }
+static inline SIMDFloat SIMDMax(SIMDFloat a, SIMDFloat b)     { return std::max(a, b); }
+static inline SIMDMask  SIMDLessEqual(SIMDFloat a, SIMDFloat b)  { return a <= b; }
+static inline SIMDMask  SIMDAnd(SIMDMask a, SIMDMask b)       { return a && b; }
+static inline SIMDFloat SIMDSelect(SIMDMask m, SIMDFloat a, SIMDFloat b)  { return m ? a : b; }
+static inline bool      SIMDAny(SIMDMask m)                   { return m; }
+
+#endif
+
+static_assert(OcclusionBuffer::TILE_SIZE % SIMDWidth == 0, "Rows of a tile must be a whole number of SIMD registers");
+
+
+/*-----------------------------------------------------------------------------------------
+    Helpers
+-----------------------------------------------------------------------------------------*/
+
+using Clock = std::chrono::steady_clock;
+
+static float MillisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+}
+
+// Call body(start, end) over the range, split across the job system's threads if there is one
+template <class Body>
+static void RunParallel(JobSystem* jobSystem, int begin, int end, int grainSize, const Body& body)
+{
+    if (jobSystem)        jobSystem->ParallelFor(begin, end, grainSize, body);
+    else if (end > begin) body(begin, end);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Construction
+-----------------------------------------------------------------------------------------*/
+
+OcclusionBuffer::OcclusionBuffer(int width, int height, JobSystem* jobSystem)
+    : mWidth(width), mHeight(height), mJobSystem(jobSystem)
+{
+    if (width <= 0 || height <= 0 || width % TILE_SIZE != 0 || height % TILE_SIZE != 0)
+    {
+        throw std::runtime_error("Occlusion buffer size must be a multiple of " + std::to_string(TILE_SIZE) + " pixels");
+    }
+    mTilesX = width / TILE_SIZE;
+    mTilesY = height / TILE_SIZE;
+    mDepths.resize(mWidth * mHeight);
+    mTileMaxDepths.resize(mTilesX * mTilesY);
+    mBands.resize(mTilesY);
+    Begin(MatrixIdentity());
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Rendering
+-----------------------------------------------------------------------------------------*/
+
+void OcclusionBuffer::Begin(const CMatrix4x4& viewProjectionMatrix)
+{
+    mViewProjection = viewProjectionMatrix;
+    std::fill(mDepths.begin(), mDepths.end(), 1.0f);
+    std::fill(mTileMaxDepths.begin(), mTileMaxDepths.end(), 1.0f);
+    mOccluders.clear();
+    mNumVertices  = 0;
+    mNumTriangles = 0;
+    mStats = OcclusionStats();
+}
+
+
+void OcclusionBuffer::AddOccluder(const CVector3* positions, int numPositions, const uint32_t* indices, int numIndices,
+                                  const CMatrix3x4& worldMatrix)
+{
+    Occluder occluder;
+    occluder.positions           = positions;
+    occluder.indices             = indices;
+    occluder.worldViewProjection = worldMatrix * mViewProjection;
+    occluder.firstVertex         = mNumVertices;
+    occluder.firstTriangle       = mNumTriangles;
+    mOccluders.push_back(occluder);
+
+    mNumVertices  += numPositions;
+    mNumTriangles += numIndices / 3;
+    ++mStats.numOccluders;
+    mStats.numTriangles += numIndices / 3;
+}
+
+
+void OcclusionBuffer::Render()
+{
+    auto start = Clock::now();
+
+    mClipVertices.resize(mNumVertices);
+    mTriangles.resize(mNumTriangles * 2);
+    mTriangleBands.resize(mNumTriangles * 2);
+    RunParallel(mJobSystem, 0, mNumVertices,  2048, [this](int begin, int end) { TransformVertices(begin, end); });
+    RunParallel(mJobSystem, 0, mNumTriangles, 1024, [this](int begin, int end) { SetupTriangles(begin, end); });
+
+    // Sort the triangles into the bands they cover. Only a few operations per triangle so not worth splitting up
+    for (auto& band : mBands)  band.clear();
+    for (int t = 0; t < static_cast<int>(mTriangleBands.size()); ++t)
+    {
+        const BandRange range = mTriangleBands[t];
+        if (range.last < range.first)  continue;
+        ++mStats.numRasterised;
+        for (int band = range.first; band <= range.last; ++band)  mBands[band].push_back(t);
+    }
+
+    RunParallel(mJobSystem, 0, mTilesY, 1, [this](int begin, int end)
+    {
+        for (int band = begin; band < end; ++band)  RasteriseBand(band);
+    });
+
+    mStats.renderMilliseconds += MillisecondsSince(start);
+}
+
+
+int OcclusionBuffer::FindOccluder(int index, bool triangles) const
+{
+    auto after = std::upper_bound(mOccluders.begin(), mOccluders.end(), index, [triangles](int i, const Occluder& o)
+    {
+        return i < (triangles ? o.firstTriangle : o.firstVertex);
+    });
+    return static_cast<int>(after - mOccluders.begin()) - 1;
+}
+
+
+// Bits of ClipVertex::outside
+const uint32_t OUTSIDE_LEFT   = 1;
+const uint32_t OUTSIDE_RIGHT  = 2;
+const uint32_t OUTSIDE_BOTTOM = 4;
+const uint32_t OUTSIDE_TOP    = 8;
+const uint32_t OUTSIDE_NEAR   = 16;
+const uint32_t OUTSIDE_FAR    = 32;
+
+void OcclusionBuffer::TransformVertices(int begin, int end)
+{
+    int o = FindOccluder(begin, false);
+    for (int v = begin; v < end; ++v)
+    {
+        while (o + 1 < static_cast<int>(mOccluders.size()) && v >= mOccluders[o + 1].firstVertex)  ++o;
+        const Occluder& occluder = mOccluders[o];
+        const CMatrix4x4& m = occluder.worldViewProjection;
+        const CVector3& p = occluder.positions[v - occluder.firstVertex];
+
+        ClipVertex& c = mClipVertices[v];
+        c.x = p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30;
+        c.y = p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31;
+        c.z = p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32;
+        c.w = p.x * m.e03 + p.y * m.e13 + p.z * m.e23 + m.e33;
+        c.outside = (c.x < -c.w ? OUTSIDE_LEFT   : 0) | (c.x > c.w ? OUTSIDE_RIGHT : 0) |
+                    (c.y < -c.w ? OUTSIDE_BOTTOM : 0) | (c.y > c.w ? OUTSIDE_TOP   : 0) |
+                    (c.z < 0    ? OUTSIDE_NEAR   : 0) | (c.z > c.w ? OUTSIDE_FAR   : 0);
+        if (c.z >= 0)  ProjectVertex(c);
+    }
+}
+
+
+void OcclusionBuffer::ProjectVertex(ClipVertex& v) const
+{
+    float invW = 1.0f / v.w;
+    v.screenX = (v.x * invW *  0.5f + 0.5f) * mWidth;
+    v.screenY = (v.y * invW * -0.5f + 0.5f) * mHeight;
+    v.depth   = v.z * invW;
+}
+
+
+// Remove triangles that are entirely off one side of the screen, behind the near plane or beyond the far plane,
+// and clip those crossing the near plane (clip space z = 0), giving one or two triangles in front of it
+void OcclusionBuffer::SetupTriangles(int begin, int end)
+{
+    int o = FindOccluder(begin, true);
+    for (int t = begin; t < end; ++t)
+    {
+        while (o + 1 < static_cast<int>(mOccluders.size()) && t >= mOccluders[o + 1].firstTriangle)  ++o;
+        const Occluder& occluder = mOccluders[o];
+        const uint32_t* index = occluder.indices + (t - occluder.firstTriangle) * 3;
+        const ClipVertex* v[3] = { &mClipVertices[occluder.firstVertex + index[0]],
+                                   &mClipVertices[occluder.firstVertex + index[1]],
+                                   &mClipVertices[occluder.firstVertex + index[2]] };
+
+        mTriangleBands[t * 2    ] = { 0, -1 };
+        mTriangleBands[t * 2 + 1] = { 0, -1 };
+        if (v[0]->outside & v[1]->outside & v[2]->outside)  continue;
+
+        if (((v[0]->outside | v[1]->outside | v[2]->outside) & OUTSIDE_NEAR) == 0)
+        {
+            SetupTriangle(*v[0], *v[1], *v[2], t * 2);
+            continue;
+        }
+
+        // Keep the part of each edge in front of the near plane
+        ClipVertex clipped[4];
+        int numClipped = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            const ClipVertex& a = *v[i];
+            const ClipVertex& b = *v[(i + 1) % 3];
+            if (a.z >= 0)  clipped[numClipped++] = a;
+            if ((a.z >= 0) != (b.z >= 0))
+            {
+                float f = a.z / (a.z - b.z);
+                ClipVertex& c = clipped[numClipped++];
+                c.x = a.x + (b.x - a.x) * f;
+                c.y = a.y + (b.y - a.y) * f;
+                c.z = 0;
+                c.w = a.w + (b.w - a.w) * f;
+                ProjectVertex(c);
+            }
+        }
+        SetupTriangle(clipped[0], clipped[1], clipped[2], t * 2);
+        if (numClipped == 4)  SetupTriangle(clipped[0], clipped[2], clipped[3], t * 2 + 1);
+    }
+}
+
+
+void OcclusionBuffer::SetupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, int slot)
+{
+    // Pixels whose centres might be covered. Rounded without std::floor / std::ceil, which are function calls
+    // without SSE4. Small triangles often fall between pixel centres
+    auto firstPixel = [](float a, float b, float c, int size)
+    {
+        float f = std::min(std::max(std::min(std::min(a, b), c) - 0.5f, 0.0f), static_cast<float>(size));
+        int   i = static_cast<int>(f);
+        return i < f ? i + 1 : i;
+    };
+    auto lastPixel = [](float a, float b, float c, int size)
+    {
+        float f = std::min(std::max(std::max(a, b), c) - 0.5f, size - 1.0f);
+        return f < 0 ? -1 : static_cast<int>(f);
+    };
+    int minX = firstPixel(v0.screenX, v1.screenX, v2.screenX, mWidth);
+    int maxX = lastPixel (v0.screenX, v1.screenX, v2.screenX, mWidth);
+    int minY = firstPixel(v0.screenY, v1.screenY, v2.screenY, mHeight);
+    int maxY = lastPixel (v0.screenY, v1.screenY, v2.screenY, mHeight);
+    if (maxX < minX || maxY < minY)  return;
+
+    // Doubles are used from here as vertices clipped near the camera can be a long way off screen, and the edge
+    // values are wanted accurately near the screen
+    const double x[3] = { v0.screenX, v1.screenX, v2.screenX };
+    const double y[3] = { v0.screenY, v1.screenY, v2.screenY };
+    const double z[3] = { v0.depth,   v1.depth,   v2.depth   };
+
+    double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (std::abs(area) < 1e-8)  return;
+
+    ScreenTriangle& triangle = mTriangles[slot];
+    triangle.minX = minX;  triangle.maxX = maxX;
+    triangle.minY = minY;  triangle.maxY = maxY;
+
+    // Edge from vertex i to vertex i + 1, made positive inside whichever way round the triangle is
+    const double originX = minX + 0.5;
+    const double originY = minY + 0.5;
+    const double sign = area > 0 ? 1.0 : -1.0;
+    for (int i = 0; i < 3; ++i)
+    {
+        int j = (i + 1) % 3;
+        double stepX = -(y[j] - y[i]) * sign;
+        double stepY =  (x[j] - x[i]) * sign;
+        triangle.edge[i]      = static_cast<float>(stepX * (originX - x[i]) + stepY * (originY - y[i]));
+        triangle.edgeStepX[i] = static_cast<float>(stepX);
+        triangle.edgeStepY[i] = static_cast<float>(stepY);
+    }
+
+    // Depth is linear in screen space. Store the farthest depth over each pixel (half a pixel further in each
+    // direction the depth increases) so objects touching the triangle aren't hidden by it
+    double invArea = 1 / area;
+    double depthStepX = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) * invArea;
+    double depthStepY = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) * invArea;
+    triangle.depth = static_cast<float>(z[0] + depthStepX * (originX - x[0]) + depthStepY * (originY - y[0]) +
+                                        0.5 * (std::abs(depthStepX) + std::abs(depthStepY)));
+    triangle.depthStepX = static_cast<float>(depthStepX);
+    triangle.depthStepY = static_cast<float>(depthStepY);
+    triangle.maxDepth   = static_cast<float>(std::max({ z[0], z[1], z[2] }));
+    mTriangleBands[slot] = { static_cast<int16_t>(minY / TILE_SIZE), static_cast<int16_t>(maxY / TILE_SIZE) };
+}
+
+
+void OcclusionBuffer::RasteriseBand(int band)
+{
+    const int bandMinY = band * TILE_SIZE;
+    const int bandMaxY = bandMinY + TILE_SIZE - 1;
+    const SIMDFloat lanes = SIMDLanes();
+    const SIMDFloat zero  = SIMDSet(0);
+
+    for (int t : mBands[band])
+    {
+        const ScreenTriangle& triangle = mTriangles[t];
+        const int minY = std::max(triangle.minY, bandMinY);
+        const int maxY = std::min(triangle.maxY, bandMaxY);
+        const int minX = triangle.minX - triangle.minX % SIMDWidth; // Rows are processed in whole registers
+
+        // Value of each edge and the depth at the start of each run of pixels, and their change from one run to the next
+        SIMDFloat edgeStepX[3], edgeStepRun[3], edgeRow[3];
+        const float offsetX = static_cast<float>(minX - triangle.minX);
+        for (int i = 0; i < 3; ++i)
+        {
+            edgeStepX[i]   = SIMDSet(triangle.edgeStepX[i]);
+            edgeStepRun[i] = SIMDSet(triangle.edgeStepX[i] * SIMDWidth);
+            edgeRow[i]     = SIMDAdd(SIMDSet(triangle.edge[i] + triangle.edgeStepX[i] * offsetX), SIMDMul(lanes, edgeStepX[i]));
+        }
+        const SIMDFloat depthStepRun = SIMDSet(triangle.depthStepX * SIMDWidth);
+        const SIMDFloat depthRow     = SIMDAdd(SIMDSet(triangle.depth + triangle.depthStepX * offsetX),
+                                               SIMDMul(lanes, SIMDSet(triangle.depthStepX)));
+        const SIMDFloat maxDepth     = SIMDSet(triangle.maxDepth);
+
+        for (int y = minY; y <= maxY; ++y)
+        {
+            const float rowsDown = static_cast<float>(y - triangle.minY);
+            SIMDFloat edge0 = SIMDAdd(edgeRow[0], SIMDSet(triangle.edgeStepY[0] * rowsDown));
+            SIMDFloat edge1 = SIMDAdd(edgeRow[1], SIMDSet(triangle.edgeStepY[1] * rowsDown));
+            SIMDFloat edge2 = SIMDAdd(edgeRow[2], SIMDSet(triangle.edgeStepY[2] * rowsDown));
+            SIMDFloat depth = SIMDAdd(depthRow,   SIMDSet(triangle.depthStepY * rowsDown));
+
+            float* pixels = &mDepths[y * mWidth];
+            for (int x = minX; x <= triangle.maxX; x += SIMDWidth)
+            {
+                SIMDMask  inside  = SIMDLessEqual(zero, SIMDMin(SIMDMin(edge0, edge1), edge2));
+                SIMDFloat current = SIMDLoad(pixels + x);
+                SIMDStore(pixels + x, SIMDSelect(inside, SIMDMin(current, SIMDMin(depth, maxDepth)), current));
+
+                edge0 = SIMDAdd(edge0, edgeStepRun[0]);
+                edge1 = SIMDAdd(edge1, edgeStepRun[1]);
+                edge2 = SIMDAdd(edge2, edgeStepRun[2]);
+                depth = SIMDAdd(depth, depthStepRun);
+            }
+        }
+    }
+
+    // Farthest depth in each tile of the band
+    for (int tile = 0; tile < mTilesX; ++tile)
+    {
+        SIMDFloat maxDepth = SIMDSet(0);
+        for (int y = bandMinY; y <= bandMaxY; ++y)
+        {
+            const float* pixels = &mDepths[y * mWidth + tile * TILE_SIZE];
+            for (int x = 0; x < TILE_SIZE; x += SIMDWidth)  maxDepth = SIMDMax(maxDepth, SIMDLoad(pixels + x));
+        }
+        float lanes[SIMDWidth];
+        SIMDStore(lanes, maxDepth);
+        mTileMaxDepths[band * mTilesX + tile] = *std::max_element(lanes, lanes + SIMDWidth);
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Testing
+-----------------------------------------------------------------------------------------*/
+
+bool OcclusionBuffer::IsVisible(const BoundingBox& box) const
+{
+    // Project the corners of the box to find the screen rectangle it covers and its nearest depth (depth is
+    // monotonic with distance from the camera, so the nearest point of a box is a corner)
+    float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+    int numInFront = 0; // Of the near plane
+    const CMatrix4x4& m = mViewProjection;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        CVector3 p = { box.centre.x + ((corner & 1) ? box.extents.x : -box.extents.x),
+                       box.centre.y + ((corner & 2) ? box.extents.y : -box.extents.y),
+                       box.centre.z + ((corner & 4) ? box.extents.z : -box.extents.z) };
+        float z = p.x * m.e02 + p.y * m.e12 + p.z * m.e22 + m.e32;
+        if (z < 0)
+        {
+            ++numInFront;
+            continue;
+        }
+        float invW = 1.0f / (p.x * m.e03 + p.y * m.e13 + p.z * m.e23 + m.e33);
+        float x = ((p.x * m.e00 + p.y * m.e10 + p.z * m.e20 + m.e30) * invW *  0.5f + 0.5f) * mWidth;
+        float y = ((p.x * m.e01 + p.y * m.e11 + p.z * m.e21 + m.e31) * invW * -0.5f + 0.5f) * mHeight;
+        minX = std::min(minX, x);  maxX = std::max(maxX, x);
+        minY = std::min(minY, y);  maxY = std::max(maxY, y);
+        nearest = std::min(nearest, z * invW);
+    }
+
+    if (numInFront == 8)  return false; // Entirely between the camera and the near plane, or behind the camera
+    if (numInFront > 0)   return true;
+
+    // Every pixel the rectangle touches
+    if (maxX < 0 || maxY < 0 || minX >= mWidth || minY >= mHeight)  return false;
+    const int pixelMinX = static_cast<int>(std::max(minX, 0.0f));
+    const int pixelMinY = static_cast<int>(std::max(minY, 0.0f));
+    const int pixelMaxX = static_cast<int>(std::min(maxX, mWidth  - 1.0f));
+    const int pixelMaxY = static_cast<int>(std::min(maxY, mHeight - 1.0f));
+
+    const SIMDFloat depth   = SIMDSet(nearest);
+    const SIMDFloat lanes   = SIMDLanes();
+    const SIMDFloat firstX  = SIMDSet(static_cast<float>(pixelMinX));
+    const SIMDFloat lastX   = SIMDSet(static_cast<float>(pixelMaxX));
+    for (int tileY = pixelMinY / TILE_SIZE; tileY <= pixelMaxY / TILE_SIZE; ++tileY)
+    {
+        for (int tileX = pixelMinX / TILE_SIZE; tileX <= pixelMaxX / TILE_SIZE; ++tileX)
+        {
+            // Hidden in this tile if farther than everything in it, otherwise check the pixels
+            if (nearest > mTileMaxDepths[tileY * mTilesX + tileX])  continue;
+
+            const int startX = std::max(pixelMinX - pixelMinX % SIMDWidth, tileX * TILE_SIZE);
+            const int endX   = std::min(pixelMaxX, tileX * TILE_SIZE + TILE_SIZE - 1);
+            const int startY = std::max(pixelMinY, tileY * TILE_SIZE);
+            const int endY   = std::min(pixelMaxY, tileY * TILE_SIZE + TILE_SIZE - 1);
+            for (int y = startY; y <= endY; ++y)
+            {
+                const float* pixels = &mDepths[y * mWidth];
+                for (int x = startX; x <= endX; x += SIMDWidth)
+                {
+                    SIMDFloat pixelX = SIMDAdd(SIMDSet(static_cast<float>(x)), lanes);
+                    SIMDMask  inRect = SIMDAnd(SIMDLessEqual(firstX, pixelX), SIMDLessEqual(pixelX, lastX));
+                    if (SIMDAny(SIMDAnd(inRect, SIMDLessEqual(depth, SIMDLoad(pixels + x)))))  return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+
+void OcclusionBuffer::TestBoxes(const BoundingBox* boxes, int numBoxes, uint8_t* visible)
+{
+    auto start = Clock::now();
+
+    RunParallel(mJobSystem, 0, numBoxes, 256, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)  visible[i] = IsVisible(boxes[i]) ? 1 : 0;
+    });
+
+    mStats.numTested += numBoxes;
+    for (int i = 0; i < numBoxes; ++i)  mStats.numHidden += 1 - visible[i];
+    mStats.testMilliseconds += MillisecondsSince(start);
+}
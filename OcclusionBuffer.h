@@ -0,0 +1,174 @@
+//--------------------------------------------------------------------------------------
+// Occlusion buffer - a small software depth buffer to find objects hidden behind others
+//--------------------------------------------------------------------------------------
+// Frustum culling keeps everything in front of the camera, even objects completely hidden behind hills or buildings.
+// Here a few large "occluders" (the ground, buildings...) are drawn on the CPU into a low resolution depth buffer
+// (256x128 by default), then the bounds of other objects ("occludees") are tested against it before they are
+// submitted for rendering. An object is hidden if, over the whole screen rectangle covered by its box, the occluders
+// are nearer than the nearest point of the box.
+//
+// Rasterising: the occluder vertices are transformed to clip space, triangles are clipped against the near plane,
+// and each triangle is set up in screen space with edge and depth equations. The screen is split into bands one tile
+// high and the triangles are sorted into the bands they cover, then each band is rasterised separately, several
+// pixels at a time with SIMD instructions (see MathSIMD.h). Given a job system the vertex, triangle and band stages
+// are each split across threads. Both sides of every triangle are drawn, so occluders needn't be closed or
+// consistently wound. A pixel is covered if its centre is inside a triangle, so an object showing less than a pixel
+// past the edge of an occluder may be hidden. The depth stored is the farthest depth of the triangle over the pixel
+// rather than at its centre, so objects that just touch an occluder are never hidden by it.
+//
+// Testing: the buffer is divided into 8x8 pixel tiles, each holding the farthest depth in the tile. A box is hidden
+// in a tile if it is farther than the tile, so most tests only look at individual pixels along the edges of
+// occluders. A box that reaches in front of the near plane is visible unless it is entirely in front of it.
+//
+// Typical use each frame, for each camera:
+//     occlusion.Begin(viewProjectionMatrix);
+//     occlusion.AddOccluder(positions, numPositions, indices, numIndices, worldMatrix); // For each occluder
+//     occlusion.Render();
+//     occlusion.TestBoxes(bounds, numObjects, visible);
+// Only uses the maths headers and the job system, so also builds outside Windows (see Benchmarks/OcclusionBenchmark.cpp)
+
+#ifndef _OCCLUSION_BUFFER_H_INCLUDED_
+#define _OCCLUSION_BUFFER_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CMatrix3x4.h"
+#include "CMatrix4x4.h"
+#include "Bounds.h"
+
+#include <vector>
+#include <cstdint>
+
+class JobSystem;
+
+
+// Counts and times for the work done since the last Begin
+struct OcclusionStats
+{
+    int   numOccluders      = 0;
+    int   numTriangles      = 0; // Occluder triangles given
+    int   numRasterised     = 0; // Triangles drawn after those off screen or behind the camera are removed (clipping may split one in two)
+    int   numTested         = 0; // Boxes tested
+    int   numHidden         = 0; // --"-- found to be hidden
+    float renderMilliseconds = 0;
+    float testMilliseconds   = 0;
+};
+
+
+class OcclusionBuffer
+{
+public:
+    // Width and height in pixels, both must be multiples of the 8 pixel tile size. Throws a std::runtime_error if
+    // not. If a job system is given rendering and testing are split across its threads
+    OcclusionBuffer(int width = 256, int height = 128, JobSystem* jobSystem = nullptr);
+
+
+    // Rendering //
+
+    // Clear the buffer and forget the occluders, ready to render from a new view. Also resets the stats
+    void Begin(const CMatrix4x4& viewProjectionMatrix);
+
+    // Add an occluder to be drawn by Render, a triangle list given by an array of model space positions, indices into
+    // it and a world matrix. The arrays are not copied so must be kept until Render
+    void AddOccluder(const CVector3* positions, int numPositions, const uint32_t* indices, int numIndices,
+                     const CMatrix3x4& worldMatrix);
+
+    // Draw the occluders added since Begin
+    void Render();
+
+
+    // Testing //
+
+    // True if any part of the box might be seen past the occluders. A box entirely off screen is not visible
+    bool IsVisible(const BoundingBox& box) const;
+
+    // Test many boxes at once, setting visible[i] to 1 if box i might be seen, 0 otherwise. Counted and timed in the stats
+    void TestBoxes(const BoundingBox* boxes, int numBoxes, uint8_t* visible);
+
+
+    // Data access //
+
+    int Width() const   { return mWidth; }
+    int Height() const  { return mHeight; }
+
+    // Depth of each pixel (0 at the near plane to 1 at the far plane, 1 where nothing was drawn), rows from the top
+    // of the screen
+    const float* Depths() const  { return mDepths.data(); }
+
+    const OcclusionStats& Stats() const  { return mStats; }
+
+    static const int TILE_SIZE = 8;
+
+
+private:
+    // Occluder as given to AddOccluder, with the positions of its vertices and triangles in the arrays below
+    struct Occluder
+    {
+        const CVector3* positions;
+        const uint32_t* indices;
+        CMatrix4x4      worldViewProjection;
+        int             firstVertex;
+        int             firstTriangle;
+    };
+
+    // A vertex in clip space, and if it is in front of the near plane its screen position in pixels and depth.
+    // Outside has a bit set for each plane of the view frustum the vertex is outside
+    struct ClipVertex
+    {
+        float    x, y, z, w;
+        float    screenX, screenY, depth;
+        uint32_t outside;
+    };
+
+    // A triangle ready to rasterise, covering the pixels from minX,minY to maxX,maxY (inclusive). Edge values are
+    // positive inside the triangle and are given at the centre of pixel minX,minY along with their change per
+    // pixel, as is the depth, which is limited to the farthest vertex depth. There are two for each occluder triangle
+    // since clipping may split it
+    struct ScreenTriangle
+    {
+        float edge[3], edgeStepX[3], edgeStepY[3];
+        float depth, depthStepX, depthStepY, maxDepth;
+        int   minX, minY, maxX, maxY;
+    };
+
+    // Bands covered by each triangle in mTriangles, so they can be sorted into bands without reading whole triangles.
+    // Unused triangles have last < first
+    struct BandRange
+    {
+        int16_t first, last;
+    };
+
+    // Stages of Render, each processing the given range of vertices / triangles / bands
+    void TransformVertices(int begin, int end);
+    void SetupTriangles(int begin, int end);
+    void RasteriseBand(int band);
+
+    // Find the screen position and depth of a clip space vertex in front of the near plane
+    void ProjectVertex(ClipVertex& v) const;
+
+    // Add a triangle with the given projected vertices to mTriangles[slot]
+    void SetupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, int slot);
+
+    // Index of the occluder that holds the given vertex / triangle
+    int FindOccluder(int index, bool triangles) const;
+
+    int        mWidth, mHeight;
+    int        mTilesX, mTilesY;
+    JobSystem* mJobSystem;
+    CMatrix4x4 mViewProjection;
+
+    std::vector<float>    mDepths;        // mWidth x mHeight
+    std::vector<float>    mTileMaxDepths; // mTilesX x mTilesY, the farthest depth in each tile
+
+    std::vector<Occluder>         mOccluders;
+    std::vector<ClipVertex>       mClipVertices;
+    std::vector<ScreenTriangle>   mTriangles;
+    std::vector<BandRange>        mTriangleBands;
+    std::vector<std::vector<int>> mBands; // Triangles in each band, a band is one row of tiles
+    int mNumVertices  = 0;
+    int mNumTriangles = 0;
+
+    OcclusionStats mStats;
+};
+
+
+#endif //_OCCLUSION_BUFFER_H_INCLUDED_
@@ -39,7 +39,7 @@ float4 main(NormalPixelShaderInput input) : SV_Target
 	// Transform camera vector from world into model space. Need *inverse* world matrix for this.
 	// Only need 3x3 matrix to transform vectors, to invert a 3x3 matrix we transpose it (flip it about its diagonal)
 	float3x3 invWorldMatrix = transpose((float3x3)gWorldMatrix);
-	float3 cameraModelDir = normalize(mul(invWorldMatrix, cameraDirection)); // Normalise in case world matrix is scaled
+	float3 cameraModelDir = normalize(mul(cameraDirection, invWorldMatrix)); // Normalise in case world matrix is scaled
 
 	// Then transform model-space camera vector into tangent space (texture coordinate space) to give the direction to offset texture
 	// coordinate, only interested in x and y components. Calculated inverse tangent matrix above, so invert it back for this step
@@ -59,7 +59,7 @@ float4 main(NormalPixelShaderInput input) : SV_Target
 
 	// Now convert the texture normal into model space using the inverse tangent matrix, and then convert into world space using the world
 	// matrix. Normalise, because of the effects of texture filtering and in case the world matrix contains scaling
-	float3 worldNormal = normalize(mul((float3x3)gWorldMatrix, mul(textureNormal, invTangentMatrix)));
+	float3 worldNormal = normalize(mul(mul(textureNormal, invTangentMatrix), (float3x3)gWorldMatrix));
 
 	// Calculate lighting
 	
@@ -0,0 +1,36 @@
+//--------------------------------------------------------------------------------------
+// Render device interface - the calls the rendering code makes to the graphics API
+//--------------------------------------------------------------------------------------
+// Kept apart from the Direct3D implementation so programs using the headless device can link without Direct3D
+
+#include "RenderDevice.h"
+
+
+//--------------------------------------------------------------------------------------
+// Global Variables
+//--------------------------------------------------------------------------------------
+
+IRenderDevice*  gRenderDevice  = nullptr;
+IRenderContext* gRenderContext = nullptr;
+
+
+//--------------------------------------------------------------------------------------
+// Call names
+//--------------------------------------------------------------------------------------
+
+static const char* const gRenderCallNames[] =
+{
+    "VSSetShader", "PSSetShader", "VSSetConstantBuffers", "PSSetConstantBuffers", "VSSetConstantBuffers1", "PSSetConstantBuffers1",
+    "PSSetShaderResources", "PSSetSamplers",
+    "OMSetBlendState", "OMSetDepthStencilState", "RSSetState",
+    "OMSetRenderTargets", "ClearRenderTargetView", "ClearDepthStencilView", "RSSetViewport",
+    "IASetVertexBuffer", "IASetInputLayout", "IASetIndexBuffer", "IASetPrimitiveTopology", "DrawIndexed",
+    "DrawIndexedInstanced", "UpdateConstantBuffer", "AppendConstantBuffer",
+};
+static_assert(sizeof(gRenderCallNames) / sizeof(gRenderCallNames[0]) == static_cast<int>(RenderCall::NumCalls),
+              "A name is needed for each RenderCall");
+
+const char* RenderCallName(RenderCall call)
+{
+    return gRenderCallNames[static_cast<int>(call)];
+}
@@ -0,0 +1,181 @@
+//--------------------------------------------------------------------------------------
+// Render device interface - the calls the rendering code makes to the graphics API
+//--------------------------------------------------------------------------------------
+// IRenderContext holds the per-frame calls (setting shaders, states, textures and buffers, drawing, updating
+// constants) and IRenderDevice the creation of the buffers that are rebuilt or updated from C++. The game uses
+// D3D11RenderDevice, which passes each call straight on to Direct3D. HeadlessRenderDevice records and checks the
+// calls without a GPU, so the CPU side of rendering can be run and measured on any platform (see Benchmarks).
+//
+// Creation of shaders, states and textures is left to the Direct3D code, they are only passed through here. Objects
+// are referred to with the usual Direct3D pointer types, but this file only declares them so it does not need the
+// Direct3D headers. The headless device uses them as opaque handles and never dereferences them.
+
+#ifndef _RENDER_DEVICE_H_INCLUDED_
+#define _RENDER_DEVICE_H_INCLUDED_
+
+// Direct3D objects, only used as handles here
+struct ID3D11Buffer;
+struct ID3D11InputLayout;
+struct ID3D11VertexShader;
+struct ID3D11PixelShader;
+struct ID3D11ShaderResourceView;
+struct ID3D11SamplerState;
+struct ID3D11BlendState;
+struct ID3D11DepthStencilState;
+struct ID3D11RasterizerState;
+struct ID3D11RenderTargetView;
+struct ID3D11DepthStencilView;
+
+
+// Area of the render target to draw to, same as D3D11_VIEWPORT
+struct RenderViewport
+{
+    float topLeftX = 0;
+    float topLeftY = 0;
+    float width;
+    float height;
+    float minDepth = 0;
+    float maxDepth = 1;
+};
+
+enum class PrimitiveTopology
+{
+    TriangleList,
+    TriangleStrip,
+    LineList,
+    PointList,
+};
+
+// Limits on the slot numbers that can be used, same as Direct3D 11
+const unsigned int MAX_CONSTANT_BUFFER_SLOTS = 14;
+const unsigned int MAX_TEXTURE_SLOTS         = 128;
+const unsigned int MAX_SAMPLER_SLOTS         = 16;
+const unsigned int MAX_RENDER_TARGETS        = 8;
+
+// Limits on binding part of a constant buffer (VSSetConstantBuffers1 etc.), same as Direct3D 11.1. Ranges are given
+// in constants (16 bytes each), must start on a multiple of 16 constants (256 bytes) and be a multiple of 16 long
+const unsigned int CONSTANT_BUFFER_RANGE_ALIGNMENT = 16;
+const unsigned int MAX_CONSTANT_BUFFER_RANGE       = 4096; // 64KB, the most a shader can read from one buffer
+
+
+//--------------------------------------------------------------------------------------
+// Render context
+//--------------------------------------------------------------------------------------
+// Method names and parameters follow the matching ID3D11DeviceContext methods, with unused parameters removed
+class IRenderContext
+{
+public:
+    virtual ~IRenderContext() = default;
+
+    // Shaders and their resources //
+    virtual void VSSetShader(ID3D11VertexShader* shader) = 0;
+    virtual void PSSetShader(ID3D11PixelShader*  shader) = 0;
+    virtual void VSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers) = 0;
+    virtual void PSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers) = 0;
+
+    // Bind part of each constant buffer, so one large buffer can hold the constants for many draws. The ranges are
+    // in constants, see CONSTANT_BUFFER_RANGE_ALIGNMENT. Only use if IRenderDevice::SupportsConstantBufferRanges
+    virtual void VSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                                       const unsigned int* firstConstants, const unsigned int* numConstants) = 0;
+    virtual void PSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                                       const unsigned int* firstConstants, const unsigned int* numConstants) = 0;
+
+    virtual void PSSetShaderResources(unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views) = 0;
+    virtual void PSSetSamplers(unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers) = 0;
+
+    // Fixed function states //
+    virtual void OMSetBlendState(ID3D11BlendState* state) = 0;
+    virtual void OMSetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef) = 0;
+    virtual void RSSetState(ID3D11RasterizerState* state) = 0;
+
+    // Render targets //
+    virtual void OMSetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* renderTargets,
+                                    ID3D11DepthStencilView* depthStencil) = 0;
+    virtual void ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const float colour[4]) = 0;
+    virtual void ClearDepthStencilView(ID3D11DepthStencilView* depthStencil, float depth) = 0; // Depth only
+    virtual void RSSetViewport(const RenderViewport& viewport) = 0;
+
+    // Geometry and drawing //
+    virtual void IASetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride) = 0; // Slot 0, no offset
+    virtual void IASetInputLayout(ID3D11InputLayout* layout) = 0;
+    virtual void IASetIndexBuffer(ID3D11Buffer* buffer) = 0; // 32-bit indices
+    virtual void IASetPrimitiveTopology(PrimitiveTopology topology) = 0;
+    virtual void DrawIndexed(unsigned int numIndices, unsigned int startIndex, int baseVertex) = 0;
+    virtual void DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances, unsigned int startIndex,
+                                      int baseVertex, unsigned int startInstance) = 0;
+
+    // Replace the whole content of a constant buffer (created with IRenderDevice::CreateConstantBuffer). Usually
+    // called with the UpdateConstantBuffer template below
+    virtual void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size) = 0;
+
+    // Write data to a constant buffer at the given byte offset, for filling a large buffer a part at a time while
+    // earlier parts are in use (e.g. bound with VSSetConstantBuffers1). An offset of 0 discards the previous content,
+    // otherwise the data must be after everything written since. Only use if IRenderDevice::SupportsConstantBufferRanges
+    virtual void AppendConstantBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size) = 0;
+};
+
+
+// Each kind of call made to a render context, for counting calls (see HeadlessRenderDevice and RenderStateCache)
+enum class RenderCall
+{
+    VSSetShader, PSSetShader, VSSetConstantBuffers, PSSetConstantBuffers, VSSetConstantBuffers1, PSSetConstantBuffers1,
+    PSSetShaderResources, PSSetSamplers,
+    OMSetBlendState, OMSetDepthStencilState, RSSetState,
+    OMSetRenderTargets, ClearRenderTargetView, ClearDepthStencilView, RSSetViewport,
+    IASetVertexBuffer, IASetInputLayout, IASetIndexBuffer, IASetPrimitiveTopology, DrawIndexed,
+    DrawIndexedInstanced, UpdateConstantBuffer, AppendConstantBuffer,
+    NumCalls
+};
+
+// Name of a call, e.g. "DrawIndexed"
+const char* RenderCallName(RenderCall call);
+
+
+//--------------------------------------------------------------------------------------
+// Render device
+//--------------------------------------------------------------------------------------
+class IRenderDevice
+{
+public:
+    virtual ~IRenderDevice() = default;
+
+    // Create a constant buffer of the given size (rounded up to a multiple of 16 bytes), for updating each frame
+    // with IRenderContext::UpdateConstantBuffer. Returns nullptr on failure
+    virtual ID3D11Buffer* CreateConstantBuffer(unsigned int size) = 0;
+
+    // Whether parts of constant buffers can be bound and written (IRenderContext::VSSetConstantBuffers1 etc. and
+    // AppendConstantBuffer). Needs Direct3D 11.1
+    virtual bool SupportsConstantBufferRanges() const = 0;
+
+    // Create fixed vertex or index buffers holding a copy of the given data. Return nullptr on failure
+    virtual ID3D11Buffer* CreateVertexBuffer(const void* data, unsigned int size) = 0;
+    virtual ID3D11Buffer* CreateIndexBuffer (const void* data, unsigned int size) = 0;
+
+    // Release a buffer created above, null is ignored
+    virtual void ReleaseBuffer(ID3D11Buffer* buffer) = 0;
+
+    // The context used by the main thread for rendering
+    virtual IRenderContext* ImmediateContext() = 0;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Global Variables
+//--------------------------------------------------------------------------------------
+// The device in use and its immediate context. Defined in RenderDevice.cpp, set up by InitDirect3D (or by a program
+// using the headless device)
+extern IRenderDevice*  gRenderDevice;
+extern IRenderContext* gRenderContext;
+
+
+// Template function to update a constant buffer. Pass the constant buffer object and the C++ data structure you
+// want to update it with. The structure will be copied in full over to the GPU constant buffer, where it will
+// be available to shaders. This is used to update model and camera positions, lighting data etc.
+template <class T>
+void UpdateConstantBuffer(ID3D11Buffer* buffer, const T& bufferData)
+{
+    gRenderContext->UpdateConstantBuffer(buffer, &bufferData, sizeof(T));
+}
+
+
+#endif //_RENDER_DEVICE_H_INCLUDED_
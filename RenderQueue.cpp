@@ -0,0 +1,295 @@
+//--------------------------------------------------------------------------------------
+// Render queue - collects the draws for a pass, sorts them to minimise state changes, then renders them
+//--------------------------------------------------------------------------------------
+
+#include "RenderQueue.h"
+#include "ConstantUploadBuffer.h"
+
+#include <atomic>
+#include <cstring>
+#include <algorithm>
+
+
+unsigned int NewGeometrySortId()
+{
+    static std::atomic<unsigned int> nextId(0);
+    return nextId++;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Materials
+-----------------------------------------------------------------------------------------*/
+
+int RenderMaterials::Add(const RenderMaterial& material)
+{
+    // Materials sharing shaders share a shader id so they sort together
+    unsigned int shaderId = 0;
+    while (shaderId < mShaderPairs.size() && (mShaderPairs[shaderId].vertexShader != material.vertexShader ||
+                                              mShaderPairs[shaderId].pixelShader  != material.pixelShader))
+    {
+        ++shaderId;
+    }
+    if (shaderId == mShaderPairs.size())  mShaderPairs.push_back({ material.vertexShader, material.pixelShader });
+
+    mMaterials.push_back(material);
+    mShaderIds.push_back(shaderId);
+    mTextureVariants.emplace_back();
+    return static_cast<int>(mMaterials.size()) - 1;
+}
+
+
+int RenderMaterials::WithTexture(int material, ID3D11ShaderResourceView* texture)
+{
+    if (mMaterials[material].textures[0] == texture)  return material;
+
+    auto variant = mTextureVariants[material].find(texture);
+    if (variant != mTextureVariants[material].end())  return variant->second;
+
+    RenderMaterial copy = mMaterials[material];
+    copy.textures[0] = texture;
+    int newMaterial = Add(copy); // May reallocate mTextureVariants so don't hold references to it across this call
+    mTextureVariants[material][texture] = newMaterial;
+    return newMaterial;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Collecting items
+-----------------------------------------------------------------------------------------*/
+
+void RenderQueue::Begin(const CMatrix4x4& viewMatrix)
+{
+    // View space z = dot(float4(position, 1), third column of view matrix) (row vectors, see CMatrix4x4.h)
+    mDepthX = viewMatrix.e02;
+    mDepthY = viewMatrix.e12;
+    mDepthZ = viewMatrix.e22;
+    mDepthW = viewMatrix.e32;
+
+    mItems.clear();
+    mSorted.clear();
+}
+
+
+void RenderQueue::Submit(int material, const RenderGeometry& geometry, const CMatrix3x4& worldMatrix,
+                         const CVector3& colour /*= { 1, 1, 1 }*/, unsigned int pass /*= 0*/, int object /*= -1*/)
+{
+    float depth = worldMatrix.e30 * mDepthX + worldMatrix.e31 * mDepthY + worldMatrix.e32 * mDepthZ + mDepthW;
+
+    mSorted.push_back({ SortKey(material, geometry, depth, pass), static_cast<uint32_t>(mItems.size()) });
+    mItems.push_back({ worldMatrix, colour, material, &geometry, object });
+}
+
+
+uint64_t RenderQueue::SortKey(int material, const RenderGeometry& geometry, float depth, unsigned int pass) const
+{
+    // Positive floats sort in the same order as their bits, keep the top 24 (all of the exponent, most of the
+    // mantissa). Anything behind the camera counts as depth 0
+    uint32_t depthBits = 0;
+    if (depth > 0)
+    {
+        std::memcpy(&depthBits, &depth, sizeof(depthBits));
+        depthBits >>= 7;
+    }
+
+    uint64_t passBits     = pass & 0xF;
+    uint64_t blendBits    = static_cast<uint64_t>(mMaterials[material].blendMode) & 0x3;
+    uint64_t shaderBits   = mMaterials.ShaderId(material) & 0x3FF;
+    uint64_t materialBits = static_cast<unsigned int>(material) & 0xFFF;
+    uint64_t geometryBits = geometry.sortId & 0xFFF;
+
+    uint64_t key = (passBits << 60) | (blendBits << 58);
+    if (mMaterials[material].blendMode == BlendMode::Opaque)
+    {
+        // Group by state, then front to back within a group so hidden pixels are rejected early
+        key |= (shaderBits << 48) | (materialBits << 36) | (geometryBits << 24) | depthBits;
+    }
+    else
+    {
+        // Back to front for correct blending, grouping by state only at equal depth
+        key |= (static_cast<uint64_t>(0xFFFFFF - depthBits) << 34) | (shaderBits << 24) | (materialBits << 12) | geometryBits;
+    }
+    return key;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Sorting
+-----------------------------------------------------------------------------------------*/
+
+// Least significant digit radix sort, 8 bits at a time. All eight digit counts are made in a single read of the keys,
+// and digits that are the same for every key are skipped (e.g. pass and blend mode in most queues)
+void RenderQueue::Sort()
+{
+    const size_t numEntries = mSorted.size();
+    if (numEntries < 2)  return;
+
+    uint32_t counts[8][256] = {};
+    for (const SortEntry& entry : mSorted)
+    {
+        for (int digit = 0; digit < 8; ++digit)
+        {
+            ++counts[digit][(entry.key >> (digit * 8)) & 0xFF];
+        }
+    }
+
+    mSortScratch.resize(numEntries);
+    for (int digit = 0; digit < 8; ++digit)
+    {
+        uint32_t* digitCounts = counts[digit];
+        if (digitCounts[(mSorted[0].key >> (digit * 8)) & 0xFF] == numEntries)  continue;
+
+        // Counts to start offsets
+        uint32_t offset = 0;
+        for (int value = 0; value < 256; ++value)
+        {
+            uint32_t count = digitCounts[value];
+            digitCounts[value] = offset;
+            offset += count;
+        }
+
+        for (const SortEntry& entry : mSorted)
+        {
+            mSortScratch[digitCounts[(entry.key >> (digit * 8)) & 0xFF]++] = entry;
+        }
+        mSorted.swap(mSortScratch);
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Rendering
+-----------------------------------------------------------------------------------------*/
+
+unsigned int RenderQueue::InstanceRunLength(size_t entry) const
+{
+    const RenderItem& first = mItems[mSorted[entry].item];
+    if (mInstanceBuffer == nullptr || mMaterials[first.material].instancedVertexShader == nullptr)  return 1;
+
+    size_t end    = entry + 1;
+    size_t maxEnd = std::min(mSorted.size(), entry + MAX_RENDER_INSTANCES);
+    while (end < maxEnd && mItems[mSorted[end].item].material == first.material &&
+                           mItems[mSorted[end].item].geometry == first.geometry)
+    {
+        ++end;
+    }
+    return static_cast<unsigned int>(end - entry);
+}
+
+
+unsigned int RenderQueue::Apply(size_t entry)
+{
+    const RenderItem& item = mItems[mSorted[entry].item];
+    unsigned int numInstances = InstanceRunLength(entry);
+
+    const RenderMaterial& material = mMaterials[item.material];
+    ID3D11VertexShader* vertexShader = (numInstances > 1) ? material.instancedVertexShader : material.vertexShader;
+    if (mCurrentMaterial < 0 || vertexShader != mCurrentVertexShader)
+    {
+        gRenderContext->VSSetShader(vertexShader);
+        mCurrentVertexShader = vertexShader;
+    }
+    if (item.material != mCurrentMaterial)
+    {
+        ApplyMaterial(item.material, mCurrentMaterial);
+        mCurrentMaterial = item.material;
+    }
+    if (item.geometry != mCurrentGeometry)
+    {
+        ApplyGeometry(*item.geometry, mCurrentGeometry);
+        mCurrentGeometry = item.geometry;
+    }
+    return numInstances;
+}
+
+
+void RenderQueue::ApplyMaterial(int material, int previousMaterial)
+{
+    const RenderMaterial& m = mMaterials[material];
+    const RenderMaterial* p = (previousMaterial >= 0) ? &mMaterials[previousMaterial] : nullptr;
+
+    if (!p || m.pixelShader       != p->pixelShader)        gRenderContext->PSSetShader(m.pixelShader);
+    if (!p || m.blendState        != p->blendState)         gRenderContext->OMSetBlendState(m.blendState);
+    if (!p || m.depthStencilState != p->depthStencilState)  gRenderContext->OMSetDepthStencilState(m.depthStencilState, 0);
+    if (!p || m.rasterizerState   != p->rasterizerState)    gRenderContext->RSSetState(m.rasterizerState);
+
+    // Set each run of adjacent changed textures / samplers with a single call. A null entry leaves the slot alone,
+    // so a slot the previous material left alone may hold anything and is always set
+    int slot = 0;
+    while (slot < MAX_MATERIAL_TEXTURES)
+    {
+        int end = slot;
+        while (end < MAX_MATERIAL_TEXTURES && m.textures[end] && (!p || m.textures[end] != p->textures[end]))  ++end;
+        if (end > slot)  gRenderContext->PSSetShaderResources(slot, end - slot, &m.textures[slot]);
+        slot = end + 1;
+    }
+    slot = 0;
+    while (slot < MAX_MATERIAL_SAMPLERS)
+    {
+        int end = slot;
+        while (end < MAX_MATERIAL_SAMPLERS && m.samplers[end] && (!p || m.samplers[end] != p->samplers[end]))  ++end;
+        if (end > slot)  gRenderContext->PSSetSamplers(slot, end - slot, &m.samplers[slot]);
+        slot = end + 1;
+    }
+}
+
+
+void RenderQueue::ApplyGeometry(const RenderGeometry& geometry, const RenderGeometry* previousGeometry)
+{
+    const RenderGeometry* p = previousGeometry;
+
+    // Everything in a queue is a triangle list, so the topology only needs setting before the first item
+    if (!p)  gRenderContext->IASetPrimitiveTopology(PrimitiveTopology::TriangleList);
+
+    if (!p || geometry.layout       != p->layout)        gRenderContext->IASetInputLayout(geometry.layout);
+    if (!p || geometry.vertexBuffer != p->vertexBuffer ||
+              geometry.vertexSize   != p->vertexSize)    gRenderContext->IASetVertexBuffer(geometry.vertexBuffer, geometry.vertexSize);
+    if (!p || geometry.indexBuffer  != p->indexBuffer)   gRenderContext->IASetIndexBuffer(geometry.indexBuffer);
+}
+
+
+void RenderQueue::DrawInstances(size_t entry, unsigned int numInstances)
+{
+    mInstances.resize(numInstances);
+    for (unsigned int i = 0; i < numInstances; ++i)
+    {
+        const RenderItem& item = mItems[mSorted[entry + i].item];
+        mInstances[i].worldMatrix = item.worldMatrix;
+        mInstances[i].colour      = item.colour;
+        mInstances[i].padding     = 0;
+    }
+    gRenderContext->UpdateConstantBuffer(mInstanceBuffer, mInstances.data(), numInstances * sizeof(RenderInstance));
+
+    const RenderGeometry& geometry = *mItems[mSorted[entry].item].geometry;
+    gRenderContext->DrawIndexedInstanced(geometry.numIndices, numInstances, 0, 0, 0);
+}
+
+
+void RenderQueue::UploadConstants()
+{
+    if (mConstantUpload == nullptr)  return;
+
+    // Objects already drawn in an earlier pass this frame get the element they were given then
+    mEntryConstants.resize(mSorted.size());
+    size_t entry = 0;
+    while (entry < mSorted.size())
+    {
+        unsigned int numInstances = InstanceRunLength(entry);
+        if (numInstances == 1)
+        {
+            const RenderItem& item = mItems[mSorted[entry].item];
+            RenderInstance constants = { item.worldMatrix, item.colour, 0 };
+            mEntryConstants[entry] = mConstantUpload->Add(item.object, &constants, sizeof(constants));
+        }
+        entry += numInstances;
+    }
+    mConstantUpload->Upload();
+}
+
+
+bool RenderQueue::BindConstants(size_t entry)
+{
+    if (mConstantUpload == nullptr || mEntryConstants[entry] < 0)  return false;
+    mConstantUpload->Bind(mConstantSlot, mEntryConstants[entry]);
+    return true;
+}
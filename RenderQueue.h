@@ -0,0 +1,299 @@
+//--------------------------------------------------------------------------------------
+// Render queue - collects the draws for a pass, sorts them to minimise state changes, then renders them
+//--------------------------------------------------------------------------------------
+// Rather than rendering each model as soon as it is reached, with the shaders, textures and states set up by hand
+// beforehand, each draw is submitted as an item: the geometry, the material to render it with (shaders, states and
+// textures, see RenderMaterial) and its world matrix. Each item gets a 64-bit sort key built from, most significant
+// first:
+//
+//     Opaque:       pass (4 bits) | blend mode (2) | shader (10) | material (12) | geometry (12) | depth (24)
+//     Blended:      pass (4 bits) | blend mode (2) | far to near depth (24) | shader (10) | material (12) | geometry (12)
+//
+// Items are radix sorted on these keys then rendered in order. So opaque items are grouped by shaders, then
+// material, then geometry - each shader, texture and buffer is set once for a group rather than once for every
+// item - and drawn roughly front to back within a group. Blended items must be drawn back to front over everything
+// opaque, so come after opaque items and sort by depth first. "Pass" orders groups of items within the queue
+// regardless of anything else, it is usually 0.
+//
+// Once sorted, a run of items with the same material and geometry (e.g. a crowd of entities) can be drawn with a
+// single instanced draw if the material has an instanced vertex shader and the queue has been given an instance
+// buffer (SetInstanceBuffer). The world matrices and colours of the run are copied into the instance buffer, up to
+// MAX_RENDER_INSTANCES at a time, and the shader reads the ones for each instance from there (see Common.hlsli).
+// Blended runs stay back to front as instances are drawn in order.
+//
+// Items drawn separately have their per-item constants sent by the caller before each draw, unless the queue has been
+// given a constant upload buffer (SetConstantUpload, see ConstantUploadBuffer.h). The constants of all the separate
+// items in the pass are then sent together before the first draw, and each draw binds its own. Items submitted with
+// the index of the object they draw share the constants of that object with the other passes of the frame.
+//
+// Materials are held in a RenderMaterials table shared by all queues, and referred to by index.
+//
+// Typical use each pass:
+//     queue.Begin(camera.viewMatrix);
+//     model->Submit(queue, material);  // Or queue.Submit(...) directly
+//     queue.Execute([](const RenderItem& item) { ... update per-item constants ... });
+//
+// This file only uses the render device interface (RenderDevice.h), so also builds outside Windows (see Benchmarks)
+
+#ifndef _RENDER_QUEUE_H_INCLUDED_
+#define _RENDER_QUEUE_H_INCLUDED_
+
+#include "RenderDevice.h"
+#include "CVector3.h"
+#include "CMatrix4x4.h"
+#include "CMatrix3x4.h"
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+class ConstantUploadBuffer;
+
+
+//--------------------------------------------------------------------------------------
+// Geometry and materials
+//--------------------------------------------------------------------------------------
+
+// Buffers and layout for a triangle list with 32-bit indices, e.g. from a Mesh
+struct RenderGeometry
+{
+    ID3D11InputLayout* layout       = nullptr;
+    ID3D11Buffer*      vertexBuffer = nullptr;
+    ID3D11Buffer*      indexBuffer  = nullptr;
+    unsigned int       vertexSize   = 0; // In bytes
+    unsigned int       numIndices   = 0;
+    unsigned int       sortId       = 0; // From NewGeometrySortId, groups draws of the same geometry when sorting
+};
+
+// Return a new number for RenderGeometry::sortId. Thread-safe, so meshes can be loaded in parallel
+unsigned int NewGeometrySortId();
+
+
+// How a material's colours are combined with what has already been rendered. Decides the order items are drawn
+// in: opaque first, then each type of blending in turn, as listed
+enum class BlendMode : uint8_t
+{
+    Opaque,
+    AlphaBlended,
+    Multiplicative,
+    Additive,
+};
+
+const int MAX_MATERIAL_TEXTURES = 6;
+const int MAX_MATERIAL_SAMPLERS = 3;
+
+// Everything that selects how geometry is rendered apart from per-item constants. Textures and samplers are set in
+// the pixel shader slot matching their index, null ones are left as they are (e.g. slots used for shadow maps,
+// which are set once per pass). Null shaders and states select the Direct3D defaults as usual
+struct RenderMaterial
+{
+    ID3D11VertexShader*       vertexShader      = nullptr;
+    ID3D11PixelShader*        pixelShader       = nullptr;
+
+    // Version of the vertex shader reading the world matrix and colour of each instance from the instance buffer
+    // rather than the per-model constants, used for runs of items sharing geometry. Null if there isn't one, which
+    // must also be the case if the pixel shader reads the per-model constants
+    ID3D11VertexShader*       instancedVertexShader = nullptr;
+
+    BlendMode                 blendMode         = BlendMode::Opaque; // Must match the blend state
+    ID3D11BlendState*         blendState        = nullptr;
+    ID3D11DepthStencilState*  depthStencilState = nullptr;
+    ID3D11RasterizerState*    rasterizerState   = nullptr;
+    ID3D11ShaderResourceView* textures[MAX_MATERIAL_TEXTURES] = {};
+    ID3D11SamplerState*       samplers[MAX_MATERIAL_SAMPLERS] = {};
+};
+
+
+// Table of all materials used by render queues
+class RenderMaterials
+{
+public:
+    // Add a material and return its index. Up to 4096 materials using up to 1024 different pairs of shaders sort
+    // efficiently, more are allowed but will be less well grouped
+    int Add(const RenderMaterial& material);
+
+    // Return the index of a copy of the given material with a different texture in slot 0, adding it the first time
+    // it is asked for. For objects sharing a material apart from their texture (e.g. entities)
+    int WithTexture(int material, ID3D11ShaderResourceView* texture);
+
+    const RenderMaterial& operator[](int material) const  { return mMaterials[material]; }
+    int NumMaterials() const  { return static_cast<int>(mMaterials.size()); }
+
+    // Index of the pair of shaders used by a material, used in the sort key
+    unsigned int ShaderId(int material) const  { return mShaderIds[material]; }
+
+private:
+    std::vector<RenderMaterial> mMaterials;
+    std::vector<unsigned int>   mShaderIds;
+
+    struct ShaderPair
+    {
+        ID3D11VertexShader* vertexShader;
+        ID3D11PixelShader*  pixelShader;
+    };
+    std::vector<ShaderPair> mShaderPairs;
+
+    // Materials created by WithTexture: mTextureVariants[material][texture] = index of the copy
+    std::vector<std::unordered_map<const ID3D11ShaderResourceView*, int>> mTextureVariants;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Render queue
+//--------------------------------------------------------------------------------------
+
+// A draw submitted to a queue
+struct RenderItem
+{
+    CMatrix3x4            worldMatrix;
+    CVector3              colour;   // Per-item constant for shaders that tint (e.g. the light models)
+    int                   material;
+    const RenderGeometry* geometry;
+    int                   object;   // Index of the object drawn for sharing constants between passes, -1 for none
+};
+
+// Constants for one instance of an instanced draw. Must match InstanceConstants in Common.hlsli. Also the per-model
+// constants written to the constant upload buffer for a separate draw, so must match PerModelConstants as well
+struct RenderInstance
+{
+    CMatrix3x4 worldMatrix;
+    CVector3   colour;
+    float      padding;
+};
+static_assert(sizeof(RenderInstance) == 64, "RenderInstance must match the layout of InstanceConstants in the shaders");
+
+// Most instances drawn at once, must match MAX_INSTANCES in Common.hlsli. Fills the 64KB limit for a constant buffer
+const unsigned int MAX_RENDER_INSTANCES = 1024;
+
+
+class RenderQueue
+{
+public:
+    // The queue refers to materials in the given table, which must exist as long as the queue
+    RenderQueue(RenderMaterials& materials) : mMaterials(materials) {}
+
+    RenderMaterials& Materials()  { return mMaterials; }
+
+    // Set the constant buffer of MAX_RENDER_INSTANCES RenderInstance structures used for instanced draws, which the
+    // caller must bind to the slot read by the instanced shaders (see Common.hlsli). If null (the default) every item
+    // is drawn separately
+    void SetInstanceBuffer(ID3D11Buffer* buffer)  { mInstanceBuffer = buffer; }
+
+    // Set the buffer the per-model constants of separate draws are added to (as RenderInstance structures) and the
+    // slot to bind them to. The caller calls Begin on it at the start of each frame. If null (the default) the
+    // constants are sent by the function passed to Execute
+    void SetConstantUpload(ConstantUploadBuffer* upload, unsigned int slot)  { mConstantUpload = upload;  mConstantSlot = slot; }
+
+
+    // Usage //
+
+    // Start collecting items for a pass viewed with the given camera view matrix (used for the depth sorting).
+    // Items from the previous pass are discarded
+    void Begin(const CMatrix4x4& viewMatrix);
+
+    // Add an item to the queue. The pass (0 to 15) orders groups of items before anything else, see top of file.
+    // Items with the same object index (0 or more) share per-model constants through the constant upload buffer for
+    // the rest of the frame, so must have the same world matrix and colour
+    void Submit(int material, const RenderGeometry& geometry, const CMatrix3x4& worldMatrix,
+                const CVector3& colour = { 1, 1, 1 }, unsigned int pass = 0, int object = -1);
+
+    // Sort the items then render them. Shaders, states, textures and buffers are only set when they differ from the
+    // previous item's. Before each separate draw its constants are bound from the constant upload buffer, or if there
+    // isn't one (or it is full) updateConstants(item) is called to send the item's constants to the GPU (constant
+    // buffers themselves must already be bound), instanced draws update the instance buffer instead. Other per-pass
+    // setup (render targets, viewport, per-frame constants) must be done beforehand
+    template <class UpdateConstants>
+    void Execute(UpdateConstants updateConstants)
+    {
+        Sort();
+        UploadConstants();
+        mCurrentMaterial = -1;
+        mCurrentGeometry = nullptr;
+        mNumDraws        = 0;
+        size_t entry = 0;
+        while (entry < mSorted.size())
+        {
+            unsigned int numInstances = Apply(entry);
+            if (numInstances > 1)
+            {
+                DrawInstances(entry, numInstances);
+            }
+            else
+            {
+                const RenderItem& item = mItems[mSorted[entry].item];
+                if (!BindConstants(entry))  updateConstants(item);
+                gRenderContext->DrawIndexed(item.geometry->numIndices, 0, 0);
+            }
+            ++mNumDraws;
+            entry += numInstances;
+        }
+    }
+
+
+    // Diagnostics //
+
+    int NumItems() const  { return static_cast<int>(mItems.size()); }
+
+    // Number of draw calls made by the last Execute, instanced or not
+    int NumDraws() const  { return mNumDraws; }
+
+    // Sort key for an item, exposed for testing
+    uint64_t SortKey(int material, const RenderGeometry& geometry, float depth, unsigned int pass) const;
+
+
+private:
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t item; // Index into mItems
+    };
+
+    // Sort mSorted by key (stable, so items with equal keys are drawn in the order submitted)
+    void Sort();
+
+    // Number of items from the given sorted entry on that can be drawn as instances of one draw, 1 if none can
+    unsigned int InstanceRunLength(size_t entry) const;
+
+    // Set up to draw the given sorted entry and return the number of items to draw with it, as above
+    unsigned int Apply(size_t entry);
+
+    // Set the parts of a material / geometry that differ from the previous one (-1 / nullptr for none). The vertex
+    // shader is set separately as it depends on whether the draw is instanced
+    void ApplyMaterial(int material, int previousMaterial);
+    void ApplyGeometry(const RenderGeometry& geometry, const RenderGeometry* previousGeometry);
+
+    // Send the constants of a run of items to the instance buffer and draw them
+    void DrawInstances(size_t entry, unsigned int numInstances);
+
+    // Add the constants of every item to be drawn separately to the constant upload buffer and send them to the GPU,
+    // if there is a buffer. Then bind those of the given sorted entry, returning false if it has none
+    void UploadConstants();
+    bool BindConstants(size_t entry);
+
+    RenderMaterials& mMaterials;
+
+    // Row of the view matrix giving view space depth
+    float mDepthX = 0, mDepthY = 0, mDepthZ = 0, mDepthW = 0;
+
+    std::vector<RenderItem> mItems;
+    std::vector<SortEntry>  mSorted;
+    std::vector<SortEntry>  mSortScratch;
+
+    // Instancing
+    ID3D11Buffer*               mInstanceBuffer = nullptr;
+    std::vector<RenderInstance> mInstances; // Copied to the instance buffer for each instanced draw
+
+    // Per-model constants of separate draws
+    ConstantUploadBuffer* mConstantUpload = nullptr;
+    unsigned int          mConstantSlot   = 0;
+    std::vector<int>      mEntryConstants; // Element of the upload buffer for each sorted entry drawn separately
+
+    // State set by Execute so far
+    int                   mCurrentMaterial     = -1;
+    const RenderGeometry* mCurrentGeometry     = nullptr;
+    ID3D11VertexShader*   mCurrentVertexShader = nullptr;
+    int                   mNumDraws            = 0;
+};
+
+
+#endif //_RENDER_QUEUE_H_INCLUDED_
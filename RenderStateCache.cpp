@@ -0,0 +1,349 @@
+//--------------------------------------------------------------------------------------
+// Render state cache - drops render context calls that would not change anything
+//--------------------------------------------------------------------------------------
+
+#include "RenderStateCache.h"
+
+
+//--------------------------------------------------------------------------------------
+// Global Variables
+//--------------------------------------------------------------------------------------
+
+RenderStateCache* gRenderStateCache = nullptr;
+
+
+/*-----------------------------------------------------------------------------------------
+    Construction / usage
+-----------------------------------------------------------------------------------------*/
+
+RenderStateCache::RenderStateCache(IRenderContext* context)
+    : mContext(context)
+{
+    Invalidate();
+}
+
+
+void RenderStateCache::Invalidate()
+{
+    mVertexShader = Unknown<ID3D11VertexShader>();
+    mPixelShader  = Unknown<ID3D11PixelShader>();
+    for (auto& binding : mVSConstantBuffers)  binding = { Unknown<ID3D11Buffer>(), 0, 0 };
+    for (auto& binding : mPSConstantBuffers)  binding = { Unknown<ID3D11Buffer>(), 0, 0 };
+    for (auto& texture : mTextures)           texture = Unknown<ID3D11ShaderResourceView>();
+    for (auto& sampler : mSamplers)           sampler = Unknown<ID3D11SamplerState>();
+
+    mBlendState        = Unknown<ID3D11BlendState>();
+    mDepthStencilState = Unknown<ID3D11DepthStencilState>();
+    mStencilRef        = 0;
+    mRasterizerState   = Unknown<ID3D11RasterizerState>();
+    mViewportKnown     = false;
+
+    mVertexBuffer  = Unknown<ID3D11Buffer>();
+    mVertexStride  = 0;
+    mInputLayout   = Unknown<ID3D11InputLayout>();
+    mIndexBuffer   = Unknown<ID3D11Buffer>();
+    mTopologyKnown = false;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Shaders and their resources
+-----------------------------------------------------------------------------------------*/
+
+template <class T>
+bool RenderStateCache::SetSlots(T** current, unsigned int maxSlots, unsigned int& slot, unsigned int& count,
+                                T* const*& objects, RenderCall call)
+{
+    if (slot >= maxSlots || count > maxSlots - slot)
+    {
+        ++mIssued[static_cast<int>(call)];
+        return true;
+    }
+
+    // Find the first and last slots that change
+    unsigned int first = 0;
+    while (first < count && current[slot + first] == objects[first])  ++first;
+    if (first == count)
+    {
+        ++mFiltered[static_cast<int>(call)];
+        return false;
+    }
+    unsigned int last = count - 1;
+    while (current[slot + last] == objects[last])  --last;
+
+    for (unsigned int i = first; i <= last; ++i)  current[slot + i] = objects[i];
+    slot    += first;
+    objects += first;
+    count    = last - first + 1;
+    ++mIssued[static_cast<int>(call)];
+    return true;
+}
+
+
+bool RenderStateCache::SetConstantBuffers(ConstantBinding* current, unsigned int& slot, unsigned int& count,
+                                          ID3D11Buffer* const*& buffers, const unsigned int*& firstConstants,
+                                          const unsigned int*& numConstants, RenderCall call)
+{
+    if (slot >= MAX_CONSTANT_BUFFER_SLOTS || count > MAX_CONSTANT_BUFFER_SLOTS - slot ||
+        (firstConstants == nullptr) != (numConstants == nullptr))
+    {
+        ++mIssued[static_cast<int>(call)];
+        return true;
+    }
+
+    auto same = [&](unsigned int i)
+    {
+        const ConstantBinding& binding = current[slot + i];
+        return binding.buffer        == buffers[i] &&
+               binding.firstConstant == (firstConstants ? firstConstants[i] : 0) &&
+               binding.numConstants  == (numConstants   ? numConstants[i]   : 0);
+    };
+
+    // Find the first and last slots that change
+    unsigned int first = 0;
+    while (first < count && same(first))  ++first;
+    if (first == count)
+    {
+        ++mFiltered[static_cast<int>(call)];
+        return false;
+    }
+    unsigned int last = count - 1;
+    while (same(last))  --last;
+
+    for (unsigned int i = first; i <= last; ++i)
+    {
+        current[slot + i] = { buffers[i], firstConstants ? firstConstants[i] : 0, numConstants ? numConstants[i] : 0 };
+    }
+    slot    += first;
+    buffers += first;
+    if (firstConstants)  firstConstants += first;
+    if (numConstants)    numConstants   += first;
+    count    = last - first + 1;
+    ++mIssued[static_cast<int>(call)];
+    return true;
+}
+
+
+void RenderStateCache::VSSetShader(ID3D11VertexShader* shader)
+{
+    if (Set(mVertexShader, shader, RenderCall::VSSetShader))  mContext->VSSetShader(shader);
+}
+
+void RenderStateCache::PSSetShader(ID3D11PixelShader* shader)
+{
+    if (Set(mPixelShader, shader, RenderCall::PSSetShader))  mContext->PSSetShader(shader);
+}
+
+void RenderStateCache::VSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers)
+{
+    const unsigned int* noRanges = nullptr;
+    if (SetConstantBuffers(mVSConstantBuffers, slot, count, buffers, noRanges, noRanges, RenderCall::VSSetConstantBuffers))
+    {
+        mContext->VSSetConstantBuffers(slot, count, buffers);
+    }
+}
+
+void RenderStateCache::PSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers)
+{
+    const unsigned int* noRanges = nullptr;
+    if (SetConstantBuffers(mPSConstantBuffers, slot, count, buffers, noRanges, noRanges, RenderCall::PSSetConstantBuffers))
+    {
+        mContext->PSSetConstantBuffers(slot, count, buffers);
+    }
+}
+
+void RenderStateCache::VSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                                             const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+    if (SetConstantBuffers(mVSConstantBuffers, slot, count, buffers, firstConstants, numConstants, RenderCall::VSSetConstantBuffers1))
+    {
+        mContext->VSSetConstantBuffers1(slot, count, buffers, firstConstants, numConstants);
+    }
+}
+
+void RenderStateCache::PSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                                             const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+    if (SetConstantBuffers(mPSConstantBuffers, slot, count, buffers, firstConstants, numConstants, RenderCall::PSSetConstantBuffers1))
+    {
+        mContext->PSSetConstantBuffers1(slot, count, buffers, firstConstants, numConstants);
+    }
+}
+
+void RenderStateCache::PSSetShaderResources(unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views)
+{
+    if (SetSlots(mTextures, MAX_TEXTURE_SLOTS, slot, count, views, RenderCall::PSSetShaderResources))
+    {
+        mContext->PSSetShaderResources(slot, count, views);
+    }
+}
+
+void RenderStateCache::PSSetSamplers(unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers)
+{
+    if (SetSlots(mSamplers, MAX_SAMPLER_SLOTS, slot, count, samplers, RenderCall::PSSetSamplers))
+    {
+        mContext->PSSetSamplers(slot, count, samplers);
+    }
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Fixed function states
+-----------------------------------------------------------------------------------------*/
+
+void RenderStateCache::OMSetBlendState(ID3D11BlendState* state)
+{
+    if (Set(mBlendState, state, RenderCall::OMSetBlendState))  mContext->OMSetBlendState(state);
+}
+
+void RenderStateCache::OMSetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef)
+{
+    if (state == mDepthStencilState && stencilRef == mStencilRef)
+    {
+        ++mFiltered[static_cast<int>(RenderCall::OMSetDepthStencilState)];
+        return;
+    }
+    mDepthStencilState = state;
+    mStencilRef        = stencilRef;
+    ++mIssued[static_cast<int>(RenderCall::OMSetDepthStencilState)];
+    mContext->OMSetDepthStencilState(state, stencilRef);
+}
+
+void RenderStateCache::RSSetState(ID3D11RasterizerState* state)
+{
+    if (Set(mRasterizerState, state, RenderCall::RSSetState))  mContext->RSSetState(state);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Render targets
+-----------------------------------------------------------------------------------------*/
+
+void RenderStateCache::OMSetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* renderTargets,
+                                          ID3D11DepthStencilView* depthStencil)
+{
+    // Any texture bound to the shaders may be one of the new targets, which Direct3D unbinds (see header)
+    for (auto& texture : mTextures)  texture = Unknown<ID3D11ShaderResourceView>();
+
+    ++mIssued[static_cast<int>(RenderCall::OMSetRenderTargets)];
+    mContext->OMSetRenderTargets(count, renderTargets, depthStencil);
+}
+
+void RenderStateCache::ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const float colour[4])
+{
+    ++mIssued[static_cast<int>(RenderCall::ClearRenderTargetView)];
+    mContext->ClearRenderTargetView(renderTarget, colour);
+}
+
+void RenderStateCache::ClearDepthStencilView(ID3D11DepthStencilView* depthStencil, float depth)
+{
+    ++mIssued[static_cast<int>(RenderCall::ClearDepthStencilView)];
+    mContext->ClearDepthStencilView(depthStencil, depth);
+}
+
+void RenderStateCache::RSSetViewport(const RenderViewport& viewport)
+{
+    if (mViewportKnown && viewport.topLeftX == mViewport.topLeftX && viewport.topLeftY == mViewport.topLeftY &&
+                          viewport.width    == mViewport.width    && viewport.height   == mViewport.height   &&
+                          viewport.minDepth == mViewport.minDepth && viewport.maxDepth == mViewport.maxDepth)
+    {
+        ++mFiltered[static_cast<int>(RenderCall::RSSetViewport)];
+        return;
+    }
+    mViewport      = viewport;
+    mViewportKnown = true;
+    ++mIssued[static_cast<int>(RenderCall::RSSetViewport)];
+    mContext->RSSetViewport(viewport);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Geometry and drawing
+-----------------------------------------------------------------------------------------*/
+
+void RenderStateCache::IASetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride)
+{
+    if (buffer == mVertexBuffer && stride == mVertexStride)
+    {
+        ++mFiltered[static_cast<int>(RenderCall::IASetVertexBuffer)];
+        return;
+    }
+    mVertexBuffer = buffer;
+    mVertexStride = stride;
+    ++mIssued[static_cast<int>(RenderCall::IASetVertexBuffer)];
+    mContext->IASetVertexBuffer(buffer, stride);
+}
+
+void RenderStateCache::IASetInputLayout(ID3D11InputLayout* layout)
+{
+    if (Set(mInputLayout, layout, RenderCall::IASetInputLayout))  mContext->IASetInputLayout(layout);
+}
+
+void RenderStateCache::IASetIndexBuffer(ID3D11Buffer* buffer)
+{
+    if (Set(mIndexBuffer, buffer, RenderCall::IASetIndexBuffer))  mContext->IASetIndexBuffer(buffer);
+}
+
+void RenderStateCache::IASetPrimitiveTopology(PrimitiveTopology topology)
+{
+    if (mTopologyKnown && topology == mTopology)
+    {
+        ++mFiltered[static_cast<int>(RenderCall::IASetPrimitiveTopology)];
+        return;
+    }
+    mTopology      = topology;
+    mTopologyKnown = true;
+    ++mIssued[static_cast<int>(RenderCall::IASetPrimitiveTopology)];
+    mContext->IASetPrimitiveTopology(topology);
+}
+
+void RenderStateCache::DrawIndexed(unsigned int numIndices, unsigned int startIndex, int baseVertex)
+{
+    ++mIssued[static_cast<int>(RenderCall::DrawIndexed)];
+    mContext->DrawIndexed(numIndices, startIndex, baseVertex);
+}
+
+void RenderStateCache::DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances, unsigned int startIndex,
+                                            int baseVertex, unsigned int startInstance)
+{
+    ++mIssued[static_cast<int>(RenderCall::DrawIndexedInstanced)];
+    mContext->DrawIndexedInstanced(numIndices, numInstances, startIndex, baseVertex, startInstance);
+}
+
+
+void RenderStateCache::UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size)
+{
+    ++mIssued[static_cast<int>(RenderCall::UpdateConstantBuffer)];
+    mContext->UpdateConstantBuffer(buffer, data, size);
+}
+
+void RenderStateCache::AppendConstantBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size)
+{
+    ++mIssued[static_cast<int>(RenderCall::AppendConstantBuffer)];
+    mContext->AppendConstantBuffer(buffer, offset, data, size);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Counts
+-----------------------------------------------------------------------------------------*/
+
+long long RenderStateCache::NumIssued() const
+{
+    long long total = 0;
+    for (long long count : mIssued)  total += count;
+    return total;
+}
+
+long long RenderStateCache::NumFiltered() const
+{
+    long long total = 0;
+    for (long long count : mFiltered)  total += count;
+    return total;
+}
+
+void RenderStateCache::ResetCounts()
+{
+    for (long long& count : mIssued)    count = 0;
+    for (long long& count : mFiltered)  count = 0;
+}
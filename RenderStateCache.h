@@ -0,0 +1,170 @@
+//--------------------------------------------------------------------------------------
+// Render state cache - drops render context calls that would not change anything
+//--------------------------------------------------------------------------------------
+// Sits in front of another render context (see RenderDevice.h) and remembers what is currently bound: shaders,
+// constant buffers, textures and samplers in each slot, blend / depth / rasterizer states, viewport, input layout,
+// topology, vertex and index buffers. A call that sets what is already set is not passed on. Calls setting several
+// slots are trimmed to the slots that actually change. A constant buffer slot remembers the part of the buffer bound
+// as well as the buffer, so binding the whole buffer and binding part of it are different. Draws, clears and constant
+// buffer updates are always passed on, as are render target changes.
+//
+// Direct3D unbinds a texture from the shaders when it is bound as a render target or depth buffer (e.g. shadow maps
+// from one frame to the next), so all texture slots are forgotten when render targets are set, and the next setting
+// of each is passed on.
+//
+// The cache only knows about calls made through it. Call Invalidate if anything else changes the state of the
+// context, or after releasing an object that may still be bound, as a new object could be given the same address.
+//
+// Counts of the calls passed on and dropped are kept for each kind of call, to show how much is being saved.
+
+#ifndef _RENDER_STATE_CACHE_H_INCLUDED_
+#define _RENDER_STATE_CACHE_H_INCLUDED_
+
+#include "RenderDevice.h"
+
+#include <cstdint>
+
+
+class RenderStateCache : public IRenderContext
+{
+public:
+
+    // Construction / usage //
+
+    // Pass the context to send calls on to, which must exist as long as the cache. Nothing is known to be bound at
+    // first, so the first call of each kind is always passed on
+    RenderStateCache(IRenderContext* context);
+
+    // Forget everything bound, so the next call of each kind is passed on
+    void Invalidate();
+
+    // The context calls are passed on to
+    IRenderContext* Context()  { return mContext; }
+
+
+    // IRenderContext //
+
+    void VSSetShader(ID3D11VertexShader* shader) override;
+    void PSSetShader(ID3D11PixelShader*  shader) override;
+    void VSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers) override;
+    void PSSetConstantBuffers(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers) override;
+    void VSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                               const unsigned int* firstConstants, const unsigned int* numConstants) override;
+    void PSSetConstantBuffers1(unsigned int slot, unsigned int count, ID3D11Buffer* const* buffers,
+                               const unsigned int* firstConstants, const unsigned int* numConstants) override;
+    void PSSetShaderResources(unsigned int slot, unsigned int count, ID3D11ShaderResourceView* const* views) override;
+    void PSSetSamplers(unsigned int slot, unsigned int count, ID3D11SamplerState* const* samplers) override;
+
+    void OMSetBlendState(ID3D11BlendState* state) override;
+    void OMSetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef) override;
+    void RSSetState(ID3D11RasterizerState* state) override;
+
+    void OMSetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* renderTargets,
+                            ID3D11DepthStencilView* depthStencil) override;
+    void ClearRenderTargetView(ID3D11RenderTargetView* renderTarget, const float colour[4]) override;
+    void ClearDepthStencilView(ID3D11DepthStencilView* depthStencil, float depth) override;
+    void RSSetViewport(const RenderViewport& viewport) override;
+
+    void IASetVertexBuffer(ID3D11Buffer* buffer, unsigned int stride) override;
+    void IASetInputLayout(ID3D11InputLayout* layout) override;
+    void IASetIndexBuffer(ID3D11Buffer* buffer) override;
+    void IASetPrimitiveTopology(PrimitiveTopology topology) override;
+    void DrawIndexed(unsigned int numIndices, unsigned int startIndex, int baseVertex) override;
+    void DrawIndexedInstanced(unsigned int numIndices, unsigned int numInstances, unsigned int startIndex,
+                              int baseVertex, unsigned int startInstance) override;
+
+    void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size) override;
+    void AppendConstantBuffer(ID3D11Buffer* buffer, unsigned int offset, const void* data, unsigned int size) override;
+
+
+    // Counts //
+
+    // Number of calls of the given kind passed on (issued) or dropped (filtered) since the last reset
+    long long NumIssued  (RenderCall call) const  { return mIssued  [static_cast<int>(call)]; }
+    long long NumFiltered(RenderCall call) const  { return mFiltered[static_cast<int>(call)]; }
+
+    // All kinds
+    long long NumIssued() const;
+    long long NumFiltered() const;
+
+    void ResetCounts();
+
+
+private:
+    // Stands in for an object when it isn't known what is bound. Never a real object (they are aligned)
+    template <class T>
+    static T* Unknown()  { return reinterpret_cast<T*>(~uintptr_t(0)); }
+
+    // Update the cached state of one object, returning true if it has changed and the call should be passed on
+    template <class T>
+    bool Set(T*& current, T* object, RenderCall call)
+    {
+        if (current == object)
+        {
+            ++mFiltered[static_cast<int>(call)];
+            return false;
+        }
+        current = object;
+        ++mIssued[static_cast<int>(call)];
+        return true;
+    }
+
+    // Update the cached state of a range of slots, returning true if any have changed. Slot, count and objects are
+    // then trimmed to the range that changes. Ranges beyond the slot limit are passed on unchanged for the context
+    // to report
+    template <class T>
+    bool SetSlots(T** current, unsigned int maxSlots, unsigned int& slot, unsigned int& count, T* const*& objects,
+                  RenderCall call);
+
+    // What is bound to a constant buffer slot. A range of 0 constants stands for the whole buffer
+    struct ConstantBinding
+    {
+        ID3D11Buffer* buffer;
+        unsigned int  firstConstant;
+        unsigned int  numConstants;
+    };
+
+    // As SetSlots for constant buffers, ranges are null when binding whole buffers and are trimmed along with the rest
+    bool SetConstantBuffers(ConstantBinding* current, unsigned int& slot, unsigned int& count, ID3D11Buffer* const*& buffers,
+                            const unsigned int*& firstConstants, const unsigned int*& numConstants, RenderCall call);
+
+    IRenderContext* mContext;
+
+    // Bound state
+    ID3D11VertexShader*       mVertexShader;
+    ID3D11PixelShader*        mPixelShader;
+    ConstantBinding           mVSConstantBuffers[MAX_CONSTANT_BUFFER_SLOTS];
+    ConstantBinding           mPSConstantBuffers[MAX_CONSTANT_BUFFER_SLOTS];
+    ID3D11ShaderResourceView* mTextures[MAX_TEXTURE_SLOTS];
+    ID3D11SamplerState*       mSamplers[MAX_SAMPLER_SLOTS];
+
+    ID3D11BlendState*         mBlendState;
+    ID3D11DepthStencilState*  mDepthStencilState;
+    unsigned int              mStencilRef;
+    ID3D11RasterizerState*    mRasterizerState;
+
+    RenderViewport            mViewport;
+    bool                      mViewportKnown;
+
+    ID3D11Buffer*             mVertexBuffer;
+    unsigned int              mVertexStride;
+    ID3D11InputLayout*        mInputLayout;
+    ID3D11Buffer*             mIndexBuffer;
+    PrimitiveTopology         mTopology;
+    bool                      mTopologyKnown;
+
+    // Counts
+    long long mIssued  [static_cast<int>(RenderCall::NumCalls)] = {};
+    long long mFiltered[static_cast<int>(RenderCall::NumCalls)] = {};
+};
+
+
+//--------------------------------------------------------------------------------------
+// Global Variables
+//--------------------------------------------------------------------------------------
+// The cache in front of the immediate context, set up by InitDirect3D (gRenderContext points to it), nullptr if
+// none is used. Defined in RenderStateCache.cpp
+extern RenderStateCache* gRenderStateCache;
+
+
+#endif //_RENDER_STATE_CACHE_H_INCLUDED_
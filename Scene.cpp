@@ -6,6 +6,15 @@
 #include "Scene.h"
 #include "Mesh.h"
 #include "Model.h"
+#include "ModelHierarchy.h"
+#include "EntityStore.h"
+#include "RenderQueue.h"
+#include "RenderStateCache.h"
+#include "ConstantUploadBuffer.h"
+#include "BoundingVolumeHierarchy.h"
+#include "SpatialGrid.h"
+#include "OcclusionBuffer.h"
+#include "SceneDescription.h"
 #include "Camera.h"
 #include "State.h"
 #include "Shader.h"
@@ -18,14 +27,22 @@
 #include "CVector2.h" 
 #include "CVector3.h" 
 #include "CMatrix4x4.h"
+#include "CFrustum.h"
 
 #include "MathHelpers.h"     // Helper functions for maths
 #include "GraphicsHelpers.h" // Helper functions to unclutter the code here
+#include "FixedTimestep.h"
+#include "FramePipeline.h"
+#include "JobSystem.h"
 
 #include "ColourRGBA.h" 
 
 #include <sstream>
 #include <memory>
+#include <vector>
+#include <filesystem>
+#include <cstring>
+#include <exception>
 #include <atlbase.h>
 
 //--------------------------------------------------------------------------------------
@@ -109,29 +126,86 @@ Model* gModels[NUM_MODELS] = { gFox,    gCrate, gGround, gSphere,
                               gSprite, gTank,  gHat, gPotion, gCat, gTrunk,
                               gLeaves, gTower, gGriffin, gWizard, gBox, gWell,
                               gPortal, gCrystal, gCellCrystal, gDragon, gPillar, gMapping };
-//Array to hold tanks
-const int NUM_TANKS = 20;
-Model* gTanks[NUM_TANKS];
+// Crowds of identical objects (tanks, sprites, trees and bats) are held as entities in a store of packed arrays
+// rather than as separate models. They are rendered a mesh at a time
+EntityStore gEntities;
 
-//Array to hold sprites
-const int NUM_SPRITES = 80;
-Model* gSprites[NUM_SPRITES];
+// Each pass submits the models and entities to a render queue (see RenderQueue.h), which sorts them to minimise state
+// changes before rendering. gRenderables lists what is submitted and the material used in the main passes, it is
+// set up in CreateRenderMaterials along with the materials
+RenderMaterials* gRenderMaterials = nullptr;
+RenderQueue*     gRenderQueue     = nullptr;
 
-//Array to hold trees. This allows for easy placement in the scene setup
-const int NUM_TREES = 10;
-Model* gTrees[NUM_TREES];
+const int NO_MATERIAL = -1;
 
-//Array to hold bats for easy scene setup placement
-const int NUM_BATS = 10;
-Model* gBats[NUM_BATS];
+struct SceneRenderable
+{
+    Model* model;             // Either a single model...
+    Mesh*  entityMesh;        // ...or all entities using this mesh
+    int    material;          // Material for the camera passes, NO_MATERIAL if only rendered into the shadow maps
+    int    outlineMaterial;   // Also rendered with this material in the camera passes (cell shading outline), or NO_MATERIAL
+    bool   useEntityTextures; // Entities only, each entity replaces the material's slot 0 texture with its own (not the outline's)
+    bool   castsShadow;       // Rendered into the shadow maps with gDepthOnlyMaterial
+};
+std::vector<SceneRenderable> gRenderables;
+
+int gDepthOnlyMaterial;
+int gLightMaterial;
+
+// The entities and lights are placed by a scene file (see SceneDescription.h), which also lists the meshes and
+// textures they use. Edit the text file to change the layout, it is compiled to the binary file when next run
+const std::string SCENE_FILE        = "Scene.txt";
+const std::string SCENE_BINARY_FILE = "Scene.bin";
+SceneDescription* gSceneDescription = nullptr; // Only kept while the scene is being set up
+
+// Meshes and textures loaded for the scene file, in the same order as its records
+std::vector<Mesh*>    gSceneMeshes;
+std::vector<Texture*> gSceneTextures;
+
+// Attachments between models, e.g. the hat on the fox. Attached models follow their parent when it moves
+ModelHierarchy gModelHierarchy;
 
 Camera* gCamera;
 Camera* gPortalCamera;
 
+JobSystem* gJobSystem = nullptr;
+
 // Store lights in an array
 const int NUM_LIGHTS = 4;
 Light* gLights[NUM_LIGHTS];
 
+// Each pass only submits the models and entities inside its own frustum (see CFrustum.h). The world bounds of the
+// models are found once a frame before the passes: one for each renderable (unused for entities, which keep their
+// own bounds, see EntityStore.h) followed by one for each light model
+std::vector<BoundingSphere> gModelBounds;
+std::vector<uint32_t>       gModelVisibleBits;  // Results of culling gModelBounds for the current pass
+std::vector<uint32_t>       gEntityVisibleBits; // --"-- the entities
+
+// The bounds of the models then the entities, in a hierarchy so each pass finds what is inside its frustum without
+// testing everything (see BoundingVolumeHierarchy.h), rebuilt when entities are added or removed. Anything seen to
+// move (e.g. the fox, the orbiting light) is handed over to a grid that is cheap to update (see SpatialGrid.h), so
+// moving objects never make the hierarchy need refitting. Passes query both
+BoundingVolumeHierarchy gSceneBVH;
+SpatialGrid             gMovingObjects(20);
+std::vector<int>        gVisibleObjects; // Results of the queries for the current pass
+
+// Large models that hide much of the scene (the hills, the tower, the cargo container) are drawn into a small software
+// depth buffer from each camera, and the models and entities found to be hidden behind them are not submitted (see
+// OcclusionBuffer.h). Press '3' to toggle
+OcclusionBuffer*         gOcclusionBuffer = nullptr;
+std::vector<Model*>      gOccluders;
+std::vector<BoundingBox> gOccludeeBounds;  // Bounds of the objects found by the queries, for testing against the buffer
+std::vector<uint8_t>     gOccludeeVisible; // Results of the tests
+bool                     gUseOcclusion = true;
+
+// Items submitted by each pass, summed over the frames since the window title was updated
+enum class ScenePass { Light1Shadow, Light2Shadow, Portal, Main, NumPasses };
+int gNumVisible[static_cast<int>(ScenePass::NumPasses)] = {};
+
+// Objects hidden by the occluders in each pass and the time taken by the occlusion buffer, also summed over the frames
+int   gNumOccluded[static_cast<int>(ScenePass::NumPasses)] = {};
+float gOcclusionMilliseconds = 0;
+
 
 // Additional light information
 CVector3 gAmbientColour = { 0.2f, 0.2f, 0.3f }; // Background level of light (slightly bluish to match the far background, which is dark blue)
@@ -146,12 +220,65 @@ float    OutlineThickness = 0.015f;
 // Variables controlling light1's orbiting of the cube
 const float gLightOrbit = 30.0f;
 const float gLightOrbitSpeed = 0.7f;
+bool gLightOrbiting = true; // Press '1' to toggle
+
+// Speed of light1's pulsing (strength change per second) and light2's colour cycling (colour change per second)
+const float gLightPulseSpeed  = 3.0f;
+const float gColourCycleSpeed = 0.06f;
+
+constexpr float gSpotlightConeAngle = 90.0f; // Spot light cone angle (degrees)
 
-float gSpotlightConeAngle = 90.0f; // Spot light cone angle (degrees)
+// Values derived from the cone angle, calculated at compile time
+constexpr float      gSpotlightCosHalfAngle     = Cos(ToRadians(gSpotlightConeAngle / 2));
+constexpr CMatrix4x4 gSpotlightProjectionMatrix = MakeProjectionMatrix(1.0f, ToRadians(gSpotlightConeAngle)); // Helper function in Utility\GraphicsHelpers.h
 
 // Lock FPS to monitor refresh rate, for me this is 165. Press 'p' to toggle to full fps
 bool lockFPS = true;
 
+
+//--------------------------------------------------------------------------------------
+// Simulation State
+//--------------------------------------------------------------------------------------
+// The scene is simulated in fixed steps (see FixedTimestep.h), so its behaviour and its cost per second are the same
+// at any frame rate. The results of each step that rendering needs are stored, and each frame is rendered part way
+// between the results of the last two steps
+
+const float SIMULATION_STEP_TIME = 1.0f / 60.0f;
+FixedTimestep gSimulationClock(SIMULATION_STEP_TIME);
+
+struct SimulationState
+{
+    std::vector<CMatrix3x4> modelMatrices; // World matrices of the models in gSimulatedModels
+    CVector3 lightColours  [NUM_LIGHTS];
+    float    lightStrengths[NUM_LIGHTS];
+    int      numSteps = 0;                 // Number of simulation steps run for this frame
+};
+
+// Models rendered from the simulation state. Entities are not included, they don't move so are rendered directly
+std::vector<Model*> gSimulatedModels;
+
+// Last two simulation steps, only used by the simulation
+SimulationState gPreviousState;
+SimulationState gCurrentState;
+
+// The simulation runs on its own thread, one frame ahead of rendering (see FramePipeline.h). Each frame the main
+// thread passes in the frame time and input, and takes the state to render, blended from two simulation steps.
+// The simulation thread owns the models' positions, rotations and world matrices, the lights and anything changed
+// in SimulateScene, the main thread only uses the render state and the models' render matrices
+// Increase the frames in flight to allow more time for the simulation at the cost of latency, or use 0 to run the
+// simulation on the main thread
+const int SIMULATION_FRAMES_IN_FLIGHT = 1;
+
+struct SimulationInput
+{
+    float            frameTime;
+    ModelControlKeys foxKeys;
+    bool             toggleLightOrbit;
+};
+
+FramePipeline<SimulationInput, SimulationState>* gSimulationPipeline = nullptr;
+const SimulationState* gRenderState = nullptr; // State being rendered, valid until the next UpdateScene
+
 //--------------------------------------------------------------------------------------
 //**** Portal Texture  ****//
 //--------------------------------------------------------------------------------------
@@ -199,6 +326,13 @@ ID3D11Buffer*     gPerFrameConstantBuffer; // The GPU buffer that will recieve t
 PerModelConstants gPerModelConstants;      // As above, but constant that change per-model (e.g. world matrix)
 ID3D11Buffer*     gPerModelConstantBuffer; // --"--
 
+// World matrices and colours for instanced draws, filled by the render queue (see RenderQueue.h)
+ID3D11Buffer*     gPerInstanceConstantBuffer;
+
+// Per-model constants of every model and entity drawn this frame, each sent to the GPU once and shared by all passes
+// (see ConstantUploadBuffer.h). gPerModelConstantBuffer is only used if this one is full
+ConstantUploadBuffer* gPerModelConstantsUpload = nullptr;
+
 //--------------------------------------------------------------------------------------
 // Textures
 //--------------------------------------------------------------------------------------
@@ -214,14 +348,11 @@ Texture* gCobbleTexture = new Texture("CobbleDiffuseSpecular.dds", "CobbleNormal
 Texture* gBrainTexture = new Texture("BrainDiffuseSpecular.dds", "BrainNormalHeight.dds");
 Texture* gPatternTexture = new Texture("PatternDiffuseSpecular.dds", "PatternNormalHeight.dds");
 Texture* gFoxTexture = new Texture("fox.png");
-Texture* gBatTexture = new Texture("Bat.png");
 Texture* gWallTexture = new Texture("WallDiffuseSpecular.dds", "WallNormalHeight.dds");
 Texture* gGlassTexture = new Texture("glass2.png");
-Texture* gSpriteTexture = new Texture("pikachu.png");
 Texture* gMetalTexture = new Texture("MetalDiffuseSpecular.dds", "MetalNormal.dds");
 Texture* gHatTexture = new Texture("hat.jpeg", "hatnormal.png");
 Texture* gPotionTexture = new Texture("potion.png");
-Texture* gTankTexture = new Texture("Tank.dds");
 Texture* gCatTexture = new Texture("CatTexture.dds");
 Texture* gTrunkTexture = new Texture("Trunk.png");
 Texture* gLeavesTexture = new Texture("Leaves.png");
@@ -232,21 +363,26 @@ Texture* gTVTexture = new Texture("tv.png");
 Texture* gCellMap = new Texture("CellGradient.png");
 Texture* gCrystalTexture = new Texture("crystal.png");
 Texture* gCellCrystalTexture = new Texture("purple.png");
-Texture* gTreeTexture = new Texture("LightGreen.png");
 Texture* gDragonTexture = new Texture("dragon.jpg", "dragonN.jpg");
 
+// Textures from the scene file that are also used by the models above
+Texture* gBatTexture;
+Texture* gSpriteTexture;
+Texture* gTankTexture;
+Texture* gTreeTexture;
 
-const int NUM_TEXTURES = 30;
+
+const int NUM_TEXTURES = 26;
 
 //Array to hold all textures. This allows for the loading of all textures and easy deletion.
 Texture* gTextures[NUM_TEXTURES] = { gTrollTexture, gCargoTexture, gGrassTexture, gFlareTexture,
                                      gWoodTexture, gTechTexture, gCobbleTexture, gBrainTexture,
-                                     gPatternTexture, gFoxTexture, gBatTexture, gWallTexture, 
-                                     gGlassTexture, gSpriteTexture, gMetalTexture, gHatTexture,
-                                     gPotionTexture, gTankTexture, gCatTexture , gTrunkTexture, 
+                                     gPatternTexture, gFoxTexture, gWallTexture, 
+                                     gGlassTexture, gMetalTexture, gHatTexture,
+                                     gPotionTexture, gCatTexture , gTrunkTexture, 
                                      gLeavesTexture, gGriffinTexture, gTowerTexture, gWizardTexture,
                                      gTVTexture, gCellMap, gCrystalTexture, gCellCrystalTexture, 
-                                     gTreeTexture, gDragonTexture };
+                                     gDragonTexture };
 
 //Cube Mapping Variables
 ID3D11Resource* cubeMapTex;
@@ -263,13 +399,117 @@ bool gUseParallax = true;
 // Get "camera-like" view matrix for a spotlight
 CMatrix4x4 CalculateLightViewMatrix(int lightIndex)
 {
-    return InverseAffine(gLights[lightIndex]->GetModel()->WorldMatrix());
+    return ToMatrix4x4(InverseAffine(gLights[lightIndex]->GetModel()->RenderMatrix()));
 }
 
 // Get "camera-like" projection matrix for a spotlight
 CMatrix4x4 CalculateLightProjectionMatrix(int lightIndex)
 {
-    return MakeProjectionMatrix(1.0f, ToRadians(gSpotlightConeAngle)); // Helper function in Utility\GraphicsHelpers.cpp
+    return gSpotlightProjectionMatrix; // All spotlights have the same cone angle, so the projection is a constant
+}
+
+// Get the volume lit by a spotlight (and so covered by its shadow map), for culling models in the shadow pass
+CFrustum CalculateLightFrustum(int lightIndex)
+{
+    return FrustumFromMatrix(CalculateLightViewMatrix(lightIndex) * CalculateLightProjectionMatrix(lightIndex));
+}
+
+
+//--------------------------------------------------------------------------------------
+// Simulation State Helper Functions
+//--------------------------------------------------------------------------------------
+
+// Store the results of the latest simulation step that rendering needs
+void StoreSimulationState(SimulationState& state)
+{
+    state.modelMatrices.resize(gSimulatedModels.size());
+    for (size_t i = 0; i < gSimulatedModels.size(); ++i)
+    {
+        state.modelMatrices[i] = gSimulatedModels[i]->WorldMatrix();
+    }
+    for (int i = 0; i < NUM_LIGHTS; ++i)
+    {
+        state.lightColours  [i] = gLights[i]->GetColour();
+        state.lightStrengths[i] = gLights[i]->GetStrength();
+    }
+}
+
+// Blend the given fraction (0 to 1) of the way from the previous simulation state to the current one, giving the
+// state to render
+void BlendSimulationStates(const SimulationState& previous, const SimulationState& current, float t, SimulationState& blended)
+{
+    blended.modelMatrices.resize(current.modelMatrices.size());
+    for (size_t i = 0; i < current.modelMatrices.size(); ++i)
+    {
+        // Most models are still, only blend those that moved in the last step
+        const CMatrix3x4& previousMatrix = previous.modelMatrices[i];
+        const CMatrix3x4& currentMatrix  = current .modelMatrices[i];
+        if (std::memcmp(&previousMatrix, &currentMatrix, sizeof(CMatrix3x4)) == 0)
+        {
+            blended.modelMatrices[i] = currentMatrix;
+        }
+        else
+        {
+            blended.modelMatrices[i] = InterpolateAffine(previousMatrix, currentMatrix, t);
+        }
+    }
+    for (int i = 0; i < NUM_LIGHTS; ++i)
+    {
+        blended.lightColours  [i] = previous.lightColours  [i] + (current.lightColours  [i] - previous.lightColours  [i]) * t;
+        blended.lightStrengths[i] = previous.lightStrengths[i] + (current.lightStrengths[i] - previous.lightStrengths[i]) * t;
+    }
+}
+
+// Forward declaration, see Scene Update section below
+void SimulateFrame(const SimulationInput& input, SimulationState& renderState);
+
+
+//--------------------------------------------------------------------------------------
+// Scene File Helper Functions
+//--------------------------------------------------------------------------------------
+
+// Load the scene file. The text file is compiled to the binary file the first time it is loaded after an edit, other
+// runs load the binary file, which is much faster for large scenes. Throws a std::runtime_error exception on failure
+SceneDescription* LoadSceneDescription(const std::string& fileName, const std::string& binaryFileName)
+{
+    std::error_code textError, binaryError;
+    auto textTime   = std::filesystem::last_write_time(fileName,       textError);
+    auto binaryTime = std::filesystem::last_write_time(binaryFileName, binaryError);
+    if (!binaryError && (textError || binaryTime >= textTime))
+    {
+        return new SceneDescription(binaryFileName);
+    }
+
+    SceneDescription* sceneDescription = new SceneDescription(fileName);
+    try
+    {
+        sceneDescription->SaveBinary(binaryFileName);
+    }
+    catch (const std::runtime_error&)
+    {
+        // Not being able to save the binary file only means the text will be loaded again next time
+    }
+    return sceneDescription;
+}
+
+// Find a mesh loaded for the scene file by the name given in the file
+Mesh* FindSceneMesh(const char* name)
+{
+    for (int i = 0; i < gSceneDescription->NumMeshes(); ++i)
+    {
+        if (std::strcmp(gSceneDescription->String(gSceneDescription->MeshRecord(i).name), name) == 0)  return gSceneMeshes[i];
+    }
+    throw std::runtime_error(std::string("No mesh called ") + name + " in " + SCENE_FILE);
+}
+
+// Find a texture loaded for the scene file by the name given in the file
+Texture* FindSceneTexture(const char* name)
+{
+    for (int i = 0; i < gSceneDescription->NumTextures(); ++i)
+    {
+        if (std::strcmp(gSceneDescription->String(gSceneDescription->TextureRecord(i).name), name) == 0)  return gSceneTextures[i];
+    }
+    throw std::runtime_error(std::string("No texture called ") + name + " in " + SCENE_FILE);
 }
 
 
@@ -281,28 +521,27 @@ CMatrix4x4 CalculateLightProjectionMatrix(int lightIndex)
 // Returns true on success
 bool InitGeometry()
 {
+    gJobSystem = new JobSystem(-1, "Job Worker");
+    gOcclusionBuffer = new OcclusionBuffer(256, 128, gJobSystem);
+
     // Load mesh geometry data, just like TL-Engine this doesn't create anything in the scene. Create a Model for that.
     try 
     {
         gFoxMesh       = new Mesh("Fox.fbx");
-        gCrateMesh     = new Mesh("CargoContainer.x");
-        gGroundMesh    = new Mesh("Hills.x");
+        gCrateMesh     = new Mesh("CargoContainer.x", false, true); // Occluders keep their positions on the CPU
+        gGroundMesh    = new Mesh("Hills.x", false, true);
         gSphereMesh    = new Mesh("Sphere.x", true);
         gLightMesh     = new Mesh("Light.x");
         gTeapotMesh    = new Mesh("Teapot.x",true);
         gCubeMesh      = new Mesh("Cube.x", true);
-        gTreeMesh      = new Mesh("Tree.fbx");
-        gBatMesh       = new Mesh("bat.fbx");
         gGlassCubeMesh = new Mesh("Cube.x");    
-        gSpriteMesh    = new Mesh("portal.x");
-        gTankMesh      = new Mesh("Tank.fbx");
         gHatMesh       = new Mesh("WizardHat.fbx", true);
         gPotionMesh    = new Mesh("potion.fbx");
         gCatMesh       = new Mesh("Cat.fbx");
         gTrunkMesh     = new Mesh("Trunk.fbx");
         gLeavesMesh    = new Mesh("Leaves.fbx");
         gGriffinMesh   = new Mesh("griffin.fbx");
-        gTowerMesh     = new Mesh("Tower.fbx");
+        gTowerMesh     = new Mesh("Tower.fbx", false, true);
         gWizardMesh    = new Mesh("wizard.fbx");
         gBoxMesh       = new Mesh("box.fbx");
         gWellMesh      = new Mesh("well.fbx");
@@ -310,6 +549,50 @@ bool InitGeometry()
         gDragonMesh    = new Mesh("dragon.fbx", true);
         gPillarMesh    = new Mesh("pillar.fbx");
 
+        // Load the scene file along with the meshes and textures it uses (textures are loaded onto the GPU below)
+        gSceneDescription = LoadSceneDescription(SCENE_FILE, SCENE_BINARY_FILE);
+
+        // Meshes are loaded in parallel, most of the time is spent in Assimp and the device is free-threaded. Each mesh
+        // has its own Assimp importer and Assimp's process-wide logger is not used (see Mesh.cpp).
+        // Exceptions from the loading jobs are passed back to be thrown here
+        int numSceneMeshes = gSceneDescription->NumMeshes();
+        gSceneMeshes.resize(numSceneMeshes, nullptr);
+        std::vector<std::exception_ptr> meshErrors(numSceneMeshes);
+        gJobSystem->ParallelFor(0, numSceneMeshes, 1, [&](int start, int end)
+        {
+            for (int i = start; i < end; ++i)
+            {
+                try
+                {
+                    const SceneMeshRecord& mesh = gSceneDescription->MeshRecord(i);
+                    gSceneMeshes[i] = new Mesh(gSceneDescription->String(mesh.fileName), mesh.requireTangents != 0);
+                }
+                catch (...)
+                {
+                    meshErrors[i] = std::current_exception();
+                }
+            }
+        });
+        for (auto& meshError : meshErrors)
+        {
+            if (meshError)  std::rethrow_exception(meshError);
+        }
+        for (int i = 0; i < gSceneDescription->NumTextures(); ++i)
+        {
+            const SceneTextureRecord& texture = gSceneDescription->TextureRecord(i);
+            gSceneTextures.push_back(new Texture(gSceneDescription->String(texture.diffuseSpecularFileName),
+                                                 gSceneDescription->String(texture.normalFileName)));
+        }
+
+        // Some of the scene file's meshes and textures are also used for individual models
+        gTreeMesh   = FindSceneMesh("tree");
+        gBatMesh    = FindSceneMesh("bat");
+        gSpriteMesh = FindSceneMesh("sprite");
+        gTankMesh   = FindSceneMesh("tank");
+        gSpriteTexture = FindSceneTexture("sprite");
+        gTankTexture   = FindSceneTexture("tank");
+        gBatTexture    = FindSceneTexture("bat");
+        gTreeTexture   = FindSceneTexture("tree");
     }
     catch (std::runtime_error e)  // Constructors cannot return error messages so use exceptions to catch mesh errors
     {
@@ -337,27 +620,39 @@ bool InitGeometry()
     // See the comments above where these variable are declared and also the UpdateScene function
     gPerFrameConstantBuffer = CreateConstantBuffer(sizeof(gPerFrameConstants));
     gPerModelConstantBuffer = CreateConstantBuffer(sizeof(gPerModelConstants));
-    if (gPerFrameConstantBuffer == nullptr || gPerModelConstantBuffer == nullptr)
+    gPerInstanceConstantBuffer = CreateConstantBuffer(sizeof(RenderInstance) * MAX_RENDER_INSTANCES);
+    if (gPerFrameConstantBuffer == nullptr || gPerModelConstantBuffer == nullptr || gPerInstanceConstantBuffer == nullptr)
     {
         gLastError = "Error creating constant buffers";
         return false;
     }
+    try
+    {
+        gPerModelConstantsUpload = new ConstantUploadBuffer(sizeof(PerModelConstants), 1024); // Grows to fit the scene
+    }
+    catch (const std::runtime_error& e)
+    {
+        gLastError = e.what();
+        return false;
+    }
 
 
     //// Load / prepare textures on the GPU ////
 
-    // Load textures and create DirectX objects for them
-    for (int i = 0; i < NUM_TEXTURES; i++)
+    // Load textures and create DirectX objects for them, both those above and those for the scene file
+    std::vector<Texture*> allTextures(gTextures, gTextures + NUM_TEXTURES);
+    allTextures.insert(allTextures.end(), gSceneTextures.begin(), gSceneTextures.end());
+    for (Texture* texture : allTextures)
     {
         //Variables to hold diffuse maps
         ID3D11Resource* DiffuseSpecularMap = nullptr;
         ID3D11ShaderResourceView* DiffuseSpecularMapSRV = nullptr;
-        std::string TextureName = gTextures[i]->GetTextureName();
+        std::string TextureName = texture->GetTextureName();
 
         //Variables to hold normal maps
         ID3D11Resource* NormalMap = nullptr;
         ID3D11ShaderResourceView* NormalMapSRV = nullptr;
-        std::string NormalName = gTextures[i]->GetNormalName();
+        std::string NormalName = texture->GetNormalName();
 
         //Load the diffuse map textures
         if (!LoadTexture(TextureName, &DiffuseSpecularMap, &DiffuseSpecularMapSRV))
@@ -375,10 +670,10 @@ bool InitGeometry()
             }
         }
         //Set textures
-        gTextures[i]->SetDiffuseSpecularMap(DiffuseSpecularMap);
-        gTextures[i]->SetDiffuseSpecularMapSRV(DiffuseSpecularMapSRV);
-        gTextures[i]->SetNormalMap(NormalMap);
-        gTextures[i]->SetNormalMapSRV(NormalMapSRV);
+        texture->SetDiffuseSpecularMap(DiffuseSpecularMap);
+        texture->SetDiffuseSpecularMapSRV(DiffuseSpecularMapSRV);
+        texture->SetNormalMap(NormalMap);
+        texture->SetNormalMapSRV(NormalMapSRV);
     }
 
     //Create cube mapping texture
@@ -531,6 +826,170 @@ bool InitGeometry()
 
 // Prepare the scene
 // Returns true on success
+// Copy of a material with the given textures in slots 0 and 3 (diffuse/specular and normal maps in most shaders)
+RenderMaterial WithTextures(RenderMaterial material, ID3D11ShaderResourceView* texture0, ID3D11ShaderResourceView* texture3 = nullptr)
+{
+    material.textures[0] = texture0;
+    material.textures[3] = texture3;
+    return material;
+}
+
+// Create the materials used to render the scene and list the models and entities rendered with them
+// The shaders, states and textures must have been created already (in InitGeometry), and the models (in InitScene)
+void CreateRenderMaterials()
+{
+    gRenderMaterials = new RenderMaterials;
+    gRenderQueue     = new RenderQueue(*gRenderMaterials);
+    gRenderQueue->SetInstanceBuffer(gPerInstanceConstantBuffer);
+    gRenderQueue->SetConstantUpload(gPerModelConstantsUpload, 1); // Slot must match the per-model constant buffer in the shaders
+    RenderMaterials& materials = *gRenderMaterials;
+
+    // Most models use per-pixel lighting, no blending, normal depth buffer and culling, and anisotropic filtering.
+    // Materials with an instanced vertex shader draw runs of the same mesh (e.g. entities) with one draw call, others
+    // don't have one or use pixel shaders reading the per-model constants
+    RenderMaterial lit;
+    lit.vertexShader          = gPixelLightingVertexShader;
+    lit.instancedVertexShader = gPixelLightingInstancedVertexShader;
+    lit.pixelShader           = gPixelLightingPixelShader;
+    lit.blendState            = gNoBlendingState;
+    lit.depthStencilState     = gUseDepthBufferState;
+    lit.rasterizerState       = gCullBackState;
+    lit.samplers[0]           = gAnisotropic4xSampler;
+
+    int groundMaterial   = materials.Add(WithTextures(lit, gGrassTexture  ->GetDiffuseSpecularMapSRV()));
+    int foxMaterial      = materials.Add(WithTextures(lit, gFoxTexture    ->GetDiffuseSpecularMapSRV()));
+    int trunkMaterial    = materials.Add(WithTextures(lit, gTrunkTexture  ->GetDiffuseSpecularMapSRV()));
+    int leavesMaterial   = materials.Add(WithTextures(lit, gLeavesTexture ->GetDiffuseSpecularMapSRV()));
+    int crateMaterial    = materials.Add(WithTextures(lit, gCargoTexture  ->GetDiffuseSpecularMapSRV()));
+    int catMaterial      = materials.Add(WithTextures(lit, gCatTexture    ->GetDiffuseSpecularMapSRV()));
+    int griffinMaterial  = materials.Add(WithTextures(lit, gGriffinTexture->GetDiffuseSpecularMapSRV()));
+    int towerMaterial    = materials.Add(WithTextures(lit, gTowerTexture  ->GetDiffuseSpecularMapSRV())); // Also used for the box
+    int wizardMaterial   = materials.Add(WithTextures(lit, gWizardTexture ->GetDiffuseSpecularMapSRV())); // Also used for the well
+    int crystalMaterial  = materials.Add(WithTextures(lit, gCrystalTexture->GetDiffuseSpecularMapSRV()));
+    int entityMaterial   = materials.Add(lit); // Bats and tanks, each with its own texture
+
+    RenderMaterial cubeMapping = lit;
+    cubeMapping.pixelShader = gCubeMappingPixelShader;
+    int cubeMappingMaterial = materials.Add(WithTextures(cubeMapping, cubeMapSRV));
+
+    // The portal shows the scene rendered from the portal camera, framed by a TV
+    RenderMaterial tv = lit;
+    tv.pixelShader = gTVPixelShader;
+    int portalMaterial = materials.Add(WithTextures(tv, gPortalTextureSRV, gTVTexture->GetDiffuseSpecularMapSRV()));
+
+    RenderMaterial normalMapping = lit;
+    normalMapping.vertexShader          = gNormalMappingVertexShader;
+    normalMapping.instancedVertexShader = nullptr;
+    normalMapping.pixelShader           = gNormalMappingPixelShader;
+    int hatMaterial    = materials.Add(WithTextures(normalMapping, gHatTexture   ->GetDiffuseSpecularMapSRV(), gHatTexture   ->GetNormalMapSRV()));
+    int dragonMaterial = materials.Add(WithTextures(normalMapping, gDragonTexture->GetDiffuseSpecularMapSRV(), gDragonTexture->GetNormalMapSRV()));
+
+    RenderMaterial parallaxMapping = normalMapping;
+    parallaxMapping.pixelShader = gParallaxMappingPixelShader;
+    int teapotMaterial = materials.Add(WithTextures(parallaxMapping, gPatternTexture->GetDiffuseSpecularMapSRV(), gPatternTexture->GetNormalMapSRV()));
+    int pillarMaterial = materials.Add(WithTextures(parallaxMapping, gTechTexture   ->GetDiffuseSpecularMapSRV(), gTechTexture   ->GetNormalMapSRV()));
+
+    RenderMaterial sphere = lit;
+    sphere.vertexShader          = gSphereVertexShader;
+    sphere.instancedVertexShader = nullptr;
+    sphere.pixelShader           = gSpherePixelShader;
+    int sphereMaterial = materials.Add(WithTextures(sphere, gBrainTexture->GetDiffuseSpecularMapSRV(), gBrainTexture->GetNormalMapSRV()));
+
+    // The cube blends between two textures, each with a normal map
+    RenderMaterial cube = normalMapping;
+    cube.pixelShader = gCubePixelShader;
+    cube.textures[0] = gWallTexture  ->GetDiffuseSpecularMapSRV();
+    cube.textures[3] = gCobbleTexture->GetDiffuseSpecularMapSRV();
+    cube.textures[4] = gWallTexture  ->GetNormalMapSRV();
+    cube.textures[5] = gCobbleTexture->GetNormalMapSRV();
+    int cubeMaterial = materials.Add(cube);
+
+    RenderMaterial sprite = lit;
+    sprite.pixelShader = gSpritePixelShader;
+    sprite.blendMode   = BlendMode::AlphaBlended;
+    sprite.blendState  = gAlphaBlending;
+    int spriteMaterial = materials.Add(WithTextures(sprite, gSpriteTexture->GetDiffuseSpecularMapSRV()));
+
+    RenderMaterial multiplicative = lit;
+    multiplicative.blendMode  = BlendMode::Multiplicative;
+    multiplicative.blendState = gMultiplicativeBlending;
+    int potionMaterial = materials.Add(WithTextures(multiplicative, gPotionTexture->GetDiffuseSpecularMapSRV()));
+    int glassMaterial  = materials.Add(WithTextures(multiplicative, gGlassTexture ->GetDiffuseSpecularMapSRV()));
+
+    // Cell shaded models are rendered twice: first inside out (front culling), slightly bigger and black for the
+    // outline, then normally with cell shading, which uses a special 1D "cell map" with point sampling
+    RenderMaterial cellOutline = lit;
+    cellOutline.vertexShader          = gCellShadingOutlineVertexShader;
+    cellOutline.instancedVertexShader = gCellShadingOutlineInstancedVertexShader;
+    cellOutline.pixelShader           = gCellShadingOutlinePixelShader;
+    cellOutline.rasterizerState       = gCullFrontState;
+    int cellOutlineMaterial = materials.Add(cellOutline);
+
+    RenderMaterial cellShading = lit;
+    cellShading.vertexShader          = gCellShadingVertexShader;
+    cellShading.instancedVertexShader = gCellShadingInstancedVertexShader;
+    cellShading.pixelShader           = gCellShadingPixelShader;
+    cellShading.samplers[2]           = gPointSampler;
+    int cellShadingMaterial = materials.Add(WithTextures(cellShading, gCellCrystalTexture->GetDiffuseSpecularMapSRV(), gCellMap->GetDiffuseSpecularMapSRV()));
+
+    // Light models - additive blending, read-only depth buffer and no culling. Not instanced as the pixel shader
+    // reads the colour from the per-model constants
+    RenderMaterial light = lit;
+    light.vertexShader          = gBasicTransformVertexShader;
+    light.instancedVertexShader = nullptr;
+    light.pixelShader           = gLightModelPixelShader;
+    light.blendMode             = BlendMode::Additive;
+    light.blendState            = gAdditiveBlendingState;
+    light.depthStencilState     = gDepthReadOnlyState;
+    light.rasterizerState       = gCullNoneState;
+    gLightMaterial = materials.Add(WithTextures(light, gFlareTexture->GetDiffuseSpecularMapSRV()));
+
+    // Shadow maps only need depth, so use special depth-only rendering shaders and no textures
+    RenderMaterial depthOnly;
+    depthOnly.vertexShader          = gBasicTransformVertexShader;
+    depthOnly.instancedVertexShader = gBasicTransformInstancedVertexShader;
+    depthOnly.pixelShader           = gDepthOnlyPixelShader;
+    depthOnly.blendState            = gNoBlendingState;
+    depthOnly.depthStencilState     = gUseDepthBufferState;
+    depthOnly.rasterizerState       = gCullBackState;
+    gDepthOnlyMaterial = materials.Add(depthOnly);
+
+    // Model / entity mesh, material, outline material, use entity textures, casts shadow
+    gRenderables =
+    {
+        { gGround,      nullptr,     groundMaterial,      NO_MATERIAL,         false, true  },
+        { nullptr,      gBatMesh,    entityMaterial,      NO_MATERIAL,         true,  true  },
+        { gFox,         nullptr,     foxMaterial,         NO_MATERIAL,         false, true  },
+        { gTrunk,       nullptr,     trunkMaterial,       NO_MATERIAL,         false, true  },
+        { gLeaves,      nullptr,     leavesMaterial,      NO_MATERIAL,         false, true  },
+        { gCrate,       nullptr,     crateMaterial,       NO_MATERIAL,         false, true  },
+        { nullptr,      gTankMesh,   entityMaterial,      NO_MATERIAL,         true,  false },
+        { gCat,         nullptr,     catMaterial,         NO_MATERIAL,         false, true  },
+        { gGriffin,     nullptr,     griffinMaterial,     NO_MATERIAL,         false, true  },
+        { gTower,       nullptr,     towerMaterial,       NO_MATERIAL,         false, true  },
+        { gWizard,      nullptr,     wizardMaterial,      NO_MATERIAL,         false, true  },
+        { gBox,         nullptr,     towerMaterial,       NO_MATERIAL,         false, true  },
+        { gWell,        nullptr,     wizardMaterial,      NO_MATERIAL,         false, true  },
+        { gCrystal,     nullptr,     crystalMaterial,     NO_MATERIAL,         false, true  },
+        { gMapping,     nullptr,     cubeMappingMaterial, NO_MATERIAL,         false, true  },
+        { gPortal,      nullptr,     portalMaterial,      NO_MATERIAL,         false, true  },
+        { gHat,         nullptr,     hatMaterial,         NO_MATERIAL,         false, true  },
+        { gDragon,      nullptr,     dragonMaterial,      NO_MATERIAL,         false, true  },
+        { gTeapot,      nullptr,     teapotMaterial,      NO_MATERIAL,         false, true  },
+        { gPillar,      nullptr,     pillarMaterial,      NO_MATERIAL,         false, true  },
+        { gSphere,      nullptr,     sphereMaterial,      NO_MATERIAL,         false, true  },
+        { gCube,        nullptr,     cubeMaterial,        NO_MATERIAL,         false, true  },
+        { gSprite,      nullptr,     spriteMaterial,      NO_MATERIAL,         false, true  },
+        { nullptr,      gSpriteMesh, spriteMaterial,      NO_MATERIAL,         true,  true  },
+        { gPotion,      nullptr,     potionMaterial,      NO_MATERIAL,         false, true  },
+        { gGlassCube,   nullptr,     glassMaterial,       NO_MATERIAL,         false, true  },
+        { gCellCrystal, nullptr,     cellShadingMaterial, cellOutlineMaterial, false, true  },
+        { nullptr,      gTreeMesh,   cellShadingMaterial, cellOutlineMaterial, true,  true  },
+        { gTank,        nullptr,     NO_MATERIAL,         NO_MATERIAL,         false, true  },
+    };
+}
+
+
 bool InitScene()
 {
     //// Set up scene ////
@@ -561,53 +1020,14 @@ bool InitScene()
     gPillar    = new Model(gCubeMesh);
     gMapping   = new Model(gTeapotMesh);
 
-    int tankCount = 0;
-    float tankAdjust = 10.0f;
-
-    //Tanks
-    for (int i = 0; i < NUM_TANKS; i++)
-    {
-        if (tankCount > 4)
-        {
-            tankCount = 0;
-            tankAdjust += 10.0f;
-        }
-        tankCount++;
-        gTanks[i] = new Model(gTankMesh);
-        gTanks[i]->SetPosition({ 66 + tankCount * 4.0f, 1 , -50 - tankAdjust });
-        gTanks[i]->SetScale(0.01);
-    }
-
-    int spriteCount = 0;
-    float spriteAdjust = 10.0f;
-
-    //Sprites
-    for (int i = 0; i < NUM_SPRITES; i++)
-    {
-        if (spriteCount > 9)
-        {
-            spriteCount = 0;
-            spriteAdjust += 10.0f;
-        }
-        spriteCount++;
-        gSprites[i] = new Model(gSpriteMesh);
-        gSprites[i]->SetPosition({ 56 + spriteCount * 4.0f, 2 , -100 - spriteAdjust});
-        gSprites[i]->SetScale(0.1);
-    }
-
-    //Bats
-    for (int i = 0; i < NUM_BATS; i++)
+    // Crowds of tanks, sprites, bats and trees are placed by the scene file
+    gEntities.Reserve(gSceneDescription->NumEntities());
+    const SceneEntityRecord* entities = gSceneDescription->EntityRecords();
+    for (int i = 0; i < gSceneDescription->NumEntities(); ++i)
     {
-        gBats[i] = new Model(gBatMesh);
-        gBats[i]->SetPosition({ -130 + 20 * sin(i * 10.0f), 24 ,150 + 20 * cos(i * 10.0f) });
-        gBats[i]->SetScale(0.1);
-    }
-    //Trees
-    for (int i = 0; i < NUM_TREES; i++)
-    {
-        gTrees[i] = new Model(gTreeMesh);
-        gTrees[i]->SetPosition({ -170 , 3, 100 + i * 10.0f });
-        gTrees[i]->SetScale(0.06);
+        const SceneEntityRecord& entity = entities[i];
+        Texture* texture = entity.texture != SceneEntityRecord::NoTexture ? gSceneTextures[entity.texture] : nullptr;
+        gEntities.Create(gSceneMeshes[entity.mesh], texture, entity.position, entity.orientation, entity.scale);
     }
 
     // Light set-up
@@ -702,27 +1122,45 @@ bool InitScene()
     gMapping->SetPosition({ 0,20,0 });
     gMapping->SetScale(2);
 
-    gLights[0]->SetColour(CVector3{ 0.5f, 0.2f, 0.87f });
-    gLights[0]->SetStrength(40);
-    gLights[0]->GetModel()->SetPosition({ 30, 28, 0 });
-    gLights[0]->GetModel()->SetScale(pow(gLights[0]->GetStrength(), 0.7f)); // Convert light strength into a nice value for the scale of the light
+    // Attach props to the models they were placed on above, they keep their current positions but will now follow
+    gModelHierarchy.Add(gHat,    gFox);
+    gModelHierarchy.Add(gPotion, gCat);
+    gModelHierarchy.Add(gLeaves, gTrunk);
+    gModelHierarchy.Add(gPillar, gDragon);
+
+    // Light colours, strengths and positions are also from the scene file
+    for (int i = 0; i < NUM_LIGHTS && i < gSceneDescription->NumLights(); ++i)
+    {
+        const SceneLightRecord& light = gSceneDescription->LightRecord(i);
+        gLights[i]->SetColour(light.colour);
+        gLights[i]->SetStrength(light.strength);
+        gLights[i]->GetModel()->SetPosition(light.position);
+        gLights[i]->GetModel()->SetScale(pow(gLights[i]->GetStrength(), 0.7f)); // Convert light strength into a nice value for the scale of the light
+    }
 	gLights[0]->GetModel()->FaceTarget(gFox->Position());
-                
-    gLights[1]->SetColour(CVector3{ 1.0f, 0.8f, 0.2f });
-    gLights[1]->SetStrength(60);
-    gLights[1]->GetModel()->SetPosition({ 20, 120, 160 });
-    gLights[1]->GetModel()->SetScale(pow(gLights[1]->GetStrength(), 0.7f));
 	gLights[1]->GetModel()->FaceTarget({ gWizard->Position() });
-                
-    gLights[2]->SetColour(CVector3{ 1.0f, 0.8f, 0.2f });
-    gLights[2]->SetStrength(30);
-    gLights[2]->GetModel()->SetPosition({ 50, 90, -120 });
-    gLights[2]->GetModel()->SetScale(pow(gLights[2]->GetStrength(), 0.7f));
 
-    gLights[3]->SetColour(CVector3{ 1.0f, 0.8f, 0.2f });
-    gLights[3]->SetStrength(30);
-    gLights[3]->GetModel()->SetPosition({ 50, 120, 60 });
-    gLights[3]->GetModel()->SetScale(pow(gLights[3]->GetStrength(), 0.7f));
+    // Everything needed from the scene file has been created
+    delete gSceneDescription;  gSceneDescription = nullptr;
+
+    CreateRenderMaterials();
+
+    // Models large and solid enough to hide others
+    gOccluders = { gGround, gTower, gCrate };
+
+    // Models that the simulation may move are rendered between simulation steps, start with both steps the same
+    gSimulatedModels = { gFox, gCrate, gGround, gSphere, gTeapot, gCube, gGlassCube, gSprite, gTank, gHat, gPotion,
+                         gCat, gTrunk, gLeaves, gGriffin, gTower, gWizard, gBox, gWell, gPortal, gCrystal,
+                         gCellCrystal, gDragon, gPillar, gMapping };
+    for (int i = 0; i < NUM_LIGHTS; ++i)
+    {
+        gSimulatedModels.push_back(gLights[i]->GetModel());
+    }
+    Model::UpdateWorldMatrices(gSimulatedModels.data(), static_cast<int>(gSimulatedModels.size()));
+    gModelHierarchy.Update();
+    gEntities.UpdateWorldMatrices();
+    StoreSimulationState(gCurrentState);
+    gPreviousState = gCurrentState;
 
     //// Set up camera ////
     gCamera = new Camera();
@@ -734,6 +1172,9 @@ bool InitScene()
     gPortalCamera->SetPosition({ -115, 12, 185 });
     gPortalCamera->SetRotation({ ToRadians(-10), ToRadians(200), 0 });
 
+    // Start the simulation thread last, from here on it owns the models and lights
+    gSimulationPipeline = new FramePipeline<SimulationInput, SimulationState>(SimulateFrame, SIMULATION_FRAMES_IN_FLIGHT, { 0, {}, false });
+
     return true;
 }
 
@@ -741,6 +1182,10 @@ bool InitScene()
 // Release the geometry and scene resources created above
 void ReleaseResources()
 {
+    // Stop the simulation thread before anything it uses is released
+    delete gSimulationPipeline;  gSimulationPipeline = nullptr;
+    gRenderState = nullptr;
+
     ReleaseStates();
 
     if (gShadowMap1DepthStencil)  gShadowMap1DepthStencil->Release();
@@ -763,12 +1208,25 @@ void ReleaseResources()
             gTextures[i]->GetDiffuseSpecularMapSRV()->Release();
         }
     }
+    for (Texture* texture : gSceneTextures)
+    {
+        if (texture->GetDiffuseSpecularMap() && texture->GetDiffuseSpecularMapSRV())
+        {
+            texture->GetDiffuseSpecularMap()->Release();
+            texture->GetDiffuseSpecularMapSRV()->Release();
+        }
+    }
 
-    if (gPerModelConstantBuffer)  gPerModelConstantBuffer->Release();
-    if (gPerFrameConstantBuffer)  gPerFrameConstantBuffer->Release();
+    delete gPerModelConstantsUpload;  gPerModelConstantsUpload = nullptr;
+    gRenderDevice->ReleaseBuffer(gPerInstanceConstantBuffer);
+    gRenderDevice->ReleaseBuffer(gPerModelConstantBuffer);
+    gRenderDevice->ReleaseBuffer(gPerFrameConstantBuffer);
 
     ReleaseShaders();
 
+    gModelHierarchy.Clear();
+    gSimulatedModels.clear();
+
     // See note in InitGeometry about why we're not using unique_ptr and having to manually delete
     delete gCamera;        gCamera = nullptr;
     delete gPortalCamera;  gPortalCamera = nullptr;
@@ -785,29 +1243,12 @@ void ReleaseResources()
         delete gModels[i]; gModels[i] = nullptr;
     }
 
-    //Delete Tanks
-    for (int i = 0; i < NUM_TANKS; i++)
-    {
-        delete gTanks[i]; gTanks[i] = nullptr;
-    }
+    //Remove tanks, sprites, trees and bats
+    gEntities.Clear();
 
-    //Delete Sprites
-    for (int i = 0; i < NUM_SPRITES; i++)
-    {
-        delete gSprites[i]; gSprites[i] = nullptr;
-    }
-
-    //Delete Trees
-    for (int i = 0; i < NUM_TREES; i++)
-    {
-        delete gTrees[i]; gTrees[i] = nullptr;
-    }
-
-    //Delete Bats
-    for (int i = 0; i < NUM_BATS; i++)
-    {
-        delete gBats[i]; gTrees[i] = nullptr;
-    }
+    gRenderables.clear();
+    delete gRenderQueue;      gRenderQueue = nullptr;
+    delete gRenderMaterials;  gRenderMaterials = nullptr;
 
     //Delete Meshes
     for (int i = 0; i < NUM_MODELS; i++)
@@ -815,378 +1256,242 @@ void ReleaseResources()
         delete gMeshes[i]; gMeshes[i] = nullptr;
     }
 
+    //Delete meshes and textures loaded for the scene file
+    for (Mesh*    mesh    : gSceneMeshes)    delete mesh;
+    for (Texture* texture : gSceneTextures)  delete texture;
+    gSceneMeshes.clear();
+    gSceneTextures.clear();
+    delete gSceneDescription;  gSceneDescription = nullptr;
+
+    gOccluders.clear();
+    delete gOcclusionBuffer;  gOcclusionBuffer = nullptr;
+    delete gJobSystem;  gJobSystem = nullptr;
 }
 
 //--------------------------------------------------------------------------------------
 // Scene Rendering
 //--------------------------------------------------------------------------------------
 
-// Render the scene from the given light's point of view. Only renders depth buffer
-void RenderDepthBufferFromLight(int lightIndex)
+// Find the world bounds of the models for culling and bring the scene hierarchy and grid up to date, once a frame as
+// nothing moves between passes. Models whose bounds have changed and entities that UpdateWorldMatrices reports as
+// moved are moved in the grid, or handed to it the first time they move. The hierarchy is only rebuilt if the number
+// of entities changes, which also empties the grid
+void UpdateSceneBounds()
 {
-    // Get camera-like matrices from the spotlight, seet in the constant buffer and send over to GPU
-    gPerFrameConstants.viewMatrix           = CalculateLightViewMatrix(lightIndex);
-    gPerFrameConstants.projectionMatrix     = CalculateLightProjectionMatrix(lightIndex);
-    gPerFrameConstants.viewProjectionMatrix = gPerFrameConstants.viewMatrix * gPerFrameConstants.projectionMatrix;
-    UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
+    const int numModels   = static_cast<int>(gRenderables.size()) + NUM_LIGHTS;
+    const int numEntities = gEntities.NumEntities();
+    const bool rebuild    = gSceneBVH.NumObjects() != numModels + numEntities;
 
-    // Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-    gD3DContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader 
-    gD3DContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
-
-
-    //// Only render models that cast shadows ////
+    auto moveObject = [](int object, const BoundingBox& bounds)
+    {
+        if (!gMovingObjects.Contains(object))  gSceneBVH.Remove(object);
+        gMovingObjects.Insert(object, bounds);
+    };
 
-    // Use special depth-only rendering shaders
-    gD3DContext->VSSetShader(gBasicTransformVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gDepthOnlyPixelShader,       nullptr, 0);
-    
-    // States - no blending, normal depth buffer and culling
-    gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-    gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
-    gD3DContext->RSSetState(gCullBackState);
-
-    // Render models - no state changes required between each object in this situation (no textures used in this step)
-    gGround->Render();
-    gFox->Render();
-    gCrate->Render();
-    gSphere->Render();
-    gTeapot->Render();
-    gCube->Render();
-    for (int i = 0; i < NUM_TREES; i++)
+    gModelBounds.resize(numModels);
+    auto updateModel = [&](int m, const Model* model)
+    {
+        BoundingSphere bounds = model->WorldBounds();
+        if (!rebuild && bounds.centre.x == gModelBounds[m].centre.x && bounds.centre.y == gModelBounds[m].centre.y &&
+                        bounds.centre.z == gModelBounds[m].centre.z && bounds.radius   == gModelBounds[m].radius)  return;
+        gModelBounds[m] = bounds;
+        if (!rebuild)  moveObject(m, BoxFromSphere(bounds));
+    };
+    for (size_t r = 0; r < gRenderables.size(); ++r)
+    {
+        if (gRenderables[r].model)  updateModel(static_cast<int>(r), gRenderables[r].model);
+    }
+    for (int i = 0; i < NUM_LIGHTS; ++i)
     {
-        gTrees[i]->Render();
+        updateModel(static_cast<int>(gRenderables.size()) + i, gLights[i]->GetModel());
     }
-    for (int i = 0; i < NUM_BATS; i++)
+
+    const BoundingSphere* entityBounds = gEntities.WorldBounds();
+    if (rebuild)
     {
-        gBats[i]->Render();
+        std::vector<BoundingBox> bounds(numModels + numEntities);
+        for (int m = 0; m < numModels; ++m)    bounds[m] = BoxFromSphere(gModelBounds[m]);
+        for (size_t r = 0; r < gRenderables.size(); ++r)
+        {
+            // Entity renderables have no bounds of their own (their entities are in the tree), inside out bounds
+            // leave them out of it
+            if (!gRenderables[r].model)  bounds[r] = { { 0, 0, 0 }, { -1, -1, -1 } };
+        }
+        for (int e = 0; e < numEntities; ++e)  bounds[numModels + e] = BoxFromSphere(entityBounds[e]);
+        gSceneBVH.Build(bounds.data(), numModels + numEntities);
+        gMovingObjects.Clear();
     }
-    for (int i = 0; i < NUM_SPRITES; i++)
+    else
     {
-        gSprites[i]->Render();
+        for (int e : gEntities.MovedEntities())  moveObject(numModels + e, BoxFromSphere(entityBounds[e]));
+        gSceneBVH.Update(); // Only does anything if objects have been handed to the grid
     }
-    gGlassCube->Render();
-    gSprite->Render();
-    gTank->Render();
-    gHat->Render();
-    gPotion->Render();
-    gCat->Render();
-    gTrunk->Render();
-    gLeaves->Render();
-    gGriffin->Render();
-    gTower->Render();
-    gWizard->Render();
-    gBox->Render();
-    gWell->Render();
-    gPortal->Render();
-    gCrystal->Render();
-    gCellCrystal->Render();
-    gDragon->Render();
-    gPillar->Render();
-    gMapping->Render();
+    gEntities.ClearMovedEntities();
 }
 
-
-
-// Render everything in the scene from the given camera
-// This code is common between rendering the main scene and rendering the scene in the portal
-// See RenderScene function below
-void RenderSceneFromCamera(Camera* camera)
+// Draw the occluders inside the camera's frustum into the occlusion buffer
+void RenderOccluders(const CameraSnapshot& camera)
 {
-    // Set camera matrices in the constant buffer and send over to GPU
-    gPerFrameConstants.viewMatrix           = camera->ViewMatrix();
-    gPerFrameConstants.projectionMatrix     = camera->ProjectionMatrix();
-    gPerFrameConstants.viewProjectionMatrix = camera->ViewProjectionMatrix();
-    UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
-
-    // Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
-    gD3DContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader 
-    gD3DContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
-
-    //// Render lit models ////
-
-    // Select which shaders to use next
-    gD3DContext->VSSetShader(gPixelLightingVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gPixelLightingPixelShader,  nullptr, 0);
-    
-    // States - no blending, normal depth buffer and culling
-    gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-    gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
-    gD3DContext->RSSetState(gCullBackState);
-
-    // Select the approriate textures and sampler to use in the pixel shader
-    ID3D11ShaderResourceView* grassDiffuseSpecularMapSRV = gGrassTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &grassDiffuseSpecularMapSRV); // First parameter must match texture slot number in the shader
-    gD3DContext->PSSetSamplers(0, 1, &gAnisotropic4xSampler);
-
-    // Render model - it will update the model's world matrix and send it to the GPU in a constant buffer, then it will call
-    // the Mesh render function, which will set up vertex & index buffer before finally calling Draw on the GPU
-    gGround->Render();
-
-    // Render other lit models
-    
-    //Render bats;
-    ID3D11ShaderResourceView* batDiffuseSpecularMapSRV = gBatTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &batDiffuseSpecularMapSRV);
-
-    for (int i = 0; i < NUM_BATS; i++)
+    gOcclusionBuffer->Begin(camera.viewProjectionMatrix);
+    for (const Model* occluder : gOccluders)
     {
-        gBats[i]->Render();
+        if (!IsVisible(camera.frustum, occluder->WorldBounds()))  continue;
+        const Mesh* mesh = occluder->GetMesh();
+        gOcclusionBuffer->AddOccluder(mesh->Positions().data(), static_cast<int>(mesh->Positions().size()),
+                                      mesh->Indices().data(), static_cast<int>(mesh->Indices().size()), occluder->RenderMatrix());
     }
+    gOcclusionBuffer->Render();
+}
 
-    //Render Fox
-    ID3D11ShaderResourceView* foxDiffuseSpecularMapSRV = gFoxTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &foxDiffuseSpecularMapSRV);
-    gFox->Render();
-
-    //Render Trunk
-    ID3D11ShaderResourceView* trunkDiffuseSpecularMapSRV = gTrunkTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &trunkDiffuseSpecularMapSRV);
-    gTrunk->Render();
-    
-    //Render Leaves
-    ID3D11ShaderResourceView* leavesDiffuseSpecularMapSRV = gLeavesTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &leavesDiffuseSpecularMapSRV);
-    gLeaves->Render();
-
-    //Render Crate
-    ID3D11ShaderResourceView* crateDiffuseSpecularMapSRV = gCargoTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &crateDiffuseSpecularMapSRV);
-    gCrate->Render();
-
-    //Render Tanks
-    ID3D11ShaderResourceView* tankDiffuseSpecularMapSRV = gTankTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &tankDiffuseSpecularMapSRV);
-
-    //Render Tanks
-    for (int i = 0; i < NUM_TANKS; i++)
+// Submit everything in the scene inside the given frustum to a render queue. For shadow passes only models that cast
+// shadows are submitted, all with the depth-only material, otherwise each model uses its own material and the lights
+// are included. Everything is given the same object index in every pass so its constants are only uploaded once a
+// frame: renderables first, then the light models, then the entities. If an occlusion buffer is given (rendered from
+// the same view) objects it finds hidden are left out too
+void SubmitScene(RenderQueue& queue, bool shadowPass, const CFrustum& frustum, OcclusionBuffer* occlusion = nullptr)
+{
+    const int numModels = static_cast<int>(gModelBounds.size());
+    gModelVisibleBits.assign((numModels + 31) / 32, 0);
+    gEntityVisibleBits.assign((gEntities.NumEntities() + 31) / 32, 0);
+    gVisibleObjects.clear();
+    gSceneBVH.QueryFrustum(frustum, gVisibleObjects);
+    gMovingObjects.QueryFrustum(frustum, gVisibleObjects);
+    if (occlusion)
     {
-        gTanks[i]->Render();
+        const BoundingSphere* entityBounds = gEntities.WorldBounds();
+        const int numFound = static_cast<int>(gVisibleObjects.size());
+        gOccludeeBounds.resize(numFound);
+        gOccludeeVisible.resize(numFound);
+        for (int i = 0; i < numFound; ++i)
+        {
+            int object = gVisibleObjects[i];
+            gOccludeeBounds[i] = BoxFromSphere(object < numModels ? gModelBounds[object] : entityBounds[object - numModels]);
+        }
+        occlusion->TestBoxes(gOccludeeBounds.data(), numFound, gOccludeeVisible.data());
+        int numVisible = 0;
+        for (int i = 0; i < numFound; ++i)
+        {
+            if (gOccludeeVisible[i])  gVisibleObjects[numVisible++] = gVisibleObjects[i];
+        }
+        gVisibleObjects.resize(numVisible);
     }
+    for (int object : gVisibleObjects)
+    {
+        if (object < numModels)  gModelVisibleBits[object / 32] |= 1u << (object % 32);
+        else                     gEntityVisibleBits[(object - numModels) / 32] |= 1u << ((object - numModels) % 32);
+    }
+    auto isVisible = [](int i) { return (gModelVisibleBits[i / 32] & (1u << (i % 32))) != 0; };
 
-    //Render Cat
-    ID3D11ShaderResourceView* catDiffuseSpecularMapSRV = gCatTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &catDiffuseSpecularMapSRV);
-    gCat->Render();
-
-    //Render Griffin
-    ID3D11ShaderResourceView* griffinDiffuseSpecularMapSRV = gGriffinTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &griffinDiffuseSpecularMapSRV);
-    gGriffin->Render();
-
-    //Render Tower
-    ID3D11ShaderResourceView* towerDiffuseSpecularMapSRV = gTowerTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &towerDiffuseSpecularMapSRV);
-    gTower->Render();
-
-    //Render Wizard
-    ID3D11ShaderResourceView* wizardDiffuseSpecularMapSRV = gWizardTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &wizardDiffuseSpecularMapSRV);
-    gWizard->Render();
-
-    //Render Box
-    ID3D11ShaderResourceView* boxDiffuseSpecularMapSRV = gTowerTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &boxDiffuseSpecularMapSRV);
-    gBox->Render();
-
-    //Render Well
-    ID3D11ShaderResourceView* wellDiffuseSpecularMapSRV = gWizardTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &wellDiffuseSpecularMapSRV);
-    gWell->Render();
-
-    //Render Crystal
-    ID3D11ShaderResourceView* crystalDiffuseSpecularMapSRV = gCrystalTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &crystalDiffuseSpecularMapSRV);
-    gCrystal->Render();
-
-    //Render cube mapping
-    gD3DContext->PSSetShader(gCubeMappingPixelShader, nullptr, 0);
-    gD3DContext->PSSetShaderResources(0, 1, &cubeMapSRV);
-    gMapping->Render();
-
-    //Set Portal Shader
-    gD3DContext->PSSetShader(gTVPixelShader, nullptr, 0);
-
-    //Render Portal
-    gD3DContext->PSSetShaderResources(0, 1, &gPortalTextureSRV);
-    ID3D11ShaderResourceView* tvDiffuseSpecularMapSRV = gTVTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(3, 1, &tvDiffuseSpecularMapSRV);
-    gPortal->Render();
-
-    //Set Normal Mapping Shaders
-    gD3DContext->VSSetShader(gNormalMappingVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gNormalMappingPixelShader, nullptr, 0);
-
-    //Render Hat
-    ID3D11ShaderResourceView* hatDiffuseSpecularMapSRV = gHatTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &hatDiffuseSpecularMapSRV);
-
-    ID3D11ShaderResourceView* hatNormalMapSRV = gHatTexture->GetNormalMapSRV();
-    gD3DContext->PSSetShaderResources(3, 1, &hatNormalMapSRV);
-
-    gHat->Render();
-
-    //Render Dragon
-    ID3D11ShaderResourceView* dragonDiffuseSpecularMapSRV = gDragonTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &dragonDiffuseSpecularMapSRV);
-
-    ID3D11ShaderResourceView* dragonNormalMapSRV = gDragonTexture->GetNormalMapSRV();
-    gD3DContext->PSSetShaderResources(3, 1, &dragonNormalMapSRV);
-
-    gDragon->Render();
-
-    //Set Parallax Mapping Shaders
-    gD3DContext->VSSetShader(gNormalMappingVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gParallaxMappingPixelShader, nullptr, 0);
-    
-    //Render Teapot
-    ID3D11ShaderResourceView* teapotDiffuseSpecularMapSRV = gPatternTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &teapotDiffuseSpecularMapSRV);
-
-    ID3D11ShaderResourceView* teapotNormalMapSRV = gPatternTexture->GetNormalMapSRV();
-    gD3DContext->PSSetShaderResources(3, 1, &teapotNormalMapSRV);
-
-    gTeapot->Render();
-
-    //Render Pillar
-    ID3D11ShaderResourceView* pillarDiffuseSpecularMapSRV = gTechTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &pillarDiffuseSpecularMapSRV);
-    ID3D11ShaderResourceView* pillarNormalMapSRV = gTechTexture->GetNormalMapSRV();
-    gD3DContext->PSSetShaderResources(3, 1, &pillarNormalMapSRV);
-
-    gPillar->Render();
+    const int firstLightObject  = static_cast<int>(gRenderables.size());
+    const int firstEntityObject = firstLightObject + NUM_LIGHTS;
+    for (size_t r = 0; r < gRenderables.size(); ++r)
+    {
+        const SceneRenderable& renderable = gRenderables[r];
+        auto submit = [&](int material, bool useEntityTextures)
+        {
+            if (renderable.model)
+            {
+                if (isVisible(static_cast<int>(r)))  renderable.model->Submit(queue, material, { 1, 1, 1 }, static_cast<int>(r));
+            }
+            else
+            {
+                gEntities.Submit(queue, material, renderable.entityMesh, useEntityTextures, gEntityVisibleBits.data(), firstEntityObject);
+            }
+        };
 
-    //Set Sphere Shaders
-    gD3DContext->VSSetShader(gSphereVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gSpherePixelShader, nullptr, 0);
+        if (shadowPass)
+        {
+            if (renderable.castsShadow)  submit(gDepthOnlyMaterial, false);
+            continue;
+        }
+        if (renderable.material        != NO_MATERIAL)  submit(renderable.material, renderable.useEntityTextures);
+        if (renderable.outlineMaterial != NO_MATERIAL)  submit(renderable.outlineMaterial, false);
+    }
 
-    //Render Sphere
-    ID3D11ShaderResourceView* sphereDiffuseSpecularMapSRV = gBrainTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &sphereDiffuseSpecularMapSRV);
-    ID3D11ShaderResourceView* sphereNormalHeightMapSRV = gBrainTexture->GetNormalMapSRV();
-    gD3DContext->PSSetShaderResources(3, 1, &sphereNormalHeightMapSRV);
-    gSphere->Render();
-    
-    //Set Cube Shaders
-    gD3DContext->VSSetShader(gNormalMappingVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gCubePixelShader, nullptr, 0);
-
-    //Render Cube
-    ID3D11ShaderResourceView* cubeDiffuseSpecularMapSRV = gWallTexture->GetDiffuseSpecularMapSRV();
-    ID3D11ShaderResourceView* cube2DiffuseSpecularMapSRV = gCobbleTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &cubeDiffuseSpecularMapSRV);
-    gD3DContext->PSSetShaderResources(3, 1, &cube2DiffuseSpecularMapSRV);
-
-    ID3D11ShaderResourceView* cubeNormalMapSRV =  gWallTexture->GetNormalMapSRV();
-    ID3D11ShaderResourceView* cube2NormalMapSRV = gCobbleTexture->GetNormalMapSRV();
-    gD3DContext->PSSetShaderResources(4, 1, &cubeNormalMapSRV);
-    gD3DContext->PSSetShaderResources(5, 1, &cube2NormalMapSRV);
-
-    gCube->Render();
-
-    //Set Alpha Testing shader
-    gD3DContext->VSSetShader(gPixelLightingVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gSpritePixelShader, nullptr, 0);
-    gD3DContext->OMSetBlendState(gAlphaBlending, nullptr, 0xffffff);
-   
-    //Render Sprite
-    ID3D11ShaderResourceView* spriteDiffuseSpecularMapSRV = gSpriteTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &spriteDiffuseSpecularMapSRV);
-    gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
-    gSprite->Render();
-
-    //Render army of sprites
-    for (int i = 0; i < NUM_SPRITES; i++)
+    if (shadowPass)  return;
+    for (int i = 0; i < NUM_LIGHTS; ++i)
     {
-        gSprites[i]->Render();
+        if (!isVisible(firstLightObject + i))  continue;
+        gLights[i]->GetModel()->Submit(queue, gLightMaterial, gRenderState->lightColours[i], firstLightObject + i); // Light models are tinted to match the light colour they cast
     }
-    
-    //Multiplicative Blending
-    // Select which shaders to use next
-    gD3DContext->VSSetShader(gPixelLightingVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gPixelLightingPixelShader, nullptr, 0);
-
-    //Set blend state
-    gD3DContext->OMSetBlendState(gMultiplicativeBlending, nullptr, 0xffffff);
-
-    //Render Potion
-    ID3D11ShaderResourceView* potionDiffuseSpecularMapSRV = gPotionTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &potionDiffuseSpecularMapSRV);
-    gPotion->Render();
-
-    //Render glass cube
-    ID3D11ShaderResourceView* glassCubeDiffuseSpecularMapSRV = gGlassTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &glassCubeDiffuseSpecularMapSRV);
-    gGlassCube->Render();
-
-    //Set Cell Shading Outline Shader
-    gD3DContext->VSSetShader(gCellShadingOutlineVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gCellShadingOutlinePixelShader, nullptr, 0);
-
-    // States - no blending, normal depth buffer. However, use front culling to draw *inside* of model
-    gD3DContext->OMSetBlendState(gNoBlendingState, nullptr, 0xffffff);
-    gD3DContext->OMSetDepthStencilState(gUseDepthBufferState, 0);
-    gD3DContext->RSSetState(gCullFrontState);
-
-    //Render cell shaded crystal: 1st pass (Inside out, slightly bigger and black)
-    gCellCrystal->Render();
-
-    //Render cell shaded trees: 1st pass
-    for (int i = 0; i < NUM_TREES; i++)
+}
+
+// Render everything submitted to the render queue. Each item's constants are selected from the upload buffer before
+// it is drawn, except for runs of items drawn together using the instance buffer. If the upload buffer is full the
+// constants are sent to the per-model constant buffer instead
+void ExecuteRenderQueue()
+{
+    // Indicate that the per-model constant buffer is for use in the vertex shader (VS) and pixel shader (PS)
+    gRenderContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // First parameter must match constant buffer number in the shader
+    gRenderContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+    gRenderContext->VSSetConstantBuffers(2, 1, &gPerInstanceConstantBuffer); // Only read by instanced vertex shaders
+
+    gRenderQueue->Execute([](const RenderItem& item)
     {
-        gTrees[i]->Render();
-    }
+        gPerModelConstants.worldMatrix  = item.worldMatrix;
+        gPerModelConstants.objectColour = item.colour;
+        UpdateConstantBuffer(gPerModelConstantBuffer, gPerModelConstants); // Send to GPU
+        gRenderContext->VSSetConstantBuffers(1, 1, &gPerModelConstantBuffer); // An upload buffer element may be bound
+        gRenderContext->PSSetConstantBuffers(1, 1, &gPerModelConstantBuffer);
+    });
+}
 
-    // Main cell shading shaders
-    gD3DContext->VSSetShader(gCellShadingVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gCellShadingPixelShader, nullptr, 0);
 
-    // Switch back to the usual back face culling (not inside out)
-    gD3DContext->RSSetState(gCullBackState);
+// Render the scene from the given light's point of view. Only renders depth buffer
+void RenderDepthBufferFromLight(int lightIndex)
+{
+    // Get camera-like matrices from the spotlight, seet in the constant buffer and send over to GPU
+    gPerFrameConstants.viewMatrix           = CalculateLightViewMatrix(lightIndex);
+    gPerFrameConstants.projectionMatrix     = CalculateLightProjectionMatrix(lightIndex);
+    gPerFrameConstants.viewProjectionMatrix = gPerFrameConstants.viewMatrix * gPerFrameConstants.projectionMatrix;
+    UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
 
-    //Render cell shaded crystal: 2nd pass(normal sized with cell shading)
-    ID3D11ShaderResourceView* cellCrystalDiffuseSpecularMapSRV = gCellCrystalTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &cellCrystalDiffuseSpecularMapSRV); // First parameter must match texture slot number in the shaer
-    gD3DContext->PSSetSamplers(0, 1, &gAnisotropic4xSampler);
+    // Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
+    gRenderContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader 
+    gRenderContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
 
-    //cell shading uses a special 1D "cell map", which uses point sampling
-    ID3D11ShaderResourceView* cellMapDiffuseSpecularMapSRV = gCellMap->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(3, 1, &cellMapDiffuseSpecularMapSRV); // First parameter must match texture slot number in the shaer
-    gD3DContext->PSSetSamplers(2, 1, &gPointSampler);
 
-    gCellCrystal->Render();
+    //// Only render models that cast shadows ////
+
+    gRenderQueue->Begin(gPerFrameConstants.viewMatrix);
+    SubmitScene(*gRenderQueue, true, CalculateLightFrustum(lightIndex)); // Models outside the light's cone can't cast shadows into its map
+    gNumVisible[static_cast<int>(ScenePass::Light1Shadow) + lightIndex] += gRenderQueue->NumItems();
+    ExecuteRenderQueue();
+}
 
-    //Render trees
-    ID3D11ShaderResourceView* treeDiffuseSpecularMapSRV = gTreeTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &treeDiffuseSpecularMapSRV);
 
-    for (int i = 0; i < NUM_TREES; i++)
-    {
-        gTrees[i]->Render();
-    }
 
-    //// Render lights ////
+// Render everything in the scene from the given camera
+// This code is common between rendering the main scene and rendering the scene in the portal
+// See RenderScene function below
+void RenderSceneFromCamera(const CameraSnapshot& camera, ScenePass pass)
+{
+    // Set camera matrices in the constant buffer and send over to GPU
+    gPerFrameConstants.viewMatrix           = camera.viewMatrix;
+    gPerFrameConstants.projectionMatrix     = camera.projectionMatrix;
+    gPerFrameConstants.viewProjectionMatrix = camera.viewProjectionMatrix;
+    UpdateConstantBuffer(gPerFrameConstantBuffer, gPerFrameConstants);
 
-    // Select which shaders to use next
-    gD3DContext->VSSetShader(gBasicTransformVertexShader, nullptr, 0);
-    gD3DContext->PSSetShader(gLightModelPixelShader,      nullptr, 0);
+    // Indicate that the constant buffer we just updated is for use in the vertex shader (VS) and pixel shader (PS)
+    gRenderContext->VSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer); // First parameter must match constant buffer number in the shader 
+    gRenderContext->PSSetConstantBuffers(0, 1, &gPerFrameConstantBuffer);
 
-    // Select the texture and sampler to use in the pixel shader
-    ID3D11ShaderResourceView* lightDiffuseSpecularMapSRV = gFlareTexture->GetDiffuseSpecularMapSRV();
-    gD3DContext->PSSetShaderResources(0, 1, &lightDiffuseSpecularMapSRV); // First parameter must match texture slot number in the shaer
-    gD3DContext->PSSetSamplers(0, 1, &gAnisotropic4xSampler);
+    //// Render models and lights ////
 
-    // States - additive blending, read-only depth buffer and no culling
-    gD3DContext->OMSetBlendState(gAdditiveBlendingState, nullptr, 0xffffff);
-    gD3DContext->OMSetDepthStencilState(gDepthReadOnlyState, 0);
-    gD3DContext->RSSetState(gCullNoneState);
+    // Find what the occluders hide from this camera before submitting
+    if (gUseOcclusion)  RenderOccluders(camera);
 
-    // Render all the lights in the array
-    for (int i = 0; i < NUM_LIGHTS; ++i)
+    // The queue sorts everything by material and mesh, blended models are rendered last, back to front
+    gRenderQueue->Begin(camera.viewMatrix);
+    SubmitScene(*gRenderQueue, false, camera.frustum, gUseOcclusion ? gOcclusionBuffer : nullptr);
+    gNumVisible[static_cast<int>(pass)] += gRenderQueue->NumItems();
+    if (gUseOcclusion)
     {
-        gPerModelConstants.objectColour = gLights[i]->GetColour(); // Set any per-model constants apart from the world matrix just before calling render (light colour here)
-        gLights[i]->GetModel()->Render();
+        const OcclusionStats& stats = gOcclusionBuffer->Stats();
+        gNumOccluded[static_cast<int>(pass)] += stats.numHidden;
+        gOcclusionMilliseconds += stats.renderMilliseconds + stats.testMilliseconds;
     }
+    ExecuteRenderQueue();
 }
 
 // Rendering the scene now renders everything twice. First it renders the scene for the portal into a texture.
@@ -1195,31 +1500,42 @@ void RenderScene()
 {
     //// Common settings ////
 
+    // Take read-only copies of the cameras for the passes below
+    const CameraSnapshot mainCamera   = gCamera->Snapshot();
+    const CameraSnapshot portalCamera = gPortalCamera->Snapshot();
+
+    // Per-model constants are uploaded by the first pass to draw each object and shared by the later passes
+    // (if the buffer can't grow to fit everything, the rest fall back to the per-model constant buffer)
+    gPerModelConstantsUpload->Begin(static_cast<unsigned int>(gRenderables.size() + NUM_LIGHTS + gEntities.NumEntities()));
+
+    // Each pass culls against its own frustum using the same bounds
+    UpdateSceneBounds();
+
     // Set up the light information in the constant buffer
     // Don't send to the GPU yet, the function RenderSceneFromCamera will do that
-    gPerFrameConstants.light1Colour   =         gLights[0]->GetColour() * gLights[0]->GetStrength();
-    gPerFrameConstants.light1Position =         gLights[0]->GetModel()->Position();
-    gPerFrameConstants.light1Facing   =         Normalise(gLights[0]->GetModel()->WorldMatrix().GetZAxis());    // Additional lighting information for spotlights
-    gPerFrameConstants.light1CosHalfAngle =     cos(ToRadians(gSpotlightConeAngle / 2)); // --"--
+    gPerFrameConstants.light1Colour   =         gRenderState->lightColours[0] * gRenderState->lightStrengths[0];
+    gPerFrameConstants.light1Position =         gLights[0]->GetModel()->RenderMatrix().GetPosition();
+    gPerFrameConstants.light1Facing   =         Normalise(gLights[0]->GetModel()->RenderMatrix().GetZAxis());    // Additional lighting information for spotlights
+    gPerFrameConstants.light1CosHalfAngle =     gSpotlightCosHalfAngle;                  // --"--
     gPerFrameConstants.light1ViewMatrix       = CalculateLightViewMatrix(0);         // Calculate camera-like matrices for...
     gPerFrameConstants.light1ProjectionMatrix = CalculateLightProjectionMatrix(0);   //...lights to support shadow mapping
 
-    gPerFrameConstants.light2Colour =           gLights[1]->GetColour() * gLights[1]->GetStrength();
-    gPerFrameConstants.light2Position =         gLights[1]->GetModel()->Position();
-    gPerFrameConstants.light2Facing =           Normalise(gLights[1]->GetModel()->WorldMatrix().GetZAxis());    // Additional lighting information for spotlights
-    gPerFrameConstants.light2CosHalfAngle =     cos(ToRadians(gSpotlightConeAngle / 2)); // --"--
+    gPerFrameConstants.light2Colour =           gRenderState->lightColours[1] * gRenderState->lightStrengths[1];
+    gPerFrameConstants.light2Position =         gLights[1]->GetModel()->RenderMatrix().GetPosition();
+    gPerFrameConstants.light2Facing =           Normalise(gLights[1]->GetModel()->RenderMatrix().GetZAxis());    // Additional lighting information for spotlights
+    gPerFrameConstants.light2CosHalfAngle =     gSpotlightCosHalfAngle;                  // --"--
     gPerFrameConstants.light2ViewMatrix =       CalculateLightViewMatrix(1);         // Calculate cara-like matrices for...
     gPerFrameConstants.light2ProjectionMatrix = CalculateLightProjectionMatrix(1);   //...lights to pport shadow mapping
 
-    gPerFrameConstants.light3Colour =           gLights[2]->GetColour() * gLights[2]->GetStrength();
-    gPerFrameConstants.light3Position =         gLights[2]->GetModel()->Position();
+    gPerFrameConstants.light3Colour =           gRenderState->lightColours[2] * gRenderState->lightStrengths[2];
+    gPerFrameConstants.light3Position =         gLights[2]->GetModel()->RenderMatrix().GetPosition();
 
-    gPerFrameConstants.light4Colour =           gLights[3]->GetColour() * gLights[3]->GetStrength();
-    gPerFrameConstants.light4Position =         gLights[3]->GetModel()->Position();
+    gPerFrameConstants.light4Colour =           gRenderState->lightColours[3] * gRenderState->lightStrengths[3];
+    gPerFrameConstants.light4Position =         gLights[3]->GetModel()->RenderMatrix().GetPosition();
 
     gPerFrameConstants.ambientColour  =         gAmbientColour;
     gPerFrameConstants.specularPower  =         gSpecularPower;
-    gPerFrameConstants.cameraPosition =         gCamera->Position();
+    gPerFrameConstants.cameraPosition =         mainCamera.position;
     gPerFrameConstants.parallaxDepth =          (gUseParallax ? gParallaxDepth : 0);
     gPerFrameConstants.outlineColour =          OutlineColour;
     gPerFrameConstants.outlineThickness =       OutlineThickness;
@@ -1229,27 +1545,27 @@ void RenderScene()
     // Only rendering from light 1 to begin with
 
     // Setup the viewport to the size of the shadow map texture
-    D3D11_VIEWPORT vp;
-    vp.Width  = static_cast<FLOAT>(gShadowMapSize);
-    vp.Height = static_cast<FLOAT>(gShadowMapSize);
-    vp.MinDepth = 0.0f;
-    vp.MaxDepth = 1.0f;
-    vp.TopLeftX = 0;
-    vp.TopLeftY = 0;
-    gD3DContext->RSSetViewports(1, &vp);
+    RenderViewport vp;
+    vp.width  = static_cast<float>(gShadowMapSize);
+    vp.height = static_cast<float>(gShadowMapSize);
+    vp.minDepth = 0.0f;
+    vp.maxDepth = 1.0f;
+    vp.topLeftX = 0;
+    vp.topLeftY = 0;
+    gRenderContext->RSSetViewport(vp);
 
     // Select the shadow map texture as the current depth buffer. We will not be rendering any pixel colours
     // Also clear the the shadow map depth buffer to the far distance
-    gD3DContext->OMSetRenderTargets(0, nullptr, gShadowMap1DepthStencil);
-    gD3DContext->ClearDepthStencilView(gShadowMap1DepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+    gRenderContext->OMSetRenderTargets(0, nullptr, gShadowMap1DepthStencil);
+    gRenderContext->ClearDepthStencilView(gShadowMap1DepthStencil, 1.0f);
 
     // Render the scene from the point of view of light 1 (only depth values written)
     RenderDepthBufferFromLight(0);
 
     // Select the shadow map texture as the current depth buffer. We will not be rendering any pixel colours
     // Also clear the the shadow map depth buffer to the far distance
-    gD3DContext->OMSetRenderTargets(0, nullptr, gShadowMap2DepthStencil);
-    gD3DContext->ClearDepthStencilView(gShadowMap2DepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+    gRenderContext->OMSetRenderTargets(0, nullptr, gShadowMap2DepthStencil);
+    gRenderContext->ClearDepthStencilView(gShadowMap2DepthStencil, 1.0f);
 
     // Render the scene from the point of view of light 2 (only depth values written)
     RenderDepthBufferFromLight(1);
@@ -1258,57 +1574,57 @@ void RenderScene()
 
     // Set the portal texture and portal depth buffer as the targets for rendering
     // The portal texture will later be used on models in the main scene
-    gD3DContext->OMSetRenderTargets(1, &gPortalRenderTarget, gPortalDepthStencilView);
+    gRenderContext->OMSetRenderTargets(1, &gPortalRenderTarget, gPortalDepthStencilView);
 
     // Clear the portal texture to a fixed colour and the portal depth buffer to the far distance
-    gD3DContext->ClearRenderTargetView(gPortalRenderTarget, &gBackgroundColor.r);
-    gD3DContext->ClearDepthStencilView(gPortalDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
+    gRenderContext->ClearRenderTargetView(gPortalRenderTarget, &gBackgroundColor.r);
+    gRenderContext->ClearDepthStencilView(gPortalDepthStencilView, 1.0f);
 
     // Setup the viewport for the portal texture size
-    vp.Width = static_cast<FLOAT>(gPortalWidth);
-    vp.Height = static_cast<FLOAT>(gPortalHeight);
-    vp.MinDepth = 0.0f;
-    vp.MaxDepth = 1.0f;
-    vp.TopLeftX = 0;
-    vp.TopLeftY = 0;
-    gD3DContext->RSSetViewports(1, &vp);
+    vp.width = static_cast<float>(gPortalWidth);
+    vp.height = static_cast<float>(gPortalHeight);
+    vp.minDepth = 0.0f;
+    vp.maxDepth = 1.0f;
+    vp.topLeftX = 0;
+    vp.topLeftY = 0;
+    gRenderContext->RSSetViewport(vp);
 
     // Render the scene for the portal
-    RenderSceneFromCamera(gPortalCamera);
+    RenderSceneFromCamera(portalCamera, ScenePass::Portal);
 
     //// Main scene rendering ////
 
     // Set the back buffer as the target for rendering and select the main depth buffer.
     // When finished the back buffer is sent to the "front buffer" - which is the monitor.
-    gD3DContext->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
+    gRenderContext->OMSetRenderTargets(1, &gBackBufferRenderTarget, gDepthStencil);
 
     // Clear the back buffer to a fixed colour and the depth buffer to the far distance
-    gD3DContext->ClearRenderTargetView(gBackBufferRenderTarget, &gBackgroundColor.r);
-    gD3DContext->ClearDepthStencilView(gDepthStencil, D3D11_CLEAR_DEPTH, 1.0f, 0);
+    gRenderContext->ClearRenderTargetView(gBackBufferRenderTarget, &gBackgroundColor.r);
+    gRenderContext->ClearDepthStencilView(gDepthStencil, 1.0f);
 
     // Setup the viewport to the size of the main window
-    vp.Width  = static_cast<FLOAT>(gViewportWidth);
-    vp.Height = static_cast<FLOAT>(gViewportHeight);
-    vp.MinDepth = 0.0f;
-    vp.MaxDepth = 1.0f;
-    vp.TopLeftX = 0;
-    vp.TopLeftY = 0;
-    gD3DContext->RSSetViewports(1, &vp);
+    vp.width  = static_cast<float>(gViewportWidth);
+    vp.height = static_cast<float>(gViewportHeight);
+    vp.minDepth = 0.0f;
+    vp.maxDepth = 1.0f;
+    vp.topLeftX = 0;
+    vp.topLeftY = 0;
+    gRenderContext->RSSetViewport(vp);
 
     // Set shadow maps in shaders
     // First parameter is the "slot", must match the Texture2D declaration in the HLSL code
     // In this app the diffuse map uses slot 0, the shadow maps use slots 1 onwards. If we were using other maps (e.g. normal map) then
     // we might arrange things differently
-    gD3DContext->PSSetShaderResources(1, 1, &gShadowMap1SRV);
-    gD3DContext->PSSetShaderResources(2, 1, &gShadowMap2SRV);
-    gD3DContext->PSSetSamplers(1, 1, &gTrilinearSampler);
+    gRenderContext->PSSetShaderResources(1, 1, &gShadowMap1SRV);
+    gRenderContext->PSSetShaderResources(2, 1, &gShadowMap2SRV);
+    gRenderContext->PSSetSamplers(1, 1, &gTrilinearSampler);
 
     // Render the scene for the main window
-    RenderSceneFromCamera(gCamera);
+    RenderSceneFromCamera(mainCamera, ScenePass::Main);
 
     // Unbind shadow maps from shaders - prevents warnings from DirectX when we try to render to the shadow maps again next frame
     ID3D11ShaderResourceView* nullView = nullptr;
-    gD3DContext->PSSetShaderResources(1, 1, &nullView);
+    gRenderContext->PSSetShaderResources(1, 1, &nullView);
 
     //// Scene completion ////
 
@@ -1322,22 +1638,17 @@ void RenderScene()
 // Scene Update
 //--------------------------------------------------------------------------------------
 
-// Update models and camera. frameTime is the time passed since the last frame
-void UpdateScene(float frameTime)
+// Run one fixed length step of the scene simulation - all movement and animation of models and lights
+void SimulateScene(float stepTime, const SimulationInput& input)
 {
 	// Control sphere (will update its world matrix)
-	gFox->Control(frameTime, Key_I, Key_K, Key_J, Key_L, Key_U, Key_O, Key_Period, Key_Comma );
+	gFox->Control(stepTime, input.foxKeys);
 
     // Orbit the light - a bit of a cheat with the static variable [ask the tutor if you want to know what this is]
 	static float rotate = 0.0f;
-    static bool go = true;
-	gLights[0]->GetModel()->SetPosition( gFox->Position() + CVector3{ cos(rotate) * gLightOrbit, 20, sin(rotate) * gLightOrbit } );
+	gLights[0]->GetModel()->SetPosition( gFox->Position() + CVector3{ Cos<MathPrecision::Fast>(rotate) * gLightOrbit, 20, Sin<MathPrecision::Fast>(rotate) * gLightOrbit } );
 	gLights[0]->GetModel()->FaceTarget(gFox->Position());
-    if (go)  rotate -= gLightOrbitSpeed * frameTime;
-    if (KeyHit(Key_1))  go = !go;
-
-    //Create create wiggle variable
-    gPerFrameConstants.wiggle += 6 * frameTime;
+    if (gLightOrbiting)  rotate -= gLightOrbitSpeed * stepTime;
 
     //Pulse light 1 on and off
     static bool lightOn = true;
@@ -1345,7 +1656,7 @@ void UpdateScene(float frameTime)
     float lightStrength = gLights[0]->GetStrength();
     if (lightOn)
     {       
-        gLights[0]->SetStrength(lightStrength += 0.05) ;
+        gLights[0]->SetStrength(lightStrength += gLightPulseSpeed * stepTime) ;
         if (gLights[0]->GetStrength() >= 20)
         {                          
             lightOn = false;
@@ -1353,7 +1664,7 @@ void UpdateScene(float frameTime)
     }
     else
     {
-        gLights[0]->SetStrength(lightStrength += -0.05);
+        gLights[0]->SetStrength(lightStrength -= gLightPulseSpeed * stepTime);
         if (gLights[0]->GetStrength() <= 0.05)
         {
             lightOn = true;
@@ -1368,13 +1679,14 @@ void UpdateScene(float frameTime)
     static bool redCycle = false;
     static bool blueCycle = false;
     static bool greenCycle = false;
+    const float colourStep = gColourCycleSpeed * stepTime;
 
     if (!redCycle)
     {
-        r = r + 0.001;
+        r = r + colourStep;
         if (b > 0.2)
         {
-            b = b - 0.001;
+            b = b - colourStep;
         }
         if (r >= 1)
         {
@@ -1383,10 +1695,10 @@ void UpdateScene(float frameTime)
     }
     else if (!greenCycle)
     {
-        g = g + 0.001;
+        g = g + colourStep;
         if (r > 0.2)
         {
-            r = r - 0.001;
+            r = r - colourStep;
         }
         if (g >= 1)
         {
@@ -1395,10 +1707,10 @@ void UpdateScene(float frameTime)
     }
     else if (!blueCycle)
     {
-        b = b + 0.001;
+        b = b + colourStep;
         if (g > 0.2)
         {
-            g = g - 0.001;
+            g = g - colourStep;
         }
         if (b >= 1)
         {
@@ -1414,13 +1726,55 @@ void UpdateScene(float frameTime)
 
     gLights[1]->SetColour(CVector3{ r, g, b });
 
+    // Rebuild the world matrices of the models moved above together, then bring attached models up to date with them
+    Model::UpdateWorldMatrices(gSimulatedModels.data(), static_cast<int>(gSimulatedModels.size()));
+    gModelHierarchy.Update();
+}
+
+
+// Simulate a frame, running as many fixed steps as fit in the time passed (possibly none), and blend the last two
+// steps to give the state to render. Called on the simulation thread
+void SimulateFrame(const SimulationInput& input, SimulationState& renderState)
+{
+    if (input.toggleLightOrbit)  gLightOrbiting = !gLightOrbiting;
+
+    int numSteps = gSimulationClock.Advance(input.frameTime);
+    for (int step = 0; step < numSteps; ++step)
+    {
+        std::swap(gPreviousState, gCurrentState);
+        SimulateScene(gSimulationClock.StepTime(), input);
+        StoreSimulationState(gCurrentState);
+    }
+    BlendSimulationStates(gPreviousState, gCurrentState, gSimulationClock.Alpha(), renderState);
+    renderState.numSteps = numSteps;
+}
+
+
+// Update the scene. Takes the simulation results for this frame and starts the simulation of the next one, which
+// runs on the simulation thread while this frame is rendered. The camera and key toggles are handled here
+void UpdateScene(float frameTime)
+{
+    gRenderState = &gSimulationPipeline->Acquire();
+    gSimulationPipeline->Submit({ frameTime, ReadControlKeys(Key_I, Key_K, Key_J, Key_L, Key_U, Key_O, Key_Period, Key_Comma),
+                                  KeyHit(Key_1) });
+    for (size_t i = 0; i < gSimulatedModels.size(); ++i)
+    {
+        gSimulatedModels[i]->SetRenderMatrix(gRenderState->modelMatrices[i]);
+    }
+    int numSteps = gRenderState->numSteps;
+
+    // Entities don't move in the simulation, any that have been changed here are updated before rendering
+    gEntities.UpdateWorldMatrices();
+
+    //Create create wiggle variable
+    gPerFrameConstants.wiggle += 6 * frameTime;
+
     // Toggle parallax
     if (KeyHit(Key_2))
     {
         gUseParallax = !gUseParallax;
     }
 
-
 	// Control camera (will update its view matrix)
 	gCamera->Control(frameTime, Key_Up, Key_Down, Key_Left, Key_Right, Key_W, Key_S, Key_A, Key_D );
 
@@ -1428,11 +1782,16 @@ void UpdateScene(float frameTime)
     // Toggle FPS limiting
     if (KeyHit(Key_P))  lockFPS = !lockFPS;
 
+    // Toggle occlusion culling (O is taken by the fox's controls)
+    if (KeyHit(Key_3))  gUseOcclusion = !gUseOcclusion;
+
     // Show frame time / FPS in the window title //
     const float fpsUpdateTime = 0.5f; // How long between updates (in seconds)
     static float totalFrameTime = 0;
     static int frameCount = 0;
+    static int stepCount = 0;
     totalFrameTime += frameTime;
+    stepCount += numSteps;
     ++frameCount;
     if (totalFrameTime > fpsUpdateTime)
     {
@@ -1441,11 +1800,33 @@ void UpdateScene(float frameTime)
         std::ostringstream frameTimeMs;
         frameTimeMs.precision(2);
         frameTimeMs << std::fixed << avgFrameTime * 1000;
+        std::ostringstream occlusionMs;
+        occlusionMs.precision(2);
+        occlusionMs << std::fixed << gOcclusionMilliseconds / frameCount;
         std::string windowTitle = "CO2409 Week 20: Shadow Mapping - Frame Time: " + frameTimeMs.str() +
                                   "ms, FPS: " + std::to_string(static_cast<int>(1 / avgFrameTime + 0.5f)) + ", XPos: " + std::to_string(gCamera->Position().x) +
-                                   ", YPos: " + std::to_string(gCamera->Position().y) + ", ZPos: " + std::to_string(gCamera->Position().z);
+                                   ", YPos: " + std::to_string(gCamera->Position().y) + ", ZPos: " + std::to_string(gCamera->Position().z) +
+                                   ", Matrix Rebuilds/Frame: " + std::to_string(Model::NumWorldMatrixRebuilds() / frameCount) +
+                                   ", Sim Steps/s: " + std::to_string(static_cast<int>(stepCount / totalFrameTime + 0.5f)) +
+                                   ", Render Calls/Frame: " + std::to_string(gRenderStateCache->NumIssued() / frameCount) +
+                                   " (" + std::to_string(gRenderStateCache->NumFiltered() / frameCount) + " filtered)" +
+                                   ", Draws/Frame: " + std::to_string((gRenderStateCache->NumIssued(RenderCall::DrawIndexed) +
+                                                                       gRenderStateCache->NumIssued(RenderCall::DrawIndexedInstanced)) / frameCount) +
+                                   ", Visible: " + std::to_string(gNumVisible[static_cast<int>(ScenePass::Main)] / frameCount) + " main, " +
+                                   std::to_string(gNumVisible[static_cast<int>(ScenePass::Portal)] / frameCount) + " portal, " +
+                                   std::to_string(gNumVisible[static_cast<int>(ScenePass::Light1Shadow)] / frameCount) + "/" +
+                                   std::to_string(gNumVisible[static_cast<int>(ScenePass::Light2Shadow)] / frameCount) + " shadow" +
+                                   ", Occluded: " + std::to_string(gNumOccluded[static_cast<int>(ScenePass::Main)] / frameCount) + " main, " +
+                                   std::to_string(gNumOccluded[static_cast<int>(ScenePass::Portal)] / frameCount) + " portal in " +
+                                   occlusionMs.str() + "ms" + (gUseOcclusion ? " (3: turn off)" : " (off, 3: turn on)");
         SetWindowTextA(gHWnd, windowTitle.c_str());
         totalFrameTime = 0;
         frameCount = 0;
+        stepCount = 0;
+        Model::ResetWorldMatrixRebuilds();
+        gRenderStateCache->ResetCounts();
+        for (int& numVisible : gNumVisible)  numVisible = 0;
+        for (int& numOccluded : gNumOccluded)  numOccluded = 0;
+        gOcclusionMilliseconds = 0;
     }
 }
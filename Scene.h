@@ -28,7 +28,8 @@ void ReleaseResources();
 
 void RenderScene();
 
-// frameTime is the time passed since the last frame
+// frameTime is the time passed since the last frame. The scene is simulated in fixed steps independent of the frame
+// rate, rendering shows the scene between the last two steps
 void UpdateScene(float frameTime);
 
 #endif //_SCENE_H_INCLUDED_
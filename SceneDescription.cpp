@@ -0,0 +1,266 @@
+//--------------------------------------------------------------------------------------
+// Class holding the contents of a scene file - the meshes, textures, entities and lights to create
+//--------------------------------------------------------------------------------------
+// Text files are parsed into the same single block of data that a binary file holds, so both are used the same way
+
+#include "SceneDescription.h"
+#include "MathHelpers.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+
+
+/*-----------------------------------------------------------------------------------------
+    Binary layout
+-----------------------------------------------------------------------------------------*/
+
+// Start of the data block / binary file. Offsets are from the start of the block
+struct SceneFileHeader
+{
+    char     id[4];        // SceneFileId
+    uint32_t version;      // SceneFileVersion, increase when the records change
+    uint32_t dataSize;     // Size of the whole block
+    uint32_t numMeshes,   meshesOffset;
+    uint32_t numTextures, texturesOffset;
+    uint32_t numEntities, entitiesOffset;
+    uint32_t numLights,   lightsOffset;
+    uint32_t stringsSize, stringsOffset;
+};
+
+static const char     SceneFileId[4]   = { 'S', 'C', 'N', 'B' };
+static const uint32_t SceneFileVersion = 1;
+
+
+// Check that an array of the given number of records fits in the data block and is aligned for its type
+template <class Record>
+static bool IsValidArray(uint32_t offset, uint32_t count, uint32_t dataSize)
+{
+    return offset % alignof(Record) == 0 && offset <= dataSize && count <= (dataSize - offset) / sizeof(Record);
+}
+
+
+// Check the header of the data block and point the arrays into it. Returns false if the data is invalid
+bool SceneDescription::FixUpPointers()
+{
+    if (mDataSize < sizeof(SceneFileHeader))  return false;
+    const SceneFileHeader& header = *reinterpret_cast<const SceneFileHeader*>(mData.get());
+    if (std::memcmp(header.id, SceneFileId, sizeof(SceneFileId)) != 0 || header.version != SceneFileVersion ||
+        header.dataSize != mDataSize)  return false;
+
+    if (!IsValidArray<SceneMeshRecord>   (header.meshesOffset,   header.numMeshes,   mDataSize) ||
+        !IsValidArray<SceneTextureRecord>(header.texturesOffset, header.numTextures, mDataSize) ||
+        !IsValidArray<SceneEntityRecord> (header.entitiesOffset, header.numEntities, mDataSize) ||
+        !IsValidArray<SceneLightRecord>  (header.lightsOffset,   header.numLights,   mDataSize) ||
+        !IsValidArray<char>              (header.stringsOffset,  header.stringsSize, mDataSize))  return false;
+
+    // Strings must end with a terminator so no string can run off the end of the block
+    if (header.stringsSize == 0 || mData[header.stringsOffset + header.stringsSize - 1] != '\0')  return false;
+
+    mMeshes   = reinterpret_cast<const SceneMeshRecord*>   (mData.get() + header.meshesOffset);
+    mTextures = reinterpret_cast<const SceneTextureRecord*>(mData.get() + header.texturesOffset);
+    mEntities = reinterpret_cast<const SceneEntityRecord*> (mData.get() + header.entitiesOffset);
+    mLights   = reinterpret_cast<const SceneLightRecord*>  (mData.get() + header.lightsOffset);
+    mStrings  = mData.get() + header.stringsOffset;
+    mNumMeshes   = static_cast<int>(header.numMeshes);
+    mNumTextures = static_cast<int>(header.numTextures);
+    mNumEntities = static_cast<int>(header.numEntities);
+    mNumLights   = static_cast<int>(header.numLights);
+
+    // Indexes and string offsets in the records must be in range
+    auto isValidString = [&](uint32_t offset) { return offset < header.stringsSize; };
+    for (int i = 0; i < mNumMeshes; ++i)
+    {
+        if (!isValidString(mMeshes[i].name) || !isValidString(mMeshes[i].fileName))  return false;
+    }
+    for (int i = 0; i < mNumTextures; ++i)
+    {
+        const SceneTextureRecord& texture = mTextures[i];
+        if (!isValidString(texture.name) || !isValidString(texture.diffuseSpecularFileName) || !isValidString(texture.normalFileName))  return false;
+    }
+    for (int i = 0; i < mNumEntities; ++i)
+    {
+        const SceneEntityRecord& entity = mEntities[i];
+        if (entity.mesh >= header.numMeshes)  return false;
+        if (entity.texture != SceneEntityRecord::NoTexture && entity.texture >= header.numTextures)  return false;
+    }
+    return true;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Loading / saving
+-----------------------------------------------------------------------------------------*/
+
+// Load a scene file, either text or binary (detected from the file contents)
+SceneDescription::SceneDescription(const std::string& fileName)
+{
+    // Read the whole file in one go
+    std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+    if (!file)  throw std::runtime_error("Error opening scene file " + fileName);
+    std::streamoff fileSize = file.tellg();
+    if (fileSize < 0 || fileSize >= UINT32_MAX)  throw std::runtime_error("Error reading scene file " + fileName);
+    mDataSize = static_cast<uint32_t>(fileSize);
+    mData = std::make_unique<char[]>(mDataSize + 1); // Extra terminator for parsing text
+    file.seekg(0);
+    if (!file.read(mData.get(), mDataSize))  throw std::runtime_error("Error reading scene file " + fileName);
+    mData[mDataSize] = '\0';
+
+    // A binary file is used as is
+    if (mDataSize >= sizeof(SceneFileId) && std::memcmp(mData.get(), SceneFileId, sizeof(SceneFileId)) == 0)
+    {
+        if (!FixUpPointers())  throw std::runtime_error("Invalid binary scene file " + fileName);
+        return;
+    }
+
+    // Otherwise parse the text, which replaces the data block with one in the binary layout
+    std::unique_ptr<char[]> text = std::move(mData);
+    ParseText(text.get(), mDataSize, fileName);
+}
+
+
+// Save the scene in binary form - the data block is already in that form
+void SceneDescription::SaveBinary(const std::string& fileName) const
+{
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file.write(mData.get(), mDataSize))  throw std::runtime_error("Error writing scene file " + fileName);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Text parsing
+-----------------------------------------------------------------------------------------*/
+
+// Parse a scene in text form (see header) and build the data block from it
+void SceneDescription::ParseText(const char* text, size_t size, const std::string& fileName)
+{
+    std::vector<SceneMeshRecord>    meshes;
+    std::vector<SceneTextureRecord> textures;
+    std::vector<SceneEntityRecord>  entities;
+    std::vector<SceneLightRecord>   lights;
+    std::string strings(1, '\0'); // Offset 0 is the empty string
+    std::unordered_map<std::string_view, uint32_t> meshIndexes, textureIndexes;
+
+    auto addString = [&](std::string_view s)
+    {
+        uint32_t offset = static_cast<uint32_t>(strings.size());
+        strings.append(s);
+        strings.push_back('\0');
+        return offset;
+    };
+
+    int lineNumber = 0;
+    auto error = [&](const std::string& message)
+    {
+        return std::runtime_error("Error in scene file " + fileName + " line " + std::to_string(lineNumber) + ": " + message);
+    };
+
+    const char* lineStart = text;
+    const char* textEnd   = text + size;
+    while (lineStart < textEnd)
+    {
+        ++lineNumber;
+        const char* lineEnd = std::find(lineStart, textEnd, '\n');
+        const char* commentStart = std::find(lineStart, lineEnd, '#');
+
+        // Split the line into words
+        const int MaxWords = 12;
+        std::string_view words[MaxWords];
+        int numWords = 0;
+        for (const char* c = lineStart; c < commentStart; )
+        {
+            while (c < commentStart && std::isspace(static_cast<unsigned char>(*c)))  ++c;
+            const char* wordStart = c;
+            while (c < commentStart && !std::isspace(static_cast<unsigned char>(*c)))  ++c;
+            if (c == wordStart)  break;
+            if (numWords == MaxWords)  throw error("too many words");
+            words[numWords++] = std::string_view(wordStart, c - wordStart);
+        }
+        lineStart = lineEnd + 1;
+        if (numWords == 0)  continue;
+
+        // Read a number from the given word, the word is always followed by a space, comment or terminator so strtof stops there
+        auto readNumber = [&](int word)
+        {
+            char* end;
+            float value = std::strtof(words[word].data(), &end);
+            if (end != words[word].data() + words[word].size())  throw error("expected a number, found '" + std::string(words[word]) + "'");
+            return value;
+        };
+        auto readVector = [&](int word) { return CVector3{ readNumber(word), readNumber(word + 1), readNumber(word + 2) }; };
+
+        std::string_view type = words[0];
+        if (type == "mesh" && (numWords == 3 || numWords == 4))
+        {
+            if (numWords == 4 && words[3] != "tangents")  throw error("expected 'tangents'");
+            if (!meshIndexes.emplace(words[1], static_cast<uint32_t>(meshes.size())).second)  throw error("mesh name used twice");
+            meshes.push_back({ addString(words[1]), addString(words[2]), numWords == 4 ? 1u : 0u });
+        }
+        else if (type == "texture" && (numWords == 3 || numWords == 4))
+        {
+            if (!textureIndexes.emplace(words[1], static_cast<uint32_t>(textures.size())).second)  throw error("texture name used twice");
+            textures.push_back({ addString(words[1]), addString(words[2]), numWords == 4 ? addString(words[3]) : 0 });
+        }
+        else if (type == "entity" && numWords == 10)
+        {
+            auto mesh = meshIndexes.find(words[1]);
+            if (mesh == meshIndexes.end())  throw error("unknown mesh '" + std::string(words[1]) + "'");
+            uint32_t texture = SceneEntityRecord::NoTexture;
+            if (words[2] != "-")
+            {
+                auto found = textureIndexes.find(words[2]);
+                if (found == textureIndexes.end())  throw error("unknown texture '" + std::string(words[2]) + "'");
+                texture = found->second;
+            }
+            CVector3 rotation = readVector(6);
+            entities.push_back({ mesh->second, texture, readVector(3),
+                                 QuaternionFromEuler({ ToRadians(rotation.x), ToRadians(rotation.y), ToRadians(rotation.z) }), readNumber(9) });
+        }
+        else if (type == "light" && numWords == 8)
+        {
+            lights.push_back({ readVector(1), readNumber(4), readVector(5) });
+        }
+        else
+        {
+            throw error("unrecognised line");
+        }
+    }
+
+    // Build the data block: header, then each array (aligned for its records), then the strings
+    SceneFileHeader header = {};
+    std::memcpy(header.id, SceneFileId, sizeof(SceneFileId));
+    header.version = SceneFileVersion;
+
+    uint32_t offset = sizeof(SceneFileHeader);
+    auto place = [&offset](const auto& array, uint32_t& arrayOffset, uint32_t& count)
+    {
+        using Record = typename std::decay_t<decltype(array)>::value_type;
+        offset = (offset + alignof(Record) - 1) / alignof(Record) * alignof(Record);
+        arrayOffset = offset;
+        count = static_cast<uint32_t>(array.size());
+        offset += count * sizeof(Record);
+    };
+    place(meshes,   header.meshesOffset,   header.numMeshes);
+    place(textures, header.texturesOffset, header.numTextures);
+    place(entities, header.entitiesOffset, header.numEntities);
+    place(lights,   header.lightsOffset,   header.numLights);
+    place(strings,  header.stringsOffset,  header.stringsSize);
+    header.dataSize = offset;
+
+    mDataSize = header.dataSize;
+    mData = std::make_unique<char[]>(mDataSize); // Zero initialised, so any padding is zero in saved files
+    std::memcpy(mData.get(), &header, sizeof(header));
+    std::memcpy(mData.get() + header.meshesOffset,   meshes.data(),   meshes.size()   * sizeof(SceneMeshRecord));
+    std::memcpy(mData.get() + header.texturesOffset, textures.data(), textures.size() * sizeof(SceneTextureRecord));
+    std::memcpy(mData.get() + header.entitiesOffset, entities.data(), entities.size() * sizeof(SceneEntityRecord));
+    std::memcpy(mData.get() + header.lightsOffset,   lights.data(),   lights.size()   * sizeof(SceneLightRecord));
+    std::memcpy(mData.get() + header.stringsOffset,  strings.data(),  strings.size());
+
+    FixUpPointers();
+}
@@ -0,0 +1,123 @@
+//--------------------------------------------------------------------------------------
+// Class holding the contents of a scene file - the meshes, textures, entities and lights to create
+//--------------------------------------------------------------------------------------
+// Scene layouts are edited as text files, one item per line ('#' starts a comment):
+//
+//   mesh    <name> <file> [tangents]                        - mesh to load, optionally with tangents
+//   texture <name> <diffuse/specular file> [normal file]    - texture to load
+//   entity  <mesh name> <texture name or -> <x y z> <rotation x y z in degrees> <scale>
+//   light   <red green blue> <strength> <x y z>             - settings for the next of the scene's lights
+//
+// The text is slow to read for large scenes, so it can be saved in a binary form that holds exactly the data
+// this class uses in memory: a header followed by arrays of records and a block of strings. Loading a binary file
+// is a single read of the whole file and then setting up pointers to the arrays within it.
+//
+// This class only reads and writes the data, it does not create anything. See InitGeometry and InitScene in Scene.cpp
+
+#include "CVector3.h"
+#include "CQuaternion.h"
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+#ifndef _SCENE_DESCRIPTION_H_INCLUDED_
+#define _SCENE_DESCRIPTION_H_INCLUDED_
+
+
+// Records stored in the scene description. Plain data, identical in memory and in a binary scene file
+// Strings are given as offsets into the string block, see SceneDescription::String
+struct SceneMeshRecord
+{
+    uint32_t name;
+    uint32_t fileName;
+    uint32_t requireTangents;
+};
+
+struct SceneTextureRecord
+{
+    uint32_t name;
+    uint32_t diffuseSpecularFileName;
+    uint32_t normalFileName;  // Empty string if there is no normal map
+};
+
+struct SceneEntityRecord
+{
+    uint32_t    mesh;          // Index into the mesh records
+    uint32_t    texture;       // Index into the texture records, or NoTexture
+    CVector3    position;
+    CQuaternion orientation;
+    float       scale;
+
+    static const uint32_t NoTexture = 0xffffffff;
+};
+
+struct SceneLightRecord
+{
+    CVector3 colour;
+    float    strength;
+    CVector3 position;
+};
+
+
+class SceneDescription
+{
+public:
+	//-------------------------------------
+	// Construction / Usage
+	//-------------------------------------
+
+    // Load a scene file, either text or binary (detected from the file contents)
+    // Will throw a std::runtime_error exception on failure (since constructors can't return errors)
+    SceneDescription(const std::string& fileName);
+
+    // Save the scene in binary form, which is much faster to load. Throws a std::runtime_error exception on failure
+    void SaveBinary(const std::string& fileName) const;
+
+
+	//-------------------------------------
+	// Data access
+	//-------------------------------------
+
+    int NumMeshes()    const { return mNumMeshes;   }
+    int NumTextures()  const { return mNumTextures; }
+    int NumEntities()  const { return mNumEntities; }
+    int NumLights()    const { return mNumLights;   }
+
+    const SceneMeshRecord&    MeshRecord   (int index) const { return mMeshes  [index]; }
+    const SceneTextureRecord& TextureRecord(int index) const { return mTextures[index]; }
+    const SceneEntityRecord*  EntityRecords()          const { return mEntities; }
+    const SceneLightRecord&   LightRecord  (int index) const { return mLights  [index]; }
+
+    // Get a string used in a record
+    const char* String(uint32_t offset) const { return mStrings + offset; }
+
+
+	//-------------------------------------
+	// Private data / members
+	//-------------------------------------
+private:
+    void ParseText(const char* text, size_t size, const std::string& fileName);
+
+    // Check the header of the data block and point the arrays above into it. Returns false if the data is invalid
+    bool FixUpPointers();
+
+    // All scene data in a single block, laid out exactly as a binary scene file
+    std::unique_ptr<char[]> mData;
+    uint32_t                mDataSize = 0;
+
+    // Arrays within the data block
+    const SceneMeshRecord*    mMeshes   = nullptr;
+    const SceneTextureRecord* mTextures = nullptr;
+    const SceneEntityRecord*  mEntities = nullptr;
+    const SceneLightRecord*   mLights   = nullptr;
+    const char*               mStrings  = nullptr;
+
+    int mNumMeshes   = 0;
+    int mNumTextures = 0;
+    int mNumEntities = 0;
+    int mNumLights   = 0;
+};
+
+
+#endif //_SCENE_DESCRIPTION_H_INCLUDED_
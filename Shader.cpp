@@ -22,6 +22,12 @@ ID3D11VertexShader* gCellShadingOutlineVertexShader = nullptr;
 ID3D11VertexShader* gCellShadingVertexShader        = nullptr;
 ID3D11VertexShader* gNormalMappingVertexShader    = nullptr;
 
+// Instanced versions of the vertex shaders above, which read the world matrix of each instance from the instance buffer
+ID3D11VertexShader* gPixelLightingInstancedVertexShader      = nullptr;
+ID3D11VertexShader* gBasicTransformInstancedVertexShader     = nullptr;
+ID3D11VertexShader* gCellShadingInstancedVertexShader        = nullptr;
+ID3D11VertexShader* gCellShadingOutlineInstancedVertexShader = nullptr;
+
 ID3D11PixelShader*  gPixelLightingPixelShader       = nullptr;
 ID3D11PixelShader*  gLightModelPixelShader          = nullptr;
 ID3D11PixelShader*  gDepthOnlyPixelShader           = nullptr;
@@ -64,6 +70,11 @@ bool LoadShaders()
     gCellShadingOutlinePixelShader  = LoadPixelShader("CellShadingOutline_ps"  );
     gCubeMappingPixelShader         = LoadPixelShader("CubeMapping_ps");
 
+    gPixelLightingInstancedVertexShader      = LoadVertexShader("ShadowMappingInstanced_vs");
+    gBasicTransformInstancedVertexShader     = LoadVertexShader("BasicTransformInstanced_vs");
+    gCellShadingInstancedVertexShader        = LoadVertexShader("CellShadingInstanced_vs");
+    gCellShadingOutlineInstancedVertexShader = LoadVertexShader("CellShadingOutlineInstanced_vs");
+
     if (gPixelLightingVertexShader  == nullptr || gPixelLightingPixelShader       == nullptr  ||
         gBasicTransformVertexShader == nullptr || gLightModelPixelShader          == nullptr  || 
         gDepthOnlyPixelShader       == nullptr || gSphereVertexShader             == nullptr  || 
@@ -72,7 +83,9 @@ bool LoadShaders()
         gSpritePixelShader          == nullptr || gNormalMappingPixelShader       == nullptr  ||
         gTVPixelShader              == nullptr || gCellShadingOutlineVertexShader == nullptr  ||
         gCellShadingVertexShader    == nullptr || gCellShadingOutlinePixelShader  == nullptr  || 
-        gCellShadingPixelShader     == nullptr || gCubeMappingPixelShader == nullptr)
+        gCellShadingPixelShader     == nullptr || gCubeMappingPixelShader == nullptr  ||
+        gPixelLightingInstancedVertexShader == nullptr || gBasicTransformInstancedVertexShader     == nullptr ||
+        gCellShadingInstancedVertexShader   == nullptr || gCellShadingOutlineInstancedVertexShader == nullptr)
     {
         gLastError = "Error loading shaders";
         return false;
@@ -102,6 +115,11 @@ void ReleaseShaders()
     if(gCellShadingOutlineVertexShader) gCellShadingOutlineVertexShader->Release();
     if(gCellShadingOutlinePixelShader)  gCellShadingOutlinePixelShader ->Release();
     if (gCubeMappingPixelShader)        gCubeMappingPixelShader->Release();
+
+    if (gPixelLightingInstancedVertexShader)      gPixelLightingInstancedVertexShader->Release();
+    if (gBasicTransformInstancedVertexShader)     gBasicTransformInstancedVertexShader->Release();
+    if (gCellShadingInstancedVertexShader)        gCellShadingInstancedVertexShader->Release();
+    if (gCellShadingOutlineInstancedVertexShader) gCellShadingOutlineInstancedVertexShader->Release();
 }
 
 
@@ -227,23 +245,10 @@ ID3DBlob* CreateSignatureForVertexLayout(const D3D11_INPUT_ELEMENT_DESC vertexLa
 // buffer the same size as the structure. That makes updating values from C++ to shader easy - see the main code.
 
 // Create and return a constant buffer of the given size
-// The returned pointer needs to be released before quitting. Returns nullptr on failure. 
+// The returned pointer needs to be released (with gRenderDevice->ReleaseBuffer) before quitting. Returns nullptr on failure.
 ID3D11Buffer* CreateConstantBuffer(int size)
 {
-    D3D11_BUFFER_DESC cbDesc;
-    cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-    cbDesc.ByteWidth = 16 * ((size + 15) / 16);     // Constant buffer size must be a multiple of 16 - this maths rounds up to the nearest multiple
-    cbDesc.Usage = D3D11_USAGE_DYNAMIC;             // Indicates that the buffer is frequently updated
-    cbDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE; // CPU is only going to write to the constants (not read them)
-    cbDesc.MiscFlags = 0;
-    ID3D11Buffer* constantBuffer;
-    HRESULT hr = gD3DDevice->CreateBuffer(&cbDesc, nullptr, &constantBuffer);
-    if (FAILED(hr))
-    {
-        return nullptr;
-    }
-
-    return constantBuffer;
+    return gRenderDevice->CreateConstantBuffer(size);
 }
 
 
@@ -35,6 +35,12 @@ extern ID3D11PixelShader*  gCellShadingPixelShader;
 extern ID3D11VertexShader* gCellShadingOutlineVertexShader;
 extern ID3D11PixelShader*  gCellShadingOutlinePixelShader;
 
+// Instanced versions of vertex shaders (see Common.hlsli)
+extern ID3D11VertexShader* gPixelLightingInstancedVertexShader;
+extern ID3D11VertexShader* gBasicTransformInstancedVertexShader;
+extern ID3D11VertexShader* gCellShadingInstancedVertexShader;
+extern ID3D11VertexShader* gCellShadingOutlineInstancedVertexShader;
+
 //--------------------------------------------------------------------------------------
 // Shader creation / destruction
 //--------------------------------------------------------------------------------------
@@ -51,7 +57,7 @@ void ReleaseShaders();
 //--------------------------------------------------------------------------------------
 
 // Create and return a constant buffer of the given size
-// The returned pointer needs to be released before quitting. Returns nullptr on failure
+// The returned pointer needs to be released (with gRenderDevice->ReleaseBuffer) before quitting. Returns nullptr on failure
 ID3D11Buffer* CreateConstantBuffer(int size);
 
 
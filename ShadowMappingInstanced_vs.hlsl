@@ -0,0 +1,7 @@
+//--------------------------------------------------------------------------------------
+// Per-Pixel Lighting Vertex Shader - instanced version
+//--------------------------------------------------------------------------------------
+// The same shader reading the world matrix of each instance from the instance buffer (see Instancing in Common.hlsli)
+
+#define INSTANCED
+#include "ShadowMapping_vs.hlsl"
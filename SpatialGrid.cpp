@@ -0,0 +1,350 @@
+//--------------------------------------------------------------------------------------
+// Spatial grid - finds moving objects in a region of space, cheap to update as they move
+//--------------------------------------------------------------------------------------
+// Loose grid of hashed cells, see header for details
+
+#include "SpatialGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+// Cell coordinates are limited to 21 bits each so all three fit in a 64-bit key. With 10 unit cells that covers
+// 10 million units either side of the origin
+static const int32_t MAX_CELL_COORDINATE = (1 << 20) - 1;
+
+static inline CVector3 Min(const CVector3& a, const CVector3& b)
+{
+    return { std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z) };
+}
+
+static inline CVector3 Max(const CVector3& a, const CVector3& b)
+{
+    return { std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z) };
+}
+
+// Result of comparing a cell's box with a query region
+enum class Overlap { Outside, Partial, Inside };
+
+
+SpatialGrid::SpatialGrid(float cellSize)
+    : mCellSize(cellSize), mInvCellSize(1 / cellSize)
+{
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Cells
+-----------------------------------------------------------------------------------------*/
+
+void SpatialGrid::CellCoordinates(const CVector3& point, int32_t& x, int32_t& y, int32_t& z) const
+{
+    auto coordinate = [&](float p)
+    {
+        float c = std::floor(p * mInvCellSize);
+        return static_cast<int32_t>(std::max(std::min(c, static_cast<float>(MAX_CELL_COORDINATE)), static_cast<float>(-MAX_CELL_COORDINATE)));
+    };
+    x = coordinate(point.x);
+    y = coordinate(point.y);
+    z = coordinate(point.z);
+}
+
+uint64_t SpatialGrid::CellKey(int32_t x, int32_t y, int32_t z) const
+{
+    const uint64_t mask = 0x1FFFFF;
+    return ((static_cast<uint64_t>(x) & mask) << 42) | ((static_cast<uint64_t>(y) & mask) << 21) | (static_cast<uint64_t>(z) & mask);
+}
+
+
+void SpatialGrid::AddToCell(int object, const CVector3& centre)
+{
+    int32_t x, y, z;
+    CellCoordinates(centre, x, y, z);
+
+    // Find the cell, or start using a new one
+    int cellIndex;
+    auto found = mCellLookup.find(CellKey(x, y, z));
+    if (found != mCellLookup.end())
+    {
+        cellIndex = found->second;
+    }
+    else
+    {
+        if (mFreeCells.empty())
+        {
+            cellIndex = static_cast<int>(mCells.size());
+            mCells.emplace_back();
+        }
+        else
+        {
+            cellIndex = mFreeCells.back();
+            mFreeCells.pop_back();
+        }
+        Cell& cell = mCells[cellIndex];
+        cell.x = x;  cell.y = y;  cell.z = z;
+        cell.min = mObjects[object].min;
+        cell.max = mObjects[object].max;
+        cell.positionInOccupied = static_cast<int>(mOccupiedCells.size());
+        mOccupiedCells.push_back(cellIndex);
+        mCellLookup[CellKey(x, y, z)] = cellIndex;
+    }
+
+    Cell&   cell  = mCells[cellIndex];
+    Object& entry = mObjects[object];
+    cell.min = Min(cell.min, entry.min);
+    cell.max = Max(cell.max, entry.max);
+    entry.cell           = cellIndex;
+    entry.positionInCell = static_cast<int>(cell.objects.size());
+    cell.objects.push_back(object);
+}
+
+
+// The last object in the cell takes the removed object's place. A cell left empty is freed for reuse
+void SpatialGrid::RemoveFromCell(int object)
+{
+    Object& entry = mObjects[object];
+    Cell&   cell  = mCells[entry.cell];
+
+    int last = cell.objects.back();
+    cell.objects[entry.positionInCell] = last;
+    mObjects[last].positionInCell = entry.positionInCell;
+    cell.objects.pop_back();
+
+    if (cell.objects.empty())
+    {
+        int lastCell = mOccupiedCells.back();
+        mOccupiedCells[cell.positionInOccupied] = lastCell;
+        mCells[lastCell].positionInOccupied = cell.positionInOccupied;
+        mOccupiedCells.pop_back();
+
+        mCellLookup.erase(CellKey(cell.x, cell.y, cell.z));
+        mFreeCells.push_back(entry.cell);
+    }
+    entry.cell = -1;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Adding, moving and removing objects
+-----------------------------------------------------------------------------------------*/
+
+void SpatialGrid::Insert(int object, const BoundingBox& bounds)
+{
+    if (Contains(object))
+    {
+        Move(object, bounds);
+        return;
+    }
+
+    if (object >= static_cast<int>(mObjects.size()))  mObjects.resize(object + 1);
+    mObjects[object].min = bounds.centre - bounds.extents;
+    mObjects[object].max = bounds.centre + bounds.extents;
+    mMaxExtents = Max(mMaxExtents, bounds.extents);
+    AddToCell(object, bounds.centre);
+    ++mNumObjects;
+}
+
+
+void SpatialGrid::Move(int object, const BoundingBox& bounds)
+{
+    Object& entry = mObjects[object];
+    entry.min = bounds.centre - bounds.extents;
+    entry.max = bounds.centre + bounds.extents;
+    mMaxExtents = Max(mMaxExtents, bounds.extents);
+
+    // Staying in the same cell only needs its box to grow
+    int32_t x, y, z;
+    CellCoordinates(bounds.centre, x, y, z);
+    Cell& cell = mCells[entry.cell];
+    if (cell.x == x && cell.y == y && cell.z == z)
+    {
+        cell.min = Min(cell.min, entry.min);
+        cell.max = Max(cell.max, entry.max);
+        return;
+    }
+    RemoveFromCell(object);
+    AddToCell(object, bounds.centre);
+}
+
+
+void SpatialGrid::Remove(int object)
+{
+    if (!Contains(object))  return;
+    RemoveFromCell(object);
+    --mNumObjects;
+}
+
+
+void SpatialGrid::Clear()
+{
+    mObjects.clear();
+    mCells.clear();
+    mOccupiedCells.clear();
+    mFreeCells.clear();
+    mCellLookup.clear();
+    mMaxExtents = { 0, 0, 0 };
+    mNumObjects = 0;
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Queries
+-----------------------------------------------------------------------------------------*/
+
+// An object overlapping the box has its centre no further outside the box than the largest extents of any object.
+// Look up each cell in that range, or if there are more of those than occupied cells, go through the occupied cells
+template <class Visit>
+void SpatialGrid::VisitCells(const CVector3& min, const CVector3& max, Visit visit) const
+{
+    int32_t minX, minY, minZ, maxX, maxY, maxZ;
+    CellCoordinates(min - mMaxExtents, minX, minY, minZ);
+    CellCoordinates(max + mMaxExtents, maxX, maxY, maxZ);
+    double numInRange = (maxX - minX + 1.0) * (maxY - minY + 1.0) * (maxZ - minZ + 1.0);
+    if (numInRange > static_cast<double>(mOccupiedCells.size()))
+    {
+        for (int cellIndex : mOccupiedCells)  visit(mCells[cellIndex]);
+        return;
+    }
+
+    for (int32_t x = minX; x <= maxX; ++x)
+    {
+        for (int32_t y = minY; y <= maxY; ++y)
+        {
+            for (int32_t z = minZ; z <= maxZ; ++z)
+            {
+                auto found = mCellLookup.find(CellKey(x, y, z));
+                if (found != mCellLookup.end())  visit(mCells[found->second]);
+            }
+        }
+    }
+}
+
+
+template <class Classify, class Test>
+void SpatialGrid::Query(const CVector3& min, const CVector3& max, Classify classify, Test test, std::vector<int>& results) const
+{
+    VisitCells(min, max, [&](const Cell& cell)
+    {
+        Overlap overlap = classify(cell.min, cell.max);
+        if (overlap == Overlap::Outside)  return;
+        if (overlap == Overlap::Inside)
+        {
+            results.insert(results.end(), cell.objects.begin(), cell.objects.end());
+            return;
+        }
+        for (int object : cell.objects)
+        {
+            if (test(mObjects[object].min, mObjects[object].max))  results.push_back(object);
+        }
+    });
+}
+
+
+void SpatialGrid::QueryFrustum(const CFrustum& frustum, std::vector<int>& results) const
+{
+    // As BoundingVolumeHierarchy::QueryFrustum. A frustum usually reaches far more cells than are occupied, so every
+    // occupied cell is tested
+    auto classify = [&](const CVector3& min, const CVector3& max)
+    {
+        CVector3 centre  = (min + max) * 0.5f;
+        CVector3 extents = (max - min) * 0.5f;
+        Overlap overlap = Overlap::Inside;
+        for (const FrustumPlane& plane : frustum.planes)
+        {
+            const CVector3& n = plane.normal;
+            float radius   = extents.x * std::abs(n.x) + extents.y * std::abs(n.y) + extents.z * std::abs(n.z);
+            float distance = Dot(n, centre) + plane.distance;
+            if (distance < -radius)  return Overlap::Outside;
+            if (distance < radius)   overlap = Overlap::Partial;
+        }
+        return overlap;
+    };
+    for (int cellIndex : mOccupiedCells)
+    {
+        const Cell& cell = mCells[cellIndex];
+        Overlap overlap = classify(cell.min, cell.max);
+        if (overlap == Overlap::Outside)  continue;
+        if (overlap == Overlap::Inside)
+        {
+            results.insert(results.end(), cell.objects.begin(), cell.objects.end());
+            continue;
+        }
+        for (int object : cell.objects)
+        {
+            const Object& entry = mObjects[object];
+            if (IsVisible(frustum, BoundingBox{ (entry.min + entry.max) * 0.5f, (entry.max - entry.min) * 0.5f }))  results.push_back(object);
+        }
+    }
+}
+
+
+void SpatialGrid::QuerySphere(const BoundingSphere& sphere, std::vector<int>& results) const
+{
+    const float radiusSquared = sphere.radius * sphere.radius;
+    auto classify = [&](const CVector3& min, const CVector3& max)
+    {
+        CVector3 toNearest = Max(min, Min(sphere.centre, max)) - sphere.centre;
+        if (Dot(toNearest, toNearest) > radiusSquared)  return Overlap::Outside;
+        CVector3 toFar = Max(sphere.centre - min, max - sphere.centre);
+        return Dot(toFar, toFar) <= radiusSquared ? Overlap::Inside : Overlap::Partial;
+    };
+    auto test = [&](const CVector3& min, const CVector3& max)
+    {
+        CVector3 toNearest = Max(min, Min(sphere.centre, max)) - sphere.centre;
+        return Dot(toNearest, toNearest) <= radiusSquared;
+    };
+    CVector3 radius = { sphere.radius, sphere.radius, sphere.radius };
+    Query(sphere.centre - radius, sphere.centre + radius, classify, test, results);
+}
+
+
+void SpatialGrid::QueryBox(const BoundingBox& box, std::vector<int>& results) const
+{
+    const CVector3 boxMin = box.centre - box.extents;
+    const CVector3 boxMax = box.centre + box.extents;
+    auto overlaps = [&](const CVector3& min, const CVector3& max)
+    {
+        return min.x <= boxMax.x && max.x >= boxMin.x && min.y <= boxMax.y && max.y >= boxMin.y &&
+               min.z <= boxMax.z && max.z >= boxMin.z;
+    };
+    auto classify = [&](const CVector3& min, const CVector3& max)
+    {
+        if (!overlaps(min, max))  return Overlap::Outside;
+        bool inside = min.x >= boxMin.x && max.x <= boxMax.x && min.y >= boxMin.y && max.y <= boxMax.y &&
+                      min.z >= boxMin.z && max.z <= boxMax.z;
+        return inside ? Overlap::Inside : Overlap::Partial;
+    };
+    Query(boxMin, boxMax, classify, overlaps, results);
+}
+
+
+void SpatialGrid::QueryRay(const Ray& ray, float maxDistance, std::vector<int>& results) const
+{
+    // Slab test as BoundingVolumeHierarchy::QueryRay. The cells looked up are those around the box enclosing the ray
+    auto reciprocal = [](float d) { return 1.0f / (d != 0 ? d : 1e-30f); };
+    const CVector3 inverse = { reciprocal(ray.direction.x), reciprocal(ray.direction.y), reciprocal(ray.direction.z) };
+    auto hits = [&](const CVector3& min, const CVector3& max)
+    {
+        float tx1 = (min.x - ray.origin.x) * inverse.x, tx2 = (max.x - ray.origin.x) * inverse.x;
+        float ty1 = (min.y - ray.origin.y) * inverse.y, ty2 = (max.y - ray.origin.y) * inverse.y;
+        float tz1 = (min.z - ray.origin.z) * inverse.z, tz2 = (max.z - ray.origin.z) * inverse.z;
+        float enter = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), 0.0f));
+        float leave = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::min(std::max(tz1, tz2), maxDistance));
+        return enter <= leave;
+    };
+    auto classify = [&](const CVector3& min, const CVector3& max) { return hits(min, max) ? Overlap::Partial : Overlap::Outside; };
+
+    CVector3 end = ray.origin + ray.direction * maxDistance;
+    Query(Min(ray.origin, end), Max(ray.origin, end), classify, hits, results);
+}
+
+
+/*-----------------------------------------------------------------------------------------
+    Data access
+-----------------------------------------------------------------------------------------*/
+
+BoundingBox SpatialGrid::Bounds(int object) const
+{
+    const Object& entry = mObjects[object];
+    return { (entry.min + entry.max) * 0.5f, (entry.max - entry.min) * 0.5f };
+}
@@ -0,0 +1,132 @@
+//--------------------------------------------------------------------------------------
+// Spatial grid - finds moving objects in a region of space, cheap to update as they move
+//--------------------------------------------------------------------------------------
+// Partner to BoundingVolumeHierarchy for objects that move often (controlled or animated models, crowds). Moving an
+// object in a hierarchy stretches the boxes above it until the tree needs rebuilding, but here inserting, moving and
+// removing an object each take constant time however many objects there are, so the cost of keeping the grid up to
+// date is in proportion to the number of objects that actually moved.
+//
+// Space is divided into cubic cells of a fixed size. Each object is kept in the one cell holding the centre of its
+// bounds, so only cells that hold objects are stored, found from their coordinates with a hash table. The grid is
+// "loose": each cell keeps a box around the bounds of all its objects, which may reach past the edges of the cell,
+// and queries test against that box. An object moving within its cell only grows the cell's box, an object moving to
+// another cell is removed from one list and added to another. A cell's box shrinks back when it empties.
+//
+// Queries take the same form as the hierarchy's, so both can be queried into one results list. Frustum queries test
+// every occupied cell. Sphere, box and ray queries look up only the cells they could reach, unless that would be more
+// cells than are occupied.
+//
+// Objects are identified by any non-negative number chosen by the caller, e.g. the same numbers the hierarchy uses,
+// so an object can be handed from one to the other. Storage is kept for every number up to the largest used.
+// Only uses the maths headers, so also builds outside Windows (see Benchmarks/SpatialBenchmark.cpp)
+
+#ifndef _SPATIAL_GRID_H_INCLUDED_
+#define _SPATIAL_GRID_H_INCLUDED_
+
+#include "CVector3.h"
+#include "CFrustum.h"
+#include "Bounds.h"
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+
+class SpatialGrid
+{
+public:
+    // Cells should be a few times bigger than typical objects, objects much bigger than a cell make queries test
+    // more cells than they need to
+    explicit SpatialGrid(float cellSize);
+
+
+    // Adding, moving and removing objects //
+
+    // Add an object with the given bounds, or move it if it is already in the grid
+    void Insert(int object, const BoundingBox& bounds);
+
+    // Change the bounds of an object already in the grid
+    void Move(int object, const BoundingBox& bounds);
+
+    // Remove an object from the grid, does nothing if it isn't in it
+    void Remove(int object);
+
+    // Remove all objects
+    void Clear();
+
+
+    // Queries //
+    // Each appends the numbers of the objects found to results, in no particular order
+
+    // Objects whose bounds are at least partly inside the frustum (conservative in the same way as IsVisible)
+    void QueryFrustum(const CFrustum& frustum, std::vector<int>& results) const;
+
+    // Objects whose bounds overlap the sphere / box
+    void QuerySphere(const BoundingSphere& sphere, std::vector<int>& results) const;
+    void QueryBox(const BoundingBox& box, std::vector<int>& results) const;
+
+    // Objects whose bounds are hit by the ray within the given distance along it
+    void QueryRay(const Ray& ray, float maxDistance, std::vector<int>& results) const;
+
+
+    // Data access //
+
+    bool Contains(int object) const  { return object < static_cast<int>(mObjects.size()) && mObjects[object].cell >= 0; }
+    BoundingBox Bounds(int object) const; // Object must be in the grid
+
+    int   NumObjects() const          { return mNumObjects; }
+    int   NumOccupiedCells() const    { return static_cast<int>(mOccupiedCells.size()); }
+    float CellSize() const            { return mCellSize; }
+
+
+private:
+    // An object's bounds, the cell it is in and its position in the cell's list
+    struct Object
+    {
+        CVector3 min;
+        int      cell = -1; // Index into mCells, -1 if not in the grid
+        CVector3 max;
+        int      positionInCell;
+    };
+
+    // A cell's coordinates, the box around its objects' bounds, its objects and its position in mOccupiedCells.
+    // Cells that empty are kept for reuse
+    struct Cell
+    {
+        int32_t          x, y, z;
+        CVector3         min;
+        CVector3         max;
+        std::vector<int> objects;
+        int              positionInOccupied;
+    };
+
+    // Cell coordinates of a point, and the key for the coordinates in the hash table
+    void     CellCoordinates(const CVector3& point, int32_t& x, int32_t& y, int32_t& z) const;
+    uint64_t CellKey(int32_t x, int32_t y, int32_t z) const;
+
+    // Add an object to / remove an object from the cell holding the given point / its current cell
+    void AddToCell(int object, const CVector3& centre);
+    void RemoveFromCell(int object);
+
+    // Call visit(cell) for each occupied cell that might hold objects overlapping the given box
+    template <class Visit>
+    void VisitCells(const CVector3& min, const CVector3& max, Visit visit) const;
+
+    // Test the cells and objects overlapping a box with the given tests, as BoundingVolumeHierarchy::Query
+    template <class Classify, class Test>
+    void Query(const CVector3& min, const CVector3& max, Classify classify, Test test, std::vector<int>& results) const;
+
+    float mCellSize;
+    float mInvCellSize;
+
+    std::vector<Object>                    mObjects;       // Indexed by object number
+    std::vector<Cell>                      mCells;
+    std::vector<int>                       mOccupiedCells; // Indexes into mCells
+    std::vector<int>                       mFreeCells;     // --"--, of cells no longer in the hash table
+    std::unordered_map<uint64_t, int>      mCellLookup;    // Cell index from the key of its coordinates
+    CVector3                               mMaxExtents = { 0, 0, 0 }; // Of any object added, so queries know how far objects can reach out of their cells
+    int                                    mNumObjects = 0;
+};
+
+
+#endif //_SPATIAL_GRID_H_INCLUDED_
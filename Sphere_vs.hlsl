@@ -15,11 +15,11 @@ NormalPixelShaderInput main(TangentVertex modelVertex)
     float4 modelPosition = float4(modelVertex.position, 1);
 
     // Multiply by the world matrix passed from C++ to transform the model vertex position into world space. 
-    float4 worldPosition = mul(gWorldMatrix, modelPosition);
+    float4 worldPosition = float4(mul(modelPosition, gWorldMatrix), 1);
 
     //Transform model normals into world space using world matrix to calculate per pixel lighting
     float4 modelNormal = float4(modelVertex.normal, 0);
-    float4 worldNormal = mul(gWorldMatrix, modelNormal);
+    float4 worldNormal = float4(mul(modelNormal, gWorldMatrix), 0);
 
     //Set world position to be offset by wiggle variable
     worldPosition.x += sin(modelPosition.y + wiggle) * 0.3f;
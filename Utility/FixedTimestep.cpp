@@ -0,0 +1,32 @@
+//--------------------------------------------------------------------------------------
+// Fixed timestep clock - runs a simulation at a fixed rate independent of the frame rate
+//--------------------------------------------------------------------------------------
+
+#include "FixedTimestep.h"
+
+// Constructor //
+
+FixedTimestep::FixedTimestep(float stepTime, float maxFrameTime)
+	: mStepTime(stepTime), mMaxFrameTime(maxFrameTime)
+{
+}
+
+
+// Timing //
+
+// Add the time passed since the last frame and return the number of simulation steps to run
+int FixedTimestep::Advance(float frameTime)
+{
+	if (frameTime > mMaxFrameTime)  frameTime = mMaxFrameTime;
+	if (frameTime < 0)  frameTime = 0;
+	mAccumulator += frameTime;
+
+	int numSteps = 0;
+	while (mAccumulator >= mStepTime)
+	{
+		mAccumulator -= mStepTime;
+		++numSteps;
+	}
+	mNumSteps += numSteps;
+	return numSteps;
+}
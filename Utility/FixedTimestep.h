@@ -0,0 +1,54 @@
+//--------------------------------------------------------------------------------------
+// Fixed timestep clock - runs a simulation at a fixed rate independent of the frame rate
+//--------------------------------------------------------------------------------------
+// Frame times are added to an accumulator and whole steps of a fixed length are taken from it. The simulation
+// is run once per step, so it behaves the same (and costs the same per second) whatever the frame rate. Rendering
+// usually happens part way through a step, so the last two simulation results are blended using Alpha()
+//
+// Typical use each frame:
+//     int numSteps = clock.Advance(frameTime);
+//     for (int i = 0; i < numSteps; ++i)  { previous = current;  Simulate(clock.StepTime());  current = ...; }
+//     Render(Blend(previous, current, clock.Alpha()));
+
+#ifndef _FIXED_TIMESTEP_H_INCLUDED_
+#define _FIXED_TIMESTEP_H_INCLUDED_
+
+class FixedTimestep
+{
+public:
+
+	// Constructor //
+
+	// Steps are stepTime seconds long. Frame times are limited to maxFrameTime so a long pause (e.g. dragging the
+	// window) is not followed by many steps at once, which could slow the next frame and fall further behind
+	FixedTimestep(float stepTime, float maxFrameTime = 0.25f);
+
+
+	// Timing //
+
+	// Add the time passed since the last frame and return the number of simulation steps to run
+	int Advance(float frameTime);
+
+	// Length of each step in seconds
+	float StepTime() const  { return mStepTime; }
+
+	// How far the clock is into the next step, from 0 to 1. Rendering should blend this far from the result of the
+	// previous step towards the result of the latest step
+	float Alpha() const  { return mAccumulator / mStepTime; }
+
+	// Total number of steps taken
+	int NumSteps() const  { return mNumSteps; }
+
+
+private:
+	float mStepTime;
+	float mMaxFrameTime;
+
+	// Time passed that has not yet been simulated, always less than one step after Advance
+	float mAccumulator = 0;
+
+	int mNumSteps = 0;
+};
+
+
+#endif //_FIXED_TIMESTEP_H_INCLUDED_
@@ -0,0 +1,155 @@
+//--------------------------------------------------------------------------------------
+// Frame pipeline - runs part of each frame's work on a worker thread, ahead of the frame that uses it
+//--------------------------------------------------------------------------------------
+// Each frame the main thread takes the output of an earlier frame's work with Acquire, then submits the input for a
+// later frame with Submit. The worker thread produces that output while the main thread carries on with the frame
+// (e.g. simulating frame N+1 while frame N is rendered), so the cost of the two overlap on a multi-core CPU.
+//
+// Outputs are held in framesInFlight + 1 slots: the one being used by the main thread and up to framesInFlight
+// being produced or waiting. So the output used is always framesInFlight frames behind the latest input, and the
+// main thread waits in Acquire if the worker falls further behind than that. The output returned by Acquire is only
+// read by the main thread and only written by the worker, so neither needs any locking to use it.
+//
+// Typical use each frame:
+//     const Output& output = pipeline.Acquire();
+//     pipeline.Submit(input);
+//     Use(output);
+//
+// All code is in this header as it is a template
+
+#ifndef _FRAME_PIPELINE_H_INCLUDED_
+#define _FRAME_PIPELINE_H_INCLUDED_
+
+#include <functional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+template <class Input, class Output>
+class FramePipeline
+{
+public:
+
+	// Construction / destruction //
+
+	// The produce function does the work for a frame, filling in the output from the input. It is called on the worker
+	// thread, one frame at a time, in the order the frames were submitted. The first framesInFlight frames are
+	// submitted straight away using firstInput, so the first Acquire has an output to wait for. If framesInFlight
+	// is 0 no worker is started and the work is done on the calling thread in Submit (for debugging or comparison).
+	// There is then a single output, which Submit overwrites with the result for the input just submitted
+	FramePipeline(std::function<void(const Input&, Output&)> produce, int framesInFlight, const Input& firstInput)
+		: mProduce(std::move(produce)), mFramesInFlight(framesInFlight),
+		  mInputs(framesInFlight + 1), mOutputs(framesInFlight + 1)
+	{
+		if (mFramesInFlight == 0)
+		{
+			mProduce(firstInput, mOutputs[0]);
+			return;
+		}
+		for (int i = 0; i < mFramesInFlight; ++i)
+		{
+			mInputs[i] = firstInput;
+		}
+		mNumSubmitted = mFramesInFlight;
+		mWorker = std::thread(&FramePipeline::WorkerLoop, this);
+	}
+
+	// Waits for the worker to finish the frame it is working on, other submitted frames are abandoned
+	~FramePipeline()
+	{
+		if (!mWorker.joinable())  return;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStopping = true;
+		}
+		mWorkSubmitted.notify_one();
+		mWorker.join();
+	}
+
+	FramePipeline(const FramePipeline&) = delete;
+	FramePipeline& operator=(const FramePipeline&) = delete;
+
+
+	// Usage //
+
+	// Wait for the oldest frame not yet acquired to be finished and return its output. The output can be used until
+	// the next call to Acquire
+	const Output& Acquire()
+	{
+		if (mFramesInFlight == 0)  return mOutputs[0];
+
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWorkCompleted.wait(lock, [this] { return mNumCompleted > mNumAcquired; });
+		const Output& output = mOutputs[mNumAcquired % mOutputs.size()];
+		++mNumAcquired;
+		return output;
+	}
+
+	// Submit the input for the next frame. Call after Acquire each frame - if there is no free slot because Acquire
+	// has not been called, the oldest output is acquired (and so skipped) here to free one
+	void Submit(const Input& input)
+	{
+		if (mFramesInFlight == 0)
+		{
+			mProduce(input, mOutputs[0]);
+			return;
+		}
+
+		// Only this thread changes these counts, so they can be checked without the lock
+		if (mNumSubmitted == mNumAcquired + mFramesInFlight)  Acquire();
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mInputs[mNumSubmitted % mInputs.size()] = input;
+			++mNumSubmitted;
+		}
+		mWorkSubmitted.notify_one();
+	}
+
+	int FramesInFlight() const  { return mFramesInFlight; }
+
+
+private:
+	// Produce outputs for submitted frames in order until stopped
+	void WorkerLoop()
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		while (true)
+		{
+			mWorkSubmitted.wait(lock, [this] { return mStopping || mNumCompleted < mNumSubmitted; });
+			if (mStopping)  return;
+
+			// The slot for this frame is not used by the main thread until the frame is completed, so it can be
+			// worked on without the lock
+			size_t slot = mNumCompleted % mOutputs.size();
+			lock.unlock();
+			mProduce(mInputs[slot], mOutputs[slot]);
+			lock.lock();
+
+			++mNumCompleted;
+			mWorkCompleted.notify_one();
+		}
+	}
+
+	std::function<void(const Input&, Output&)> mProduce;
+	int mFramesInFlight;
+
+	// Inputs and outputs for each frame, frame n uses slot n % (framesInFlight + 1)
+	std::vector<Input>  mInputs;
+	std::vector<Output> mOutputs;
+
+	// Number of frames submitted, completed by the worker and acquired by the main thread. Protected by mMutex
+	uint64_t mNumSubmitted = 0;
+	uint64_t mNumCompleted = 0;
+	uint64_t mNumAcquired  = 0;
+	bool     mStopping = false;
+
+	std::mutex              mMutex;
+	std::condition_variable mWorkSubmitted;
+	std::condition_variable mWorkCompleted;
+	std::thread             mWorker;
+};
+
+
+#endif //_FRAME_PIPELINE_H_INCLUDED_
@@ -30,27 +30,3 @@ bool LoadTexture(std::string filename, ID3D11Resource** texture, ID3D11ShaderRes
         return SUCCEEDED(DirectX::CreateWICTextureFromFile(gD3DDevice, gD3DContext, CA2CT(filename.c_str()), texture, textureSRV));
     }
 }
-
-
-//--------------------------------------------------------------------------------------
-// Camera Helpers
-//--------------------------------------------------------------------------------------
-
-// A "projection matrix" contains properties of a camera. Covered mid-module - the maths is an optional topic (not examinable).
-// - Aspect ratio is screen width / height (like 4:3, 16:9)
-// - FOVx is the viewing angle from left->right (high values give a fish-eye look),
-// - near and far clip are the range of z distances that can be rendered
-CMatrix4x4 MakeProjectionMatrix(float aspectRatio /*= 4.0f / 3.0f*/, float FOVx /*= ToRadians(60)*/,
-                                float nearClip /*= 0.1f*/, float farClip /*= 10000.0f*/)
-{
-    float tanFOVx = std::tan(FOVx * 0.5f);
-    float scaleX = 1.0f / tanFOVx;
-    float scaleY = aspectRatio / tanFOVx;
-    float scaleZa = farClip / (farClip - nearClip);
-    float scaleZb = -nearClip * scaleZa;
-
-    return CMatrix4x4{ scaleX,   0.0f,    0.0f,   0.0f,
-                         0.0f, scaleY,    0.0f,   0.0f,
-                         0.0f,   0.0f, scaleZa,   1.0f,
-                         0.0f,   0.0f, scaleZb,   0.0f };
-}
@@ -0,0 +1,219 @@
+//--------------------------------------------------------------------------------------
+// Job system - runs small pieces of work ("jobs") across all CPU cores
+//--------------------------------------------------------------------------------------
+
+#include "JobSystem.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+
+// The job system and queue used by the current thread (only set for worker threads)
+static thread_local const JobSystem* tJobSystem = nullptr;
+static thread_local int              tQueueIndex = 0;
+
+
+// Give the current thread a name to show in debuggers and profilers
+static void SetCurrentThreadName(const std::string& name)
+{
+#if defined(_WIN32)
+	std::wstring wideName(name.begin(), name.end()); // Names are plain ASCII
+	SetThreadDescription(GetCurrentThread(), wideName.c_str());
+#elif defined(__APPLE__)
+	pthread_setname_np(name.c_str());
+#else
+	pthread_setname_np(pthread_self(), name.substr(0, 15).c_str()); // Linux limits names to 15 characters
+#endif
+}
+
+
+// Construction / destruction //
+
+JobSystem::JobSystem(int numWorkers, const std::string& threadName)
+{
+	if (numWorkers < 0)
+	{
+		numWorkers = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+		if (numWorkers < 0)  numWorkers = 0;
+	}
+
+	for (int i = 0; i < numWorkers + 1; ++i)
+	{
+		mQueues.push_back(std::make_unique<JobQueue>());
+	}
+	for (int i = 0; i < numWorkers; ++i)
+	{
+		mWorkers.emplace_back(&JobSystem::WorkerLoop, this, i + 1, threadName + " " + std::to_string(i + 1));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mSleepMutex);
+		mStopping = true;
+	}
+	mJobsAvailable.notify_all();
+	for (auto& worker : mWorkers)
+	{
+		worker.join();
+	}
+}
+
+
+// Usage //
+
+// Queue a job, optionally counted and optionally waiting for another counter to reach zero
+void JobSystem::Run(Job job, JobCounter* counter, JobCounter* dependency)
+{
+	if (counter != nullptr)
+	{
+		counter->mCount.fetch_add(1, std::memory_order_relaxed);
+		job = [this, job = std::move(job), counter]
+		{
+			job();
+
+			// Decrement the counter. The last decrement is done under the counter's lock, then any dependent jobs
+			// are taken from it. Wait takes the lock before returning, so the counter can't be destroyed while
+			// it is still in use here
+			int count = counter->mCount.load(std::memory_order_relaxed);
+			while (count > 1)
+			{
+				if (counter->mCount.compare_exchange_weak(count, count - 1, std::memory_order_release))  return;
+			}
+			std::vector<Job> dependents;
+			{
+				std::lock_guard<std::mutex> lock(counter->mMutex);
+				if (counter->mCount.fetch_sub(1, std::memory_order_acq_rel) == 1)  dependents.swap(counter->mDependents);
+			}
+			for (auto& dependent : dependents)
+			{
+				Push(std::move(dependent));
+			}
+		};
+	}
+
+	if (dependency != nullptr)
+	{
+		std::lock_guard<std::mutex> lock(dependency->mMutex);
+		if (!dependency->IsDone())
+		{
+			dependency->mDependents.push_back(std::move(job));
+			return;
+		}
+	}
+	Push(std::move(job));
+}
+
+
+// Run other jobs until the counter reaches zero
+void JobSystem::Wait(JobCounter& counter)
+{
+	int queueIndex = CurrentQueueIndex();
+	while (!counter.IsDone())
+	{
+		Job job;
+		if (TakeJob(queueIndex, job))
+		{
+			job();
+		}
+		else
+		{
+			std::this_thread::yield(); // The remaining jobs are running on other threads
+		}
+	}
+
+	// The job that finished the counter may still hold its lock, wait for it to let go
+	std::lock_guard<std::mutex> lock(counter.mMutex);
+}
+
+
+// Private functions //
+
+void JobSystem::WorkerLoop(int queueIndex, std::string threadName)
+{
+	tJobSystem = this;
+	tQueueIndex = queueIndex;
+	SetCurrentThreadName(threadName);
+
+	while (true)
+	{
+		Job job;
+		if (TakeJob(queueIndex, job))
+		{
+			job();
+			continue;
+		}
+
+		// Nothing to do, sleep until more jobs are queued
+		std::unique_lock<std::mutex> lock(mSleepMutex);
+		++mNumSleeping;
+		mJobsAvailable.wait(lock, [this] { return mStopping || mNumQueuedJobs > 0; });
+		--mNumSleeping;
+		if (mStopping)  return;
+	}
+}
+
+
+// Add a job that is ready to run to the current thread's queue
+void JobSystem::Push(Job job)
+{
+	JobQueue& queue = *mQueues[CurrentQueueIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(std::move(job));
+	}
+	++mNumQueuedJobs;
+
+	// Wake a sleeping worker. Taking the sleep lock ensures a worker that has just found no jobs is either already
+	// waiting (and so is woken) or has yet to check mNumQueuedJobs (and so will see this job)
+	if (mNumSleeping > 0)
+	{
+		{ std::lock_guard<std::mutex> lock(mSleepMutex); }
+		mJobsAvailable.notify_one();
+	}
+}
+
+
+// Take the newest job from the given queue, or failing that steal the oldest job from another queue
+bool JobSystem::TakeJob(int queueIndex, Job& job)
+{
+	if (mNumQueuedJobs == 0)  return false;
+
+	{
+		JobQueue& queue = *mQueues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty())
+		{
+			job = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+			--mNumQueuedJobs;
+			return true;
+		}
+	}
+
+	int numQueues = static_cast<int>(mQueues.size());
+	for (int i = 1; i < numQueues; ++i)
+	{
+		JobQueue& queue = *mQueues[(queueIndex + i) % numQueues];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty())
+		{
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			--mNumQueuedJobs;
+			++mNumSteals;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+int JobSystem::CurrentQueueIndex() const
+{
+	return tJobSystem == this ? tQueueIndex : 0;
+}
@@ -0,0 +1,155 @@
+//--------------------------------------------------------------------------------------
+// Job system - runs small pieces of work ("jobs") across all CPU cores
+//--------------------------------------------------------------------------------------
+// A fixed set of worker threads run jobs from queues. Each worker (and the thread that created the job system,
+// which joins in while waiting) has its own queue. A thread adds jobs to the back of its own queue and takes jobs
+// from the back, so it works on the jobs it created most recently, whose data is most likely to be in its cache.
+// When its queue is empty it "steals" from the front of another thread's queue - the oldest jobs there, which are
+// usually the biggest. This keeps all threads busy without them all fighting over one shared queue.
+//
+// Jobs are grouped with JobCounters. Each job run with a counter increments it and decrements it when finished,
+// so waiting for a counter to reach zero waits for the whole group. A job can also be given a counter to depend on,
+// it will not start until that counter reaches zero. Waiting doesn't just block - the waiting thread runs other
+// jobs until the counter reaches zero, so it is fine to wait inside a job.
+//
+// Typical use:
+//     gJobSystem->ParallelFor(0, numModels, 64, [&](int start, int end) { for (int i = start; i < end; ++i) ... });
+//
+//     JobCounter loaded, processed;
+//     gJobSystem->Run([&] { Load(); }, &loaded);
+//     gJobSystem->Run([&] { Process(); }, &processed, &loaded); // Runs after Load
+//     gJobSystem->Wait(processed);
+
+#ifndef _JOB_SYSTEM_H_INCLUDED_
+#define _JOB_SYSTEM_H_INCLUDED_
+
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+using Job = std::function<void()>;
+
+
+// Counts unfinished jobs in a group, see above. Must not be destroyed until it has been waited on
+class JobCounter
+{
+public:
+	JobCounter() = default;
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	// True when all jobs run with this counter have finished
+	bool IsDone() const  { return mCount.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<int> mCount = 0;
+
+	// Jobs waiting for this counter to reach zero
+	std::mutex       mMutex;
+	std::vector<Job> mDependents;
+};
+
+
+class JobSystem
+{
+public:
+
+	// Construction / destruction //
+
+	// Start the given number of worker threads, or one fewer than the number of CPU cores if numWorkers is negative
+	// (the thread creating the job system is expected to be busy too). With 0 workers all jobs run on threads that
+	// wait. Worker threads are named threadName followed by a number, to identify them in debuggers and profilers
+	JobSystem(int numWorkers = -1, const std::string& threadName = "Job Worker");
+
+	// Waits for jobs already running to finish, jobs that haven't started are abandoned
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+
+	// Usage //
+
+	// Queue a job. If a counter is given it is incremented now and decremented when the job finishes. If a
+	// dependency is given the job will not start until that counter reaches zero
+	void Run(Job job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+
+	// Run other jobs until the counter reaches zero
+	void Wait(JobCounter& counter);
+
+	// Call body(start, end) for sub-ranges covering begin to end, in parallel, and wait for them all. Each sub-range
+	// holds up to grainSize indexes - make this large enough that each call does a reasonable amount of work (at
+	// least a few microseconds) otherwise the cost of the jobs will outweigh the gain
+	template <class Body>
+	void ParallelFor(int begin, int end, int grainSize, const Body& body)
+	{
+		if (end <= begin)  return;
+		if (grainSize < 1)  grainSize = 1;
+		if (end - begin <= grainSize)
+		{
+			body(begin, end);
+			return;
+		}
+
+		JobCounter counter;
+		for (int start = begin + grainSize; start < end; start += grainSize)
+		{
+			int rangeEnd = (end - start > grainSize) ? start + grainSize : end;
+			Run([&body, start, rangeEnd] { body(start, rangeEnd); }, &counter);
+		}
+		body(begin, begin + grainSize); // Do the first range on this thread rather than waiting idle
+		Wait(counter);
+	}
+
+	// Number of worker threads, not including threads that join in when waiting
+	int NumWorkers() const  { return static_cast<int>(mWorkers.size()); }
+
+	// Diagnostics: number of jobs that have been taken from another thread's queue
+	int NumSteals() const  { return mNumSteals.load(std::memory_order_relaxed); }
+
+
+private:
+	// A queue of jobs for one thread. A mutex per queue is simple and, with each thread mostly using its own queue,
+	// rarely contended
+	struct JobQueue
+	{
+		std::mutex      mutex;
+		std::deque<Job> jobs;
+	};
+
+	void WorkerLoop(int queueIndex, std::string threadName);
+
+	// Add a job that is ready to run to the current thread's queue (or the shared queue if the current thread has none)
+	void Push(Job job);
+
+	// Take a job from the given thread's own queue, or failing that steal one from another. Returns false if there
+	// were no jobs anywhere
+	bool TakeJob(int queueIndex, Job& job);
+
+	// Queue index of the current thread, or the shared queue (0) for threads that are not workers
+	int CurrentQueueIndex() const;
+
+	// Queue 0 is shared by all threads that are not workers (e.g. the main thread), queue i + 1 is for worker i
+	std::vector<std::unique_ptr<JobQueue>> mQueues;
+	std::vector<std::thread>               mWorkers;
+
+	// Number of jobs in all queues, and sleeping workers waiting for it to become non-zero
+	std::atomic<int>        mNumQueuedJobs = 0;
+	std::atomic<int>        mNumSleeping = 0;
+	std::mutex              mSleepMutex;
+	std::condition_variable mJobsAvailable;
+	bool                    mStopping = false;
+
+	std::atomic<int> mNumSteals = 0;
+};
+
+
+#endif //_JOB_SYSTEM_H_INCLUDED_